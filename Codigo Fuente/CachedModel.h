@@ -0,0 +1,784 @@
+#pragma once
+
+// Modelo estatico que se carga a traves de MeshCache: todas las submallas
+// comparten un VAO con un solo VBO/EBO intercalado, asi que cargar desde el
+// cache es solo mapear el archivo y hacer dos glBufferData.
+// Cada submalla trae MESH_LOD_LEVELS niveles de detalle; con SetLodProjection
+// el Draw con matrices elige por submalla el mas simple cuyo error proyectado
+// no pase de LOD_PIXEL_ERROR pixeles.
+// Con compactVertices los vertices se suben en el formato de 16 bytes de
+// VertexQuantization.h (requiere lighting.vs con COMPACT_VERTEX).
+// Submit/SubmitInstanced hacen el mismo trabajo que los Draw pero dejan los
+// lotes en una RenderQueue en vez de dibujarlos.
+// Si junto al OBJ hay un "<archivo>.lightmap" horneado para este mismo cache
+// (--bake-lightmaps), se suben sus vertices extra, el segundo juego de UV y
+// la textura de irradiancia, que se usa con la variante LIGHTMAP del shader.
+// Del mismo modo un "<archivo>.probes" queda disponible en Probes(); los
+// modelos que se mueven reciben su muestra con SetIrradiance y la usan con la
+// variante IRRADIANCE_PROBES.
+// La carga tiene dos mitades: Prepare (mapear o importar el cache, mapa de
+// luz, cuantizacion y sondas) no toca OpenGL y puede correr en otro hilo;
+// Upload sube los buffers por partes dentro de un presupuesto de bytes, asi
+// RoomStreaming.h reparte un modelo grande en varios fotogramas.
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "MeshCache.h"
+#include "MeshBVH.h"
+#include "TextureCache.h"
+#include "GLStats.h"
+#include "InstanceBuffer.h"
+#include "LightingState.h"
+#include "VertexQuantization.h"
+#include "RenderQueue.h"
+#include "LightmapBaker.h"
+#include "IrradianceVolume.h"
+
+const float LOD_PIXEL_ERROR = 1.0f;
+// Para pasar a un nivel mas simple el error debe bajar de
+// umbral * (1 - LOD_HYSTERESIS); asi una submalla en el limite no parpadea
+const float LOD_HYSTERESIS = 0.25f;
+
+const GLuint LIGHTMAP_TEXTURE_UNIT = 5;  // 2 a 4 son de ClusteredLights
+const GLuint LIGHTMAP_UV_LOCATION = 10;  // despues de los atributos de InstanceBuffer
+
+// Lo que deja CachedModel::Prepare para Upload. El cache queda mapeado hasta
+// que termina la subida; vertexBytes/indexBytes apuntan a el o a las copias
+// con el mapa de luz o en formato compacto
+struct CachedModelData
+{
+    std::string path;
+    MeshCache cache;
+    std::vector<CacheMesh> meshes;
+    std::vector<CacheBatch> batches;
+    std::vector<CacheMaterial> materials;
+    std::vector<CacheLod> lods;
+    MeshBVH bvh;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    bool compact = false;
+    LightmapData lightmap;
+    IrradianceVolume probes;
+    std::vector<CacheVertex> lightmapVertices;
+    std::vector<uint32_t> lightmapIndices;
+    std::vector<CompactVertex> compactVertices;
+    const void* vertexBytes = nullptr;
+    size_t vertexSize = 0;
+    const void* indexBytes = nullptr;
+    size_t indexSize = 0;
+    size_t uploadedBytes = 0;           // primero los vertices y despues los indices
+    double prepareMilliseconds = 0.0;
+    double uploadMilliseconds = 0.0;
+
+    size_t TotalBytes() const { return this->vertexSize + this->indexSize; }
+};
+
+class CachedModel : public RenderSource
+{
+public:
+    // Modelo vacio; se llena con Upload
+    CachedModel() { }
+
+    CachedModel(const GLchar* path, bool compactVertices = false)
+    {
+        CachedModelData data;
+        if (CachedModel::Prepare(path, compactVertices, data)) {
+            size_t budget = SIZE_MAX;
+            this->Upload(data, budget);
+        }
+    }
+
+    // Como CachedTexture: despues de TextureCache::Shutdown el contexto ya no existe
+    ~CachedModel()
+    {
+        if (!TextureCache::Instance().ContextAlive()) {
+            return;
+        }
+        glDeleteVertexArrays(1, &this->VAO);
+        glDeleteBuffers(1, &this->VBO);
+        glDeleteBuffers(1, &this->EBO);
+        glDeleteBuffers(1, &this->lightmapVBO);
+        glDeleteTextures(1, &this->lightmap);
+    }
+
+    CachedModel(const CachedModel&) = delete;
+    CachedModel& operator=(const CachedModel&) = delete;
+
+    // Primera mitad de la carga; no usa OpenGL, asi que puede llamarse desde
+    // cualquier hilo. false si el modelo no se pudo leer
+    static bool Prepare(const std::string& path, bool useCompact, CachedModelData& data)
+    {
+        auto start = std::chrono::steady_clock::now();
+        data.path = path;
+        if (!data.cache.Load(path)) {
+            std::cout << "ERROR::CACHED_MODEL:: could not load " << path << std::endl;
+            return false;
+        }
+        const MeshCacheView& view = data.cache.View();
+        data.meshes.assign(view.meshes, view.meshes + view.meshCount);
+        data.batches.assign(view.batches, view.batches + view.batchCount);
+        data.materials.assign(view.materials, view.materials + view.materialCount);
+        data.lods.assign(view.lods, view.lods + view.lodCount);
+        data.boundsMin = view.boundsMin;
+        data.boundsMax = view.boundsMax;
+        data.bvh.Build(data.meshes);
+
+        // Con mapa de luz los vertices que comparten varias cartas van
+        // duplicados al final y los indices del nivel 0 apuntan a las copias
+        const CacheVertex* vertices = view.vertices;
+        uint32_t vertexCount = view.vertexCount;
+        const uint32_t* indices = view.indices;
+        if (ReadLightmap(path + ".lightmap", view, data.lightmap)) {
+            data.lightmapVertices.assign(view.vertices, view.vertices + view.vertexCount);
+            for (uint32_t original : data.lightmap.remap) {
+                data.lightmapVertices.push_back(view.vertices[original]);
+            }
+            data.lightmapIndices.assign(view.indices, view.indices + view.indexCount);
+            std::copy(data.lightmap.indices.begin(), data.lightmap.indices.end(), data.lightmapIndices.begin());
+            vertices = data.lightmapVertices.data();
+            vertexCount = uint32_t(data.lightmapVertices.size());
+            indices = data.lightmapIndices.data();
+        }
+        data.indexBytes = indices;
+        data.indexSize = view.indexCount * sizeof(GLuint);
+
+        // Formato compacto solo si pasa la prueba de precision contra los floats
+        if (useCompact) {
+            QuantizationError error = QuantizeVertices(vertices, vertexCount, view.boundsMin, view.boundsMax, data.compactVertices);
+            data.compact = error.Acceptable();
+            std::cout << "[CompactVertex] " << path << ": max error " << error.position << " units, " << error.normalDegrees
+                      << " deg normal, " << error.texCoords << " UV; "
+                      << (data.compact ? "using 16-byte vertices (" : "keeping 32-byte float vertices (")
+                      << vertexCount * sizeof(CacheVertex) / 1024 << " KB -> " << vertexCount * sizeof(CompactVertex) / 1024
+                      << " KB)" << std::endl;
+        }
+        if (data.compact) {
+            data.vertexBytes = data.compactVertices.data();
+            data.vertexSize = vertexCount * sizeof(CompactVertex);
+        }
+        else {
+            data.compactVertices.clear();
+            data.vertexBytes = vertices;
+            data.vertexSize = vertexCount * sizeof(CacheVertex);
+        }
+        data.probes.Load(path + ".probes", view);
+        data.prepareMilliseconds = MillisecondsSince(start);
+        return true;
+    }
+
+    // Segunda mitad, en el hilo de OpenGL: sube a lo mas "budgetBytes" de
+    // vertices e indices (y los descuenta). La llamada que sube lo ultimo
+    // tambien crea el mapa de luz y pide las texturas; entonces devuelve true
+    // y el modelo ya se puede dibujar
+    bool Upload(CachedModelData& data, size_t& budgetBytes)
+    {
+        auto uploadStart = std::chrono::steady_clock::now();
+        if (this->VAO == 0) {
+            this->createBuffers(data);
+        }
+        while (data.uploadedBytes < data.TotalBytes() && budgetBytes > 0) {
+            bool vertices = data.uploadedBytes < data.vertexSize;
+            size_t offset = vertices ? data.uploadedBytes : data.uploadedBytes - data.vertexSize;
+            size_t size = std::min((vertices ? data.vertexSize : data.indexSize) - offset, budgetBytes);
+            const unsigned char* source = static_cast<const unsigned char*>(vertices ? data.vertexBytes : data.indexBytes);
+            // GL_COPY_WRITE_BUFFER no cambia lo que el VAO tiene enlazado
+            glBindBuffer(GL_COPY_WRITE_BUFFER, vertices ? this->VBO : this->EBO);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, GLintptr(offset), GLsizeiptr(size), source + offset);
+            data.uploadedBytes += size;
+            budgetBytes -= size;
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        if (data.uploadedBytes < data.TotalBytes()) {
+            data.uploadMilliseconds += MillisecondsSince(uploadStart);
+            return false;
+        }
+
+        if (!data.lightmap.uvs.empty()) {
+            glBindVertexArray(this->VAO);
+            this->uploadLightmap(data.lightmap);
+            glBindVertexArray(0);
+            size_t lightmapBytes = data.lightmap.texels.size() * sizeof(uint16_t);
+            budgetBytes -= std::min(budgetBytes, lightmapBytes);
+            std::cout << "[Lightmap] " << data.path << ": " << data.lightmap.size << "x" << data.lightmap.size << " lightmap, "
+                      << data.lightmap.remap.size() << " extra vertices for chart seams" << std::endl;
+        }
+        this->probes = std::move(data.probes);
+        if (this->probes.Loaded()) {
+            glm::ivec3 resolution = this->probes.Resolution();
+            std::cout << "[Probes] " << data.path << ": " << resolution.x << "x" << resolution.y << "x" << resolution.z
+                      << " irradiance probes" << std::endl;
+        }
+        this->instances.Attach(this->VAO);
+        data.uploadMilliseconds += MillisecondsSince(uploadStart);
+
+        // Sin mapa especular se reutiliza la difusa, igual que hacia lighting.frag
+        // cuando ambos samplers quedaban en la unidad 0
+        for (const CacheMaterial& material : this->materials) {
+            TextureHandle diffuse = this->loadTexture(material.diffuse);
+            TextureHandle specular = material.specular[0] != '\0' ? this->loadTexture(material.specular) : diffuse;
+            this->diffuseMaps.push_back(diffuse);
+            this->specularMaps.push_back(specular);
+        }
+
+        // Reporte de tiempos: ruta con Assimp frente a ruta con el cache mapeado
+        const MeshCache& cache = data.cache;
+        if (cache.FromCache()) {
+            double rebuildMilliseconds = cache.ImportMilliseconds() + cache.CookMilliseconds();
+            std::cout << "[MeshCache] " << data.path << ": cache hit, mapped in " << cache.LoadMilliseconds()
+                      << " ms + " << data.uploadMilliseconds << " ms upload (Assimp import took " << cache.ImportMilliseconds()
+                      << " ms + " << cache.CookMilliseconds() << " ms optimize/batch/LOD, "
+                      << rebuildMilliseconds / (cache.LoadMilliseconds() + data.uploadMilliseconds) << "x slower)" << std::endl;
+        }
+        else {
+            std::cout << "[MeshCache] " << data.path << ": cache miss, imported with Assimp in " << cache.ImportMilliseconds()
+                      << " ms, optimized/batched/LODs in " << cache.CookMilliseconds() << " ms (" << this->meshes.size() << " meshes, " << cache.View().vertexCount << " vertices, "
+                      << this->lodTriangles(0) << " triangles; LODs " << this->lodTriangles(1) << " / "
+                      << this->lodTriangles(2) << " / " << this->lodTriangles(MESH_LOD_LEVELS - 1) << ")" << std::endl;
+        }
+        std::cout << "[StaticBatch] " << data.path << ": " << this->meshes.size() << " draw calls per frame -> "
+                  << this->batches.size() << " (one per texture set)" << std::endl;
+        data.cache.Release();
+        this->ready = true;
+        return true;
+    }
+
+    // false hasta que Upload termina (o si el modelo no se pudo cargar)
+    bool Ready() const { return this->ready; }
+
+    // Dibuja cada lote estatico con sus texturas (difusa en la unidad 0, especular en la 1)
+    void Draw(GLuint program)
+    {
+        this->bindQuantization(program);
+        this->bindIrradiance(program);
+        this->bindLightmap();
+        GL_COUNT(glBindVertexArray(this->VAO));
+        for (const CacheBatch& batch : this->batches) {
+            GL_COUNT(glActiveTexture(GL_TEXTURE0));
+            GL_COUNT(glBindTexture(GL_TEXTURE_2D, this->diffuseMaps[batch.material]->id));
+            GL_COUNT(glActiveTexture(GL_TEXTURE1));
+            GL_COUNT(glBindTexture(GL_TEXTURE_2D, this->specularMaps[batch.material]->id));
+            GL_COUNT_DRAW(batch.indexCount / 3, glDrawElements(GL_TRIANGLES, batch.indexCount, GL_UNSIGNED_INT, (GLvoid*)(sizeof(GLuint) * batch.firstIndex)));
+        }
+        GL_COUNT(glBindVertexArray(0));
+        GL_COUNT(glActiveTexture(GL_TEXTURE0));
+    }
+
+    // Igual que Draw(program) pero descarta las submallas fuera del frustum de
+    // viewProjection * model (y las que "mask" marque en cero, p. ej. cuartos
+    // no visibles). Dentro de cada lote, las submallas visibles que quedan
+    // seguidas en el buffer de indices (con el mismo LOD) se unen en un solo
+    // rango y el lote se dibuja con glMultiDrawElements
+    void Draw(GLuint program, const glm::mat4& viewProjection, const glm::mat4& model, const std::vector<uint8_t>* mask = nullptr)
+    {
+        glm::mat4 clip = viewProjection * model;
+        float scale = this->cull(clip, model, mask);
+
+        this->bindQuantization(program);
+        this->bindIrradiance(program);
+        this->bindLightmap();
+        GL_COUNT(glBindVertexArray(this->VAO));
+        for (const CacheBatch& batch : this->batches) {
+            float depth;
+            uint32_t runIndices = this->buildRuns(batch, clip, scale, depth);
+            if (runIndices == 0) {
+                continue;
+            }
+
+            GL_COUNT(glActiveTexture(GL_TEXTURE0));
+            GL_COUNT(glBindTexture(GL_TEXTURE_2D, this->diffuseMaps[batch.material]->id));
+            GL_COUNT(glActiveTexture(GL_TEXTURE1));
+            GL_COUNT(glBindTexture(GL_TEXTURE_2D, this->specularMaps[batch.material]->id));
+            if (this->runCounts.size() == 1) {
+                GL_COUNT_DRAW(runIndices / 3, glDrawElements(GL_TRIANGLES, this->runCounts[0], GL_UNSIGNED_INT, this->runOffsets[0]));
+            }
+            else {
+                GL_COUNT_DRAW(runIndices / 3, glMultiDrawElements(GL_TRIANGLES, this->runCounts.data(), GL_UNSIGNED_INT, this->runOffsets.data(), GLsizei(this->runCounts.size())));
+            }
+        }
+        GL_COUNT(glBindVertexArray(0));
+        GL_COUNT(glActiveTexture(GL_TEXTURE0));
+    }
+
+    // Como Draw con matrices, pero cada lote visible queda en "queue" con la
+    // profundidad de su submalla visible mas cercana. La matriz va en el
+    // bloque Object de LightingState al ejecutar la cola
+    void Submit(RenderQueue& queue, GLuint program, const glm::mat4& viewProjection, const glm::mat4& model,
+                const std::vector<uint8_t>* mask = nullptr)
+    {
+        glm::mat4 clip = viewProjection * model;
+        float scale = this->cull(clip, model, mask);
+        uint32_t object = queue.AddObject(model, this);
+        for (const CacheBatch& batch : this->batches) {
+            float depth;
+            if (this->buildRuns(batch, clip, scale, depth) == 0) {
+                continue;
+            }
+            DrawItem& item = queue.Add(RENDER_PASS_SCENE, program, object, this->VAO, this->diffuseMaps[batch.material]->id,
+                                       this->specularMaps[batch.material]->id, depth);
+            queue.AddRuns(item, this->runCounts.data(), this->runOffsets.data(), this->runCounts.size());
+        }
+    }
+
+    // Dibuja "count" copias del modelo con una llamada por lote; el programa debe
+    // ser la variante INSTANCED. Las matrices se suben una vez por llamada
+    void DrawInstanced(GLuint program, const glm::mat4* transforms, size_t count)
+    {
+        if (count == 0) {
+            return;
+        }
+        this->instances.Upload(transforms, count);
+        this->bindQuantization(program);
+        this->bindIrradiance(program);
+        this->bindLightmap();
+        GL_COUNT(glBindVertexArray(this->VAO));
+        for (const CacheBatch& batch : this->batches) {
+            GL_COUNT(glActiveTexture(GL_TEXTURE0));
+            GL_COUNT(glBindTexture(GL_TEXTURE_2D, this->diffuseMaps[batch.material]->id));
+            GL_COUNT(glActiveTexture(GL_TEXTURE1));
+            GL_COUNT(glBindTexture(GL_TEXTURE_2D, this->specularMaps[batch.material]->id));
+            GL_COUNT_DRAW(batch.indexCount / 3 * this->instances.Count(),
+                          glDrawElementsInstanced(GL_TRIANGLES, batch.indexCount, GL_UNSIGNED_INT, (GLvoid*)(sizeof(GLuint) * batch.firstIndex),
+                                                  this->instances.Count()));
+        }
+        GL_COUNT(glBindVertexArray(0));
+        GL_COUNT(glActiveTexture(GL_TEXTURE0));
+    }
+
+    void DrawInstanced(GLuint program, const std::vector<glm::mat4>& transforms)
+    {
+        this->DrawInstanced(program, transforms.data(), transforms.size());
+    }
+
+    // Como DrawInstanced pero en la cola. Las matrices se suben ahora, asi
+    // que solo puede haber un SubmitInstanced por modelo antes de Execute
+    void SubmitInstanced(RenderQueue& queue, GLuint program, RenderPass pass, const std::vector<glm::mat4>& transforms, float depth = 0.0f)
+    {
+        if (transforms.empty()) {
+            return;
+        }
+        this->instances.Upload(transforms.data(), transforms.size());
+        uint32_t object = queue.AddObject(glm::mat4(1.0f), this, -1, false);
+        for (const CacheBatch& batch : this->batches) {
+            DrawItem& item = queue.Add(pass, program, object, this->VAO, this->diffuseMaps[batch.material]->id,
+                                       this->specularMaps[batch.material]->id, depth);
+            queue.AddElementsInstanced(item, batch.indexCount, batch.firstIndex, GLsizei(this->instances.Count()));
+        }
+    }
+
+    // Llamado por RenderQueue al empezar a dibujar este modelo con "program"
+    void BindObject(GLuint program, GLStateCache& cache) override
+    {
+        this->bindQuantization(program, &cache);
+        this->bindIrradiance(program, &cache);
+        if (this->lightmap != 0) {
+            cache.BindTexture(LIGHTMAP_TEXTURE_UNIT, this->lightmap);
+        }
+    }
+
+    // Pixeles por unidad de mundo a distancia 1: projection[1][1] * alto / 2.
+    // Con umbral <= 0 siempre se dibuja el nivel 0
+    void SetLodProjection(const glm::mat4& projection, int screenHeight, float pixelThreshold = LOD_PIXEL_ERROR)
+    {
+        this->lodPixelScale = projection[1][1] * float(screenHeight) * 0.5f;
+        this->lodThreshold = pixelThreshold;
+    }
+
+    bool CompactVertices() const { return this->compact; }
+    bool HasLightmap() const { return this->lightmap != 0; }
+
+    // Sondas horneadas para este modelo (vacio si no hay "<archivo>.probes")
+    const IrradianceVolume& Probes() const { return this->probes; }
+
+    // Irradiancia que usan los programas con IRRADIANCE_PROBES al dibujar
+    // este modelo; se actualiza cuando el modelo se mueve
+    void SetIrradiance(const ShIrradiance& value) { this->irradiance = value; }
+
+    const std::vector<CacheMesh>& Meshes() const { return this->meshes; }
+    const std::vector<CacheMaterial>& Materials() const { return this->materials; }
+
+    // Caja que envuelve todo el modelo (espacio del modelo)
+    glm::vec3 BoundsMin() const { return this->boundsMin; }
+    glm::vec3 BoundsMax() const { return this->boundsMax; }
+
+private:
+    GLuint VAO = 0, VBO = 0, EBO = 0;
+    std::vector<CacheMesh> meshes;
+    std::vector<CacheBatch> batches;
+    std::vector<CacheMaterial> materials;
+    std::vector<CacheLod> lods;                 // lods[level * meshes.size() + mesh]
+    std::vector<uint8_t> lodLevels;             // nivel elegido en el fotograma anterior
+    float lodPixelScale = 0.0f;
+    float lodThreshold = 0.0f;
+    std::vector<TextureHandle> diffuseMaps;   // por material
+    std::vector<TextureHandle> specularMaps;  // por material
+    std::string directory;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    MeshBVH bvh;
+    std::vector<uint8_t> visible;               // por submalla, del ultimo Cull
+    std::vector<GLsizei> runCounts;             // rangos visibles del lote actual
+    std::vector<const GLvoid*> runOffsets;
+    InstanceBuffer instances;
+    bool compact = false;
+    GLuint lightmap = 0;
+    GLuint lightmapVBO = 0;
+    bool ready = false;
+    // Ubicaciones de los uniforms de COMPACT_VERTEX por programa (-1 si no los usa)
+    struct QuantizationUniforms
+    {
+        GLuint program;
+        GLint offsetLoc, scaleLoc, octNormalsLoc;
+    };
+    std::vector<QuantizationUniforms> quantizationUniforms;
+    IrradianceVolume probes;
+    ShIrradiance irradiance = {};
+    // Ubicacion de cada elemento de irradianceSH por programa (-1 si no lo usa)
+    struct IrradianceUniforms
+    {
+        GLuint program;
+        GLint locations[SH_COEFFICIENTS];
+    };
+    std::vector<IrradianceUniforms> irradianceUniforms;
+
+    // Primera llamada a Upload: toma las tablas de "data" y crea el VAO con
+    // los buffers vacios del tamano final, que se llenan por partes
+    void createBuffers(CachedModelData& data)
+    {
+        this->directory = DirectoryOf(data.path);
+        this->meshes = std::move(data.meshes);
+        this->batches = std::move(data.batches);
+        this->materials = std::move(data.materials);
+        this->lods = std::move(data.lods);
+        this->bvh = std::move(data.bvh);
+        this->lodLevels.assign(this->meshes.size(), 0);
+        this->boundsMin = data.boundsMin;
+        this->boundsMax = data.boundsMax;
+        this->compact = data.compact;
+
+        glGenVertexArrays(1, &this->VAO);
+        glGenBuffers(1, &this->VBO);
+        glGenBuffers(1, &this->EBO);
+        glBindVertexArray(this->VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indexSize, nullptr, GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, data.vertexSize, nullptr, GL_STATIC_DRAW);
+        if (this->compact) {
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (GLvoid*)offsetof(CompactVertex, position));
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (GLvoid*)offsetof(CompactVertex, normal));
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (GLvoid*)offsetof(CompactVertex, texCoords));
+        }
+        else {
+            // Posicion, normal y coordenadas de textura (mismo layout que Mesh)
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(CacheVertex), (GLvoid*)0);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(CacheVertex), (GLvoid*)offsetof(CacheVertex, Normal));
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(CacheVertex), (GLvoid*)offsetof(CacheVertex, TexCoords));
+        }
+        glBindVertexArray(0);
+    }
+
+    // Los Draw directos dejan la unidad 0 activa al final, como siempre
+    void bindLightmap()
+    {
+        if (this->lightmap != 0) {
+            GL_COUNT(glActiveTexture(GL_TEXTURE0 + LIGHTMAP_TEXTURE_UNIT));
+            GL_COUNT(glBindTexture(GL_TEXTURE_2D, this->lightmap));
+        }
+    }
+
+    // Con el VAO enlazado: UV del atlas en LIGHTMAP_UV_LOCATION (en su propio
+    // buffer, sirve igual con vertices compactos) y la textura RGB16F
+    void uploadLightmap(const LightmapData& data)
+    {
+        glGenBuffers(1, &this->lightmapVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, this->lightmapVBO);
+        glBufferData(GL_ARRAY_BUFFER, data.uvs.size() * sizeof(uint16_t), data.uvs.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(LIGHTMAP_UV_LOCATION);
+        glVertexAttribPointer(LIGHTMAP_UV_LOCATION, 2, GL_UNSIGNED_SHORT, GL_TRUE, 2 * sizeof(uint16_t), (GLvoid*)0);
+
+        glGenTextures(1, &this->lightmap);
+        glBindTexture(GL_TEXTURE_2D, this->lightmap);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, GLsizei(data.size), GLsizei(data.size), 0, GL_RGB, GL_HALF_FLOAT, data.texels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Frustum (y mascara) sobre las submallas; deja el resultado en "visible"
+    // y devuelve la escala del modelo para los LOD
+    float cull(const glm::mat4& clip, const glm::mat4& model, const std::vector<uint8_t>* mask)
+    {
+        this->bvh.Cull(Frustum(clip), this->meshes, this->visible, CullingStats().frame);
+        if (mask != nullptr) {
+            for (size_t i = 0; i < this->visible.size(); i++) {
+                this->visible[i] &= (*mask)[i];
+            }
+        }
+        // El error de los LOD esta en unidades del modelo; se escala con la
+        // mayor escala de "model" para compararlo en el mundo
+        return std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    }
+
+    // Rangos de indices visibles del lote en runCounts/runOffsets: las
+    // submallas que quedan seguidas en el buffer (con el mismo LOD) se unen.
+    // Devuelve los indices a dibujar y en "depth" el menor w de sus centros
+    uint32_t buildRuns(const CacheBatch& batch, const glm::mat4& clip, float scale, float& depth)
+    {
+        CullingCounters& counters = CullingStats().frame;
+        this->runCounts.clear();
+        this->runOffsets.clear();
+        depth = FLT_MAX;
+        uint32_t runEnd = 0;
+        uint32_t runIndices = 0;
+        for (uint32_t i = batch.firstMesh; i < batch.firstMesh + batch.meshCount; i++) {
+            const CacheMesh& mesh = this->meshes[i];
+            counters.meshes++;
+            counters.triangles += mesh.indexCount / 3;
+            if (!this->visible[i]) {
+                counters.culledMeshes++;
+                counters.culledTriangles += mesh.indexCount / 3;
+                continue;
+            }
+            glm::vec3 center = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+            depth = std::min(depth, clip[0][3] * center.x + clip[1][3] * center.y + clip[2][3] * center.z + clip[3][3]);
+            const CacheLod& lod = this->lods[this->selectLod(i, clip, scale) * this->meshes.size() + i];
+            counters.lodSavedTriangles += (mesh.indexCount - lod.indexCount) / 3;
+            if (!this->runCounts.empty() && runEnd == lod.firstIndex) {
+                this->runCounts.back() += lod.indexCount;
+            }
+            else {
+                this->runCounts.push_back(lod.indexCount);
+                this->runOffsets.push_back((GLvoid*)(sizeof(GLuint) * lod.firstIndex));
+            }
+            runEnd = lod.firstIndex + lod.indexCount;
+            runIndices += lod.indexCount;
+        }
+        return runIndices;
+    }
+
+    // Con el programa en uso: decodificacion de vertices de este modelo. Los
+    // programas sin COMPACT_VERTEX no tienen estos uniforms y no se toca nada.
+    // Con "cache" los valores repetidos no se vuelven a subir
+    void bindQuantization(GLuint program, GLStateCache* cache = nullptr)
+    {
+        const QuantizationUniforms* uniforms = nullptr;
+        for (const QuantizationUniforms& entry : this->quantizationUniforms) {
+            if (entry.program == program) {
+                uniforms = &entry;
+            }
+        }
+        if (uniforms == nullptr) {
+            this->quantizationUniforms.push_back({ program, glGetUniformLocation(program, "positionOffset"),
+                                                   glGetUniformLocation(program, "positionScale"),
+                                                   glGetUniformLocation(program, "octNormals") });
+            uniforms = &this->quantizationUniforms.back();
+        }
+        if (uniforms->offsetLoc < 0) {
+            return;
+        }
+        glm::vec3 offset = this->compact ? this->boundsMin : glm::vec3(0.0f);
+        glm::vec3 scale = this->compact ? CompactScale(this->boundsMin, this->boundsMax) : glm::vec3(1.0f);
+        if (cache != nullptr) {
+            cache->Uniform3(uniforms->offsetLoc, offset);
+            cache->Uniform3(uniforms->scaleLoc, scale);
+            cache->Uniform1(uniforms->octNormalsLoc, this->compact ? 1 : 0);
+            return;
+        }
+        GL_COUNT(glUniform3fv(uniforms->offsetLoc, 1, glm::value_ptr(offset)));
+        GL_COUNT(glUniform3fv(uniforms->scaleLoc, 1, glm::value_ptr(scale)));
+        GL_COUNT(glUniform1i(uniforms->octNormalsLoc, this->compact ? 1 : 0));
+    }
+
+    // Con el programa en uso: la irradiancia de SetIrradiance, solo si el
+    // programa tiene IRRADIANCE_PROBES
+    void bindIrradiance(GLuint program, GLStateCache* cache = nullptr)
+    {
+        const IrradianceUniforms* uniforms = nullptr;
+        for (const IrradianceUniforms& entry : this->irradianceUniforms) {
+            if (entry.program == program) {
+                uniforms = &entry;
+            }
+        }
+        if (uniforms == nullptr) {
+            IrradianceUniforms entry;
+            entry.program = program;
+            for (int k = 0; k < SH_COEFFICIENTS; k++) {
+                entry.locations[k] = glGetUniformLocation(program, ("irradianceSH[" + std::to_string(k) + "]").c_str());
+            }
+            this->irradianceUniforms.push_back(entry);
+            uniforms = &this->irradianceUniforms.back();
+        }
+        if (uniforms->locations[0] < 0) {
+            return;
+        }
+        if (cache != nullptr) {
+            for (int k = 0; k < SH_COEFFICIENTS; k++) {
+                cache->Uniform3(uniforms->locations[k], this->irradiance.coefficients[k]);
+            }
+            return;
+        }
+        GL_COUNT(glUniform3fv(uniforms->locations[0], SH_COEFFICIENTS, glm::value_ptr(this->irradiance.coefficients[0])));
+    }
+
+    // Error en pixeles del nivel "level" de la submalla a la profundidad "depth"
+    float pixelError(uint32_t mesh, uint32_t level, float scale, float depth) const
+    {
+        return this->lods[level * this->meshes.size() + mesh].error * scale * this->lodPixelScale / depth;
+    }
+
+    // Nivel mas simple que no pase del umbral, con histeresis respecto al anterior
+    uint32_t selectLod(uint32_t mesh, const glm::mat4& clip, float scale)
+    {
+        if (this->lodThreshold <= 0.0f || this->lodPixelScale <= 0.0f) {
+            return 0;
+        }
+        // Profundidad de la parte mas cercana de la caja: w del centro menos el radio
+        const CacheMesh& bounds = this->meshes[mesh];
+        glm::vec3 center = (bounds.boundsMin + bounds.boundsMax) * 0.5f;
+        float radius = glm::length(bounds.boundsMax - center) * scale;
+        float depth = clip[0][3] * center.x + clip[1][3] * center.y + clip[2][3] * center.z + clip[3][3] - radius;
+        uint32_t level = this->lodLevels[mesh];
+        if (depth <= 1e-3f) {
+            level = 0;
+        }
+        else {
+            while (level + 1 < MESH_LOD_LEVELS && this->pixelError(mesh, level + 1, scale, depth) < this->lodThreshold * (1.0f - LOD_HYSTERESIS)) {
+                level++;
+            }
+            while (level > 0 && this->pixelError(mesh, level, scale, depth) > this->lodThreshold) {
+                level--;
+            }
+        }
+        this->lodLevels[mesh] = uint8_t(level);
+        return level;
+    }
+
+    unsigned long long lodTriangles(uint32_t level) const
+    {
+        unsigned long long triangles = 0;
+        for (size_t i = 0; i < this->meshes.size(); i++) {
+            triangles += this->lods[level * this->meshes.size() + i].indexCount / 3;
+        }
+        return triangles;
+    }
+
+    // Las texturas se piden al cache global, que las comparte entre modelos
+    TextureHandle loadTexture(const char* file)
+    {
+        if (file[0] == '\0') {
+            return TextureCache::Instance().White();
+        }
+        return TextureCache::Instance().Load(this->directory + '/' + std::string(file));
+    }
+};
+
+// --benchmark-lod: dibuja el modelo desde varias distancias sin LOD y con LOD
+// y mide triangulos por fotograma y tiempo de GPU (con glFinish). El programa ya
+// debe tener proyeccion, luces y el bloque Object listos
+inline void BenchmarkLod(CachedModel& model, GLuint program, GLint viewLoc, const glm::mat4& projection, int screenHeight,
+                         const glm::vec3& target, const glm::vec3& direction)
+{
+    const float distances[] = { 6.0f, 12.0f, 25.0f, 50.0f, 95.0f };
+    const int frames = 30;
+    std::cout << "[LOD] distance  mode  triangles/frame  ms/frame  Mtris/s" << std::endl;
+    glUseProgram(program);
+    glEnable(GL_DEPTH_TEST);
+    for (float distance : distances) {
+        glm::mat4 view = glm::lookAt(target + glm::normalize(direction) * distance, target, glm::vec3(0.0f, 1.0f, 0.0f));
+        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+        for (int mode = 0; mode < 2; mode++) {
+            model.SetLodProjection(projection, screenHeight, mode == 0 ? 0.0f : LOD_PIXEL_ERROR);
+            unsigned long long triangles = 0;
+            double milliseconds = 0.0;
+            for (int frame = -3; frame < frames; frame++) {
+                CullingStats().frame = CullingCounters();
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                glFinish();
+                auto start = std::chrono::steady_clock::now();
+                model.Draw(program, projection * view, glm::mat4(1.0f));
+                glFinish();
+                // Los primeros fotogramas solo asientan la histeresis y los drivers
+                if (frame >= 0) {
+                    milliseconds += MillisecondsSince(start);
+                    const CullingCounters& counters = CullingStats().frame;
+                    triangles += counters.triangles - counters.culledTriangles - counters.lodSavedTriangles;
+                }
+            }
+            std::cout << "[LOD] " << distance << "  " << (mode == 0 ? "full" : "lod ") << "  " << triangles / frames << "  "
+                      << milliseconds / frames << "  " << double(triangles) / milliseconds / 1000.0 << std::endl;
+        }
+    }
+    CullingStats().frame = CullingCounters();
+    model.SetLodProjection(projection, screenHeight);
+}
+
+// --benchmark-instancing: dibuja N copias del modelo con un Draw por copia
+// (subiendo el bloque Object cada vez) y con un solo DrawInstanced, y mide
+// llamadas GL y tiempo con glFinish. Ambos programas deben tener proyeccion,
+// vista y luces listos
+inline void BenchmarkInstancing(CachedModel& model, GLuint program, GLuint instancedProgram, LightingState& lighting)
+{
+    const size_t counts[] = { 1, 10, 100, 1000, 5000 };
+    const int frames = 10;
+    std::cout << "[Instancing] copies  mode       GL calls/frame  ms/frame" << std::endl;
+    glEnable(GL_DEPTH_TEST);
+    for (size_t count : counts) {
+        // Cuadricula centrada en el origen, a escala pequena para que quepan en pantalla
+        std::vector<glm::mat4> transforms(count);
+        int side = int(std::ceil(std::sqrt(double(count))));
+        for (size_t i = 0; i < count; i++) {
+            glm::vec3 offset(float(int(i) % side - side / 2), 0.0f, -float(int(i) / side));
+            transforms[i] = glm::scale(glm::translate(glm::mat4(1.0f), offset * 1.5f), glm::vec3(0.2f));
+        }
+        for (int mode = 0; mode < 2; mode++) {
+            double milliseconds = 0.0;
+            unsigned long long calls = 0;
+            for (int frame = -2; frame < frames; frame++) {
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                glFinish();
+                unsigned long long callsBefore = GLStats().calls;
+                auto start = std::chrono::steady_clock::now();
+                if (mode == 0) {
+                    glUseProgram(program);
+                    for (const glm::mat4& transform : transforms) {
+                        lighting.SetObject(transform);
+                        model.Draw(program);
+                    }
+                }
+                else {
+                    glUseProgram(instancedProgram);
+                    model.DrawInstanced(instancedProgram, transforms);
+                }
+                glFinish();
+                if (frame >= 0) {
+                    milliseconds += MillisecondsSince(start);
+                    calls += GLStats().calls - callsBefore;
+                }
+            }
+            std::cout << "[Instancing] " << count << "  " << (mode == 0 ? "per-copy " : "instanced") << "  " << calls / frames << "  "
+                      << milliseconds / frames << std::endl;
+        }
+    }
+}
@@ -0,0 +1,579 @@
+#pragma once
+
+// Iluminacion "clustered forward": el frustum de la camara se divide en
+// CLUSTER_TILES_X x CLUSTER_TILES_Y baldosas de pantalla y CLUSTER_SLICES
+// cortes de profundidad logaritmicos. Cada fotograma la CPU asigna las luces
+// puntuales a los clusters que tocan (prueba esfera-AABB de 4 en 4 con SSE,
+// un corte de profundidad por tarea en ParallelFor) y lighting.frag compilado
+// con CLUSTERED solo evalua las luces de su cluster.
+//
+// Los datos llegan al shader en tres texture buffers (GL 3.3 no tiene SSBO):
+//   clusterLights  RGBA32F, 4 texeles por luz (ver ClusterLight)
+//   clusterRanges  RG32UI, (inicio, cantidad) por cluster
+//   clusterIndices R32UI, indices de luz de todos los clusters seguidos
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CLUSTER_SIMD 1
+#else
+#define CLUSTER_SIMD 0
+#endif
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "GLStats.h"
+#include "TextureCache.h"
+#include "ThreadPool.h"
+
+const unsigned int CLUSTER_TILES_X = 16;
+const unsigned int CLUSTER_TILES_Y = 9;
+const unsigned int CLUSTER_SLICES = 24;
+const unsigned int CLUSTER_TILES = CLUSTER_TILES_X * CLUSTER_TILES_Y;
+const unsigned int CLUSTER_COUNT = CLUSTER_TILES * CLUSTER_SLICES;
+const unsigned int CLUSTER_MAX_LIGHTS = 256;  // por cluster; el resto se descarta
+const float CLUSTER_LIGHT_CUTOFF = 1.0f / 256.0f;  // aporte minimo que se considera visible
+
+const GLint CLUSTER_LIGHTS_UNIT = 2;  // 0 y 1 son las texturas difusa y especular
+const GLint CLUSTER_RANGES_UNIT = 3;
+const GLint CLUSTER_INDICES_UNIT = 4;
+
+static_assert(CLUSTER_TILES_X % 4 == 0, "las filas de baldosas se prueban de 4 en 4");
+
+// Una luz puntual tal como la lee lighting.frag (misma atenuacion que
+// CalcPointLight); w de cada texel lleva el radio y los coeficientes
+struct ClusterLight
+{
+    glm::vec4 positionRadius;
+    glm::vec4 ambientConstant;
+    glm::vec4 diffuseLinear;
+    glm::vec4 specularQuadratic;
+};
+
+// Distancia a la que constant + linear*d + quadratic*d^2 deja el aporte mas
+// brillante por debajo de CLUSTER_LIGHT_CUTOFF. Sin atenuacion el radio es
+// infinito (la luz entra en todos los clusters) y sin color es cero
+inline float PointLightRadius(const glm::vec3& ambient, const glm::vec3& diffuse, const glm::vec3& specular,
+                              float constant, float linear, float quadratic)
+{
+    glm::vec3 brightest = glm::max(ambient, glm::max(diffuse, specular));
+    float intensity = std::max(brightest.x, std::max(brightest.y, brightest.z));
+    if (intensity <= 0.0f) {
+        return 0.0f;
+    }
+    float limit = intensity / CLUSTER_LIGHT_CUTOFF;
+    if (constant >= limit) {
+        return 0.0f;
+    }
+    if (quadratic > 0.0f) {
+        return (-linear + std::sqrt(linear * linear - 4.0f * quadratic * (constant - limit))) / (2.0f * quadratic);
+    }
+    if (linear > 0.0f) {
+        return (limit - constant) / linear;
+    }
+    return std::numeric_limits<float>::infinity();
+}
+
+inline ClusterLight MakeClusterLight(const glm::vec3& position, const glm::vec3& ambient, const glm::vec3& diffuse, const glm::vec3& specular,
+                                     float constant, float linear, float quadratic)
+{
+    ClusterLight light;
+    light.positionRadius = glm::vec4(position, PointLightRadius(ambient, diffuse, specular, constant, linear, quadratic));
+    light.ambientConstant = glm::vec4(ambient, constant);
+    light.diffuseLinear = glm::vec4(diffuse, linear);
+    light.specularQuadratic = glm::vec4(specular, quadratic);
+    return light;
+}
+
+// Parte de CPU: no toca OpenGL, asi que el benchmark la usa sin contexto
+class LightClusterer
+{
+public:
+    bool simd = CLUSTER_SIMD != 0;  // el benchmark la apaga para comparar
+
+    // Recalcula las cajas de los clusters (en espacio de vista) para una
+    // proyeccion en perspectiva simetrica como la de glm::perspective
+    void SetProjection(const glm::mat4& projection, float zNear, float zFar)
+    {
+        this->scaleX = projection[0][0];
+        this->scaleY = projection[1][1];
+        this->zNear = zNear;
+        this->zFar = zFar;
+        this->sliceScale = float(CLUSTER_SLICES) / std::log(zFar / zNear);
+        this->sliceBias = -float(CLUSTER_SLICES) * std::log(zNear) / std::log(zFar / zNear);
+
+        for (std::vector<float>* bounds : { &this->minX, &this->minY, &this->minZ, &this->maxX, &this->maxY, &this->maxZ }) {
+            bounds->resize(CLUSTER_COUNT);
+        }
+        for (unsigned int slice = 0; slice < CLUSTER_SLICES; slice++) {
+            float nearDepth = zNear * std::pow(zFar / zNear, float(slice) / CLUSTER_SLICES);
+            float farDepth = zNear * std::pow(zFar / zNear, float(slice + 1) / CLUSTER_SLICES);
+            for (unsigned int y = 0; y < CLUSTER_TILES_Y; y++) {
+                float ndcY0 = -1.0f + 2.0f * y / CLUSTER_TILES_Y;
+                float ndcY1 = -1.0f + 2.0f * (y + 1) / CLUSTER_TILES_Y;
+                for (unsigned int x = 0; x < CLUSTER_TILES_X; x++) {
+                    float ndcX0 = -1.0f + 2.0f * x / CLUSTER_TILES_X;
+                    float ndcX1 = -1.0f + 2.0f * (x + 1) / CLUSTER_TILES_X;
+                    unsigned int cluster = slice * CLUSTER_TILES + y * CLUSTER_TILES_X + x;
+                    this->minX[cluster] = std::min(ndcX0 * nearDepth, ndcX0 * farDepth) / this->scaleX;
+                    this->maxX[cluster] = std::max(ndcX1 * nearDepth, ndcX1 * farDepth) / this->scaleX;
+                    this->minY[cluster] = std::min(ndcY0 * nearDepth, ndcY0 * farDepth) / this->scaleY;
+                    this->maxY[cluster] = std::max(ndcY1 * nearDepth, ndcY1 * farDepth) / this->scaleY;
+                    this->minZ[cluster] = -farDepth;
+                    this->maxZ[cluster] = -nearDepth;
+                }
+            }
+        }
+    }
+
+    // Llena Ranges()/Indices() con las luces que tocan cada cluster
+    void Assign(const std::vector<ClusterLight>& lights, const glm::mat4& view, unsigned int threadCount)
+    {
+        auto start = std::chrono::steady_clock::now();
+        this->buildLightBounds(lights, view);
+
+        this->slices.resize(CLUSTER_SLICES);
+        ParallelFor(CLUSTER_SLICES, threadCount, [this](size_t begin, size_t end, unsigned int) {
+            for (size_t slice = begin; slice < end; slice++) {
+                this->assignSlice(unsigned(slice));
+            }
+        });
+
+        // Une los cortes en orden: los indices de cada cluster quedan contiguos
+        this->ranges.resize(CLUSTER_COUNT * 2);
+        this->indices.clear();
+        this->maxPerCluster = 0;
+        this->clampedClusters = 0;
+        for (unsigned int slice = 0; slice < CLUSTER_SLICES; slice++) {
+            const SliceLists& lists = this->slices[slice];
+            for (unsigned int tile = 0; tile < CLUSTER_TILES; tile++) {
+                uint32_t first = lists.offsets[tile];
+                uint32_t count = lists.offsets[tile + 1] - first;
+                if (count > CLUSTER_MAX_LIGHTS) {
+                    count = CLUSTER_MAX_LIGHTS;
+                    this->clampedClusters++;
+                }
+                unsigned int cluster = slice * CLUSTER_TILES + tile;
+                this->ranges[cluster * 2] = uint32_t(this->indices.size());
+                this->ranges[cluster * 2 + 1] = count;
+                this->indices.insert(this->indices.end(), lists.lights.begin() + first, lists.lights.begin() + first + count);
+                this->maxPerCluster = std::max(this->maxPerCluster, count);
+            }
+        }
+        this->assignMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    const std::vector<uint32_t>& Ranges() const { return this->ranges; }
+    const std::vector<uint32_t>& Indices() const { return this->indices; }
+    double AssignMilliseconds() const { return this->assignMilliseconds; }
+    uint32_t MaxPerCluster() const { return this->maxPerCluster; }
+    unsigned int ClampedClusters() const { return this->clampedClusters; }
+    size_t VisibleLights() const { return this->bounds.size(); }
+    float Near() const { return this->zNear; }
+    float Far() const { return this->zFar; }
+    float SliceScale() const { return this->sliceScale; }
+    float SliceBias() const { return this->sliceBias; }
+
+private:
+    // Esfera de una luz en espacio de vista y rango de clusters que puede tocar
+    struct LightBounds
+    {
+        glm::vec3 center;
+        float radius;
+        uint32_t light;
+        unsigned int x0, x1, y0, y1, z0, z1;
+    };
+
+    // Listas de un corte de profundidad, ordenadas por baldosa
+    struct SliceLists
+    {
+        std::vector<uint16_t> hitTiles;
+        std::vector<uint32_t> hitLights;
+        std::vector<uint32_t> offsets;  // CLUSTER_TILES + 1
+        std::vector<uint32_t> lights;
+    };
+
+    float scaleX = 1.0f, scaleY = 1.0f;
+    float zNear = 0.1f, zFar = 100.0f;
+    float sliceScale = 0.0f, sliceBias = 0.0f;
+    std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;  // SoA por cluster
+    std::vector<LightBounds> bounds;
+    std::vector<SliceLists> slices;
+    std::vector<uint32_t> ranges;
+    std::vector<uint32_t> indices;
+    double assignMilliseconds = 0.0;
+    uint32_t maxPerCluster = 0;
+    unsigned int clampedClusters = 0;
+
+    unsigned int sliceOf(float depth) const
+    {
+        float slice = std::floor(std::log(depth) * this->sliceScale + this->sliceBias);
+        return unsigned(std::min(std::max(slice, 0.0f), float(CLUSTER_SLICES - 1)));
+    }
+
+    static unsigned int tileOf(float ndc, unsigned int tiles)
+    {
+        float tile = std::floor((ndc * 0.5f + 0.5f) * tiles);
+        return unsigned(std::min(std::max(tile, 0.0f), float(tiles - 1)));
+    }
+
+    // Rango conservador de baldosas y cortes: la caja de la esfera proyectada
+    // tiene sus extremos en las esquinas porque x/d es monotona en x y en d
+    void buildLightBounds(const std::vector<ClusterLight>& lights, const glm::mat4& view)
+    {
+        this->bounds.clear();
+        for (uint32_t i = 0; i < lights.size(); i++) {
+            float radius = lights[i].positionRadius.w;
+            if (!(radius > 0.0f)) {
+                continue;
+            }
+            glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(lights[i].positionRadius), 1.0f));
+            float depth = -center.z;
+            float nearDepth = depth - radius;
+            float farDepth = depth + radius;
+            if (farDepth < this->zNear || nearDepth > this->zFar) {
+                continue;
+            }
+
+            LightBounds light;
+            light.center = center;
+            light.radius = std::min(radius, 2.0f * this->zFar);
+            light.light = i;
+            light.z0 = this->sliceOf(std::max(nearDepth, this->zNear));
+            light.z1 = this->sliceOf(std::min(farDepth, this->zFar));
+            light.x0 = light.y0 = 0;
+            light.x1 = CLUSTER_TILES_X - 1;
+            light.y1 = CLUSTER_TILES_Y - 1;
+            if (nearDepth > this->zNear) {
+                float ndcX[4] = { (center.x - radius) / nearDepth, (center.x - radius) / farDepth,
+                                  (center.x + radius) / nearDepth, (center.x + radius) / farDepth };
+                float ndcY[4] = { (center.y - radius) / nearDepth, (center.y - radius) / farDepth,
+                                  (center.y + radius) / nearDepth, (center.y + radius) / farDepth };
+                float minNdcX = *std::min_element(ndcX, ndcX + 4) * this->scaleX;
+                float maxNdcX = *std::max_element(ndcX, ndcX + 4) * this->scaleX;
+                float minNdcY = *std::min_element(ndcY, ndcY + 4) * this->scaleY;
+                float maxNdcY = *std::max_element(ndcY, ndcY + 4) * this->scaleY;
+                if (maxNdcX < -1.0f || minNdcX > 1.0f || maxNdcY < -1.0f || minNdcY > 1.0f) {
+                    continue;
+                }
+                light.x0 = tileOf(minNdcX, CLUSTER_TILES_X);
+                light.x1 = tileOf(maxNdcX, CLUSTER_TILES_X);
+                light.y0 = tileOf(minNdcY, CLUSTER_TILES_Y);
+                light.y1 = tileOf(maxNdcY, CLUSTER_TILES_Y);
+            }
+            this->bounds.push_back(light);
+        }
+    }
+
+    void assignSlice(unsigned int slice)
+    {
+        SliceLists& lists = this->slices[slice];
+        lists.hitTiles.clear();
+        lists.hitLights.clear();
+        unsigned int sliceBase = slice * CLUSTER_TILES;
+
+        for (const LightBounds& light : this->bounds) {
+            if (slice < light.z0 || slice > light.z1) {
+                continue;
+            }
+            float radiusSquared = light.radius * light.radius;
+            for (unsigned int y = light.y0; y <= light.y1; y++) {
+                unsigned int rowBase = sliceBase + y * CLUSTER_TILES_X;
+                for (unsigned int x = light.x0 & ~3u; x <= light.x1; x += 4) {
+                    unsigned int mask = this->simd ? this->sphereMask4(rowBase + x, light.center, radiusSquared)
+                                                   : this->sphereMask4Scalar(rowBase + x, light.center, radiusSquared);
+                    for (unsigned int lane = 0; lane < 4; lane++) {
+                        unsigned int tileX = x + lane;
+                        if ((mask & (1u << lane)) && tileX >= light.x0 && tileX <= light.x1) {
+                            lists.hitTiles.push_back(uint16_t(y * CLUSTER_TILES_X + tileX));
+                            lists.hitLights.push_back(light.light);
+                        }
+                    }
+                }
+            }
+        }
+
+        // Ordenamiento por conteo estable: cada baldosa conserva el orden de las luces
+        lists.offsets.assign(CLUSTER_TILES + 1, 0);
+        for (uint16_t tile : lists.hitTiles) {
+            lists.offsets[tile + 1]++;
+        }
+        for (unsigned int tile = 0; tile < CLUSTER_TILES; tile++) {
+            lists.offsets[tile + 1] += lists.offsets[tile];
+        }
+        lists.lights.resize(lists.hitLights.size());
+        std::vector<uint32_t> cursor(lists.offsets.begin(), lists.offsets.end() - 1);
+        for (size_t i = 0; i < lists.hitTiles.size(); i++) {
+            lists.lights[cursor[lists.hitTiles[i]]++] = lists.hitLights[i];
+        }
+    }
+
+    // Distancia al cuadrado de la esfera a 4 cajas consecutivas; bit i = toca la caja i
+    unsigned int sphereMask4(unsigned int first, const glm::vec3& center, float radiusSquared) const
+    {
+#if CLUSTER_SIMD
+        __m128 zero = _mm_setzero_ps();
+        __m128 cx = _mm_set1_ps(center.x);
+        __m128 cy = _mm_set1_ps(center.y);
+        __m128 cz = _mm_set1_ps(center.z);
+        __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&this->minX[first]), cx), _mm_sub_ps(cx, _mm_loadu_ps(&this->maxX[first]))), zero);
+        __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&this->minY[first]), cy), _mm_sub_ps(cy, _mm_loadu_ps(&this->maxY[first]))), zero);
+        __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&this->minZ[first]), cz), _mm_sub_ps(cz, _mm_loadu_ps(&this->maxZ[first]))), zero);
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        return unsigned(_mm_movemask_ps(_mm_cmple_ps(distance, _mm_set1_ps(radiusSquared))));
+#else
+        return this->sphereMask4Scalar(first, center, radiusSquared);
+#endif
+    }
+
+    unsigned int sphereMask4Scalar(unsigned int first, const glm::vec3& center, float radiusSquared) const
+    {
+        unsigned int mask = 0;
+        for (unsigned int lane = 0; lane < 4; lane++) {
+            unsigned int i = first + lane;
+            float dx = std::max(std::max(this->minX[i] - center.x, center.x - this->maxX[i]), 0.0f);
+            float dy = std::max(std::max(this->minY[i] - center.y, center.y - this->maxY[i]), 0.0f);
+            float dz = std::max(std::max(this->minZ[i] - center.z, center.z - this->maxZ[i]), 0.0f);
+            if (dx * dx + dy * dy + dz * dz <= radiusSquared) {
+                mask |= 1u << lane;
+            }
+        }
+        return mask;
+    }
+};
+
+// Parte de GPU: lista de luces, texture buffers y uniforms del shader
+class ClusteredLights
+{
+public:
+    ClusteredLights()
+    {
+        GLuint* buffers[3] = { &this->lightsBuffer, &this->rangesBuffer, &this->indicesBuffer };
+        GLuint* textures[3] = { &this->lightsTexture, &this->rangesTexture, &this->indicesTexture };
+        GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+        for (int i = 0; i < 3; i++) {
+            glGenBuffers(1, buffers[i]);
+            glBindBuffer(GL_TEXTURE_BUFFER, *buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+            glGenTextures(1, textures[i]);
+            glBindTexture(GL_TEXTURE_BUFFER, *textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], *buffers[i]);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        this->threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Como CachedModel: despues de TextureCache::Shutdown el contexto ya no existe
+    ~ClusteredLights()
+    {
+        if (!TextureCache::Instance().ContextAlive()) {
+            return;
+        }
+        GLuint buffers[3] = { this->lightsBuffer, this->rangesBuffer, this->indicesBuffer };
+        GLuint textures[3] = { this->lightsTexture, this->rangesTexture, this->indicesTexture };
+        glDeleteBuffers(3, buffers);
+        glDeleteTextures(3, textures);
+    }
+
+    ClusteredLights(const ClusteredLights&) = delete;
+    ClusteredLights& operator=(const ClusteredLights&) = delete;
+
+    // Definiciones para CompileShaderVariant (ver ShaderVariants.h)
+    static std::vector<std::string> ShaderDefines()
+    {
+        return { "CLUSTERED",
+                 "CLUSTER_TILES_X " + std::to_string(CLUSTER_TILES_X),
+                 "CLUSTER_TILES_Y " + std::to_string(CLUSTER_TILES_Y),
+                 "CLUSTER_SLICES " + std::to_string(CLUSTER_SLICES) };
+    }
+
+    int AddPointLight(const glm::vec3& position, const glm::vec3& ambient, const glm::vec3& diffuse, const glm::vec3& specular,
+                      float constant, float linear, float quadratic)
+    {
+        this->lights.push_back(MakeClusterLight(position, ambient, diffuse, specular, constant, linear, quadratic));
+        return int(this->lights.size()) - 1;
+    }
+
+    void SetPosition(int index, const glm::vec3& position)
+    {
+        this->lights[index].positionRadius = glm::vec4(position, this->lights[index].positionRadius.w);
+    }
+
+    // Cambiar el color cambia tambien el radio de influencia
+    void SetColor(int index, const glm::vec3& ambient, const glm::vec3& diffuse)
+    {
+        ClusterLight& light = this->lights[index];
+        light = MakeClusterLight(glm::vec3(light.positionRadius), ambient, diffuse, glm::vec3(light.specularQuadratic),
+                                 light.ambientConstant.w, light.diffuseLinear.w, light.specularQuadratic.w);
+    }
+
+    size_t Count() const { return this->lights.size(); }
+
+    // Proyeccion y tamano del framebuffer; recalcula los clusters
+    void SetProjection(const glm::mat4& projection, float zNear, float zFar, int width, int height)
+    {
+        this->clusterer.SetProjection(projection, zNear, zFar);
+        this->tileWidth = float(width) / CLUSTER_TILES_X;
+        this->tileHeight = float(height) / CLUSTER_TILES_Y;
+        for (GLuint program : this->programs) {
+            this->applyUniforms(program);
+        }
+    }
+
+    // Fija las unidades de los samplers y el tamano de los clusters en
+    // "program" (queda en uso). Puede haber varios programas conectados;
+    // SetProjection vuelve a escribir los uniforms en todos
+    void Attach(GLuint program)
+    {
+        this->programs.push_back(program);
+        this->applyUniforms(program);
+    }
+
+    // Asigna las luces con la vista del fotograma y sube los tres buffers
+    void Update(const glm::mat4& view)
+    {
+        this->clusterer.Assign(this->lights, view, this->threads);
+        this->upload(this->lightsBuffer, this->lights.data(), this->lights.size() * sizeof(ClusterLight));
+        this->upload(this->rangesBuffer, this->clusterer.Ranges().data(), this->clusterer.Ranges().size() * sizeof(uint32_t));
+        this->upload(this->indicesBuffer, this->clusterer.Indices().data(), this->clusterer.Indices().size() * sizeof(uint32_t));
+        GL_COUNT(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+
+        this->accumulatedMilliseconds += this->clusterer.AssignMilliseconds();
+        this->accumulatedIndices += this->clusterer.Indices().size();
+        this->frames++;
+    }
+
+    // Antes de dibujar: enlaza los tres buffers en sus unidades
+    void Bind()
+    {
+        GLuint textures[3] = { this->lightsTexture, this->rangesTexture, this->indicesTexture };
+        GLint units[3] = { CLUSTER_LIGHTS_UNIT, CLUSTER_RANGES_UNIT, CLUSTER_INDICES_UNIT };
+        for (int i = 0; i < 3; i++) {
+            GL_COUNT(glActiveTexture(GL_TEXTURE0 + units[i]));
+            GL_COUNT(glBindTexture(GL_TEXTURE_BUFFER, textures[i]));
+        }
+        GL_COUNT(glActiveTexture(GL_TEXTURE0));
+    }
+
+    // Cada "interval" segundos imprime el promedio de la asignacion
+    void Report(double now, double interval = 2.0)
+    {
+        if (now - this->lastReport < interval || this->frames == 0) {
+            return;
+        }
+        std::cout << "[Clustered] " << this->lights.size() << " lights (" << this->clusterer.VisibleLights() << " visible), "
+                  << double(this->accumulatedIndices) / this->frames / CLUSTER_COUNT << " avg / "
+                  << this->clusterer.MaxPerCluster() << " max per cluster, assign "
+                  << this->accumulatedMilliseconds / this->frames << " ms on " << this->threads << " threads";
+        if (this->clusterer.ClampedClusters() > 0) {
+            std::cout << ", " << this->clusterer.ClampedClusters() << " clusters over " << CLUSTER_MAX_LIGHTS << " lights";
+        }
+        std::cout << std::endl;
+        this->accumulatedMilliseconds = 0.0;
+        this->accumulatedIndices = 0;
+        this->frames = 0;
+        this->lastReport = now;
+    }
+
+private:
+    std::vector<ClusterLight> lights;
+    LightClusterer clusterer;
+    unsigned int threads = 1;
+    GLuint lightsBuffer = 0, rangesBuffer = 0, indicesBuffer = 0;
+    GLuint lightsTexture = 0, rangesTexture = 0, indicesTexture = 0;
+    std::vector<GLuint> programs;
+    float tileWidth = 1.0f, tileHeight = 1.0f;
+    double accumulatedMilliseconds = 0.0;
+    size_t accumulatedIndices = 0;
+    unsigned int frames = 0;
+    double lastReport = 0.0;
+
+    void applyUniforms(GLuint program)
+    {
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "clusterLights"), CLUSTER_LIGHTS_UNIT);
+        glUniform1i(glGetUniformLocation(program, "clusterRanges"), CLUSTER_RANGES_UNIT);
+        glUniform1i(glGetUniformLocation(program, "clusterIndices"), CLUSTER_INDICES_UNIT);
+        glUniform2f(glGetUniformLocation(program, "clusterTileSize"), this->tileWidth, this->tileHeight);
+        glUniform4f(glGetUniformLocation(program, "clusterDepth"), this->clusterer.Near(), this->clusterer.Far(),
+                    this->clusterer.SliceScale(), this->clusterer.SliceBias());
+    }
+
+    // Huerfana el almacenamiento anterior para no esperar a la GPU
+    void upload(GLuint buffer, const void* data, size_t size)
+    {
+        size = std::max<size_t>(size, 16);
+        GL_COUNT(glBindBuffer(GL_TEXTURE_BUFFER, buffer));
+        GL_COUNT(glBufferData(GL_TEXTURE_BUFFER, size, NULL, GL_STREAM_DRAW));
+        GL_COUNT(glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data));
+    }
+};
+
+// Luces de prueba repartidas dentro de una caja (p. ej. los limites de la casa)
+inline void AddScatteredLights(ClusteredLights& clustered, int count, const glm::vec3& boundsMin, const glm::vec3& boundsMax, unsigned int seed = 7)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for (int i = 0; i < count; i++) {
+        glm::vec3 position = boundsMin + (boundsMax - boundsMin) * glm::vec3(unit(random), unit(random), unit(random));
+        glm::vec3 color = glm::vec3(1.0f, 0.6f + 0.4f * unit(random), 0.3f + 0.5f * unit(random));  // lamparas calidas
+        clustered.AddPointLight(position, glm::vec3(0.0f), color, color * 0.5f, 1.0f, 0.7f, 1.8f);
+    }
+}
+
+// --benchmark-lights: barrido del numero de luces sobre la asignacion en CPU,
+// sin contexto de OpenGL. Compara escalar/SSE y uno/varios hilos, y el numero
+// medio de luces que evalua un fragmento frente a la ruta con todas las luces
+inline int BenchmarkClusteredLights()
+{
+    const int iterations = 50;
+    const int counts[] = { 16, 64, 256, 1024, 4096 };
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    glm::vec3 player(0.0f, 0.8f, 0.0f);
+    glm::mat4 view = glm::lookAt(player + glm::vec3(0.0f, 4.0f, 12.0f), player, glm::vec3(0.0f, 1.0f, 0.0f));
+
+    std::cout << "[Clustered] " << CLUSTER_TILES_X << "x" << CLUSTER_TILES_Y << "x" << CLUSTER_SLICES << " clusters, "
+              << iterations << " iterations, " << threads << " threads, SIMD " << (CLUSTER_SIMD ? "SSE" : "off") << std::endl;
+    std::cout << "lights  scalar-1t ms  simd-1t ms  simd-" << threads << "t ms  avg/cluster  max/cluster" << std::endl;
+
+    for (int count : counts) {
+        std::mt19937 random(11);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::vector<ClusterLight> lights;
+        for (int i = 0; i < count; i++) {
+            glm::vec3 position = glm::vec3(-20.0f, 0.0f, -20.0f) + glm::vec3(40.0f, 6.0f, 40.0f) * glm::vec3(unit(random), unit(random), unit(random));
+            lights.push_back(MakeClusterLight(position, glm::vec3(0.0f), glm::vec3(1.0f), glm::vec3(0.5f), 1.0f, 0.7f, 1.8f));
+        }
+
+        LightClusterer clusterer;
+        clusterer.SetProjection(projection, 0.1f, 100.0f);
+        double milliseconds[3] = { 0.0, 0.0, 0.0 };
+        for (int mode = 0; mode < 3; mode++) {
+            clusterer.simd = mode > 0 && CLUSTER_SIMD;
+            unsigned int modeThreads = mode == 2 ? threads : 1;
+            clusterer.Assign(lights, view, modeThreads);  // calentamiento
+            for (int i = 0; i < iterations; i++) {
+                clusterer.Assign(lights, view, modeThreads);
+                milliseconds[mode] += clusterer.AssignMilliseconds();
+            }
+            milliseconds[mode] /= iterations;
+        }
+        std::cout << count << "\t" << milliseconds[0] << "\t" << milliseconds[1] << "\t" << milliseconds[2] << "\t"
+                  << double(clusterer.Indices().size()) / CLUSTER_COUNT << "\t" << clusterer.MaxPerCluster() << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,900 @@
+#pragma once
+
+// Mundo de colision estatico con los triangulos de la casa. Usa el BVH con
+// SAH de TriangleBVH.h y guarda los triangulos de cada hoja en paquetes de
+// cuatro (en columnas) para probarlos juntos con SSE: Moller-Trumbore para
+// rayos, y cajas y planos de los triangulos para descartar casi todos antes de
+// la prueba exacta de esferas y capsulas.
+//
+// Consultas:
+//  - Raycast: impacto mas cercano de un rayo.
+//  - SphereCast: primer contacto de una esfera que avanza en linea recta
+//    (brazo de la camara).
+//  - MoveCapsule: mueve la capsula del personaje y la desliza sobre lo que
+//    toca. Avanza en subpasos de medio radio para no atravesar paredes finas y
+//    en cada subpaso empuja la capsula fuera de los triangulos que la cortan.
+//
+// El archivo <modelo>.collision (opcional) lista las texturas de las submallas
+// que no chocan, p. ej. las puertas.
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define COLLISION_SIMD 1
+#else
+#define COLLISION_SIMD 0
+#endif
+
+#include <glm/glm.hpp>
+
+#include "LightmapUnwrap.h"
+#include "MeshCache.h"
+#include "TriangleBVH.h"
+
+const float COLLISION_SKIN = 0.005f;       // separacion que queda despues de empujar
+const int COLLISION_ITERATIONS = 4;        // pasadas de empuje por subpaso
+const int COLLISION_MAX_SUBSTEPS = 64;
+const float COLLISION_MIN_PLANAR = 0.2f;   // al caminar se ignoran los empujes casi verticales...
+const float COLLISION_FLOOR_NORMAL = 0.7f; // ...y los triangulos con |normal.y| mayor (piso, techo)
+
+// Capsula vertical: los centros de sus dos esferas estan a "bottom" y "top"
+// unidades sobre la posicion
+struct CollisionCapsule
+{
+    float radius = 0.3f;
+    float bottom = -0.3f;
+    float top = 0.6f;
+};
+
+struct CollisionHit
+{
+    float distance = FLT_MAX;
+    glm::vec3 position = glm::vec3(0.0f);  // punto de contacto sobre el triangulo
+    glm::vec3 normal = glm::vec3(0.0f);    // apunta hacia el lado de la consulta
+    uint32_t triangle = UINT32_MAX;        // indice dentro de los triangulos del mundo
+};
+
+// Cuatro triangulos en columnas; los lugares vacios tienen aristas nulas
+// (ningun rayo los cruza) y quedan fuera de "lanes"
+struct CollisionPacket
+{
+    float v0[3][4];
+    float edge1[3][4];
+    float edge2[3][4];
+    float boundsMin[3][4];
+    float boundsMax[3][4];
+    float normal[3][4];      // unitaria (nula si el triangulo es degenerado)
+    float plane[4];          // dot(normal, v0)
+    uint32_t triangle[4];
+    int lanes;  // bits de los lugares ocupados
+};
+
+namespace CollisionDetail
+{
+    // Punto del triangulo mas cercano a p (regiones de Voronoi)
+    inline glm::vec3 closestOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+    {
+        glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+        float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+        if (d1 <= 0.0f && d2 <= 0.0f) {
+            return a;
+        }
+        glm::vec3 bp = p - b;
+        float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+        if (d3 >= 0.0f && d4 <= d3) {
+            return b;
+        }
+        float vc = d1 * d4 - d3 * d2;
+        if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+            return a + ab * (d1 / (d1 - d3));
+        }
+        glm::vec3 cp = p - c;
+        float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+        if (d6 >= 0.0f && d5 <= d6) {
+            return c;
+        }
+        float vb = d5 * d2 - d1 * d6;
+        if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+            return a + ac * (d2 / (d2 - d6));
+        }
+        float va = d3 * d6 - d5 * d4;
+        if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+            return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+        }
+        float denominator = 1.0f / (va + vb + vc);
+        return a + ab * (vb * denominator) + ac * (vc * denominator);
+    }
+
+    // Puntos mas cercanos entre los segmentos p1q1 y p2q2
+    inline void closestSegmentSegment(const glm::vec3& p1, const glm::vec3& q1, const glm::vec3& p2, const glm::vec3& q2,
+                                      glm::vec3& c1, glm::vec3& c2)
+    {
+        glm::vec3 d1 = q1 - p1, d2 = q2 - p2, r = p1 - p2;
+        float a = glm::dot(d1, d1), e = glm::dot(d2, d2), f = glm::dot(d2, r);
+        float s = 0.0f, t = 0.0f;
+        if (a <= 1e-12f && e <= 1e-12f) {
+            c1 = p1;
+            c2 = p2;
+            return;
+        }
+        if (a <= 1e-12f) {
+            t = glm::clamp(f / e, 0.0f, 1.0f);
+        }
+        else {
+            float c = glm::dot(d1, r);
+            if (e <= 1e-12f) {
+                s = glm::clamp(-c / a, 0.0f, 1.0f);
+            }
+            else {
+                float b = glm::dot(d1, d2);
+                float denominator = a * e - b * b;
+                s = denominator > 1e-12f ? glm::clamp((b * f - c * e) / denominator, 0.0f, 1.0f) : 0.0f;
+                t = (b * s + f) / e;
+                if (t < 0.0f) {
+                    t = 0.0f;
+                    s = glm::clamp(-c / a, 0.0f, 1.0f);
+                }
+                else if (t > 1.0f) {
+                    t = 1.0f;
+                    s = glm::clamp((b - c) / a, 0.0f, 1.0f);
+                }
+            }
+        }
+        c1 = p1 + d1 * s;
+        c2 = p2 + d2 * t;
+    }
+
+    // Rayo (direccion unitaria) contra esfera; 0 si ya empieza adentro
+    inline bool raySphere(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& center, float radius, float& t)
+    {
+        glm::vec3 m = origin - center;
+        float c = glm::dot(m, m) - radius * radius;
+        if (c <= 0.0f) {
+            t = 0.0f;
+            return true;
+        }
+        float b = glm::dot(m, direction);
+        float discriminant = b * b - c;
+        if (b > 0.0f || discriminant < 0.0f) {
+            return false;
+        }
+        t = -b - std::sqrt(discriminant);
+        return true;
+    }
+
+    // Rayo contra el cilindro de radio "radius" alrededor del segmento pq, sin
+    // las tapas (las cubren las esferas de los vertices)
+    inline bool rayCylinder(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& p, const glm::vec3& q, float radius,
+                            float& t)
+    {
+        glm::vec3 d = q - p, m = origin - p;
+        float dd = glm::dot(d, d), md = glm::dot(m, d), nd = glm::dot(direction, d);
+        float a = dd - nd * nd;
+        float k = glm::dot(m, m) - radius * radius;
+        float c = dd * k - md * md;
+        if (std::abs(a) < 1e-12f * dd) {
+            return false;  // paralelo al eje
+        }
+        float b = dd * glm::dot(m, direction) - nd * md;
+        float discriminant = b * b - a * c;
+        if (discriminant < 0.0f) {
+            return false;
+        }
+        float hit = (-b - std::sqrt(discriminant)) / a;
+        if (hit < 0.0f) {
+            if (c > 0.0f) {
+                return false;
+            }
+            hit = 0.0f;  // ya estaba dentro del cilindro
+        }
+        float s = md + hit * nd;
+        if (s < 0.0f || s > dd) {
+            return false;
+        }
+        t = hit;
+        return true;
+    }
+
+    // Primer contacto en [0, tMax) de una esfera que avanza desde "origin". Si
+    // ya empieza tocando el triangulo solo cuenta cuando se acerca a el (la
+    // camara que parte rozando el piso no se queda trabada)
+    inline bool sweepSphereTriangle(const glm::vec3& origin, const glm::vec3& direction, float radius, const glm::vec3& a,
+                                    const glm::vec3& b, const glm::vec3& c, float tMax, float& t)
+    {
+        glm::vec3 nearest = closestOnTriangle(origin, a, b, c);
+        if (glm::dot(origin - nearest, origin - nearest) < radius * radius) {
+            if (glm::dot(direction, origin - nearest) >= 0.0f) {
+                return false;
+            }
+            t = 0.0f;
+            return true;
+        }
+
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+        if (length < 1e-12f) {
+            return false;
+        }
+        normal /= length;
+        float distance = glm::dot(origin - a, normal);
+        if (distance < 0.0f) {
+            normal = -normal;
+            distance = -distance;
+        }
+
+        // Cara: el punto de la esfera que toca primero el plano cae dentro del triangulo
+        float approach = -glm::dot(direction, normal);
+        float planeT = distance > radius && approach > 0.0f ? (distance - radius) / approach : FLT_MAX;
+        if (planeT < tMax) {
+            glm::vec3 contact = origin + direction * planeT - normal * radius;
+            if (glm::distance(closestOnTriangle(contact, a, b, c), contact) < 1e-5f * (1.0f + radius)) {
+                t = planeT;
+                return true;
+            }
+        }
+
+        // Aristas y vertices
+        float best = tMax, hit;
+        const glm::vec3* vertices[3] = { &a, &b, &c };
+        for (int i = 0; i < 3; i++) {
+            if (rayCylinder(origin, direction, *vertices[i], *vertices[(i + 1) % 3], radius, hit) && hit < best) {
+                best = hit;
+            }
+            if (raySphere(origin, direction, *vertices[i], radius, hit) && hit < best) {
+                best = hit;
+            }
+        }
+        if (best < tMax) {
+            t = best;
+            return true;
+        }
+        return false;
+    }
+}
+
+class CollisionWorld
+{
+public:
+    bool simd = COLLISION_SIMD != 0;  // el benchmark la apaga para comparar
+
+    // Triangulos de a tres vertices, ya en coordenadas del mundo
+    void SetTriangles(std::vector<glm::vec3> vertices)
+    {
+        this->vertices = std::move(vertices);
+        size_t triangleCount = this->vertices.size() / 3;
+        std::vector<uint32_t> indices(triangleCount * 3);
+        for (size_t i = 0; i < indices.size(); i++) {
+            indices[i] = uint32_t(i);
+        }
+        this->bvh.Build(this->vertices.data(), indices.data(), triangleCount);
+        this->buildPackets();
+    }
+
+    // Triangulos del nivel 0 de "objPath" (del cache que ya escribio
+    // CachedModel) menos los de las texturas "passable" de "configPath"
+    bool Load(const std::string& objPath, const std::string& configPath)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::string> passable;
+        std::ifstream file(configPath);
+        std::string line;
+        while (file && std::getline(file, line)) {
+            std::istringstream tokens(line);
+            std::string keyword;
+            if (!(tokens >> keyword) || keyword[0] == '#') {
+                continue;
+            }
+            if (keyword == "passable") {
+                std::string texture;
+                while (tokens >> texture) {
+                    passable.push_back(texture);
+                }
+            }
+            else {
+                std::cout << "ERROR::COLLISION:: unknown keyword '" << keyword << "' in " << configPath << std::endl;
+            }
+        }
+
+        MeshCache cache;
+        if (!cache.Load(objPath)) {
+            std::cout << "ERROR::COLLISION:: could not load " << objPath << std::endl;
+            return false;
+        }
+        const MeshCacheView& view = cache.View();
+        std::vector<glm::vec3> triangles;
+        triangles.reserve(BaseIndexCount(view));
+        size_t skipped = 0;
+        for (uint32_t m = 0; m < view.meshCount; m++) {
+            const CacheMesh& mesh = view.meshes[m];
+            std::string texture = view.materials[mesh.material].diffuse;
+            if (std::find(passable.begin(), passable.end(), texture) != passable.end()) {
+                skipped += mesh.indexCount / 3;
+                continue;
+            }
+            for (uint32_t i = mesh.firstIndex; i < mesh.firstIndex + mesh.indexCount; i++) {
+                triangles.push_back(view.vertices[view.indices[i]].Position);
+            }
+        }
+        cache.Release();
+        this->SetTriangles(std::move(triangles));
+        std::cout << "[Collision] " << objPath << ": " << this->TriangleCount() << " triangles (" << skipped << " passable), "
+                  << this->bvh.NodeCount() << " BVH nodes, " << this->packets.size() << " packets in " << MillisecondsSince(start)
+                  << " ms" << std::endl;
+        return true;
+    }
+
+    bool Empty() const { return this->packets.empty(); }
+    size_t TriangleCount() const { return this->vertices.size() / 3; }
+
+    // Impacto mas cercano en [0, maxDistance); "direction" debe ser unitaria
+    bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, CollisionHit& hit) const
+    {
+        float best = maxDistance;
+        uint32_t triangle = UINT32_MAX;
+        this->traverse(origin, direction, 0.0f, best, [&](const CollisionPacket& packet) {
+            this->rayPacket(packet, origin, direction, best, triangle);
+        });
+        if (triangle == UINT32_MAX) {
+            return false;
+        }
+        const glm::vec3* v = &this->vertices[size_t(triangle) * 3];
+        glm::vec3 normal = glm::normalize(glm::cross(v[1] - v[0], v[2] - v[0]));
+        hit.distance = best;
+        hit.position = origin + direction * best;
+        hit.normal = glm::dot(normal, direction) > 0.0f ? -normal : normal;
+        hit.triangle = triangle;
+        return true;
+    }
+
+    // Primer contacto de una esfera de radio "radius" que avanza desde
+    // "origin"; hit.distance es cuanto puede avanzar su centro
+    bool SphereCast(const glm::vec3& origin, const glm::vec3& direction, float radius, float maxDistance, CollisionHit& hit) const
+    {
+        float best = maxDistance;
+        uint32_t triangle = UINT32_MAX;
+        this->traverse(origin, direction, radius, best, [&](const CollisionPacket& packet) {
+            int candidates = this->slabPacket(packet, origin, direction, radius, best);
+            for (int lane = 0; lane < 4; lane++) {
+                if ((candidates & (1 << lane)) == 0) {
+                    continue;
+                }
+                uint32_t index = packet.triangle[lane];
+                const glm::vec3* v = &this->vertices[size_t(index) * 3];
+                float t;
+                if (CollisionDetail::sweepSphereTriangle(origin, direction, radius, v[0], v[1], v[2], best, t)) {
+                    best = t;
+                    triangle = index;
+                }
+            }
+        });
+        if (triangle == UINT32_MAX) {
+            return false;
+        }
+        const glm::vec3* v = &this->vertices[size_t(triangle) * 3];
+        glm::vec3 center = origin + direction * best;
+        hit.distance = best;
+        hit.position = CollisionDetail::closestOnTriangle(center, v[0], v[1], v[2]);
+        glm::vec3 away = center - hit.position;
+        float length = glm::length(away);
+        hit.normal = length > 1e-6f ? away / length : -direction;
+        hit.triangle = triangle;
+        return true;
+    }
+
+    // Mueve la capsula "motion" desde "position" y devuelve donde termina,
+    // deslizandose por las superficies que toca. Con "planar" solo empuja en
+    // XZ (el personaje no salta ni cae) y no cuentan el piso ni el techo
+    glm::vec3 MoveCapsule(const CollisionCapsule& capsule, glm::vec3 position, const glm::vec3& motion, bool planar = true) const
+    {
+        if (this->Empty()) {
+            return position + motion;
+        }
+        float length = glm::length(motion);
+        int steps = std::min(COLLISION_MAX_SUBSTEPS, std::max(1, int(std::ceil(length / (capsule.radius * 0.5f)))));
+        glm::vec3 step = motion / float(steps);
+        for (int i = 0; i < steps; i++) {
+            position = this->ResolveCapsule(capsule, position + step, planar);
+        }
+        return position;
+    }
+
+    // Empuja la capsula fuera de los triangulos que la cortan
+    glm::vec3 ResolveCapsule(const CollisionCapsule& capsule, glm::vec3 position, bool planar = true) const
+    {
+        for (int iteration = 0; iteration < COLLISION_ITERATIONS; iteration++) {
+            bool moved = false;
+            glm::vec3 reach(capsule.radius + COLLISION_SKIN);
+            glm::vec3 boxMin = position + glm::vec3(0.0f, capsule.bottom, 0.0f) - reach;
+            glm::vec3 boxMax = position + glm::vec3(0.0f, capsule.top, 0.0f) + reach;
+            glm::vec3 p = position + glm::vec3(0.0f, capsule.bottom, 0.0f);
+            glm::vec3 q = position + glm::vec3(0.0f, capsule.top, 0.0f);
+            this->overlap(boxMin, boxMax, [&](const CollisionPacket& packet, int lanes) {
+                lanes &= this->planePacket(packet, p, q, reach.x, planar);
+                for (int lane = 0; lane < 4; lane++) {
+                    if ((lanes & (1 << lane)) != 0) {
+                        moved |= this->pushCapsule(capsule, this->vertices.data() + size_t(packet.triangle[lane]) * 3, planar, position);
+                    }
+                }
+            });
+            if (!moved) {
+                break;
+            }
+        }
+        return position;
+    }
+
+private:
+    TriangleBVH bvh;
+    std::vector<glm::vec3> vertices;        // tres por triangulo, en el orden original
+    std::vector<CollisionPacket> packets;
+    std::vector<uint32_t> firstPacket;      // por nodo hoja del BVH
+
+    void buildPackets()
+    {
+        const std::vector<TriangleBVHNode>& nodes = this->bvh.Nodes();
+        this->packets.clear();
+        this->firstPacket.assign(nodes.size(), 0);
+        for (size_t n = 0; n < nodes.size(); n++) {
+            if (nodes[n].count == 0) {
+                continue;
+            }
+            this->firstPacket[n] = uint32_t(this->packets.size());
+            for (uint32_t first = 0; first < nodes[n].count; first += 4) {
+                CollisionPacket packet;
+                packet.lanes = 0;
+                for (int lane = 0; lane < 4; lane++) {
+                    glm::vec3 a(0.0f), edge1(0.0f), edge2(0.0f), normal(0.0f), boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+                    uint32_t triangle = UINT32_MAX;
+                    if (first + lane < nodes[n].count) {
+                        packet.lanes |= 1 << lane;
+                        triangle = this->bvh.Original(nodes[n].leftOrFirst + first + lane);
+                        const glm::vec3* v = &this->vertices[size_t(triangle) * 3];
+                        a = v[0];
+                        edge1 = v[1] - v[0];
+                        edge2 = v[2] - v[0];
+                        boundsMin = glm::min(v[0], glm::min(v[1], v[2]));
+                        boundsMax = glm::max(v[0], glm::max(v[1], v[2]));
+                        normal = glm::cross(edge1, edge2);
+                        float length = glm::length(normal);
+                        normal = length > 1e-12f ? normal / length : glm::vec3(0.0f);
+                    }
+                    for (int axis = 0; axis < 3; axis++) {
+                        packet.v0[axis][lane] = a[axis];
+                        packet.edge1[axis][lane] = edge1[axis];
+                        packet.edge2[axis][lane] = edge2[axis];
+                        packet.boundsMin[axis][lane] = boundsMin[axis];
+                        packet.boundsMax[axis][lane] = boundsMax[axis];
+                        packet.normal[axis][lane] = normal[axis];
+                    }
+                    packet.plane[lane] = glm::dot(normal, a);
+                    packet.triangle[lane] = triangle;
+                }
+                this->packets.push_back(packet);
+            }
+        }
+    }
+
+    static glm::vec3 safeInverse(const glm::vec3& direction)
+    {
+        return glm::vec3(std::abs(direction.x) > 1e-12f ? 1.0f / direction.x : FLT_MAX,
+                         std::abs(direction.y) > 1e-12f ? 1.0f / direction.y : FLT_MAX,
+                         std::abs(direction.z) > 1e-12f ? 1.0f / direction.z : FLT_MAX);
+    }
+
+    // Entrada a la caja agrandada en "inflate", o FLT_MAX si el rayo no la cruza en [0, tMax)
+    static float slab(const glm::vec3& boundsMin, const glm::vec3& boundsMax, float inflate, const glm::vec3& origin,
+                      const glm::vec3& inverse, float tMax)
+    {
+        glm::vec3 t0 = (boundsMin - glm::vec3(inflate) - origin) * inverse;
+        glm::vec3 t1 = (boundsMax + glm::vec3(inflate) - origin) * inverse;
+        glm::vec3 near = glm::min(t0, t1), far = glm::max(t0, t1);
+        float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+        float exit = std::min(std::min(far.x, far.y), std::min(far.z, tMax));
+        return enter <= exit ? enter : FLT_MAX;
+    }
+
+    // Recorre de adelante hacia atras las hojas cuyas cajas (agrandadas en
+    // "inflate") cruza el rayo; "visit" puede acortar "tMax"
+    template <typename Visit>
+    void traverse(const glm::vec3& origin, const glm::vec3& direction, float inflate, const float& tMax, Visit visit) const
+    {
+        const std::vector<TriangleBVHNode>& nodes = this->bvh.Nodes();
+        if (nodes.empty()) {
+            return;
+        }
+        glm::vec3 inverse = safeInverse(direction);
+        uint32_t stack[TRIANGLE_BVH_STACK];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const TriangleBVHNode& node = nodes[stack[--top]];
+            if (slab(node.boundsMin, node.boundsMax, inflate, origin, inverse, tMax) == FLT_MAX) {
+                continue;
+            }
+            if (node.count > 0) {
+                uint32_t first = this->firstPacket[&node - nodes.data()];
+                for (uint32_t p = first; p < first + (node.count + 3) / 4; p++) {
+                    visit(this->packets[p]);
+                }
+                continue;
+            }
+            uint32_t left = node.leftOrFirst, right = left + 1;
+            float leftDistance = slab(nodes[left].boundsMin, nodes[left].boundsMax, inflate, origin, inverse, tMax);
+            float rightDistance = slab(nodes[right].boundsMin, nodes[right].boundsMax, inflate, origin, inverse, tMax);
+            if (leftDistance > rightDistance) {
+                std::swap(left, right);
+                std::swap(leftDistance, rightDistance);
+            }
+            if (rightDistance != FLT_MAX && top < TRIANGLE_BVH_STACK) {
+                stack[top++] = right;
+            }
+            if (leftDistance != FLT_MAX && top < TRIANGLE_BVH_STACK) {
+                stack[top++] = left;
+            }
+        }
+    }
+
+    // Paquetes de las hojas que tocan la caja, con los bits de los
+    // triangulos cuya propia caja tambien la toca
+    template <typename Visit>
+    void overlap(const glm::vec3& boxMin, const glm::vec3& boxMax, Visit visit) const
+    {
+        const std::vector<TriangleBVHNode>& nodes = this->bvh.Nodes();
+        if (nodes.empty()) {
+            return;
+        }
+        uint32_t stack[TRIANGLE_BVH_STACK];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            uint32_t index = stack[--top];
+            const TriangleBVHNode& node = nodes[index];
+            if (node.boundsMin.x > boxMax.x || node.boundsMin.y > boxMax.y || node.boundsMin.z > boxMax.z || node.boundsMax.x < boxMin.x
+                || node.boundsMax.y < boxMin.y || node.boundsMax.z < boxMin.z) {
+                continue;
+            }
+            if (node.count > 0) {
+                for (uint32_t p = this->firstPacket[index]; p < this->firstPacket[index] + (node.count + 3) / 4; p++) {
+                    int lanes = this->boxPacket(this->packets[p], boxMin, boxMax);
+                    if (lanes != 0) {
+                        visit(this->packets[p], lanes);
+                    }
+                }
+                continue;
+            }
+            if (top + 2 <= TRIANGLE_BVH_STACK) {
+                stack[top++] = node.leftOrFirst + 1;
+                stack[top++] = node.leftOrFirst;
+            }
+        }
+    }
+
+    // Moller-Trumbore con los cuatro triangulos del paquete a la vez
+    void rayPacket(const CollisionPacket& packet, const glm::vec3& origin, const glm::vec3& direction, float& best, uint32_t& triangle) const
+    {
+#if COLLISION_SIMD
+        if (this->simd) {
+            __m128 dx = _mm_set1_ps(direction.x), dy = _mm_set1_ps(direction.y), dz = _mm_set1_ps(direction.z);
+            __m128 e1x = _mm_loadu_ps(packet.edge1[0]), e1y = _mm_loadu_ps(packet.edge1[1]), e1z = _mm_loadu_ps(packet.edge1[2]);
+            __m128 e2x = _mm_loadu_ps(packet.edge2[0]), e2y = _mm_loadu_ps(packet.edge2[1]), e2z = _mm_loadu_ps(packet.edge2[2]);
+            __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+            __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+            __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+            __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+            __m128 absolute = _mm_andnot_ps(_mm_set1_ps(-0.0f), determinant);
+            __m128 valid = _mm_cmpgt_ps(absolute, _mm_set1_ps(1e-12f));
+            __m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), _mm_or_ps(_mm_and_ps(valid, determinant), _mm_andnot_ps(valid, _mm_set1_ps(1.0f))));
+            __m128 sx = _mm_sub_ps(_mm_set1_ps(origin.x), _mm_loadu_ps(packet.v0[0]));
+            __m128 sy = _mm_sub_ps(_mm_set1_ps(origin.y), _mm_loadu_ps(packet.v0[1]));
+            __m128 sz = _mm_sub_ps(_mm_set1_ps(origin.z), _mm_loadu_ps(packet.v0[2]));
+            __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverse);
+            __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+            __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+            __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+            __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverse);
+            __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverse);
+            __m128 zero = _mm_setzero_ps();
+            valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)));
+            valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+            valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmplt_ps(t, _mm_set1_ps(best))));
+            int mask = _mm_movemask_ps(valid);
+            if (mask != 0) {
+                float distances[4];
+                _mm_storeu_ps(distances, t);
+                for (int lane = 0; lane < 4; lane++) {
+                    if ((mask & (1 << lane)) != 0 && distances[lane] < best) {
+                        best = distances[lane];
+                        triangle = packet.triangle[lane];
+                    }
+                }
+            }
+            return;
+        }
+#endif
+        for (int lane = 0; lane < 4; lane++) {
+            glm::vec3 edge1(packet.edge1[0][lane], packet.edge1[1][lane], packet.edge1[2][lane]);
+            glm::vec3 edge2(packet.edge2[0][lane], packet.edge2[1][lane], packet.edge2[2][lane]);
+            glm::vec3 p = glm::cross(direction, edge2);
+            float determinant = glm::dot(edge1, p);
+            if (std::abs(determinant) <= 1e-12f) {
+                continue;
+            }
+            float inverse = 1.0f / determinant;
+            glm::vec3 s = origin - glm::vec3(packet.v0[0][lane], packet.v0[1][lane], packet.v0[2][lane]);
+            float u = glm::dot(s, p) * inverse;
+            glm::vec3 q = glm::cross(s, edge1);
+            float v = glm::dot(direction, q) * inverse;
+            float t = glm::dot(edge2, q) * inverse;
+            if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t >= 0.0f && t < best) {
+                best = t;
+                triangle = packet.triangle[lane];
+            }
+        }
+    }
+
+    // Bits de los triangulos cuya caja (agrandada en "inflate") cruza el rayo en [0, tMax)
+    int slabPacket(const CollisionPacket& packet, const glm::vec3& origin, const glm::vec3& direction, float inflate, float tMax) const
+    {
+        glm::vec3 inverse = safeInverse(direction);
+#if COLLISION_SIMD
+        if (this->simd) {
+            __m128 enter = _mm_setzero_ps(), exit = _mm_set1_ps(tMax), grow = _mm_set1_ps(inflate);
+            for (int axis = 0; axis < 3; axis++) {
+                __m128 o = _mm_set1_ps(origin[axis]), inv = _mm_set1_ps(inverse[axis]);
+                __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(packet.boundsMin[axis]), grow), o), inv);
+                __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_loadu_ps(packet.boundsMax[axis]), grow), o), inv);
+                enter = _mm_max_ps(enter, _mm_min_ps(t0, t1));
+                exit = _mm_min_ps(exit, _mm_max_ps(t0, t1));
+            }
+            return _mm_movemask_ps(_mm_cmple_ps(enter, exit)) & packet.lanes;
+        }
+#endif
+        int mask = 0;
+        for (int lane = 0; lane < 4; lane++) {
+            glm::vec3 boundsMin(packet.boundsMin[0][lane], packet.boundsMin[1][lane], packet.boundsMin[2][lane]);
+            glm::vec3 boundsMax(packet.boundsMax[0][lane], packet.boundsMax[1][lane], packet.boundsMax[2][lane]);
+            if (slab(boundsMin, boundsMax, inflate, origin, inverse, tMax) != FLT_MAX) {
+                mask |= 1 << lane;
+            }
+        }
+        return mask & packet.lanes;
+    }
+
+    // Bits de los triangulos cuya caja toca [boxMin, boxMax]
+    int boxPacket(const CollisionPacket& packet, const glm::vec3& boxMin, const glm::vec3& boxMax) const
+    {
+#if COLLISION_SIMD
+        if (this->simd) {
+            __m128 inside = _mm_cmple_ps(_mm_loadu_ps(packet.boundsMin[0]), _mm_set1_ps(boxMax[0]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_loadu_ps(packet.boundsMax[0]), _mm_set1_ps(boxMin[0])));
+            for (int axis = 1; axis < 3; axis++) {
+                inside = _mm_and_ps(inside, _mm_cmple_ps(_mm_loadu_ps(packet.boundsMin[axis]), _mm_set1_ps(boxMax[axis])));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_loadu_ps(packet.boundsMax[axis]), _mm_set1_ps(boxMin[axis])));
+            }
+            return _mm_movemask_ps(inside) & packet.lanes;
+        }
+#endif
+        int mask = 0;
+        for (int lane = 0; lane < 4; lane++) {
+            bool inside = true;
+            for (int axis = 0; axis < 3; axis++) {
+                inside = inside && packet.boundsMin[axis][lane] <= boxMax[axis] && packet.boundsMax[axis][lane] >= boxMin[axis];
+            }
+            mask |= inside ? 1 << lane : 0;
+        }
+        return mask & packet.lanes;
+    }
+
+    // Bits de los triangulos cuyo plano pasa a menos de "reach" del segmento
+    // pq (si los dos extremos quedan lejos y del mismo lado, no hay contacto).
+    // Con "planar" tambien se descartan el piso y el techo: las aristas de los
+    // triangulos del piso que corta la capsula la empujarian hacia los costados
+    int planePacket(const CollisionPacket& packet, const glm::vec3& p, const glm::vec3& q, float reach, bool planar) const
+    {
+#if COLLISION_SIMD
+        if (this->simd) {
+            __m128 nx = _mm_loadu_ps(packet.normal[0]), ny = _mm_loadu_ps(packet.normal[1]), nz = _mm_loadu_ps(packet.normal[2]);
+            __m128 plane = _mm_loadu_ps(packet.plane);
+            __m128 dp = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_set1_ps(p.x)), _mm_mul_ps(ny, _mm_set1_ps(p.y))),
+                                              _mm_mul_ps(nz, _mm_set1_ps(p.z))), plane);
+            __m128 dq = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_set1_ps(q.x)), _mm_mul_ps(ny, _mm_set1_ps(q.y))),
+                                              _mm_mul_ps(nz, _mm_set1_ps(q.z))), plane);
+            __m128 limit = _mm_set1_ps(reach);
+            __m128 above = _mm_cmpgt_ps(_mm_min_ps(dp, dq), limit);
+            __m128 below = _mm_cmplt_ps(_mm_max_ps(dp, dq), _mm_sub_ps(_mm_setzero_ps(), limit));
+            __m128 rejected = _mm_or_ps(above, below);
+            if (planar) {
+                __m128 slope = _mm_andnot_ps(_mm_set1_ps(-0.0f), ny);
+                rejected = _mm_or_ps(rejected, _mm_cmpgt_ps(slope, _mm_set1_ps(COLLISION_FLOOR_NORMAL)));
+            }
+            return ~_mm_movemask_ps(rejected) & packet.lanes;
+        }
+#endif
+        int mask = 0;
+        for (int lane = 0; lane < 4; lane++) {
+            glm::vec3 normal(packet.normal[0][lane], packet.normal[1][lane], packet.normal[2][lane]);
+            float dp = glm::dot(normal, p) - packet.plane[lane];
+            float dq = glm::dot(normal, q) - packet.plane[lane];
+            bool floor = planar && std::abs(normal.y) > COLLISION_FLOOR_NORMAL;
+            if (!(std::min(dp, dq) > reach || std::max(dp, dq) < -reach || floor)) {
+                mask |= 1 << lane;
+            }
+        }
+        return mask & packet.lanes;
+    }
+
+    // Separa la capsula de un triangulo; true si la tuvo que mover
+    bool pushCapsule(const CollisionCapsule& capsule, const glm::vec3* v, bool planar, glm::vec3& position) const
+    {
+        using namespace CollisionDetail;
+        glm::vec3 p = position + glm::vec3(0.0f, capsule.bottom, 0.0f);
+        glm::vec3 q = position + glm::vec3(0.0f, capsule.top, 0.0f);
+        glm::vec3 normal = glm::cross(v[1] - v[0], v[2] - v[0]);
+        float normalLength = glm::length(normal);
+        if (normalLength < 1e-12f) {
+            return false;
+        }
+        normal /= normalLength;
+
+        // Par de puntos mas cercanos entre el eje de la capsula y el triangulo:
+        // los extremos contra la cara o un punto del eje contra una arista
+        glm::vec3 onAxis = p, onTriangle = closestOnTriangle(p, v[0], v[1], v[2]);
+        float distance2 = glm::dot(onAxis - onTriangle, onAxis - onTriangle);
+        glm::vec3 candidate = closestOnTriangle(q, v[0], v[1], v[2]);
+        if (glm::dot(q - candidate, q - candidate) < distance2) {
+            onAxis = q;
+            onTriangle = candidate;
+            distance2 = glm::dot(q - candidate, q - candidate);
+        }
+        for (int i = 0; i < 3; i++) {
+            glm::vec3 axisPoint, edgePoint;
+            closestSegmentSegment(p, q, v[i], v[(i + 1) % 3], axisPoint, edgePoint);
+            float edgeDistance2 = glm::dot(axisPoint - edgePoint, axisPoint - edgePoint);
+            if (edgeDistance2 < distance2) {
+                onAxis = axisPoint;
+                onTriangle = edgePoint;
+                distance2 = edgeDistance2;
+            }
+        }
+
+        // Toca si entra en el radio; se empuja hasta el radio mas COLLISION_SKIN
+        // para que la pasada siguiente ya no lo cuente
+        if (distance2 >= capsule.radius * capsule.radius) {
+            return false;
+        }
+        float reach = capsule.radius + COLLISION_SKIN;
+        // Si el eje atraviesa la cara se empuja hacia el lado donde esta el centro
+        float distance = std::sqrt(distance2);
+        glm::vec3 direction;
+        if (distance > 1e-5f) {
+            direction = (onAxis - onTriangle) / distance;
+        }
+        else {
+            direction = glm::dot((p + q) * 0.5f - v[0], normal) >= 0.0f ? normal : -normal;
+        }
+        float depth = reach - distance;
+        if (planar) {
+            glm::vec3 flat(direction.x, 0.0f, direction.z);
+            float flatLength = glm::length(flat);
+            if (flatLength < COLLISION_MIN_PLANAR) {
+                return false;
+            }
+            flat /= flatLength;
+            // Avanzar "x" en XZ separa x * cos(angulo) en la direccion del empuje
+            position += flat * std::min(depth / flatLength, capsule.radius);
+        }
+        else {
+            position += direction * depth;
+        }
+        return true;
+    }
+};
+
+// --benchmark-collision: casa de prueba (paredes subdivididas y muebles) y
+// miles de consultas de cada tipo, con y sin SSE. Las capsulas caminan como el
+// personaje: cada paso sigue desde donde termino el anterior
+inline int BenchmarkCollision()
+{
+    std::vector<glm::vec3> triangles;
+    auto addQuad = [&triangles](glm::vec3 origin, glm::vec3 u, glm::vec3 v, int subdivisions) {
+        for (int i = 0; i < subdivisions; i++) {
+            for (int j = 0; j < subdivisions; j++) {
+                glm::vec3 a = origin + u * (float(i) / subdivisions) + v * (float(j) / subdivisions);
+                glm::vec3 b = a + u / float(subdivisions);
+                glm::vec3 c = b + v / float(subdivisions);
+                glm::vec3 d = a + v / float(subdivisions);
+                triangles.insert(triangles.end(), { a, b, c, a, c, d });
+            }
+        }
+    };
+    auto addBox = [&addQuad](glm::vec3 boxMin, glm::vec3 boxMax, int subdivisions) {
+        glm::vec3 size = boxMax - boxMin;
+        glm::vec3 x(size.x, 0, 0), y(0, size.y, 0), z(0, 0, size.z);
+        addQuad(boxMin, x, y, subdivisions);
+        addQuad(boxMin + z, x, y, subdivisions);
+        addQuad(boxMin, z, y, subdivisions);
+        addQuad(boxMin + x, z, y, subdivisions);
+        addQuad(boxMin + y, x, z, subdivisions);
+    };
+    const int subdivisions = 24;
+    addQuad(glm::vec3(-10, 0, 10), glm::vec3(20, 0, 0), glm::vec3(0, 6, 0), subdivisions);    // frente
+    addQuad(glm::vec3(-10, 0, -10), glm::vec3(20, 0, 0), glm::vec3(0, 6, 0), subdivisions);   // fondo
+    addQuad(glm::vec3(-10, 0, -10), glm::vec3(0, 0, 20), glm::vec3(0, 6, 0), subdivisions);   // izquierda
+    addQuad(glm::vec3(10, 0, -10), glm::vec3(0, 0, 20), glm::vec3(0, 6, 0), subdivisions);    // derecha
+    addQuad(glm::vec3(-10, 6, -10), glm::vec3(20, 0, 0), glm::vec3(0, 0, 20), subdivisions);  // techo
+    addQuad(glm::vec3(-10, 0, -10), glm::vec3(20, 0, 0), glm::vec3(0, 0, 20), subdivisions);  // piso
+    std::mt19937 random(9);
+    std::uniform_real_distribution<float> inside(-9.0f, 9.0f), size(0.3f, 1.5f);
+    for (int i = 0; i < 60; i++) {
+        glm::vec3 corner(inside(random), 0.0f, inside(random));
+        addBox(corner, corner + glm::vec3(size(random), size(random), size(random)), 8);
+    }
+
+    CollisionWorld world;
+    auto buildStart = std::chrono::steady_clock::now();
+    world.SetTriangles(triangles);
+    double buildMilliseconds = MillisecondsSince(buildStart);
+
+    const int queries = 20000;
+    std::vector<glm::vec3> origins(queries), directions(queries);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f), height(0.3f, 5.5f);
+    for (int i = 0; i < queries; i++) {
+        origins[i] = glm::vec3(inside(random), height(random), inside(random));
+        glm::vec3 direction(unit(random), unit(random) * 0.5f, unit(random));
+        directions[i] = glm::length(direction) > 1e-3f ? glm::normalize(direction) : glm::vec3(1, 0, 0);
+    }
+
+    std::cout << "[Collision] " << world.TriangleCount() << " triangles, BVH built in " << buildMilliseconds << " ms, " << queries
+              << " queries per test, SIMD " << (COLLISION_SIMD ? "SSE" : "off") << std::endl;
+    std::cout << "mode     raycast q/ms  spherecast q/ms  capsule-move q/ms  hits" << std::endl;
+    CollisionCapsule capsule;
+    const int walkers = 200;
+    std::vector<glm::vec3> start(walkers);
+    for (int i = 0; i < walkers; i++) {
+        start[i] = world.ResolveCapsule(capsule, glm::vec3(origins[i].x, 0.8f, origins[i].z));
+    }
+    volatile float sink = 0.0f;  // que el compilador no descarte las consultas
+    for (int mode = 0; mode < 2; mode++) {
+        world.simd = mode > 0 && COLLISION_SIMD;
+        double rates[3];
+        int hits = 0;
+        for (int test = 0; test < 3; test++) {
+            std::vector<glm::vec3> positions = start;
+            auto begin = std::chrono::steady_clock::now();
+            float checksum = 0.0f;
+            for (int i = 0; i < queries; i++) {
+                CollisionHit hit;
+                if (test == 0 && world.Raycast(origins[i], directions[i], 30.0f, hit)) {
+                    checksum += hit.distance;
+                    hits++;
+                }
+                else if (test == 1 && world.SphereCast(origins[i], directions[i], 0.2f, 6.0f, hit)) {
+                    checksum += hit.distance;
+                }
+                else if (test == 2) {
+                    glm::vec3 flat(directions[i].x, 0.0f, directions[i].z);
+                    glm::vec3& position = positions[i % walkers];
+                    position = world.MoveCapsule(capsule, position, flat * (0.17f / std::max(glm::length(flat), 1e-3f)));
+                    checksum += position.x;
+                }
+            }
+            double milliseconds = MillisecondsSince(begin);
+            rates[test] = queries / std::max(milliseconds, 1e-6);
+            sink = sink + checksum;
+        }
+        std::cout << (world.simd ? "sse   " : "scalar") << "   " << rates[0] << "        " << rates[1] << "           " << rates[2]
+                  << "             " << hits << std::endl;
+    }
+    return 0;
+}
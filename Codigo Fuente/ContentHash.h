@@ -0,0 +1,82 @@
+#pragma once
+
+// Hash de contenido de 64 bits para identificar archivos por sus bytes
+// (caches de mallas, texturas y shaders). No es criptografico: solo sirve
+// para detectar cambios en los archivos fuente.
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+const uint64_t CONTENT_HASH_SEED = 0xcbf29ce484222325ULL;
+
+// Mezcla final (splitmix64) para repartir bien los bits
+inline uint64_t HashMix(uint64_t h)
+{
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+// Procesa 8 bytes por paso para que hashear el OBJ de 8 MB cueste pocos ms
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t seed = CONTENT_HASH_SEED)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t h = seed ^ (size * 0x9e3779b97f4a7c15ULL);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+        h = (h ^ HashMix(word)) * 0x100000001b3ULL;
+    }
+    uint64_t tail = 0;
+    for (size_t shift = 0; i < size; i++, shift += 8) {
+        tail |= uint64_t(bytes[i]) << shift;
+    }
+    h = (h ^ HashMix(tail)) * 0x100000001b3ULL;
+    return HashMix(h);
+}
+
+inline uint64_t HashString(const std::string& text, uint64_t seed = CONTENT_HASH_SEED)
+{
+    return HashBytes(text.data(), text.size(), seed);
+}
+
+// Lee un archivo completo en memoria; devuelve false si no existe
+inline bool ReadFileBytes(const std::string& path, std::vector<unsigned char>& out)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return false;
+    }
+    std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    out.resize(size_t(size));
+    return size == 0 || bool(file.read(reinterpret_cast<char*>(out.data()), size));
+}
+
+// Hash del contenido de un archivo (0 si no se pudo leer)
+inline uint64_t HashFile(const std::string& path, uint64_t seed = CONTENT_HASH_SEED)
+{
+    std::vector<unsigned char> bytes;
+    if (!ReadFileBytes(path, bytes)) {
+        return 0;
+    }
+    return HashBytes(bytes.data(), bytes.size(), seed);
+}
+
+inline std::string HashToHex(uint64_t h)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string out(16, '0');
+    for (int i = 15; i >= 0; i--) {
+        out[i] = digits[h & 0xf];
+        h >>= 4;
+    }
+    return out;
+}
@@ -0,0 +1,241 @@
+#pragma once
+
+// Modo --benchmark: recorridos de camara repetibles y resultados en JSON.
+// Un CameraPath son posiciones del personaje, offset de la camara y estado de
+// la luz en el tiempo; se graba jugando (--record-path) o se usa el recorrido
+// por defecto alrededor de la casa. El benchmark dibuja N fotogramas
+// repartidos en todo el recorrido y junta tiempos y contadores por fotograma.
+//
+// Formato del archivo de recorrido, una linea por punto ('#' comenta):
+//   tiempo  jugador.x jugador.y jugador.z  offset.x offset.y offset.z  luz(0/1)
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+const int BENCHMARK_DEFAULT_FRAMES = 600;
+const int BENCHMARK_WARMUP_FRAMES = 10;     // se dibujan pero no se miden
+const float CAMERA_PATH_RECORD_INTERVAL = 0.1f;
+
+struct CameraKey
+{
+    float time;
+    glm::vec3 playerPosition;
+    glm::vec3 cameraOffset;
+    bool lightActive;
+};
+
+class CameraPath
+{
+public:
+    bool Load(const std::string& path)
+    {
+        std::ifstream file(path);
+        if (!file) {
+            std::cout << "ERROR::CAMERA_PATH::FILE_NOT_FOUND: " << path << std::endl;
+            return false;
+        }
+        this->keys.clear();
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            std::istringstream stream(line);
+            CameraKey key;
+            int light = 0;
+            if (stream >> key.time >> key.playerPosition.x >> key.playerPosition.y >> key.playerPosition.z
+                       >> key.cameraOffset.x >> key.cameraOffset.y >> key.cameraOffset.z >> light) {
+                key.lightActive = light != 0;
+                this->Add(key);
+            }
+        }
+        if (this->keys.empty()) {
+            std::cout << "ERROR::CAMERA_PATH::EMPTY: " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool Save(const std::string& path) const
+    {
+        std::ofstream file(path);
+        if (!file) {
+            std::cout << "ERROR::CAMERA_PATH::CANNOT_WRITE: " << path << std::endl;
+            return false;
+        }
+        file << "# tiempo  jugador.xyz  offset.xyz  luz\n" << std::setprecision(6);
+        for (const CameraKey& key : this->keys) {
+            file << key.time << " " << key.playerPosition.x << " " << key.playerPosition.y << " " << key.playerPosition.z << " "
+                 << key.cameraOffset.x << " " << key.cameraOffset.y << " " << key.cameraOffset.z << " " << (key.lightActive ? 1 : 0) << "\n";
+        }
+        std::cout << "[CameraPath] Wrote " << this->keys.size() << " keys (" << this->Duration() << " s) to " << path << std::endl;
+        return true;
+    }
+
+    // Los tiempos deben crecer; los puntos fuera de orden se ignoran
+    void Add(const CameraKey& key)
+    {
+        if (this->keys.empty() || key.time > this->keys.back().time) {
+            this->keys.push_back(key);
+        }
+    }
+
+    bool Empty() const { return this->keys.empty(); }
+    size_t Size() const { return this->keys.size(); }
+    float Duration() const { return this->keys.empty() ? 0.0f : this->keys.back().time - this->keys.front().time; }
+    float LastTime() const { return this->keys.empty() ? 0.0f : this->keys.back().time; }
+
+    // Interpola posiciones; la luz toma el valor del punto anterior
+    CameraKey Sample(float time) const
+    {
+        if (time <= this->keys.front().time) {
+            return this->keys.front();
+        }
+        if (time >= this->keys.back().time) {
+            return this->keys.back();
+        }
+        auto next = std::upper_bound(this->keys.begin(), this->keys.end(), time,
+                                     [](float t, const CameraKey& key) { return t < key.time; });
+        const CameraKey& b = *next;
+        const CameraKey& a = *(next - 1);
+        float alpha = (time - a.time) / (b.time - a.time);
+        CameraKey key = a;
+        key.time = time;
+        key.playerPosition = glm::mix(a.playerPosition, b.playerPosition, alpha);
+        key.cameraOffset = glm::mix(a.cameraOffset, b.cameraOffset, alpha);
+        return key;
+    }
+
+    // Recorrido por defecto: una vuelta alrededor de "center" con la camara
+    // detras del personaje mirando hacia la casa, y luego camina hasta el
+    // centro. La luz se prende en el segundo tercio
+    static CameraPath Orbit(const glm::vec3& center, float radius, float height, float duration)
+    {
+        CameraPath path;
+        const int orbitKeys = 48;
+        float orbitTime = duration * 0.75f;
+        for (int i = 0; i <= orbitKeys; i++) {
+            float t = float(i) / orbitKeys;
+            float angle = glm::radians(360.0f) * t;
+            glm::vec3 outward(std::cos(angle), 0.0f, std::sin(angle));
+            CameraKey key;
+            key.time = orbitTime * t;
+            key.playerPosition = glm::vec3(center.x, height, center.z) + outward * radius;
+            key.cameraOffset = outward * 8.0f + glm::vec3(0.0f, 4.0f, 0.0f);
+            key.lightActive = t >= 1.0f / 3.0f && t < 2.0f / 3.0f;
+            path.Add(key);
+        }
+        CameraKey inside = path.keys.back();
+        inside.time = duration;
+        inside.playerPosition = glm::vec3(center.x, height, center.z);
+        inside.lightActive = true;
+        path.Add(inside);
+        return path;
+    }
+
+private:
+    std::vector<CameraKey> keys;
+};
+
+// Tiempos y contadores de cada fotograma medido
+class BenchmarkResults
+{
+public:
+    void AddFrame(double milliseconds, unsigned int glCalls, unsigned int draws, unsigned long long triangles)
+    {
+        this->frameMs.push_back(milliseconds);
+        this->glCalls.push_back(double(glCalls));
+        this->draws.push_back(double(draws));
+        this->triangles.push_back(double(triangles));
+    }
+
+    size_t Frames() const { return this->frameMs.size(); }
+
+    // Tiempos de otra pasada del recorrido (p. ej. con una permutacion fija)
+    void AddVariant(const std::string& name, const BenchmarkResults& run)
+    {
+        this->variantNames.push_back(name);
+        this->variantFrameMs.push_back(run.frameMs);
+    }
+
+    std::string Json(int width, int height, const std::string& pathName, double seconds, uint64_t imageHash) const
+    {
+        std::ostringstream json;
+        json << std::fixed << std::setprecision(3);
+        json << "{\n"
+             << "  \"frames\": " << this->frameMs.size() << ",\n"
+             << "  \"width\": " << width << ",\n"
+             << "  \"height\": " << height << ",\n"
+             << "  \"path\": \"" << escape(pathName) << "\",\n"
+             << "  \"seconds\": " << seconds << ",\n"
+             << "  \"frameMs\": " << summary(this->frameMs) << ",\n"
+             << "  \"glCalls\": " << summary(this->glCalls) << ",\n"
+             << "  \"draws\": " << summary(this->draws) << ",\n"
+             << "  \"triangles\": " << summary(this->triangles) << ",\n";
+        if (!this->variantNames.empty()) {
+            json << "  \"variants\": [\n";
+            for (size_t i = 0; i < this->variantNames.size(); i++) {
+                json << "    { \"features\": \"" << escape(this->variantNames[i]) << "\", \"frameMs\": " << summary(this->variantFrameMs[i])
+                     << " }" << (i + 1 < this->variantNames.size() ? "," : "") << "\n";
+            }
+            json << "  ],\n";
+        }
+        json << "  \"imageHash\": \"" << std::hex << std::setw(16) << std::setfill('0') << imageHash << "\"\n"
+             << "}\n";
+        return json.str();
+    }
+
+private:
+    static double percentile(std::vector<double>& values, double p)
+    {
+        size_t index = std::min(values.size() - 1, size_t(p * double(values.size() - 1) + 0.5));
+        std::nth_element(values.begin(), values.begin() + index, values.end());
+        return values[index];
+    }
+
+    static std::string escape(const std::string& text)
+    {
+        std::string escaped;
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+
+    static std::string summary(std::vector<double> values)
+    {
+        std::ostringstream json;
+        json << std::fixed << std::setprecision(3);
+        if (values.empty()) {
+            json << "null";
+            return json.str();
+        }
+        double sum = 0.0;
+        for (double value : values) {
+            sum += value;
+        }
+        double maximum = *std::max_element(values.begin(), values.end());
+        json << "{ \"mean\": " << sum / double(values.size()) << ", \"p50\": " << percentile(values, 0.5) << ", \"p95\": "
+             << percentile(values, 0.95) << ", \"p99\": " << percentile(values, 0.99) << ", \"max\": " << maximum << " }";
+        return json.str();
+    }
+
+    std::vector<double> frameMs;
+    std::vector<double> glCalls;
+    std::vector<double> draws;
+    std::vector<double> triangles;
+    std::vector<std::string> variantNames;
+    std::vector<std::vector<double>> variantFrameMs;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+// Contador de llamadas a OpenGL por fotograma. Las llamadas del bucle de
+// render se envuelven con GL_COUNT(...) para poder comparar cuanto trabajo
+// de driver cuesta cada fotograma. Las llamadas de dibujo usan
+// GL_COUNT_DRAW(triangulos, ...) y tambien cuentan dibujos y triangulos
+// enviados (un glMultiDrawElements cuenta como un dibujo).
+
+#include <iostream>
+
+struct GLCallStats
+{
+    unsigned int calls = 0;       // llamadas emitidas en el fotograma actual
+    unsigned int lastFrame = 0;   // total del fotograma anterior
+    unsigned int draws = 0;
+    unsigned long long triangles = 0;
+    unsigned int lastDraws = 0;
+    unsigned long long lastTriangles = 0;
+    unsigned long long accumulated = 0;
+    unsigned long long accumulatedDraws = 0;
+    unsigned long long accumulatedTriangles = 0;
+    unsigned int frames = 0;
+    double lastReport = 0.0;
+
+    // Cierra el fotograma; cada "interval" segundos imprime el promedio
+    void EndFrame(double now, double interval = 2.0)
+    {
+        this->lastFrame = this->calls;
+        this->lastDraws = this->draws;
+        this->lastTriangles = this->triangles;
+        this->accumulated += this->calls;
+        this->accumulatedDraws += this->draws;
+        this->accumulatedTriangles += this->triangles;
+        this->frames++;
+        this->calls = 0;
+        this->draws = 0;
+        this->triangles = 0;
+        if (now - this->lastReport >= interval && this->frames > 0) {
+            std::cout << "[GLStats] " << double(this->accumulated) / this->frames << " GL calls/frame, "
+                      << double(this->accumulatedDraws) / this->frames << " draws/frame, "
+                      << double(this->accumulatedTriangles) / this->frames << " triangles/frame" << std::endl;
+            this->accumulated = 0;
+            this->accumulatedDraws = 0;
+            this->accumulatedTriangles = 0;
+            this->frames = 0;
+            this->lastReport = now;
+        }
+    }
+};
+
+inline GLCallStats& GLStats()
+{
+    static GLCallStats stats;
+    return stats;
+}
+
+#define GL_COUNT(call) (GLStats().calls++, call)
+#define GL_COUNT_DRAW(triangleCount, call) (GLStats().calls++, GLStats().draws++, GLStats().triangles += (triangleCount), call)
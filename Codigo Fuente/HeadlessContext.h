@@ -0,0 +1,163 @@
+#pragma once
+
+// Contexto de OpenGL sin ventana para --benchmark. En Linux usa EGL con la
+// plataforma "surfaceless" de Mesa (funciona con llvmpipe, sin GPU ni
+// servidor grafico); en otros sistemas, o si EGL falla, crea una ventana
+// GLFW oculta. En los dos casos se dibuja en un framebuffer propio del
+// tamano pedido, asi que la resolucion no depende de la pantalla.
+
+#include <iostream>
+#include <vector>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#if defined(__linux__)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+class HeadlessContext
+{
+public:
+    HeadlessContext() = default;
+
+    ~HeadlessContext()
+    {
+        this->Destroy();
+    }
+
+    HeadlessContext(const HeadlessContext&) = delete;
+    HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+    bool Create(int width, int height)
+    {
+        this->width = width;
+        this->height = height;
+        if (!this->createEgl() && !this->createHiddenWindow()) {
+            std::cout << "ERROR::HEADLESS::NO_CONTEXT" << std::endl;
+            return false;
+        }
+
+        glGenFramebuffers(1, &this->framebuffer);
+        glGenRenderbuffers(2, this->renderbuffers);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, this->renderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->renderbuffers[0]);
+        glBindRenderbuffer(GL_RENDERBUFFER, this->renderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, this->renderbuffers[1]);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "ERROR::HEADLESS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+            return false;
+        }
+        glViewport(0, 0, width, height);
+
+        std::cout << "[Headless] " << (this->usingEgl ? "EGL surfaceless" : "hidden GLFW window") << ", " << width << "x" << height
+                  << ", " << glGetString(GL_RENDERER) << std::endl;
+        return true;
+    }
+
+    void Destroy()
+    {
+        if (this->framebuffer != 0) {
+            glDeleteFramebuffers(1, &this->framebuffer);
+            glDeleteRenderbuffers(2, this->renderbuffers);
+            this->framebuffer = 0;
+        }
+#if defined(__linux__)
+        if (this->usingEgl) {
+            eglMakeCurrent(this->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(this->display, this->context);
+            eglTerminate(this->display);
+            this->usingEgl = false;
+        }
+#endif
+        if (this->window != nullptr) {
+            glfwDestroyWindow(this->window);
+            glfwTerminate();
+            this->window = nullptr;
+        }
+    }
+
+    // Pixeles RGBA del framebuffer (fila de abajo primero)
+    std::vector<unsigned char> ReadPixels() const
+    {
+        std::vector<unsigned char> pixels(size_t(this->width) * this->height * 4);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, this->framebuffer);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, this->width, this->height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        return pixels;
+    }
+
+    int Width() const { return this->width; }
+    int Height() const { return this->height; }
+
+private:
+    bool createEgl()
+    {
+#if defined(__linux__)
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay == nullptr) {
+            return false;
+        }
+        this->display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        EGLint major, minor;
+        if (this->display == EGL_NO_DISPLAY || !eglInitialize(this->display, &major, &minor) || !eglBindAPI(EGL_OPENGL_API)) {
+            return false;
+        }
+        const EGLint attributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        this->context = eglCreateContext(this->display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+        if (this->context == EGL_NO_CONTEXT || !eglMakeCurrent(this->display, EGL_NO_SURFACE, EGL_NO_SURFACE, this->context)) {
+            eglTerminate(this->display);
+            return false;
+        }
+        // glewInit busca un display de GLX que aqui no existe; glewContextInit
+        // solo carga las funciones del contexto actual
+        glewExperimental = GL_TRUE;
+        if (glewContextInit() != GLEW_OK) {
+            eglMakeCurrent(this->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(this->display, this->context);
+            eglTerminate(this->display);
+            return false;
+        }
+        this->usingEgl = true;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool createHiddenWindow()
+    {
+        if (!glfwInit()) {
+            return false;
+        }
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        this->window = glfwCreateWindow(this->width, this->height, "Benchmark", nullptr, nullptr);
+        if (this->window == nullptr) {
+            glfwTerminate();
+            return false;
+        }
+        glfwMakeContextCurrent(this->window);
+        glewExperimental = GL_TRUE;
+        return glewInit() == GLEW_OK;
+    }
+
+    int width = 0;
+    int height = 0;
+    GLuint framebuffer = 0;
+    GLuint renderbuffers[2] = { 0, 0 };
+    GLFWwindow* window = nullptr;
+    bool usingEgl = false;
+#if defined(__linux__)
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+#endif
+};
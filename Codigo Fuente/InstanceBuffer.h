@@ -0,0 +1,90 @@
+#pragma once
+
+// Buffer de atributos por instancia para dibujar muchas copias de la misma
+// malla en una sola llamada. Cada instancia usa el mismo layout que el bloque
+// Object (matriz de modelo + matriz normal en tres vec4), y los shaders con
+// INSTANCED lo leen de las locations 3-6 (modelo) y 7-9 (normal).
+
+#include <cstddef>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "LightingState.h"
+#include "GLStats.h"
+#include "TextureCache.h"
+
+const GLuint INSTANCE_MODEL_LOCATION = 3;
+const GLuint INSTANCE_NORMAL_LOCATION = 7;
+
+class InstanceBuffer
+{
+public:
+    InstanceBuffer()
+    {
+        glGenBuffers(1, &this->VBO);
+    }
+
+    ~InstanceBuffer()
+    {
+        if (!TextureCache::Instance().ContextAlive()) {
+            return;
+        }
+        glDeleteBuffers(1, &this->VBO);
+    }
+
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+    // Agrega los atributos por instancia al VAO (que no debe usar las locations 3-9)
+    void Attach(GLuint VAO)
+    {
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+        for (GLuint column = 0; column < 4; column++) {
+            glEnableVertexAttribArray(INSTANCE_MODEL_LOCATION + column);
+            glVertexAttribPointer(INSTANCE_MODEL_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(ObjectBlock),
+                                  (GLvoid*)(offsetof(ObjectBlock, model) + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(INSTANCE_MODEL_LOCATION + column, 1);
+        }
+        for (GLuint column = 0; column < 3; column++) {
+            glEnableVertexAttribArray(INSTANCE_NORMAL_LOCATION + column);
+            glVertexAttribPointer(INSTANCE_NORMAL_LOCATION + column, 3, GL_FLOAT, GL_FALSE, sizeof(ObjectBlock),
+                                  (GLvoid*)(offsetof(ObjectBlock, normalMatrix) + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(INSTANCE_NORMAL_LOCATION + column, 1);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Calcula las matrices normales y sube todas las instancias de una vez;
+    // el almacenamiento se huerfana para no esperar a la GPU
+    void Upload(const glm::mat4* transforms, size_t count)
+    {
+        this->instances.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transforms[i])));
+            this->instances[i].model = transforms[i];
+            for (int k = 0; k < 3; k++) {
+                this->instances[i].normalMatrix[k] = glm::vec4(normalMatrix[k], 0.0f);
+            }
+        }
+        GL_COUNT(glBindBuffer(GL_ARRAY_BUFFER, this->VBO));
+        if (count > this->capacity) {
+            this->capacity = count;
+        }
+        GL_COUNT(glBufferData(GL_ARRAY_BUFFER, this->capacity * sizeof(ObjectBlock), nullptr, GL_STREAM_DRAW));
+        GL_COUNT(glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(ObjectBlock), this->instances.data()));
+        GL_COUNT(glBindBuffer(GL_ARRAY_BUFFER, 0));
+        this->count = count;
+    }
+
+    GLsizei Count() const { return GLsizei(this->count); }
+
+private:
+    GLuint VBO = 0;
+    size_t capacity = 0;
+    size_t count = 0;
+    std::vector<ObjectBlock> instances;
+};
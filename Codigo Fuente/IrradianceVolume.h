@@ -0,0 +1,381 @@
+#pragma once
+
+// Volumen de irradiancia para lo que se mueve (el personaje). Una grilla 3D de
+// sondas sobre la caja de la casa; cada sonda guarda la irradiancia que llega
+// a ese punto como armonicos esfericos de orden 2 (9 coeficientes RGB): el
+// sol si la sonda lo ve, los rebotes difusos de la casa y el ambiente fijo.
+// Se hornea junto con el mapa de luz (--bake-lightmaps), con la misma escena
+// de rayos (LightmapBaker.h), y se guarda en "<modelo>.probes" en half float,
+// en el orden de una textura 3D de ancho X, alto Y y profundidad Z.
+//
+// En tiempo de ejecucion se interpola trilinealmente en la posicion del
+// objeto una vez por fotograma y los 9 coeficientes van como uniform a
+// lighting.vs con IRRADIANCE_PROBES, que evalua el polinomio por vertice.
+// Los coeficientes ya vienen multiplicados por las constantes de la base y
+// por la convolucion con el coseno, asi que el shader solo suma productos.
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "LightmapBaker.h"
+
+// Incrementar cada vez que cambie el formato del archivo
+const uint32_t IRRADIANCE_VOLUME_VERSION = 2;
+const char IRRADIANCE_VOLUME_MAGIC[4] = { 'P', 'R', 'B', 'V' };
+
+const int SH_COEFFICIENTS = 9;
+const float IRRADIANCE_DEFAULT_SPACING = 1.0f;  // unidades del modelo entre sondas
+const int IRRADIANCE_MAX_RESOLUTION = 32;       // sondas por eje como maximo
+const int IRRADIANCE_DEFAULT_SAMPLES = 256;     // rayos por sonda
+// Una sonda que ve caras de atras en mas de esta fraccion de sus rayos esta
+// dentro de una pared; toma el valor de sus vecinas
+const float IRRADIANCE_MAX_BACKFACES = 0.3f;
+
+struct IrradianceVolumeSettings
+{
+    float spacing = IRRADIANCE_DEFAULT_SPACING;
+    int samples = IRRADIANCE_DEFAULT_SAMPLES;
+    int bounces = LIGHTMAP_DEFAULT_BOUNCES;
+    unsigned int threads = 0;  // 0: todos los nucleos
+};
+
+// Irradiancia de un punto lista para el shader (uniform irradianceSH)
+struct ShIrradiance
+{
+    glm::vec3 coefficients[SH_COEFFICIENTS];
+};
+
+struct IrradianceVolumeHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t meshKey;
+    uint32_t resolution[3];
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+namespace IrradianceDetail
+{
+    // Base de orden 2 en el orden de lighting.vs (1, y, z, x, xy, yz,
+    // 3z^2 - 1, xz, x^2 - y^2), sin constantes
+    inline void basis(const glm::vec3& n, float out[SH_COEFFICIENTS])
+    {
+        out[0] = 1.0f;
+        out[1] = n.y;
+        out[2] = n.z;
+        out[3] = n.x;
+        out[4] = n.x * n.y;
+        out[5] = n.y * n.z;
+        out[6] = 3.0f * n.z * n.z - 1.0f;
+        out[7] = n.x * n.z;
+        out[8] = n.x * n.x - n.y * n.y;
+    }
+
+    // Constante de cada funcion de la base (Y_lm = constante * polinomio)
+    const float BASIS_SCALE[SH_COEFFICIENTS] = { 0.282095f, 0.488603f, 0.488603f, 0.488603f, 1.092548f,
+                                                 1.092548f, 0.315392f, 1.092548f, 0.546274f };
+    // Convolucion con el lobulo del coseno por banda: pi, 2pi/3, pi/4
+    const float COSINE_LOBE[SH_COEFFICIENTS] = { 3.141593f, 2.094395f, 2.094395f, 2.094395f, 0.785398f,
+                                                 0.785398f, 0.785398f, 0.785398f, 0.785398f };
+
+    // Direccion uniforme en la esfera
+    inline glm::vec3 sphereSample(float u1, float u2)
+    {
+        float z = 1.0f - 2.0f * u1;
+        float radius = std::sqrt(std::max(0.0f, 1.0f - z * z));
+        float angle = 6.2831853f * u2;
+        return glm::vec3(radius * std::cos(angle), radius * std::sin(angle), z);
+    }
+}
+
+// Irradiancia en la direccion "normal" (la misma cuenta que lighting.vs)
+inline glm::vec3 EvaluateIrradiance(const ShIrradiance& sh, const glm::vec3& normal)
+{
+    float basis[SH_COEFFICIENTS];
+    IrradianceDetail::basis(normal, basis);
+    glm::vec3 result(0.0f);
+    for (int k = 0; k < SH_COEFFICIENTS; k++) {
+        result += sh.coefficients[k] * basis[k];
+    }
+    return glm::max(result, glm::vec3(0.0f));
+}
+
+class IrradianceVolume
+{
+public:
+    // false si no existe, esta incompleto o es de otra version del modelo
+    bool Load(const std::string& path, const MeshCacheView& view)
+    {
+        std::vector<unsigned char> bytes;
+        if (!ReadFileBytes(path, bytes) || bytes.size() < sizeof(IrradianceVolumeHeader)) {
+            return false;
+        }
+        IrradianceVolumeHeader header;
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        size_t probes = size_t(header.resolution[0]) * header.resolution[1] * header.resolution[2];
+        if (std::memcmp(header.magic, IRRADIANCE_VOLUME_MAGIC, sizeof(header.magic)) != 0 || header.version != IRRADIANCE_VOLUME_VERSION
+            || header.meshKey != LightmapKey(view) || bytes.size() != sizeof(header) + probes * SH_COEFFICIENTS * 3 * sizeof(uint16_t)) {
+            std::cout << "WARNING::PROBES:: " << path << " does not match the model, ignoring it" << std::endl;
+            return false;
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            this->resolution[axis] = int(header.resolution[axis]);
+            this->boundsMin[axis] = header.boundsMin[axis];
+            this->boundsMax[axis] = header.boundsMax[axis];
+        }
+        this->texels.resize(probes * SH_COEFFICIENTS * 3);
+        std::memcpy(this->texels.data(), bytes.data() + sizeof(header), this->texels.size() * sizeof(uint16_t));
+        return true;
+    }
+
+    bool Loaded() const { return !this->texels.empty(); }
+
+    // Interpolacion trilineal de las 8 sondas alrededor de "position"
+    // (espacio del modelo); fuera de la caja se usa el borde
+    ShIrradiance Sample(const glm::vec3& position) const
+    {
+        ShIrradiance result = {};
+        if (!this->Loaded()) {
+            return result;
+        }
+        int base[3];
+        float weight[3];
+        for (int axis = 0; axis < 3; axis++) {
+            float extent = this->boundsMax[axis] - this->boundsMin[axis];
+            float cell = extent > 0.0f ? (position[axis] - this->boundsMin[axis]) / extent * float(this->resolution[axis] - 1) : 0.0f;
+            cell = glm::clamp(cell, 0.0f, float(this->resolution[axis] - 1));
+            base[axis] = std::min(int(cell), std::max(this->resolution[axis] - 2, 0));
+            weight[axis] = cell - float(base[axis]);
+        }
+        for (int corner = 0; corner < 8; corner++) {
+            int x = std::min(base[0] + (corner & 1), this->resolution[0] - 1);
+            int y = std::min(base[1] + ((corner >> 1) & 1), this->resolution[1] - 1);
+            int z = std::min(base[2] + ((corner >> 2) & 1), this->resolution[2] - 1);
+            float w = ((corner & 1) ? weight[0] : 1.0f - weight[0]) * (((corner >> 1) & 1) ? weight[1] : 1.0f - weight[1])
+                      * (((corner >> 2) & 1) ? weight[2] : 1.0f - weight[2]);
+            if (w <= 0.0f) {
+                continue;
+            }
+            const uint16_t* probe = &this->texels[this->probeIndex(x, y, z) * SH_COEFFICIENTS * 3];
+            for (int k = 0; k < SH_COEFFICIENTS; k++) {
+                result.coefficients[k] += w * glm::vec3(HalfToFloat(probe[k * 3]), HalfToFloat(probe[k * 3 + 1]), HalfToFloat(probe[k * 3 + 2]));
+            }
+        }
+        return result;
+    }
+
+    glm::ivec3 Resolution() const { return glm::ivec3(this->resolution[0], this->resolution[1], this->resolution[2]); }
+
+private:
+    size_t probeIndex(int x, int y, int z) const
+    {
+        return (size_t(z) * this->resolution[1] + y) * this->resolution[0] + x;
+    }
+
+    int resolution[3] = { 0, 0, 0 };
+    float boundsMin[3] = { 0.0f, 0.0f, 0.0f };
+    float boundsMax[3] = { 0.0f, 0.0f, 0.0f };
+    std::vector<uint16_t> texels;  // 9 coeficientes RGB por sonda, half float
+};
+
+// Hornea las sondas de "modelPath" y las guarda en "<modelPath>.probes".
+// Devuelve el codigo de salida del programa
+inline int BakeIrradianceVolume(const std::string& modelPath, const LightmapLights& lights, const IrradianceVolumeSettings& settings)
+{
+    using namespace LightmapDetail;
+    using namespace IrradianceDetail;
+    MeshCache cache;
+    if (!cache.Load(modelPath)) {
+        std::cout << "ERROR::PROBES:: could not load " << modelPath << std::endl;
+        return 1;
+    }
+    const MeshCacheView& view = cache.View();
+    std::string directory = DirectoryOf(modelPath);
+
+    auto start = std::chrono::steady_clock::now();
+    Scene scene;
+    buildScene(scene, view, directory, lights);
+
+    // Sondas en los vertices de la grilla, incluidas las caras de la caja
+    int resolution[3];
+    glm::vec3 extent = view.boundsMax - view.boundsMin;
+    for (int axis = 0; axis < 3; axis++) {
+        resolution[axis] = glm::clamp(int(std::ceil(extent[axis] / std::max(settings.spacing, 1e-3f))) + 1, 2, IRRADIANCE_MAX_RESOLUTION);
+    }
+    size_t probeCount = size_t(resolution[0]) * resolution[1] * resolution[2];
+    glm::vec3 step = extent / glm::vec3(float(resolution[0] - 1), float(resolution[1] - 1), float(resolution[2] - 1));
+    std::cout << "[Probes] " << modelPath << ": " << resolution[0] << "x" << resolution[1] << "x" << resolution[2] << " probes, "
+              << scene.bvh.NodeCount() << " BVH nodes (" << MillisecondsSince(start) << " ms)" << std::endl;
+
+    // Radiancia proyectada en la base con rayos uniformes en la esfera; el
+    // sol entra como una direccion puntual si la sonda lo ve
+    unsigned int threads = settings.threads != 0 ? settings.threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned long long> rays(threads, 0);
+    std::vector<ShIrradiance> probes(probeCount);
+    std::vector<uint8_t> valid(probeCount, 0);
+    int samples = std::max(settings.samples, 1);
+    auto traceStart = std::chrono::steady_clock::now();
+    ParallelFor(probeCount, threads, [&](size_t begin, size_t end, unsigned int worker) {
+        unsigned long long workerRays = 0;
+        for (size_t p = begin; p < end; p++) {
+            glm::vec3 position = view.boundsMin
+                                 + glm::vec3(float(p % resolution[0]), float(p / resolution[0] % resolution[1]), float(p / (size_t(resolution[0]) * resolution[1])))
+                                       * step;
+            Random random(static_cast<uint32_t>(p));
+            glm::vec3 radiance[SH_COEFFICIENTS] = {};
+            float basisValues[SH_COEFFICIENTS];
+            int backFaces = 0;
+            for (int s = 0; s < samples; s++) {
+                glm::vec3 direction = sphereSample(random.Next(), random.Next());
+                RayHit hit;
+                workerRays++;
+                if (!scene.bvh.Intersect(position, direction, hit)) {
+                    continue;
+                }
+                glm::vec3 hitPosition, normal, faceNormal;
+                scene.Surface(hit.triangle, hit.u, hit.v, hitPosition, normal, faceNormal);
+                if (glm::dot(faceNormal, direction) > 0.0f) {
+                    backFaces++;
+                    continue;
+                }
+                // Radiancia que sale de la superficie: albedo / pi por su irradiancia
+                glm::vec3 origin = hitPosition + faceNormal * scene.epsilon;
+                glm::vec3 albedo = scene.albedo[scene.materialOf[hit.triangle]];
+                glm::vec3 incoming = scene.SunIrradiance(origin, normal, workerRays);
+                if (settings.bounces > 1) {
+                    incoming += scene.Gather(origin, cosineSample(normal, random.Next(), random.Next()), settings.bounces - 1, random, workerRays);
+                }
+                basis(direction, basisValues);
+                for (int k = 0; k < SH_COEFFICIENTS; k++) {
+                    radiance[k] += albedo * incoming * (basisValues[k] * 0.3183099f);
+                }
+            }
+            float sampleWeight = 4.0f * 3.141593f / float(samples);
+            for (int k = 0; k < SH_COEFFICIENTS; k++) {
+                radiance[k] = radiance[k] * (sampleWeight * BASIS_SCALE[k]);
+            }
+            workerRays++;
+            if (!scene.bvh.Occluded(position, scene.toSun, FLT_MAX)) {
+                basis(scene.toSun, basisValues);
+                for (int k = 0; k < SH_COEFFICIENTS; k++) {
+                    radiance[k] += scene.sunDiffuse * (basisValues[k] * BASIS_SCALE[k]);
+                }
+            }
+
+            // Irradiancia = radiancia convolucionada con el coseno; se guarda
+            // con la constante de la base ya aplicada para el shader
+            ShIrradiance& probe = probes[p];
+            for (int k = 0; k < SH_COEFFICIENTS; k++) {
+                probe.coefficients[k] = radiance[k] * (COSINE_LOBE[k] * BASIS_SCALE[k]);
+            }
+            probe.coefficients[0] += lights.ambient;
+            valid[p] = float(backFaces) <= IRRADIANCE_MAX_BACKFACES * float(samples) ? 1 : 0;
+        }
+        rays[worker] += workerRays;
+    });
+    double traceSeconds = MillisecondsSince(traceStart) / 1000.0;
+
+    // Las sondas dentro de paredes toman el promedio de sus vecinas validas
+    size_t invalid = 0;
+    for (uint8_t flag : valid) {
+        invalid += flag ? 0 : 1;
+    }
+    for (int pass = 0; pass < IRRADIANCE_MAX_RESOLUTION && invalid > 0; pass++) {
+        std::vector<uint8_t> next = valid;
+        for (size_t p = 0; p < probeCount; p++) {
+            if (valid[p]) {
+                continue;
+            }
+            int coordinate[3] = { int(p % resolution[0]), int(p / resolution[0] % resolution[1]), int(p / (size_t(resolution[0]) * resolution[1])) };
+            ShIrradiance sum = {};
+            int count = 0;
+            for (int axis = 0; axis < 3; axis++) {
+                for (int sign = -1; sign <= 1; sign += 2) {
+                    int neighbour[3] = { coordinate[0], coordinate[1], coordinate[2] };
+                    neighbour[axis] += sign;
+                    if (neighbour[axis] < 0 || neighbour[axis] >= resolution[axis]) {
+                        continue;
+                    }
+                    size_t n = (size_t(neighbour[2]) * resolution[1] + neighbour[1]) * resolution[0] + neighbour[0];
+                    if (valid[n]) {
+                        for (int k = 0; k < SH_COEFFICIENTS; k++) {
+                            sum.coefficients[k] += probes[n].coefficients[k];
+                        }
+                        count++;
+                    }
+                }
+            }
+            if (count > 0) {
+                for (int k = 0; k < SH_COEFFICIENTS; k++) {
+                    probes[p].coefficients[k] = sum.coefficients[k] / float(count);
+                }
+                next[p] = 1;
+            }
+        }
+        valid.swap(next);
+        invalid = 0;
+        for (uint8_t flag : valid) {
+            invalid += flag ? 0 : 1;
+        }
+    }
+
+    unsigned long long totalRays = 0;
+    for (unsigned long long count : rays) {
+        totalRays += count;
+    }
+    double raysPerSecond = traceSeconds > 0.0 ? double(totalRays) / traceSeconds : 0.0;
+    std::cout << "[Probes] " << samples << " samples x " << settings.bounces << " bounces: " << totalRays << " rays in "
+              << traceSeconds << " s on " << threads << " threads, " << raysPerSecond / 1e6 << " Mrays/s ("
+              << raysPerSecond / 1e6 / threads << " Mrays/s per core)" << std::endl;
+
+    IrradianceVolumeHeader header;
+    std::memcpy(header.magic, IRRADIANCE_VOLUME_MAGIC, sizeof(header.magic));
+    header.version = IRRADIANCE_VOLUME_VERSION;
+    header.meshKey = LightmapKey(view);
+    for (int axis = 0; axis < 3; axis++) {
+        header.resolution[axis] = uint32_t(resolution[axis]);
+        header.boundsMin[axis] = view.boundsMin[axis];
+        header.boundsMax[axis] = view.boundsMax[axis];
+    }
+    std::vector<uint16_t> texels(probeCount * SH_COEFFICIENTS * 3);
+    for (size_t p = 0; p < probeCount; p++) {
+        for (int k = 0; k < SH_COEFFICIENTS; k++) {
+            for (int c = 0; c < 3; c++) {
+                texels[(p * SH_COEFFICIENTS + k) * 3 + c] = FloatToHalf(glm::clamp(probes[p].coefficients[k][c], -65504.0f, 65504.0f));
+            }
+        }
+    }
+
+    std::string outputPath = modelPath + ".probes";
+    std::string temporary = outputPath + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(texels.data()), std::streamsize(texels.size() * sizeof(uint16_t)));
+        if (!file) {
+            std::cout << "ERROR::PROBES:: could not write " << outputPath << std::endl;
+            return 1;
+        }
+    }
+    std::remove(outputPath.c_str());
+    if (std::rename(temporary.c_str(), outputPath.c_str()) != 0) {
+        std::cout << "ERROR::PROBES:: could not write " << outputPath << std::endl;
+        return 1;
+    }
+    std::cout << "[Probes] Wrote " << outputPath << " (" << probeCount << " probes, " << texels.size() * sizeof(uint16_t) / 1024
+              << " KB, " << invalid << " left without valid neighbours; " << MillisecondsSince(start) / 1000.0 << " s total)" << std::endl;
+    return 0;
+}
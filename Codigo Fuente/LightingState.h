@@ -0,0 +1,281 @@
+#pragma once
+
+// Estado de iluminacion en uniform buffers (std140). El bloque "Lights" lo
+// comparten lighting.frag y cualquier shader que lo declare; solo se sube la
+// parte que cambio desde el ultimo fotograma. El bloque "Object" lleva la
+// matriz de modelo y la matriz normal calculada en la CPU, para que
+// lighting.vs no tenga que invertir una matriz por vertice.
+// ActiveFeatures dice que partes de lighting.frag aportan algo con las luces
+// actuales, para elegir la permutacion mas barata (ShaderPermutations).
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "GLStats.h"
+
+const int LIGHTING_POINT_LIGHTS = 4;  // NUMBER_OF_POINT_LIGHTS en lighting.frag
+const GLuint LIGHTS_BLOCK_BINDING = 0;
+const GLuint OBJECT_BLOCK_BINDING = 1;
+
+// Bits de las permutaciones de lighting.frag
+const uint32_t LIGHTING_POINT_LIGHT_0 = 1u << 0;  // un bit por luz puntual
+const uint32_t LIGHTING_POINT_LIGHT_1 = 1u << 1;
+const uint32_t LIGHTING_POINT_LIGHT_MASK = (1u << LIGHTING_POINT_LIGHTS) - 1;
+const uint32_t LIGHTING_SPOT_LIGHT = 1u << 4;
+const uint32_t LIGHTING_SPECULAR = 1u << 5;
+const uint32_t LIGHTING_ALPHA_TEST = 1u << 6;
+const uint32_t LIGHTING_ALL_FEATURES = LIGHTING_POINT_LIGHT_MASK | LIGHTING_SPOT_LIGHT | LIGHTING_SPECULAR | LIGHTING_ALPHA_TEST;
+
+// #define de lighting.frag para una combinacion de bits
+inline std::vector<std::string> LightingFeatureDefines(uint32_t features)
+{
+    return { "POINT_LIGHT_MASK " + std::to_string(features & LIGHTING_POINT_LIGHT_MASK),
+             std::string("SPOT_LIGHT ") + ((features & LIGHTING_SPOT_LIGHT) ? "1" : "0"),
+             std::string("SPECULAR ") + ((features & LIGHTING_SPECULAR) ? "1" : "0"),
+             std::string("ALPHA_TEST ") + ((features & LIGHTING_ALPHA_TEST) ? "1" : "0") };
+}
+
+// Espejos en C++ de los structs de lighting.frag con el relleno de std140
+struct DirLightStd140
+{
+    glm::vec3 direction; float pad0;
+    glm::vec3 ambient; float pad1;
+    glm::vec3 diffuse; float pad2;
+    glm::vec3 specular; float pad3;
+};
+
+struct PointLightStd140
+{
+    glm::vec3 position;
+    float constant;
+    float linear;
+    float quadratic;
+    float pad0[2];
+    glm::vec3 ambient; float pad1;
+    glm::vec3 diffuse; float pad2;
+    glm::vec3 specular; float pad3;
+};
+
+struct SpotLightStd140
+{
+    glm::vec3 position; float pad0;
+    glm::vec3 direction;
+    float cutOff;
+    float outerCutOff;
+    float constant;
+    float linear;
+    float quadratic;
+    glm::vec3 ambient; float pad1;
+    glm::vec3 diffuse; float pad2;
+    glm::vec3 specular; float pad3;
+};
+
+struct LightsBlock
+{
+    DirLightStd140 dirLight;
+    PointLightStd140 pointLights[LIGHTING_POINT_LIGHTS];
+    SpotLightStd140 spotLight;
+    glm::vec3 viewPos; float pad0;
+};
+
+// mat3 en std140 ocupa tres columnas de vec4
+struct ObjectBlock
+{
+    glm::mat4 model;
+    glm::vec4 normalMatrix[3];
+};
+
+static_assert(sizeof(DirLightStd140) == 64, "DirLight no coincide con std140");
+static_assert(sizeof(PointLightStd140) == 80, "PointLight no coincide con std140");
+static_assert(sizeof(SpotLightStd140) == 96, "SpotLight no coincide con std140");
+static_assert(sizeof(LightsBlock) == 496, "Lights no coincide con std140");
+static_assert(sizeof(ObjectBlock) == 112, "Object no coincide con std140");
+
+class LightingState
+{
+public:
+    LightingState()
+    {
+        glGenBuffers(1, &this->lightsUBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, this->lightsUBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(LightsBlock), &this->lights, GL_DYNAMIC_DRAW);
+        glGenBuffers(1, &this->objectUBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, this->objectUBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(ObjectBlock), &this->object, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        glBindBufferBase(GL_UNIFORM_BUFFER, LIGHTS_BLOCK_BINDING, this->lightsUBO);
+        glBindBufferBase(GL_UNIFORM_BUFFER, OBJECT_BLOCK_BINDING, this->objectUBO);
+    }
+
+    // Conecta los bloques del programa con los puntos de enlace de los UBO
+    void Attach(GLuint program)
+    {
+        GLuint lightsIndex = glGetUniformBlockIndex(program, "Lights");
+        if (lightsIndex != GL_INVALID_INDEX) {
+            glUniformBlockBinding(program, lightsIndex, LIGHTS_BLOCK_BINDING);
+        }
+        GLuint objectIndex = glGetUniformBlockIndex(program, "Object");
+        if (objectIndex != GL_INVALID_INDEX) {
+            glUniformBlockBinding(program, objectIndex, OBJECT_BLOCK_BINDING);
+        }
+    }
+
+    void SetDirLight(const glm::vec3& direction, const glm::vec3& ambient, const glm::vec3& diffuse, const glm::vec3& specular)
+    {
+        DirLightStd140 light = this->lights.dirLight;
+        light.direction = direction;
+        light.ambient = ambient;
+        light.diffuse = diffuse;
+        light.specular = specular;
+        this->write(offsetof(LightsBlock, dirLight), &light, sizeof(light));
+    }
+
+    void SetPointLight(int index, const glm::vec3& position, const glm::vec3& ambient, const glm::vec3& diffuse, const glm::vec3& specular,
+                       float constant, float linear, float quadratic)
+    {
+        PointLightStd140 light = this->lights.pointLights[index];
+        light.position = position;
+        light.ambient = ambient;
+        light.diffuse = diffuse;
+        light.specular = specular;
+        light.constant = constant;
+        light.linear = linear;
+        light.quadratic = quadratic;
+        this->write(offsetof(LightsBlock, pointLights) + index * sizeof(PointLightStd140), &light, sizeof(light));
+    }
+
+    void SetPointLightPosition(int index, const glm::vec3& position)
+    {
+        this->write(offsetof(LightsBlock, pointLights) + index * sizeof(PointLightStd140) + offsetof(PointLightStd140, position), &position, sizeof(glm::vec3));
+    }
+
+    // Solo el color cambia cada fotograma cuando la luz parpadea
+    void SetPointLightColor(int index, const glm::vec3& ambient, const glm::vec3& diffuse)
+    {
+        size_t base = offsetof(LightsBlock, pointLights) + index * sizeof(PointLightStd140);
+        this->write(base + offsetof(PointLightStd140, ambient), &ambient, sizeof(glm::vec3));
+        this->write(base + offsetof(PointLightStd140, diffuse), &diffuse, sizeof(glm::vec3));
+    }
+
+    void SetPointLightColor(int index, const glm::vec3& ambient, const glm::vec3& diffuse, const glm::vec3& specular)
+    {
+        this->SetPointLightColor(index, ambient, diffuse);
+        this->write(offsetof(LightsBlock, pointLights) + index * sizeof(PointLightStd140) + offsetof(PointLightStd140, specular), &specular, sizeof(glm::vec3));
+    }
+
+    void SetSpotLight(const glm::vec3& position, const glm::vec3& direction, float cutOff, float outerCutOff,
+                      const glm::vec3& ambient, const glm::vec3& diffuse, const glm::vec3& specular,
+                      float constant, float linear, float quadratic)
+    {
+        SpotLightStd140 light = this->lights.spotLight;
+        light.position = position;
+        light.direction = direction;
+        light.cutOff = cutOff;
+        light.outerCutOff = outerCutOff;
+        light.ambient = ambient;
+        light.diffuse = diffuse;
+        light.specular = specular;
+        light.constant = constant;
+        light.linear = linear;
+        light.quadratic = quadratic;
+        this->write(offsetof(LightsBlock, spotLight), &light, sizeof(light));
+    }
+
+    void SetSpotLightTransform(const glm::vec3& position, const glm::vec3& direction)
+    {
+        this->write(offsetof(LightsBlock, spotLight) + offsetof(SpotLightStd140, position), &position, sizeof(glm::vec3));
+        this->write(offsetof(LightsBlock, spotLight) + offsetof(SpotLightStd140, direction), &direction, sizeof(glm::vec3));
+    }
+
+    void SetViewPosition(const glm::vec3& position)
+    {
+        this->write(offsetof(LightsBlock, viewPos), &position, sizeof(glm::vec3));
+    }
+
+    // Sube en una sola llamada el rango que cambio desde la ultima vez
+    void Upload()
+    {
+        if (this->dirtyEnd <= this->dirtyBegin) {
+            return;
+        }
+        GL_COUNT(glBindBuffer(GL_UNIFORM_BUFFER, this->lightsUBO));
+        GL_COUNT(glBufferSubData(GL_UNIFORM_BUFFER, this->dirtyBegin, this->dirtyEnd - this->dirtyBegin,
+                                 reinterpret_cast<const char*>(&this->lights) + this->dirtyBegin));
+        this->dirtyBegin = sizeof(LightsBlock);
+        this->dirtyEnd = 0;
+        this->uploads++;
+    }
+
+    // Matriz de modelo del siguiente objeto; si no cambio no se toca el buffer
+    void SetObject(const glm::mat4& model)
+    {
+        if (this->objectValid && model == this->object.model) {
+            return;
+        }
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+        this->object.model = model;
+        for (int i = 0; i < 3; i++) {
+            this->object.normalMatrix[i] = glm::vec4(normalMatrix[i], 0.0f);
+        }
+        this->objectValid = true;
+        GL_COUNT(glBindBuffer(GL_UNIFORM_BUFFER, this->objectUBO));
+        GL_COUNT(glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(ObjectBlock), &this->object));
+    }
+
+    // Partes de lighting.frag que aportan algo con las luces actuales: una luz
+    // con todos sus colores en cero no se calcula, y sin especular en ninguna
+    // luz calculada no se evalua el brillo. "pointLights" son las luces
+    // puntuales que el shader calcula por pixel y "sun" si evalua el sol (las
+    // variantes LIGHTMAP e IRRADIANCE_PROBES lo traen horneado)
+    uint32_t ActiveFeatures(uint32_t pointLights = LIGHTING_POINT_LIGHT_MASK, bool sun = true) const
+    {
+        const glm::vec3 zero(0.0f);
+        uint32_t features = 0;
+        bool specular = sun && this->lights.dirLight.specular != zero;
+        for (int i = 0; i < LIGHTING_POINT_LIGHTS; i++) {
+            const PointLightStd140& light = this->lights.pointLights[i];
+            if ((pointLights & (1u << i)) == 0 || (light.ambient == zero && light.diffuse == zero && light.specular == zero)) {
+                continue;
+            }
+            features |= 1u << i;
+            specular = specular || light.specular != zero;
+        }
+        const SpotLightStd140& spot = this->lights.spotLight;
+        if (spot.ambient != zero || spot.diffuse != zero || spot.specular != zero) {
+            features |= LIGHTING_SPOT_LIGHT;
+            specular = specular || spot.specular != zero;
+        }
+        return features | (specular ? LIGHTING_SPECULAR : 0u);
+    }
+
+    unsigned int Uploads() const { return this->uploads; }
+
+private:
+    GLuint lightsUBO = 0;
+    GLuint objectUBO = 0;
+    LightsBlock lights{};
+    ObjectBlock object{};
+    bool objectValid = false;
+    size_t dirtyBegin = 0;
+    size_t dirtyEnd = sizeof(LightsBlock);  // la primera subida manda el bloque entero
+    unsigned int uploads = 0;
+
+    // Copia el valor solo si cambia y amplia el rango sucio
+    void write(size_t offset, const void* value, size_t size)
+    {
+        char* destination = reinterpret_cast<char*>(&this->lights) + offset;
+        if (std::memcmp(destination, value, size) == 0) {
+            return;
+        }
+        std::memcpy(destination, value, size);
+        this->dirtyBegin = offset < this->dirtyBegin ? offset : this->dirtyBegin;
+        this->dirtyEnd = offset + size > this->dirtyEnd ? offset + size : this->dirtyEnd;
+    }
+};
@@ -0,0 +1,473 @@
+#pragma once
+
+// Horneado de luz estatica (--bake-lightmaps). Para un modelo que no se mueve
+// (la casa) genera el segundo juego de UV (LightmapUnwrap.h), arma un BVH con
+// sus triangulos (TriangleBVH.h) y traza rayos desde cada texel del atlas en
+// todos los nucleos: luz directa del sol con sombras, rebotes difusos con el
+// color promedio de la textura de cada material, y la luz ambiente fija. El
+// resultado es la irradiancia por texel; lighting.frag con LIGHTMAP la
+// multiplica por la textura difusa en vez de evaluar el sol en cada pixel.
+// El ambiente de la segunda luz puntual no se hornea: en lighting.frag es un
+// termino plano, sin textura, y el shader lo sigue sumando.
+//
+// Se guarda en "<modelo>.lightmap" junto al OBJ con la clave del contenido
+// del cache de mallas; si el modelo cambia, el archivo deja de aplicarse.
+// No necesita contexto de OpenGL.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "SOIL2/SOIL2.h"
+
+#include "ContentHash.h"
+#include "LightmapUnwrap.h"
+#include "MeshCache.h"
+#include "ThreadPool.h"
+#include "TriangleBVH.h"
+#include "VertexQuantization.h"
+
+// Incrementar cada vez que cambie el formato del archivo
+const uint32_t LIGHTMAP_VERSION = 2;
+const char LIGHTMAP_MAGIC[4] = { 'L', 'M', 'A', 'P' };
+
+const int LIGHTMAP_DEFAULT_SIZE = 1024;
+const int LIGHTMAP_DEFAULT_SAMPLES = 64;   // rayos de rebote por texel
+const int LIGHTMAP_DEFAULT_BOUNCES = 2;
+const float LIGHTMAP_MAX_ALBEDO = 0.9f;    // ningun material devuelve toda la luz
+
+// Luces que no se mueven, con los mismos valores que LightingState
+struct LightmapLights
+{
+    glm::vec3 sunDirection;
+    glm::vec3 sunDiffuse;
+    glm::vec3 ambient;  // ambiente del sol (se multiplica por la textura difusa)
+};
+
+struct LightmapSettings
+{
+    int size = LIGHTMAP_DEFAULT_SIZE;
+    int samples = LIGHTMAP_DEFAULT_SAMPLES;
+    int bounces = LIGHTMAP_DEFAULT_BOUNCES;
+    unsigned int threads = 0;  // 0: todos los nucleos
+};
+
+struct LightmapFileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t meshKey;
+    uint32_t size;
+    uint32_t baseVertexCount;
+    uint32_t extraVertexCount;
+    uint32_t indexCount;       // indices del nivel 0
+};
+
+// Lo que necesita CachedModel: vertices extra, UV del atlas por vertice,
+// indices del nivel 0 ya remapeados y la irradiancia en half float RGB
+struct LightmapData
+{
+    uint32_t size = 0;
+    uint32_t baseVertexCount = 0;
+    std::vector<uint32_t> remap;
+    std::vector<uint16_t> uvs;     // 2 por vertice, normalizados a [0, 65535]
+    std::vector<uint32_t> indices;
+    std::vector<uint16_t> texels;  // 3 por texel
+};
+
+// Identifica el contenido del cache de mallas al que corresponde el mapa
+inline uint64_t LightmapKey(const MeshCacheView& view)
+{
+    uint64_t h = HashBytes(view.vertices, size_t(view.vertexCount) * sizeof(CacheVertex));
+    return HashBytes(view.indices, size_t(BaseIndexCount(view)) * sizeof(uint32_t), h);
+}
+
+inline bool WriteLightmap(const std::string& path, const LightmapData& data, uint64_t meshKey)
+{
+    LightmapFileHeader header;
+    std::memcpy(header.magic, LIGHTMAP_MAGIC, sizeof(header.magic));
+    header.version = LIGHTMAP_VERSION;
+    header.meshKey = meshKey;
+    header.size = data.size;
+    header.baseVertexCount = data.baseVertexCount;
+    header.extraVertexCount = uint32_t(data.remap.size());
+    header.indexCount = uint32_t(data.indices.size());
+
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(data.remap.data()), std::streamsize(data.remap.size() * sizeof(uint32_t)));
+        file.write(reinterpret_cast<const char*>(data.uvs.data()), std::streamsize(data.uvs.size() * sizeof(uint16_t)));
+        file.write(reinterpret_cast<const char*>(data.indices.data()), std::streamsize(data.indices.size() * sizeof(uint32_t)));
+        file.write(reinterpret_cast<const char*>(data.texels.data()), std::streamsize(data.texels.size() * sizeof(uint16_t)));
+        if (!file) {
+            return false;
+        }
+    }
+    std::remove(path.c_str());
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+// false si no existe, esta incompleto o es de otra version del modelo
+inline bool ReadLightmap(const std::string& path, const MeshCacheView& view, LightmapData& data)
+{
+    std::vector<unsigned char> bytes;
+    if (!ReadFileBytes(path, bytes) || bytes.size() < sizeof(LightmapFileHeader)) {
+        return false;
+    }
+    LightmapFileHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (std::memcmp(header.magic, LIGHTMAP_MAGIC, sizeof(header.magic)) != 0 || header.version != LIGHTMAP_VERSION
+        || header.baseVertexCount != view.vertexCount || header.indexCount != BaseIndexCount(view)) {
+        std::cout << "WARNING::LIGHTMAP:: " << path << " does not match the model, ignoring it" << std::endl;
+        return false;
+    }
+    size_t vertexCount = size_t(header.baseVertexCount) + header.extraVertexCount;
+    size_t expected = sizeof(header) + header.extraVertexCount * sizeof(uint32_t) + vertexCount * 2 * sizeof(uint16_t)
+                      + size_t(header.indexCount) * sizeof(uint32_t) + size_t(header.size) * header.size * 3 * sizeof(uint16_t);
+    if (bytes.size() != expected || header.meshKey != LightmapKey(view)) {
+        std::cout << "WARNING::LIGHTMAP:: " << path << " does not match the model, ignoring it" << std::endl;
+        return false;
+    }
+
+    const unsigned char* cursor = bytes.data() + sizeof(header);
+    auto take = [&cursor](auto& out, size_t count) {
+        out.resize(count);
+        std::memcpy(out.data(), cursor, count * sizeof(out[0]));
+        cursor += count * sizeof(out[0]);
+    };
+    data.size = header.size;
+    data.baseVertexCount = header.baseVertexCount;
+    take(data.remap, header.extraVertexCount);
+    take(data.uvs, vertexCount * 2);
+    take(data.indices, header.indexCount);
+    take(data.texels, size_t(header.size) * header.size * 3);
+    return true;
+}
+
+namespace LightmapDetail
+{
+    // xorshift32: barato y con semilla por texel, asi el resultado no depende
+    // de como se repartan los texeles entre hilos
+    struct Random
+    {
+        uint32_t state;
+
+        explicit Random(uint32_t seed) : state(uint32_t(HashMix(seed)) | 1u) {}
+
+        float Next()
+        {
+            this->state ^= this->state << 13;
+            this->state ^= this->state >> 17;
+            this->state ^= this->state << 5;
+            return float(this->state >> 8) * (1.0f / 16777216.0f);
+        }
+    };
+
+    // Direccion con densidad proporcional al coseno alrededor de "normal"
+    inline glm::vec3 cosineSample(const glm::vec3& normal, float u1, float u2)
+    {
+        float radius = std::sqrt(u1);
+        float angle = 6.2831853f * u2;
+        glm::vec3 tangent = std::abs(normal.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+        tangent = glm::normalize(glm::cross(tangent, normal));
+        glm::vec3 bitangent = glm::cross(normal, tangent);
+        return glm::normalize(tangent * (radius * std::cos(angle)) + bitangent * (radius * std::sin(angle))
+                              + normal * std::sqrt(std::max(0.0f, 1.0f - u1)));
+    }
+
+    // Color promedio de la textura difusa de cada material
+    inline std::vector<glm::vec3> materialAlbedo(const MeshCacheView& view, const std::string& directory)
+    {
+        std::vector<glm::vec3> albedo(view.materialCount, glm::vec3(LIGHTMAP_MAX_ALBEDO));
+        ParallelFor(view.materialCount, 0, [&](size_t begin, size_t end, unsigned int) {
+            for (size_t i = begin; i < end; i++) {
+                std::vector<unsigned char> bytes;
+                if (view.materials[i].diffuse[0] == '\0' || !ReadFileBytes(directory + '/' + view.materials[i].diffuse, bytes)) {
+                    continue;
+                }
+                int width, height, channels;
+                unsigned char* image = SOIL_load_image_from_memory(bytes.data(), int(bytes.size()), &width, &height, &channels, SOIL_LOAD_RGB);
+                if (image == nullptr) {
+                    continue;
+                }
+                double sum[3] = { 0.0, 0.0, 0.0 };
+                size_t pixels = size_t(width) * height;
+                for (size_t p = 0; p < pixels; p++) {
+                    for (int k = 0; k < 3; k++) {
+                        sum[k] += image[p * 3 + k];
+                    }
+                }
+                SOIL_free_image_data(image);
+                double scale = 1.0 / (255.0 * double(std::max<size_t>(pixels, 1)));
+                albedo[i] = glm::min(glm::vec3(float(sum[0] * scale), float(sum[1] * scale), float(sum[2] * scale)), glm::vec3(LIGHTMAP_MAX_ALBEDO));
+            }
+        });
+        return albedo;
+    }
+
+    // Texeles vacios toman el promedio de sus vecinos cubiertos; asi el
+    // filtrado bilineal en los bordes de las cartas no mezcla negro
+    inline void dilate(std::vector<glm::vec3>& irradiance, std::vector<uint8_t>& covered, int size, int passes)
+    {
+        for (int pass = 0; pass < passes; pass++) {
+            std::vector<uint8_t> next = covered;
+            for (int y = 0; y < size; y++) {
+                for (int x = 0; x < size; x++) {
+                    if (covered[size_t(y) * size + x]) {
+                        continue;
+                    }
+                    glm::vec3 sum(0.0f);
+                    int count = 0;
+                    for (int dy = -1; dy <= 1; dy++) {
+                        for (int dx = -1; dx <= 1; dx++) {
+                            int nx = x + dx, ny = y + dy;
+                            if (nx >= 0 && ny >= 0 && nx < size && ny < size && covered[size_t(ny) * size + nx]) {
+                                sum += irradiance[size_t(ny) * size + nx];
+                                count++;
+                            }
+                        }
+                    }
+                    if (count > 0) {
+                        irradiance[size_t(y) * size + x] = sum / float(count);
+                        next[size_t(y) * size + x] = 1;
+                    }
+                }
+            }
+            covered.swap(next);
+        }
+    }
+
+    // Triangulos del nivel 0 con su BVH y el albedo de cada uno; lo comparten
+    // el mapa de luz y el volumen de irradiancia (IrradianceVolume.h)
+    struct Scene
+    {
+        const MeshCacheView* view = nullptr;
+        TriangleBVH bvh;
+        std::vector<glm::vec3> albedo;      // por material
+        std::vector<uint32_t> materialOf;   // por triangulo
+        glm::vec3 toSun;
+        glm::vec3 sunDiffuse;
+        float epsilon = 1e-4f;              // separacion del origen de los rayos
+
+        // Punto, normal interpolada y normal de la cara (del mismo lado) en
+        // las coordenadas baricentricas (w1, w2) del triangulo t
+        void Surface(uint32_t t, float w1, float w2, glm::vec3& position, glm::vec3& normal, glm::vec3& faceNormal) const
+        {
+            const CacheVertex& a = this->view->vertices[this->view->indices[t * 3]];
+            const CacheVertex& b = this->view->vertices[this->view->indices[t * 3 + 1]];
+            const CacheVertex& c = this->view->vertices[this->view->indices[t * 3 + 2]];
+            float w0 = 1.0f - w1 - w2;
+            position = a.Position * w0 + b.Position * w1 + c.Position * w2;
+            faceNormal = glm::normalize(glm::cross(b.Position - a.Position, c.Position - a.Position));
+            normal = a.Normal * w0 + b.Normal * w1 + c.Normal * w2;
+            normal = glm::dot(normal, normal) > 1e-12f ? glm::normalize(normal) : faceNormal;
+            if (glm::dot(faceNormal, normal) < 0.0f) {
+                faceNormal = -faceNormal;
+            }
+        }
+
+        // Irradiancia del sol en un punto, con su rayo de sombra
+        glm::vec3 SunIrradiance(const glm::vec3& origin, const glm::vec3& normal, unsigned long long& rays) const
+        {
+            float sunCosine = glm::dot(normal, this->toSun);
+            if (sunCosine <= 0.0f) {
+                return glm::vec3(0.0f);
+            }
+            rays++;
+            return this->bvh.Occluded(origin, this->toSun, FLT_MAX) ? glm::vec3(0.0f) : this->sunDiffuse * sunCosine;
+        }
+
+        // Luz del sol que llega rebotando por "direction": cada superficie
+        // difusa devuelve albedo * su irradiancia del sol. Es pi veces la
+        // radiancia; con direcciones con densidad de coseno su promedio es la
+        // irradiancia indirecta
+        glm::vec3 Gather(glm::vec3 origin, glm::vec3 direction, int bounces, Random& random, unsigned long long& rays) const
+        {
+            glm::vec3 result(0.0f), throughput(1.0f);
+            for (int bounce = 0; bounce < bounces; bounce++) {
+                RayHit hit;
+                rays++;
+                if (!this->bvh.Intersect(origin, direction, hit)) {
+                    break;
+                }
+                glm::vec3 position, normal, faceNormal;
+                this->Surface(hit.triangle, hit.u, hit.v, position, normal, faceNormal);
+                if (glm::dot(faceNormal, direction) > 0.0f) {
+                    break;  // cara de atras: el rayo quedo dentro de la geometria
+                }
+                throughput = throughput * this->albedo[this->materialOf[hit.triangle]];
+                origin = position + faceNormal * this->epsilon;
+                result += throughput * this->SunIrradiance(origin, normal, rays);
+                direction = cosineSample(normal, random.Next(), random.Next());
+            }
+            return result;
+        }
+    };
+
+    inline void buildScene(Scene& scene, const MeshCacheView& view, const std::string& directory, const LightmapLights& lights)
+    {
+        uint32_t triangleCount = BaseIndexCount(view) / 3;
+        std::vector<glm::vec3> positions(view.vertexCount);
+        for (uint32_t i = 0; i < view.vertexCount; i++) {
+            positions[i] = view.vertices[i].Position;
+        }
+        scene.view = &view;
+        scene.bvh.Build(positions.data(), view.indices, triangleCount);
+        scene.albedo = materialAlbedo(view, directory);
+        scene.materialOf.assign(triangleCount, 0);
+        for (uint32_t m = 0; m < view.meshCount; m++) {
+            for (uint32_t t = view.meshes[m].firstIndex / 3; t < (view.meshes[m].firstIndex + view.meshes[m].indexCount) / 3; t++) {
+                scene.materialOf[t] = view.meshes[m].material;
+            }
+        }
+        scene.toSun = -glm::normalize(lights.sunDirection);
+        scene.sunDiffuse = lights.sunDiffuse;
+        scene.epsilon = std::max(1e-4f, 1e-4f * glm::length(view.boundsMax - view.boundsMin));
+    }
+}
+
+// Hornea el mapa de luz de "modelPath" y lo guarda en "<modelPath>.lightmap".
+// Devuelve el codigo de salida del programa
+inline int BakeLightmap(const std::string& modelPath, const LightmapLights& lights, const LightmapSettings& settings)
+{
+    using namespace LightmapDetail;
+    MeshCache cache;
+    if (!cache.Load(modelPath)) {
+        std::cout << "ERROR::LIGHTMAP:: could not load " << modelPath << std::endl;
+        return 1;
+    }
+    const MeshCacheView& view = cache.View();
+    std::string directory = DirectoryOf(modelPath);
+
+    auto start = std::chrono::steady_clock::now();
+    LightmapUnwrap unwrap = UnwrapLightmap(view, settings.size);
+    uint32_t triangleCount = uint32_t(unwrap.indices.size() / 3);
+    std::cout << "[Lightmap] " << modelPath << ": " << triangleCount << " triangles in " << unwrap.chartCount << " charts, "
+              << settings.size << "x" << settings.size << " atlas at " << unwrap.texelsPerUnit << " texels/unit, "
+              << view.vertexCount << " -> " << unwrap.uvs.size() << " vertices (" << MillisecondsSince(start) << " ms)" << std::endl;
+
+    auto bvhStart = std::chrono::steady_clock::now();
+    Scene scene;
+    buildScene(scene, view, directory, lights);
+    std::cout << "[Lightmap] BVH: " << scene.bvh.NodeCount() << " nodes in " << MillisecondsSince(bvhStart) << " ms" << std::endl;
+
+    // Triangulo que cubre el centro de cada texel
+    const int size = settings.size;
+    std::vector<uint32_t> texelTriangle(size_t(size) * size, UINT32_MAX);
+    for (uint32_t t = 0; t < triangleCount; t++) {
+        glm::vec2 a = unwrap.uvs[unwrap.indices[t * 3]] * float(size);
+        glm::vec2 b = unwrap.uvs[unwrap.indices[t * 3 + 1]] * float(size);
+        glm::vec2 c = unwrap.uvs[unwrap.indices[t * 3 + 2]] * float(size);
+        float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        if (std::abs(area) < 1e-12f) {
+            continue;
+        }
+        int x0 = std::max(0, int(std::floor(std::min(a.x, std::min(b.x, c.x))))), x1 = std::min(size - 1, int(std::ceil(std::max(a.x, std::max(b.x, c.x)))));
+        int y0 = std::max(0, int(std::floor(std::min(a.y, std::min(b.y, c.y))))), y1 = std::min(size - 1, int(std::ceil(std::max(a.y, std::max(b.y, c.y)))));
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) {
+                glm::vec2 p(float(x) + 0.5f, float(y) + 0.5f);
+                float w1 = ((p.x - a.x) * (c.y - a.y) - (p.y - a.y) * (c.x - a.x)) / area;
+                float w2 = ((b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x)) / area;
+                if (w1 >= -1e-4f && w2 >= -1e-4f && w1 + w2 <= 1.0f + 1e-4f) {
+                    texelTriangle[size_t(y) * size + x] = t;
+                }
+            }
+        }
+    }
+
+    // Trazado en paralelo por filas; cada hilo cuenta sus rayos
+    unsigned int threads = settings.threads != 0 ? settings.threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned long long> rays(threads, 0);
+    std::vector<glm::vec3> irradiance(size_t(size) * size, glm::vec3(0.0f));
+    std::vector<uint8_t> covered(size_t(size) * size, 0);
+    auto traceStart = std::chrono::steady_clock::now();
+    ParallelFor(size_t(size), threads, [&](size_t begin, size_t end, unsigned int worker) {
+        unsigned long long workerRays = 0;
+        for (size_t y = begin; y < end; y++) {
+            for (int x = 0; x < size; x++) {
+                size_t texel = y * size + x;
+                uint32_t t = texelTriangle[texel];
+                if (t == UINT32_MAX) {
+                    continue;
+                }
+                Random random(static_cast<uint32_t>(texel));
+                glm::vec2 a = unwrap.uvs[unwrap.indices[t * 3]] * float(size);
+                glm::vec2 b = unwrap.uvs[unwrap.indices[t * 3 + 1]] * float(size);
+                glm::vec2 c = unwrap.uvs[unwrap.indices[t * 3 + 2]] * float(size);
+                float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+
+                glm::vec3 direct(0.0f), indirect(0.0f);
+                for (int s = 0; s < settings.samples; s++) {
+                    // Punto al azar dentro del texel; si cae fuera del triangulo se usa el centro
+                    glm::vec2 p(float(x) + random.Next(), float(y) + random.Next());
+                    float w1 = ((p.x - a.x) * (c.y - a.y) - (p.y - a.y) * (c.x - a.x)) / area;
+                    float w2 = ((b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x)) / area;
+                    if (w1 < 0.0f || w2 < 0.0f || w1 + w2 > 1.0f) {
+                        p = glm::vec2(float(x) + 0.5f, float(y) + 0.5f);
+                        w1 = glm::clamp(((p.x - a.x) * (c.y - a.y) - (p.y - a.y) * (c.x - a.x)) / area, 0.0f, 1.0f);
+                        w2 = glm::clamp(((b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x)) / area, 0.0f, 1.0f - w1);
+                    }
+                    glm::vec3 position, normal, faceNormal;
+                    scene.Surface(t, w1, w2, position, normal, faceNormal);
+                    glm::vec3 origin = position + faceNormal * scene.epsilon;
+                    direct += scene.SunIrradiance(origin, normal, workerRays);
+                    indirect += scene.Gather(origin, cosineSample(normal, random.Next(), random.Next()), settings.bounces, random, workerRays);
+                }
+                irradiance[texel] = lights.ambient + (direct + indirect) / float(std::max(settings.samples, 1));
+                covered[texel] = 1;
+            }
+        }
+        rays[worker] += workerRays;
+    });
+    double traceSeconds = MillisecondsSince(traceStart) / 1000.0;
+    dilate(irradiance, covered, size, LIGHTMAP_PADDING);
+
+    unsigned long long totalRays = 0;
+    for (unsigned long long count : rays) {
+        totalRays += count;
+    }
+    double raysPerSecond = traceSeconds > 0.0 ? double(totalRays) / traceSeconds : 0.0;
+    std::cout << "[Lightmap] " << settings.samples << " samples x " << settings.bounces << " bounces: " << totalRays << " rays in "
+              << traceSeconds << " s on " << threads << " threads, " << raysPerSecond / 1e6 << " Mrays/s ("
+              << raysPerSecond / 1e6 / threads << " Mrays/s per core)" << std::endl;
+
+    LightmapData data;
+    data.size = uint32_t(size);
+    data.baseVertexCount = view.vertexCount;
+    data.remap = unwrap.remap;
+    data.indices = unwrap.indices;
+    data.uvs.resize(unwrap.uvs.size() * 2);
+    for (size_t i = 0; i < unwrap.uvs.size(); i++) {
+        data.uvs[i * 2] = uint16_t(glm::clamp(unwrap.uvs[i].x, 0.0f, 1.0f) * 65535.0f + 0.5f);
+        data.uvs[i * 2 + 1] = uint16_t(glm::clamp(unwrap.uvs[i].y, 0.0f, 1.0f) * 65535.0f + 0.5f);
+    }
+    data.texels.resize(irradiance.size() * 3);
+    for (size_t i = 0; i < irradiance.size(); i++) {
+        for (int k = 0; k < 3; k++) {
+            data.texels[i * 3 + k] = FloatToHalf(std::min(irradiance[i][k], 65504.0f));
+        }
+    }
+    std::string outputPath = modelPath + ".lightmap";
+    if (!WriteLightmap(outputPath, data, LightmapKey(view))) {
+        std::cout << "ERROR::LIGHTMAP:: could not write " << outputPath << std::endl;
+        return 1;
+    }
+    std::cout << "[Lightmap] Wrote " << outputPath << " (" << MillisecondsSince(start) / 1000.0 << " s total)" << std::endl;
+    return 0;
+}
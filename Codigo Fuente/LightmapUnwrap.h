@@ -0,0 +1,213 @@
+#pragma once
+
+// Segundo juego de UV para mapas de luz. Los triangulos se agrupan en cartas:
+// triangulos vecinos (comparten una arista) cuya normal apunta al mismo eje
+// dominante (+X, -X, +Y, ...). Cada carta se proyecta sobre el plano de ese
+// eje, todas con la misma densidad de texeles por unidad, y se acomodan por
+// estantes en un atlas cuadrado con LIGHTMAP_PADDING texeles de margen.
+// Un vertice que usan varias cartas se duplica: los vertices originales
+// conservan su indice y las copias se agregan al final, asi que los rangos de
+// los LOD (que solo usan vertices originales) siguen siendo validos.
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "MeshCache.h"
+
+const int LIGHTMAP_PADDING = 2;          // texeles libres alrededor de cada carta
+const float LIGHTMAP_FILL_TARGET = 0.7f; // fraccion del atlas que se intenta ocupar
+
+struct LightmapUnwrap
+{
+    int size = 0;                          // lado del atlas en texeles
+    float texelsPerUnit = 0.0f;
+    uint32_t baseVertexCount = 0;          // vertices del modelo original
+    std::vector<uint32_t> remap;           // original de cada vertice agregado (indice - baseVertexCount)
+    std::vector<glm::vec2> uvs;            // por vertice (originales y agregados), en [0, 1]
+    std::vector<uint32_t> indices;         // indices del nivel 0 con las copias ya aplicadas
+    std::vector<uint32_t> chartOfTriangle;
+    uint32_t chartCount = 0;
+};
+
+// Cantidad de indices del nivel 0 (van al principio del buffer de indices)
+inline uint32_t BaseIndexCount(const MeshCacheView& view)
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < view.meshCount; i++) {
+        count = std::max(count, view.meshes[i].firstIndex + view.meshes[i].indexCount);
+    }
+    return count;
+}
+
+namespace LightmapDetail
+{
+    inline uint32_t findRoot(std::vector<uint32_t>& parent, uint32_t i)
+    {
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+
+    // Coordenadas sobre el plano perpendicular al eje dominante
+    inline glm::vec2 project(const glm::vec3& p, int axis)
+    {
+        return axis == 0 ? glm::vec2(p.z, p.y) : axis == 1 ? glm::vec2(p.x, p.z) : glm::vec2(p.x, p.y);
+    }
+
+    struct Chart
+    {
+        int axis;
+        glm::vec2 boundsMin, boundsMax;  // en unidades del modelo
+        int width, height;               // en texeles, con margen
+        int x, y;                        // posicion en el atlas
+    };
+
+    // Acomoda por estantes de mayor a menor altura; false si no caben
+    inline bool pack(std::vector<Chart>& charts, float texelsPerUnit, int size)
+    {
+        std::vector<uint32_t> order(charts.size());
+        for (uint32_t i = 0; i < charts.size(); i++) {
+            Chart& chart = charts[i];
+            glm::vec2 extent = (chart.boundsMax - chart.boundsMin) * texelsPerUnit;
+            chart.width = int(std::ceil(extent.x)) + 1 + 2 * LIGHTMAP_PADDING;
+            chart.height = int(std::ceil(extent.y)) + 1 + 2 * LIGHTMAP_PADDING;
+            if (chart.width > size || chart.height > size) {
+                return false;
+            }
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&charts](uint32_t a, uint32_t b) { return charts[a].height > charts[b].height; });
+        int x = 0, y = 0, shelfHeight = 0;
+        for (uint32_t i : order) {
+            Chart& chart = charts[i];
+            if (x + chart.width > size) {
+                x = 0;
+                y += shelfHeight;
+                shelfHeight = 0;
+            }
+            if (y + chart.height > size) {
+                return false;
+            }
+            chart.x = x;
+            chart.y = y;
+            x += chart.width;
+            shelfHeight = std::max(shelfHeight, chart.height);
+        }
+        return true;
+    }
+}
+
+// Cartas y atlas para los triangulos del nivel 0 de "view"
+inline LightmapUnwrap UnwrapLightmap(const MeshCacheView& view, int size)
+{
+    using namespace LightmapDetail;
+    LightmapUnwrap unwrap;
+    unwrap.size = size;
+    unwrap.baseVertexCount = view.vertexCount;
+    uint32_t indexCount = BaseIndexCount(view);
+    uint32_t triangleCount = indexCount / 3;
+
+    // Eje dominante de cada triangulo (0..5: +X, +Y, +Z, -X, -Y, -Z)
+    std::vector<int> direction(triangleCount);
+    for (uint32_t t = 0; t < triangleCount; t++) {
+        glm::vec3 a = view.vertices[view.indices[t * 3]].Position;
+        glm::vec3 b = view.vertices[view.indices[t * 3 + 1]].Position;
+        glm::vec3 c = view.vertices[view.indices[t * 3 + 2]].Position;
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        if (glm::dot(normal, normal) < 1e-20f) {
+            normal = view.vertices[view.indices[t * 3]].Normal;
+        }
+        glm::vec3 magnitude = glm::abs(normal);
+        int axis = magnitude.x >= magnitude.y && magnitude.x >= magnitude.z ? 0 : magnitude.y >= magnitude.z ? 1 : 2;
+        direction[t] = axis + (normal[axis] < 0.0f ? 3 : 0);
+    }
+
+    // Une triangulos que comparten una arista y la misma direccion
+    std::vector<uint32_t> parent(triangleCount);
+    for (uint32_t t = 0; t < triangleCount; t++) {
+        parent[t] = t;
+    }
+    std::unordered_map<uint64_t, uint32_t> edges;
+    edges.reserve(indexCount);
+    for (uint32_t t = 0; t < triangleCount; t++) {
+        for (int e = 0; e < 3; e++) {
+            uint32_t a = view.indices[t * 3 + e], b = view.indices[t * 3 + (e + 1) % 3];
+            uint64_t key = uint64_t(std::min(a, b)) << 32 | std::max(a, b);
+            auto found = edges.emplace(key, t);
+            if (!found.second && direction[found.first->second] == direction[t]) {
+                parent[findRoot(parent, t)] = findRoot(parent, found.first->second);
+            }
+        }
+    }
+
+    std::vector<Chart> charts;
+    std::unordered_map<uint32_t, uint32_t> chartOfRoot;
+    unwrap.chartOfTriangle.resize(triangleCount);
+    for (uint32_t t = 0; t < triangleCount; t++) {
+        uint32_t root = findRoot(parent, t);
+        auto found = chartOfRoot.emplace(root, uint32_t(charts.size()));
+        if (found.second) {
+            charts.push_back({ direction[t] % 3, glm::vec2(FLT_MAX), glm::vec2(-FLT_MAX), 0, 0, 0, 0 });
+        }
+        uint32_t chart = found.first->second;
+        unwrap.chartOfTriangle[t] = chart;
+        for (int k = 0; k < 3; k++) {
+            glm::vec2 p = project(view.vertices[view.indices[t * 3 + k]].Position, charts[chart].axis);
+            charts[chart].boundsMin = glm::min(charts[chart].boundsMin, p);
+            charts[chart].boundsMax = glm::max(charts[chart].boundsMax, p);
+        }
+    }
+    unwrap.chartCount = uint32_t(charts.size());
+
+    // Densidad inicial por area de las cartas; se baja hasta que todo cabe
+    double chartArea = 0.0;
+    for (const Chart& chart : charts) {
+        glm::vec2 extent = chart.boundsMax - chart.boundsMin;
+        chartArea += double(extent.x) * extent.y;
+    }
+    float texelsPerUnit = chartArea > 0.0 ? float(std::sqrt(double(size) * size * LIGHTMAP_FILL_TARGET / chartArea)) : 1.0f;
+    while (!pack(charts, texelsPerUnit, size) && texelsPerUnit > 1e-4f) {
+        texelsPerUnit *= 0.9f;
+    }
+    unwrap.texelsPerUnit = texelsPerUnit;
+
+    // Un vertice por (vertice original, carta); el primero conserva su indice
+    unwrap.uvs.assign(view.vertexCount, glm::vec2(0.0f));
+    std::vector<uint32_t> firstChart(view.vertexCount, UINT32_MAX);
+    std::unordered_map<uint64_t, uint32_t> copies;
+    unwrap.indices.resize(indexCount);
+    for (uint32_t t = 0; t < triangleCount; t++) {
+        uint32_t chartIndex = unwrap.chartOfTriangle[t];
+        const Chart& chart = charts[chartIndex];
+        for (int k = 0; k < 3; k++) {
+            uint32_t vertex = view.indices[t * 3 + k];
+            glm::vec2 texel = (project(view.vertices[vertex].Position, chart.axis) - chart.boundsMin) * texelsPerUnit
+                              + glm::vec2(float(chart.x + LIGHTMAP_PADDING) + 0.5f, float(chart.y + LIGHTMAP_PADDING) + 0.5f);
+            glm::vec2 uv = texel / float(size);
+            uint32_t index = vertex;
+            if (firstChart[vertex] == UINT32_MAX) {
+                firstChart[vertex] = chartIndex;
+                unwrap.uvs[vertex] = uv;
+            }
+            else if (firstChart[vertex] != chartIndex) {
+                uint64_t key = uint64_t(vertex) << 32 | chartIndex;
+                auto found = copies.emplace(key, uint32_t(unwrap.uvs.size()));
+                if (found.second) {
+                    unwrap.remap.push_back(vertex);
+                    unwrap.uvs.push_back(uv);
+                }
+                index = found.first->second;
+            }
+            unwrap.indices[t * 3 + k] = index;
+        }
+    }
+    return unwrap;
+}
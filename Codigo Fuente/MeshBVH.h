@@ -0,0 +1,240 @@
+#pragma once
+
+// Jerarquia de volumenes (BVH) sobre las cajas de las submallas de un modelo
+// y prueba contra el frustum de la camara. Los subarboles fuera del frustum
+// se descartan sin revisar sus submallas, y los que quedan completamente
+// dentro marcan todas sus submallas sin mas pruebas.
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "MeshCache.h"
+
+const uint32_t BVH_LEAF_MESHES = 4;
+
+// Seis planos (a, b, c, d) con la normal hacia adentro, extraidos de una
+// matriz proyeccion * vista (* modelo) al estilo Gribb-Hartmann
+struct Frustum
+{
+    glm::vec4 planes[6];
+
+    explicit Frustum(const glm::mat4& clip)
+    {
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++) {
+            rows[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+        }
+        for (int i = 0; i < 3; i++) {
+            this->planes[i * 2] = rows[3] + rows[i];
+            this->planes[i * 2 + 1] = rows[3] - rows[i];
+        }
+    }
+};
+
+enum CullResult
+{
+    CULL_OUTSIDE,
+    CULL_INTERSECTS,
+    CULL_INSIDE
+};
+
+inline CullResult TestBox(const Frustum& frustum, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    CullResult result = CULL_INSIDE;
+    for (const glm::vec4& plane : frustum.planes) {
+        // Vertice de la caja mas adentro y mas afuera respecto al plano
+        glm::vec3 positive(plane.x >= 0.0f ? boundsMax.x : boundsMin.x,
+                           plane.y >= 0.0f ? boundsMax.y : boundsMin.y,
+                           plane.z >= 0.0f ? boundsMax.z : boundsMin.z);
+        glm::vec3 negative(plane.x >= 0.0f ? boundsMin.x : boundsMax.x,
+                           plane.y >= 0.0f ? boundsMin.y : boundsMax.y,
+                           plane.z >= 0.0f ? boundsMin.z : boundsMax.z);
+        if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f) {
+            return CULL_OUTSIDE;
+        }
+        if (glm::dot(glm::vec3(plane), negative) + plane.w < 0.0f) {
+            result = CULL_INTERSECTS;
+        }
+    }
+    return result;
+}
+
+// Contadores de submallas y triangulos descartados, acumulados por fotograma
+struct CullingCounters
+{
+    unsigned int meshes = 0;
+    unsigned int culledMeshes = 0;
+    unsigned long long triangles = 0;
+    unsigned long long culledTriangles = 0;
+    unsigned int nodesVisited = 0;
+    unsigned long long lodSavedTriangles = 0;  // triangulos que se ahorraron usando un LOD
+
+    CullingCounters& operator+=(const CullingCounters& other)
+    {
+        this->meshes += other.meshes;
+        this->culledMeshes += other.culledMeshes;
+        this->triangles += other.triangles;
+        this->culledTriangles += other.culledTriangles;
+        this->nodesVisited += other.nodesVisited;
+        this->lodSavedTriangles += other.lodSavedTriangles;
+        return *this;
+    }
+};
+
+struct CullingReport
+{
+    CullingCounters frame;        // fotograma actual
+    CullingCounters lastFrame;    // fotograma anterior completo
+    CullingCounters accumulated;
+    unsigned int frames = 0;
+    double lastReport = 0.0;
+
+    // Cierra el fotograma; cada "interval" segundos imprime el promedio
+    void EndFrame(double now, double interval = 2.0)
+    {
+        this->lastFrame = this->frame;
+        this->accumulated += this->frame;
+        this->frames++;
+        this->frame = CullingCounters();
+        if (now - this->lastReport >= interval && this->frames > 0) {
+            const CullingCounters& total = this->accumulated;
+            std::cout << "[Culling] " << double(total.culledMeshes) / this->frames << " of " << double(total.meshes) / this->frames
+                      << " meshes and " << double(total.culledTriangles) / this->frames << " of " << double(total.triangles) / this->frames
+                      << " triangles culled/frame (" << double(total.nodesVisited) / this->frames << " BVH nodes visited), "
+                      << double(total.lodSavedTriangles) / this->frames << " triangles saved by LOD" << std::endl;
+            this->accumulated = CullingCounters();
+            this->frames = 0;
+            this->lastReport = now;
+        }
+    }
+};
+
+inline CullingReport& CullingStats()
+{
+    static CullingReport stats;
+    return stats;
+}
+
+class MeshBVH
+{
+public:
+    // Nodo hoja si count > 0: submallas order[first .. first + count)
+    struct Node
+    {
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+        uint32_t first;   // hoja: inicio en order; interno: hijo izquierdo
+        uint32_t count;   // hoja: numero de submallas; interno: 0
+    };
+
+    void Build(const std::vector<CacheMesh>& meshes)
+    {
+        this->nodes.clear();
+        this->order.resize(meshes.size());
+        for (uint32_t i = 0; i < meshes.size(); i++) {
+            this->order[i] = i;
+        }
+        if (!meshes.empty()) {
+            this->nodes.reserve(meshes.size() * 2);
+            this->nodes.push_back(Node());
+            this->buildNode(meshes, 0, 0, uint32_t(meshes.size()));
+        }
+    }
+
+    // Marca visible[i] para cada submalla dentro (o cruzando) el frustum
+    void Cull(const Frustum& frustum, const std::vector<CacheMesh>& meshes, std::vector<uint8_t>& visible, CullingCounters& counters) const
+    {
+        visible.assign(meshes.size(), 0);
+        if (this->nodes.empty()) {
+            return;
+        }
+        uint32_t stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node& node = this->nodes[stack[--top]];
+            counters.nodesVisited++;
+            CullResult result = TestBox(frustum, node.boundsMin, node.boundsMax);
+            if (result == CULL_OUTSIDE) {
+                continue;
+            }
+            if (result == CULL_INSIDE) {
+                this->markSubtree(uint32_t(&node - this->nodes.data()), visible);
+                continue;
+            }
+            if (node.count > 0) {
+                for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                    const CacheMesh& mesh = meshes[this->order[i]];
+                    if (TestBox(frustum, mesh.boundsMin, mesh.boundsMax) != CULL_OUTSIDE) {
+                        visible[this->order[i]] = 1;
+                    }
+                }
+                continue;
+            }
+            stack[top++] = node.first;
+            stack[top++] = node.first + 1;
+        }
+    }
+
+    size_t NodeCount() const { return this->nodes.size(); }
+
+private:
+    std::vector<Node> nodes;
+    std::vector<uint32_t> order;
+
+    // Division por la mediana de los centros en el eje mas largo; los dos
+    // hijos se guardan juntos para que baste un indice por nodo interno
+    void buildNode(const std::vector<CacheMesh>& meshes, uint32_t index, uint32_t first, uint32_t count)
+    {
+        glm::vec3 boundsMin(1e30f), boundsMax(-1e30f), centerMin(1e30f), centerMax(-1e30f);
+        for (uint32_t i = first; i < first + count; i++) {
+            const CacheMesh& mesh = meshes[this->order[i]];
+            boundsMin = glm::min(boundsMin, mesh.boundsMin);
+            boundsMax = glm::max(boundsMax, mesh.boundsMax);
+            glm::vec3 center = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+            centerMin = glm::min(centerMin, center);
+            centerMax = glm::max(centerMax, center);
+        }
+        this->nodes[index].boundsMin = boundsMin;
+        this->nodes[index].boundsMax = boundsMax;
+
+        glm::vec3 extent = centerMax - centerMin;
+        if (count <= BVH_LEAF_MESHES || (extent.x <= 0.0f && extent.y <= 0.0f && extent.z <= 0.0f)) {
+            this->nodes[index].first = first;
+            this->nodes[index].count = count;
+            return;
+        }
+
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        uint32_t half = count / 2;
+        std::nth_element(this->order.begin() + first, this->order.begin() + first + half, this->order.begin() + first + count,
+                         [&meshes, axis](uint32_t a, uint32_t b) {
+                             return meshes[a].boundsMin[axis] + meshes[a].boundsMax[axis] < meshes[b].boundsMin[axis] + meshes[b].boundsMax[axis];
+                         });
+
+        uint32_t left = uint32_t(this->nodes.size());
+        this->nodes.push_back(Node());
+        this->nodes.push_back(Node());
+        this->nodes[index].first = left;
+        this->nodes[index].count = 0;
+        this->buildNode(meshes, left, first, half);
+        this->buildNode(meshes, left + 1, first + half, count - half);
+    }
+
+    void markSubtree(uint32_t index, std::vector<uint8_t>& visible) const
+    {
+        const Node& node = this->nodes[index];
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                visible[this->order[i]] = 1;
+            }
+            return;
+        }
+        this->markSubtree(node.first, visible);
+        this->markSubtree(node.first + 1, visible);
+    }
+};
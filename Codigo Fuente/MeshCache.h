@@ -0,0 +1,815 @@
+#pragma once
+
+// Cache binario de mallas. La primera vez que se carga un OBJ se importa con
+// Assimp y se escribe "<archivo>.meshcache" junto al original con los buffers
+// de vertices/indices ya intercalados, los rangos de cada submalla, sus
+// materiales y sus cajas envolventes. Las siguientes ejecuciones mapean ese
+// archivo en memoria y lo suben directo a los VBO sin parsear nada.
+// El cache se invalida solo: guarda el hash del contenido del OBJ y sus MTL.
+// Al cocinar los vertices se sueldan y los buffers se reordenan para la cache
+// de vertices (MeshOptimize.h), y se generan MESH_LOD_LEVELS niveles de
+// detalle por submalla (MeshSimplify.h), guardados como rangos extra de indices.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "ContentHash.h"
+#include "MeshOptimize.h"
+#include "MeshSimplify.h"
+#include "ThreadPool.h"
+
+// Incrementar cada vez que cambie el formato del archivo
+const uint32_t MESH_CACHE_VERSION = 5;
+const char MESH_CACHE_MAGIC[4] = { 'M', 'S', 'H', 'C' };
+
+// Vertice intercalado con el mismo layout que lighting.vs (location 0/1/2)
+struct CacheVertex
+{
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+};
+
+// Submalla: rango dentro del buffer de indices del modelo (los indices son
+// absolutos respecto al buffer de vertices compartido)
+struct CacheMesh
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t material;
+    uint32_t vertexCount;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+};
+
+// Lote estatico: submallas contiguas que comparten el mismo juego de texturas
+// y se dibujan con una sola llamada (sus indices quedan seguidos en el buffer)
+struct CacheBatch
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t firstMesh;
+    uint32_t meshCount;
+    uint32_t material;  // material representativo (mismas texturas que el resto del lote)
+    uint32_t pad;
+};
+
+// Nivel de detalle de una submalla; el nivel 0 es la submalla original.
+// Estan ordenados por nivel: lods[level * meshCount + mesh], y los indices de
+// cada nivel quedan despues de todos los del nivel anterior, asi que submallas
+// seguidas en un lote con el mismo nivel siguen siendo contiguas
+struct CacheLod
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;  // desviacion geometrica respecto al original (unidades del modelo)
+    uint32_t pad;
+};
+
+const uint32_t MESH_LOD_LEVELS = 4;
+const float MESH_LOD_RATIO = 0.5f;  // cada nivel intenta quedarse con la mitad de triangulos
+
+// Material con rutas de textura relativas al directorio del modelo
+struct CacheMaterial
+{
+    char name[64];
+    char diffuse[128];
+    char specular[128];
+};
+
+enum MeshCacheSectionId
+{
+    CACHE_SECTION_VERTICES = 1,
+    CACHE_SECTION_INDICES = 2,
+    CACHE_SECTION_MESHES = 3,
+    CACHE_SECTION_MATERIALS = 4,
+    CACHE_SECTION_BATCHES = 5,
+    CACHE_SECTION_LODS = 6
+};
+
+struct CacheSection
+{
+    uint32_t id;
+    uint32_t count;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct MeshCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    float importMilliseconds;  // lo que tardo la importacion con Assimp
+    float cookMilliseconds;    // optimizacion, lotes y LODs despues de importar
+    uint32_t sectionCount;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+};
+
+// Datos de un modelo en memoria (resultado de la importacion con Assimp)
+struct ModelData
+{
+    std::vector<CacheVertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<CacheMesh> meshes;
+    std::vector<CacheMaterial> materials;
+    std::vector<CacheBatch> batches;
+    std::vector<CacheLod> lods;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+};
+
+// Vista de solo lectura sobre los datos, ya sea del archivo mapeado o de un ModelData
+struct MeshCacheView
+{
+    const CacheVertex* vertices = nullptr;
+    uint32_t vertexCount = 0;
+    const uint32_t* indices = nullptr;
+    uint32_t indexCount = 0;
+    const CacheMesh* meshes = nullptr;
+    uint32_t meshCount = 0;
+    const CacheMaterial* materials = nullptr;
+    uint32_t materialCount = 0;
+    const CacheBatch* batches = nullptr;
+    uint32_t batchCount = 0;
+    const CacheLod* lods = nullptr;
+    uint32_t lodCount = 0;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+};
+
+// Archivo mapeado en memoria de solo lectura
+class MappedFile
+{
+public:
+    MappedFile() { }
+    ~MappedFile() { this->Close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const std::string& path)
+    {
+        this->Close();
+#ifdef _WIN32
+        this->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (this->file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(this->file, &fileSize) || fileSize.QuadPart == 0) {
+            this->Close();
+            return false;
+        }
+        this->mapping = CreateFileMappingA(this->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (this->mapping == nullptr) {
+            this->Close();
+            return false;
+        }
+        this->data = static_cast<const unsigned char*>(MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0));
+        this->size = size_t(fileSize.QuadPart);
+#else
+        this->fd = open(path.c_str(), O_RDONLY);
+        if (this->fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(this->fd, &info) != 0 || info.st_size == 0) {
+            this->Close();
+            return false;
+        }
+        void* address = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, this->fd, 0);
+        this->data = (address == MAP_FAILED) ? nullptr : static_cast<const unsigned char*>(address);
+        this->size = size_t(info.st_size);
+#endif
+        if (this->data == nullptr) {
+            this->Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close()
+    {
+#ifdef _WIN32
+        if (this->data != nullptr) {
+            UnmapViewOfFile(this->data);
+        }
+        if (this->mapping != nullptr) {
+            CloseHandle(this->mapping);
+        }
+        if (this->file != INVALID_HANDLE_VALUE) {
+            CloseHandle(this->file);
+        }
+        this->mapping = nullptr;
+        this->file = INVALID_HANDLE_VALUE;
+#else
+        if (this->data != nullptr) {
+            munmap(const_cast<unsigned char*>(this->data), this->size);
+        }
+        if (this->fd >= 0) {
+            close(this->fd);
+        }
+        this->fd = -1;
+#endif
+        this->data = nullptr;
+        this->size = 0;
+    }
+
+    const unsigned char* Data() const { return this->data; }
+    size_t Size() const { return this->size; }
+
+private:
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+inline double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline void CopyCacheString(char* destination, size_t capacity, const char* source)
+{
+    std::strncpy(destination, source, capacity - 1);
+    destination[capacity - 1] = '\0';
+}
+
+inline glm::mat4 AiToGlm(const aiMatrix4x4& m)
+{
+    // Assimp guarda por filas y GLM por columnas
+    return glm::mat4(glm::vec4(m.a1, m.b1, m.c1, m.d1),
+                     glm::vec4(m.a2, m.b2, m.c2, m.d2),
+                     glm::vec4(m.a3, m.b3, m.c3, m.d3),
+                     glm::vec4(m.a4, m.b4, m.c4, m.d4));
+}
+
+// Directorio de un archivo; acepta separadores de Windows y rutas sin directorio
+inline std::string DirectoryOf(const std::string& path)
+{
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+}
+
+// Hash del OBJ mas todas las bibliotecas de materiales (mtllib) que referencia
+inline uint64_t HashModelSource(const std::string& path)
+{
+    std::vector<unsigned char> bytes;
+    if (!ReadFileBytes(path, bytes)) {
+        return 0;
+    }
+    uint64_t hash = HashBytes(bytes.data(), bytes.size());
+
+    std::string directory = DirectoryOf(path);
+    const char* text = reinterpret_cast<const char*>(bytes.data());
+    size_t length = bytes.size();
+    for (size_t i = 0; i + 7 < length; i++) {
+        if ((i == 0 || text[i - 1] == '\n') && std::strncmp(text + i, "mtllib ", 7) == 0) {
+            size_t end = i + 7;
+            while (end < length && text[end] != '\n' && text[end] != '\r') {
+                end++;
+            }
+            std::string library(text + i + 7, end - i - 7);
+            hash = HashFile(directory + "/" + library, hash);
+            i = end;
+        }
+    }
+    return hash;
+}
+
+// Recorre los nodos de Assimp y acumula sus transformaciones en los vertices
+inline void CookNode(aiNode* node, const aiScene* scene, const glm::mat4& parent, ModelData& out)
+{
+    glm::mat4 transform = parent * AiToGlm(node->mTransformation);
+    glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+
+    for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+        aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+        CacheMesh entry;
+        entry.firstIndex = uint32_t(out.indices.size());
+        entry.material = mesh->mMaterialIndex;
+        entry.vertexCount = mesh->mNumVertices;
+        entry.boundsMin = glm::vec3(1e30f);
+        entry.boundsMax = glm::vec3(-1e30f);
+
+        uint32_t baseVertex = uint32_t(out.vertices.size());
+        for (unsigned int v = 0; v < mesh->mNumVertices; v++) {
+            CacheVertex vertex;
+            glm::vec4 position = transform * glm::vec4(mesh->mVertices[v].x, mesh->mVertices[v].y, mesh->mVertices[v].z, 1.0f);
+            vertex.Position = glm::vec3(position);
+            vertex.Normal = glm::vec3(0.0f);
+            if (mesh->mNormals != nullptr) {
+                vertex.Normal = normalMatrix * glm::vec3(mesh->mNormals[v].x, mesh->mNormals[v].y, mesh->mNormals[v].z);
+            }
+            vertex.TexCoords = glm::vec2(0.0f);
+            if (mesh->mTextureCoords[0] != nullptr) {
+                vertex.TexCoords = glm::vec2(mesh->mTextureCoords[0][v].x, mesh->mTextureCoords[0][v].y);
+            }
+            entry.boundsMin = glm::min(entry.boundsMin, vertex.Position);
+            entry.boundsMax = glm::max(entry.boundsMax, vertex.Position);
+            out.vertices.push_back(vertex);
+        }
+
+        for (unsigned int f = 0; f < mesh->mNumFaces; f++) {
+            const aiFace& face = mesh->mFaces[f];
+            // Triangulate deja solo triangulos; se descartan puntos y lineas
+            if (face.mNumIndices != 3) {
+                continue;
+            }
+            for (unsigned int k = 0; k < 3; k++) {
+                out.indices.push_back(baseVertex + face.mIndices[k]);
+            }
+        }
+        entry.indexCount = uint32_t(out.indices.size()) - entry.firstIndex;
+        if (entry.indexCount > 0) {
+            out.meshes.push_back(entry);
+        }
+    }
+
+    for (unsigned int i = 0; i < node->mNumChildren; i++) {
+        CookNode(node->mChildren[i], scene, transform, out);
+    }
+}
+
+// Importa el modelo con Assimp (mismas opciones que Model) y lo aplana en ModelData
+inline bool CookModel(const std::string& path, ModelData& out)
+{
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+        std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+        return false;
+    }
+
+    out = ModelData();
+    for (unsigned int i = 0; i < scene->mNumMaterials; i++) {
+        aiMaterial* material = scene->mMaterials[i];
+        CacheMaterial entry = {};
+        aiString value;
+        if (material->Get(AI_MATKEY_NAME, value) == aiReturn_SUCCESS) {
+            CopyCacheString(entry.name, sizeof(entry.name), value.C_Str());
+        }
+        if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0 && material->GetTexture(aiTextureType_DIFFUSE, 0, &value) == aiReturn_SUCCESS) {
+            CopyCacheString(entry.diffuse, sizeof(entry.diffuse), value.C_Str());
+        }
+        if (material->GetTextureCount(aiTextureType_SPECULAR) > 0 && material->GetTexture(aiTextureType_SPECULAR, 0, &value) == aiReturn_SUCCESS) {
+            CopyCacheString(entry.specular, sizeof(entry.specular), value.C_Str());
+        }
+        out.materials.push_back(entry);
+    }
+
+    CookNode(scene->mRootNode, scene, glm::mat4(1.0f), out);
+
+    out.boundsMin = glm::vec3(1e30f);
+    out.boundsMax = glm::vec3(-1e30f);
+    for (const CacheMesh& mesh : out.meshes) {
+        out.boundsMin = glm::min(out.boundsMin, mesh.boundsMin);
+        out.boundsMax = glm::max(out.boundsMax, mesh.boundsMax);
+    }
+    return !out.meshes.empty();
+}
+
+// Agrupa las submallas por juego de texturas (difusa + especular). Las
+// submallas ya estan en espacio del modelo, asi que basta con reordenarlas
+// para que cada grupo quede contiguo en el buffer de indices.
+inline void BuildStaticBatches(ModelData& data)
+{
+    std::vector<std::string> keys;
+    for (const CacheMesh& mesh : data.meshes) {
+        const CacheMaterial& material = data.materials[mesh.material];
+        keys.push_back(std::string(material.diffuse) + "|" + material.specular);
+    }
+
+    std::vector<uint32_t> order(data.meshes.size());
+    for (uint32_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+
+    std::vector<CacheMesh> meshes;
+    std::vector<uint32_t> indices;
+    meshes.reserve(data.meshes.size());
+    indices.reserve(data.indices.size());
+    data.batches.clear();
+    for (uint32_t i = 0; i < order.size(); i++) {
+        CacheMesh mesh = data.meshes[order[i]];
+        if (i == 0 || keys[order[i]] != keys[order[i - 1]]) {
+            CacheBatch batch;
+            batch.firstIndex = uint32_t(indices.size());
+            batch.indexCount = 0;
+            batch.firstMesh = i;
+            batch.meshCount = 0;
+            batch.material = mesh.material;
+            batch.pad = 0;
+            data.batches.push_back(batch);
+        }
+        indices.insert(indices.end(), data.indices.begin() + mesh.firstIndex, data.indices.begin() + mesh.firstIndex + mesh.indexCount);
+        mesh.firstIndex = uint32_t(indices.size()) - mesh.indexCount;
+        data.batches.back().indexCount += mesh.indexCount;
+        data.batches.back().meshCount++;
+        meshes.push_back(mesh);
+    }
+    data.meshes.swap(meshes);
+    data.indices.swap(indices);
+}
+
+// Resultado de OptimizeModel: metricas con los datos tal como salen de
+// Assimp, ya soldados, y al final del proceso
+struct MeshOptimizeReport
+{
+    uint32_t rawVertices = 0, weldedVertices = 0, finalVertices = 0;
+    VertexCacheStats raw, welded, optimized;
+    double milliseconds = 0.0;
+
+    void Print(const std::string& path) const
+    {
+        std::cout << "[MeshOptimize] " << path << ": " << this->rawVertices << " -> " << this->finalVertices << " vertices, ACMR "
+                  << this->raw.acmr << " / " << this->welded.acmr << " / " << this->optimized.acmr << ", ATVR "
+                  << this->raw.atvr << " / " << this->welded.atvr << " / " << this->optimized.atvr
+                  << " (raw / welded / optimized) in " << this->milliseconds << " ms" << std::endl;
+    }
+};
+
+// Suelda los vertices y ordena los triangulos de cada submalla para la cache
+// de vertices y el overdraw. Se llama antes de BuildStaticBatches (que solo
+// mueve submallas enteras); OptimizeModelFetch va despues
+inline void OptimizeModel(ModelData& data, MeshOptimizeReport& report)
+{
+    auto start = std::chrono::steady_clock::now();
+    report.rawVertices = uint32_t(data.vertices.size());
+    report.raw = AnalyzeVertexCache(data.indices.data(), data.indices.size());
+
+    std::vector<uint32_t> remap;
+    uint32_t count = WeldVertexBytes(data.vertices.data(), data.vertices.size(), sizeof(CacheVertex), remap);
+    std::vector<CacheVertex> welded(count);
+    for (size_t i = 0; i < data.vertices.size(); i++) {
+        welded[remap[i]] = data.vertices[i];
+    }
+    data.vertices.swap(welded);
+    for (uint32_t& index : data.indices) {
+        index = remap[index];
+    }
+    report.weldedVertices = count;
+    report.welded = AnalyzeVertexCache(data.indices.data(), data.indices.size());
+
+    ParallelFor(data.meshes.size(), std::max(1u, std::thread::hardware_concurrency()), [&data](size_t begin, size_t end, unsigned int) {
+        for (size_t m = begin; m < end; m++) {
+            CacheMesh& mesh = data.meshes[m];
+            uint32_t* indices = data.indices.data() + mesh.firstIndex;
+            OptimizeVertexCache(indices, mesh.indexCount);
+            OptimizeOverdraw(data.vertices.data(), indices, mesh.indexCount);
+            std::vector<uint32_t> unique(indices, indices + mesh.indexCount);
+            std::sort(unique.begin(), unique.end());
+            mesh.vertexCount = uint32_t(std::unique(unique.begin(), unique.end()) - unique.begin());
+        }
+    });
+    report.milliseconds = MillisecondsSince(start);
+}
+
+// Ultimo paso: los vertices quedan en el orden en que los pide el buffer final
+inline void OptimizeModelFetch(ModelData& data, MeshOptimizeReport& report)
+{
+    auto start = std::chrono::steady_clock::now();
+    report.finalVertices = OptimizeVertexFetch(data.vertices, data.indices.data(), data.indices.size());
+    report.optimized = AnalyzeVertexCache(data.indices.data(), data.indices.size());
+    report.milliseconds += MillisecondsSince(start);
+}
+
+// --analyze-meshes: importa el OBJ, lo optimiza e imprime las metricas sin
+// tocar el cache ni OpenGL
+inline bool AnalyzeModel(const std::string& path)
+{
+    ModelData data;
+    if (!CookModel(path, data)) {
+        return false;
+    }
+    MeshOptimizeReport report;
+    OptimizeModel(data, report);
+    BuildStaticBatches(data);
+    OptimizeModelFetch(data, report);
+    report.Print(path);
+    return true;
+}
+
+// Genera los LOD de cada submalla en paralelo y agrega sus indices al final
+inline void BuildMeshLods(ModelData& data)
+{
+    uint32_t meshCount = uint32_t(data.meshes.size());
+    std::vector<std::vector<std::vector<uint32_t>>> levels(meshCount);
+    std::vector<std::vector<float>> errors(meshCount);
+    ParallelFor(meshCount, std::max(1u, std::thread::hardware_concurrency()), [&](size_t begin, size_t end, unsigned int) {
+        for (size_t m = begin; m < end; m++) {
+            const CacheMesh& mesh = data.meshes[m];
+            std::vector<uint32_t> targets;
+            float triangles = float(mesh.indexCount / 3);
+            for (uint32_t level = 1; level < MESH_LOD_LEVELS; level++) {
+                triangles *= MESH_LOD_RATIO;
+                targets.push_back(uint32_t(triangles));
+            }
+            SimplifyMesh(data.vertices.data(), data.indices.data() + mesh.firstIndex, mesh.indexCount, targets, levels[m], errors[m]);
+            for (std::vector<uint32_t>& level : levels[m]) {
+                OptimizeVertexCache(level.data(), level.size());
+            }
+        }
+    });
+
+    data.lods.clear();
+    for (uint32_t m = 0; m < meshCount; m++) {
+        data.lods.push_back({ data.meshes[m].firstIndex, data.meshes[m].indexCount, 0.0f, 0 });
+    }
+    for (uint32_t level = 1; level < MESH_LOD_LEVELS; level++) {
+        for (uint32_t m = 0; m < meshCount; m++) {
+            const std::vector<uint32_t>& indices = levels[m][level - 1];
+            data.lods.push_back({ uint32_t(data.indices.size()), uint32_t(indices.size()), errors[m][level - 1], 0 });
+            data.indices.insert(data.indices.end(), indices.begin(), indices.end());
+        }
+    }
+}
+
+inline MeshCacheView ViewOf(const ModelData& data)
+{
+    MeshCacheView view;
+    view.vertices = data.vertices.data();
+    view.vertexCount = uint32_t(data.vertices.size());
+    view.indices = data.indices.data();
+    view.indexCount = uint32_t(data.indices.size());
+    view.meshes = data.meshes.data();
+    view.meshCount = uint32_t(data.meshes.size());
+    view.materials = data.materials.data();
+    view.materialCount = uint32_t(data.materials.size());
+    view.batches = data.batches.data();
+    view.batchCount = uint32_t(data.batches.size());
+    view.lods = data.lods.data();
+    view.lodCount = uint32_t(data.lods.size());
+    view.boundsMin = data.boundsMin;
+    view.boundsMax = data.boundsMax;
+    return view;
+}
+
+// Escribe el cache en un archivo temporal y lo renombra al final para que una
+// escritura interrumpida nunca deje un cache a medias
+inline bool WriteMeshCache(const std::string& cachePath, const ModelData& data, uint64_t sourceHash, float importMilliseconds, float cookMilliseconds)
+{
+    struct Chunk { uint32_t id; uint32_t count; const void* bytes; uint64_t size; };
+    std::vector<Chunk> chunks = {
+        { CACHE_SECTION_VERTICES, uint32_t(data.vertices.size()), data.vertices.data(), data.vertices.size() * sizeof(CacheVertex) },
+        { CACHE_SECTION_INDICES, uint32_t(data.indices.size()), data.indices.data(), data.indices.size() * sizeof(uint32_t) },
+        { CACHE_SECTION_MESHES, uint32_t(data.meshes.size()), data.meshes.data(), data.meshes.size() * sizeof(CacheMesh) },
+        { CACHE_SECTION_MATERIALS, uint32_t(data.materials.size()), data.materials.data(), data.materials.size() * sizeof(CacheMaterial) },
+        { CACHE_SECTION_BATCHES, uint32_t(data.batches.size()), data.batches.data(), data.batches.size() * sizeof(CacheBatch) },
+        { CACHE_SECTION_LODS, uint32_t(data.lods.size()), data.lods.data(), data.lods.size() * sizeof(CacheLod) }
+    };
+
+    MeshCacheHeader header = {};
+    std::memcpy(header.magic, MESH_CACHE_MAGIC, 4);
+    header.version = MESH_CACHE_VERSION;
+    header.sourceHash = sourceHash;
+    header.importMilliseconds = importMilliseconds;
+    header.cookMilliseconds = cookMilliseconds;
+    header.sectionCount = uint32_t(chunks.size());
+    header.boundsMin = data.boundsMin;
+    header.boundsMax = data.boundsMax;
+
+    // Cada seccion empieza alineada a 16 bytes para poder leerla directo del mapeo
+    std::vector<CacheSection> sections;
+    uint64_t offset = sizeof(MeshCacheHeader) + chunks.size() * sizeof(CacheSection);
+    for (const Chunk& chunk : chunks) {
+        offset = (offset + 15) & ~uint64_t(15);
+        sections.push_back({ chunk.id, chunk.count, offset, chunk.size });
+        offset += chunk.size;
+    }
+
+    std::string temporaryPath = cachePath + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(sections.data()), sections.size() * sizeof(CacheSection));
+        uint64_t written = sizeof(MeshCacheHeader) + sections.size() * sizeof(CacheSection);
+        static const char padding[16] = { 0 };
+        for (size_t i = 0; i < chunks.size(); i++) {
+            file.write(padding, std::streamsize(sections[i].offset - written));
+            file.write(static_cast<const char*>(chunks[i].bytes), std::streamsize(chunks[i].size));
+            written = sections[i].offset + chunks[i].size;
+        }
+        if (!file) {
+            return false;
+        }
+    }
+    std::remove(cachePath.c_str());
+    return std::rename(temporaryPath.c_str(), cachePath.c_str()) == 0;
+}
+
+// Un rango [first, first + count) dentro de un arreglo de total elementos
+inline bool RangeInside(uint32_t first, uint32_t count, uint32_t total)
+{
+    return first <= total && count <= total - first;
+}
+
+// Un archivo corrupto o truncado no debe llegar a glDrawElements: cada seccion
+// tiene que caber en los bytes que declara, los indices tienen que apuntar a
+// vertices existentes y los rangos de submallas, lotes y LODs tienen que caer
+// dentro del buffer de indices
+inline bool ValidateMeshCacheView(const CacheSection* sections, uint32_t sectionCount, const MeshCacheView& view)
+{
+    for (uint32_t i = 0; i < sectionCount; i++) {
+        size_t elementSize = 0;
+        switch (sections[i].id) {
+        case CACHE_SECTION_VERTICES: elementSize = sizeof(CacheVertex); break;
+        case CACHE_SECTION_INDICES: elementSize = sizeof(uint32_t); break;
+        case CACHE_SECTION_MESHES: elementSize = sizeof(CacheMesh); break;
+        case CACHE_SECTION_MATERIALS: elementSize = sizeof(CacheMaterial); break;
+        case CACHE_SECTION_BATCHES: elementSize = sizeof(CacheBatch); break;
+        case CACHE_SECTION_LODS: elementSize = sizeof(CacheLod); break;
+        default: break;
+        }
+        if (uint64_t(sections[i].count) * elementSize > sections[i].size) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < view.indexCount; i++) {
+        if (view.indices[i] >= view.vertexCount) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < view.meshCount; i++) {
+        const CacheMesh& mesh = view.meshes[i];
+        if (!RangeInside(mesh.firstIndex, mesh.indexCount, view.indexCount) || mesh.material >= view.materialCount) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < view.batchCount; i++) {
+        const CacheBatch& batch = view.batches[i];
+        if (!RangeInside(batch.firstIndex, batch.indexCount, view.indexCount) || !RangeInside(batch.firstMesh, batch.meshCount, view.meshCount)
+            || batch.material >= view.materialCount) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < view.lodCount; i++) {
+        if (!RangeInside(view.lods[i].firstIndex, view.lods[i].indexCount, view.indexCount)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Valida el archivo mapeado y llena la vista; false si es de otra version o de otro OBJ
+inline bool ReadMeshCache(const MappedFile& file, uint64_t sourceHash, MeshCacheView& view, float& importMilliseconds, float& cookMilliseconds)
+{
+    if (file.Size() < sizeof(MeshCacheHeader)) {
+        return false;
+    }
+    const MeshCacheHeader* header = reinterpret_cast<const MeshCacheHeader*>(file.Data());
+    if (std::memcmp(header->magic, MESH_CACHE_MAGIC, 4) != 0 || header->version != MESH_CACHE_VERSION || header->sourceHash != sourceHash) {
+        return false;
+    }
+    if (file.Size() < sizeof(MeshCacheHeader) + header->sectionCount * sizeof(CacheSection)) {
+        return false;
+    }
+
+    view = MeshCacheView();
+    const CacheSection* sections = reinterpret_cast<const CacheSection*>(file.Data() + sizeof(MeshCacheHeader));
+    for (uint32_t i = 0; i < header->sectionCount; i++) {
+        const CacheSection& section = sections[i];
+        if (section.offset > file.Size() || section.size > file.Size() - section.offset) {
+            return false;
+        }
+        const void* bytes = file.Data() + section.offset;
+        switch (section.id) {
+        case CACHE_SECTION_VERTICES:
+            view.vertices = static_cast<const CacheVertex*>(bytes);
+            view.vertexCount = section.count;
+            break;
+        case CACHE_SECTION_INDICES:
+            view.indices = static_cast<const uint32_t*>(bytes);
+            view.indexCount = section.count;
+            break;
+        case CACHE_SECTION_MESHES:
+            view.meshes = static_cast<const CacheMesh*>(bytes);
+            view.meshCount = section.count;
+            break;
+        case CACHE_SECTION_MATERIALS:
+            view.materials = static_cast<const CacheMaterial*>(bytes);
+            view.materialCount = section.count;
+            break;
+        case CACHE_SECTION_BATCHES:
+            view.batches = static_cast<const CacheBatch*>(bytes);
+            view.batchCount = section.count;
+            break;
+        case CACHE_SECTION_LODS:
+            view.lods = static_cast<const CacheLod*>(bytes);
+            view.lodCount = section.count;
+            break;
+        default:
+            break;
+        }
+    }
+    view.boundsMin = header->boundsMin;
+    view.boundsMax = header->boundsMax;
+    importMilliseconds = header->importMilliseconds;
+    cookMilliseconds = header->cookMilliseconds;
+    if (view.vertices == nullptr || view.indices == nullptr || view.meshes == nullptr || view.materials == nullptr || view.batches == nullptr
+        || view.lods == nullptr || view.lodCount != view.meshCount * MESH_LOD_LEVELS) {
+        return false;
+    }
+    return ValidateMeshCacheView(sections, header->sectionCount, view);
+}
+
+// Punto de entrada: da acceso a los datos de un OBJ, usando el cache si es valido
+class MeshCache
+{
+public:
+    bool Load(const std::string& sourcePath)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::string cachePath = sourcePath + ".meshcache";
+        uint64_t sourceHash = HashModelSource(sourcePath);
+
+        this->fromCache = this->file.Open(cachePath) && ReadMeshCache(this->file, sourceHash, this->view, this->importMilliseconds, this->cookMilliseconds);
+        if (this->fromCache) {
+            this->loadMilliseconds = MillisecondsSince(start);
+            return true;
+        }
+        this->file.Close();
+
+        auto importStart = std::chrono::steady_clock::now();
+        if (!CookModel(sourcePath, this->data)) {
+            return false;
+        }
+        this->importMilliseconds = float(MillisecondsSince(importStart));
+        auto cookStart = std::chrono::steady_clock::now();
+        MeshOptimizeReport report;
+        OptimizeModel(this->data, report);
+        BuildStaticBatches(this->data);
+        OptimizeModelFetch(this->data, report);
+        report.Print(sourcePath);
+        BuildMeshLods(this->data);
+        this->cookMilliseconds = float(MillisecondsSince(cookStart));
+        if (!WriteMeshCache(cachePath, this->data, sourceHash, this->importMilliseconds, this->cookMilliseconds)) {
+            std::cout << "WARNING::MESH_CACHE:: could not write " << cachePath << std::endl;
+        }
+        this->view = ViewOf(this->data);
+        this->loadMilliseconds = MillisecondsSince(start);
+        return true;
+    }
+
+    // Libera el mapeo y los datos en CPU una vez subidos a la GPU
+    void Release()
+    {
+        this->file.Close();
+        this->data = ModelData();
+        this->view = MeshCacheView();
+    }
+
+    const MeshCacheView& View() const { return this->view; }
+    bool FromCache() const { return this->fromCache; }
+    double LoadMilliseconds() const { return this->loadMilliseconds; }
+    float ImportMilliseconds() const { return this->importMilliseconds; }
+    float CookMilliseconds() const { return this->cookMilliseconds; }
+
+private:
+    MappedFile file;
+    ModelData data;
+    MeshCacheView view;
+    bool fromCache = false;
+    double loadMilliseconds = 0.0;
+    float importMilliseconds = 0.0f;
+    float cookMilliseconds = 0.0f;
+};
@@ -0,0 +1,368 @@
+#pragma once
+
+// Optimizacion de los buffers al cocinar el cache de mallas:
+//   1. soldadura de vertices identicos (Assimp deja uno por esquina de cara),
+//   2. orden de triangulos para la cache post-transformacion (Forsyth),
+//   3. orden de grupos de triangulos para reducir overdraw (de afuera hacia
+//      adentro, como Sander et al.), solo si la cache casi no empeora,
+//   4. orden de vertices segun su primer uso para que la lectura sea lineal.
+// Las metricas (ACMR/ATVR con una cache FIFO simulada) se calculan en la CPU,
+// asi que el reporte no necesita contexto de OpenGL.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+const uint32_t VERTEX_CACHE_SIZE = 16;       // FIFO simulada para ACMR/ATVR
+const uint32_t FORSYTH_CACHE_SIZE = 32;      // LRU del algoritmo de Forsyth
+const uint32_t OVERDRAW_MIN_CLUSTER = 32;    // triangulos minimos por grupo
+const float OVERDRAW_ACMR_TOLERANCE = 1.05f; // cuanto puede empeorar el ACMR al ordenar por overdraw
+
+// Fallos de una cache FIFO de VERTEX_CACHE_SIZE entradas al dibujar los indices
+inline uint32_t VertexCacheMisses(const uint32_t* indices, size_t indexCount)
+{
+    uint32_t cache[VERTEX_CACHE_SIZE];
+    uint32_t filled = 0, next = 0, misses = 0;
+    for (size_t i = 0; i < indexCount; i++) {
+        bool hit = false;
+        for (uint32_t k = 0; k < filled; k++) {
+            hit = hit || cache[k] == indices[i];
+        }
+        if (!hit) {
+            cache[next] = indices[i];
+            next = (next + 1) % VERTEX_CACHE_SIZE;
+            filled = std::min(filled + 1, VERTEX_CACHE_SIZE);
+            misses++;
+        }
+    }
+    return misses;
+}
+
+// Metricas de un buffer de indices: fallos por triangulo (ACMR, 0.5 es el
+// ideal en mallas grandes y 3 el peor) y por vertice usado (ATVR, ideal 1)
+struct VertexCacheStats
+{
+    double acmr = 0.0;
+    double atvr = 0.0;
+};
+
+inline VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount)
+{
+    VertexCacheStats stats;
+    if (indexCount < 3) {
+        return stats;
+    }
+    std::vector<uint32_t> unique(indices, indices + indexCount);
+    std::sort(unique.begin(), unique.end());
+    size_t vertexCount = size_t(std::unique(unique.begin(), unique.end()) - unique.begin());
+    uint32_t misses = VertexCacheMisses(indices, indexCount);
+    stats.acmr = double(misses) / double(indexCount / 3);
+    stats.atvr = double(misses) / double(vertexCount);
+    return stats;
+}
+
+// Suelda vertices con los mismos bytes. remap[i] es el nuevo indice del
+// vertice i; devuelve cuantos vertices distintos quedan (en orden de aparicion)
+inline uint32_t WeldVertexBytes(const void* vertices, size_t vertexCount, size_t vertexSize, std::vector<uint32_t>& remap)
+{
+    struct Key
+    {
+        const unsigned char* bytes;
+        size_t size;
+        bool operator==(const Key& other) const { return std::memcmp(this->bytes, other.bytes, this->size) == 0; }
+    };
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const
+        {
+            // FNV-1a sobre los bytes del vertice
+            uint64_t hash = 1469598103934665603ull;
+            for (size_t i = 0; i < key.size; i++) {
+                hash = (hash ^ key.bytes[i]) * 1099511628211ull;
+            }
+            return size_t(hash);
+        }
+    };
+
+    const unsigned char* data = static_cast<const unsigned char*>(vertices);
+    std::unordered_map<Key, uint32_t, KeyHash> unique;
+    unique.reserve(vertexCount);
+    remap.resize(vertexCount);
+    uint32_t count = 0;
+    for (size_t i = 0; i < vertexCount; i++) {
+        auto inserted = unique.emplace(Key{ data + i * vertexSize, vertexSize }, count);
+        if (inserted.second) {
+            count++;
+        }
+        remap[i] = inserted.first->second;
+    }
+    return count;
+}
+
+// Suelda un arreglo de vertices y genera los indices que lo recorren
+template <typename Vertex>
+void WeldVertices(const std::vector<Vertex>& input, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+    std::vector<uint32_t> remap;
+    uint32_t count = WeldVertexBytes(input.data(), input.size(), sizeof(Vertex), remap);
+    vertices.resize(count);
+    indices.resize(input.size());
+    for (size_t i = 0; i < input.size(); i++) {
+        vertices[remap[i]] = input[i];
+        indices[i] = remap[i];
+    }
+}
+
+// Ordena los triangulos de "indices" para la cache de vertices (Tom Forsyth,
+// "Linear-Speed Vertex Cache Optimisation"): en cada paso emite el triangulo
+// cuyos vertices suman mas puntaje por estar en cache y por tener pocos
+// triangulos pendientes
+inline void OptimizeVertexCache(uint32_t* indices, size_t indexCount)
+{
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2) {
+        return;
+    }
+    // Vertices locales al rango para poder usar arreglos planos
+    std::unordered_map<uint32_t, uint32_t> localOf;
+    std::vector<uint32_t> globalOf;
+    std::vector<uint32_t> local(indexCount);
+    for (size_t i = 0; i < indexCount; i++) {
+        auto inserted = localOf.emplace(indices[i], uint32_t(globalOf.size()));
+        if (inserted.second) {
+            globalOf.push_back(indices[i]);
+        }
+        local[i] = inserted.first->second;
+    }
+    size_t vertexCount = globalOf.size();
+
+    std::vector<uint32_t> pending(vertexCount, 0), firstTriangle(vertexCount + 1, 0), triangleList(indexCount);
+    for (size_t i = 0; i < indexCount; i++) {
+        pending[local[i]]++;
+    }
+    for (size_t v = 0; v < vertexCount; v++) {
+        firstTriangle[v + 1] = firstTriangle[v] + pending[v];
+    }
+    std::vector<uint32_t> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t i = 0; i < indexCount; i++) {
+        triangleList[fill[local[i]]++] = uint32_t(i / 3);
+    }
+
+    auto vertexScore = [](int cachePosition, uint32_t remaining) {
+        if (remaining == 0) {
+            return -1.0f;
+        }
+        float score = 0.0f;
+        if (cachePosition >= 0) {
+            if (cachePosition < 3) {
+                score = 0.75f;
+            }
+            else {
+                score = std::pow(1.0f - float(cachePosition - 3) / float(FORSYTH_CACHE_SIZE - 3), 1.5f);
+            }
+        }
+        return score + 2.0f / std::sqrt(float(remaining));
+    };
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        score[v] = vertexScore(-1, pending[v]);
+    }
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    for (size_t t = 0; t < triangleCount; t++) {
+        triangleScore[t] = score[local[t * 3]] + score[local[t * 3 + 1]] + score[local[t * 3 + 2]];
+    }
+
+    std::vector<uint32_t> output;
+    output.reserve(indexCount);
+    std::vector<uint32_t> cache, nextCache;
+    size_t scan = 0;  // siguiente triangulo a revisar si la cache no ofrece candidatos
+    int best = -1;
+    float bestScore = -1.0f;
+    for (size_t t = 0; t < triangleCount; t++) {
+        if (triangleScore[t] > bestScore) {
+            bestScore = triangleScore[t];
+            best = int(t);
+        }
+    }
+
+    for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++) {
+        if (best < 0) {
+            while (emitted[scan]) {
+                scan++;
+            }
+            best = int(scan);
+        }
+        emitted[best] = 1;
+        const uint32_t* triangle = &local[size_t(best) * 3];
+        for (int k = 0; k < 3; k++) {
+            output.push_back(globalOf[triangle[k]]);
+        }
+
+        // Saca el triangulo de las listas pendientes de sus vertices
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = triangle[k];
+            uint32_t* list = &triangleList[firstTriangle[v]];
+            for (uint32_t j = 0; j < pending[v]; j++) {
+                if (list[j] == uint32_t(best)) {
+                    std::swap(list[j], list[pending[v] - 1]);
+                    break;
+                }
+            }
+            pending[v]--;
+        }
+
+        // Los vertices del triangulo pasan al frente de la cache LRU
+        nextCache.assign(triangle, triangle + 3);
+        for (uint32_t v : cache) {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+                nextCache.push_back(v);
+            }
+        }
+        for (size_t k = FORSYTH_CACHE_SIZE; k < nextCache.size(); k++) {
+            cachePosition[nextCache[k]] = -1;
+            score[nextCache[k]] = vertexScore(-1, pending[nextCache[k]]);
+        }
+        if (nextCache.size() > FORSYTH_CACHE_SIZE) {
+            nextCache.resize(FORSYTH_CACHE_SIZE);
+        }
+        cache.swap(nextCache);
+
+        // Recalcula los puntajes de lo que esta en cache y elige el siguiente
+        for (size_t k = 0; k < cache.size(); k++) {
+            cachePosition[cache[k]] = int(k);
+            score[cache[k]] = vertexScore(int(k), pending[cache[k]]);
+        }
+        best = -1;
+        bestScore = -1.0f;
+        for (uint32_t v : cache) {
+            for (uint32_t j = 0; j < pending[v]; j++) {
+                uint32_t t = triangleList[firstTriangle[v] + j];
+                float candidate = score[local[t * 3]] + score[local[t * 3 + 1]] + score[local[t * 3 + 2]];
+                triangleScore[t] = candidate;
+                if (candidate > bestScore) {
+                    bestScore = candidate;
+                    best = int(t);
+                }
+            }
+        }
+    }
+    std::copy(output.begin(), output.end(), indices);
+}
+
+// Parte la secuencia (ya ordenada para la cache) en grupos que empiezan donde
+// la cache se vacia y los ordena de afuera hacia adentro: primero los que miran
+// lejos del centro de la malla, que suelen tapar a los demas
+template <typename Vertex>
+void OptimizeOverdraw(const Vertex* vertices, uint32_t* indices, size_t indexCount)
+{
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount < OVERDRAW_MIN_CLUSTER * 2) {
+        return;
+    }
+    uint32_t cacheBefore = VertexCacheMisses(indices, indexCount);
+
+    // Inicio de un grupo: el triangulo tiene sus tres vertices fuera de la cache
+    std::vector<size_t> clusterStart(1, 0);
+    {
+        uint32_t cache[VERTEX_CACHE_SIZE];
+        uint32_t filled = 0, next = 0;
+        for (size_t t = 0; t < triangleCount; t++) {
+            int misses = 0;
+            for (int k = 0; k < 3; k++) {
+                uint32_t index = indices[t * 3 + k];
+                bool hit = false;
+                for (uint32_t j = 0; j < filled; j++) {
+                    hit = hit || cache[j] == index;
+                }
+                if (!hit) {
+                    cache[next] = index;
+                    next = (next + 1) % VERTEX_CACHE_SIZE;
+                    filled = std::min(filled + 1, VERTEX_CACHE_SIZE);
+                    misses++;
+                }
+            }
+            if (misses == 3 && t - clusterStart.back() >= OVERDRAW_MIN_CLUSTER) {
+                clusterStart.push_back(t);
+            }
+        }
+    }
+    if (clusterStart.size() < 2) {
+        return;
+    }
+    clusterStart.push_back(triangleCount);
+
+    glm::vec3 meshCenter(0.0f);
+    float meshArea = 0.0f;
+    std::vector<float> sortKey(clusterStart.size() - 1);
+    std::vector<glm::vec3> clusterCenters(sortKey.size()), clusterNormals(sortKey.size());
+    for (size_t c = 0; c + 1 < clusterStart.size(); c++) {
+        glm::vec3 center(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++) {
+            glm::vec3 p0 = vertices[indices[t * 3]].Position, p1 = vertices[indices[t * 3 + 1]].Position, p2 = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 cross = glm::cross(p1 - p0, p2 - p0);
+            float triangleArea = glm::length(cross) * 0.5f;
+            center += (p0 + p1 + p2) * (triangleArea / 3.0f);
+            normal += cross;
+            area += triangleArea;
+        }
+        meshCenter += center;
+        meshArea += area;
+        clusterCenters[c] = area > 0.0f ? center / area : center;
+        float length = glm::length(normal);
+        clusterNormals[c] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+    }
+    if (meshArea <= 0.0f) {
+        return;
+    }
+    meshCenter /= meshArea;
+    for (size_t c = 0; c < sortKey.size(); c++) {
+        sortKey[c] = glm::dot(clusterCenters[c] - meshCenter, clusterNormals[c]);
+    }
+
+    std::vector<uint32_t> order(sortKey.size());
+    for (uint32_t c = 0; c < order.size(); c++) {
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&sortKey](uint32_t a, uint32_t b) { return sortKey[a] > sortKey[b]; });
+
+    std::vector<uint32_t> output;
+    output.reserve(indexCount);
+    for (uint32_t c : order) {
+        output.insert(output.end(), indices + clusterStart[c] * 3, indices + clusterStart[c + 1] * 3);
+    }
+    // Se queda con el orden de overdraw solo si la cache casi no lo resiente
+    if (VertexCacheMisses(output.data(), output.size()) <= uint32_t(cacheBefore * OVERDRAW_ACMR_TOLERANCE)) {
+        std::copy(output.begin(), output.end(), indices);
+    }
+}
+
+// Renumera los vertices en el orden en que los usa el buffer de indices y
+// descarta los que nadie usa. Devuelve el nuevo numero de vertices
+template <typename Vertex>
+uint32_t OptimizeVertexFetch(std::vector<Vertex>& vertices, uint32_t* indices, size_t indexCount)
+{
+    const uint32_t unused = ~0u;
+    std::vector<uint32_t> remap(vertices.size(), unused);
+    std::vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+    for (size_t i = 0; i < indexCount; i++) {
+        uint32_t& target = remap[indices[i]];
+        if (target == unused) {
+            target = uint32_t(reordered.size());
+            reordered.push_back(vertices[indices[i]]);
+        }
+        indices[i] = target;
+    }
+    vertices.swap(reordered);
+    return uint32_t(vertices.size());
+}
@@ -0,0 +1,310 @@
+#pragma once
+
+// Simplificacion de mallas por colapso de aristas con metrica de error
+// cuadratico (Garland-Heckbert). Se usa al cocinar el cache para generar los
+// niveles de detalle (LOD) de cada submalla.
+//
+// Los OBJ importados con Assimp no comparten vertices entre caras, asi que
+// primero se sueldan por posicion; los colapsos trabajan sobre esa topologia
+// y al final cada esquina se reasigna al vertice original (con su UV y
+// normal) mas parecido dentro del grupo que sobrevivio. El vertice que queda
+// es siempre uno de los originales: los LOD solo agregan indices, nunca
+// vertices, y comparten el VBO del modelo.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Cuadrica simetrica 4x4 (10 coeficientes): error(p) = p^T Q p
+struct Quadric
+{
+    double a[10] = { 0.0 };
+
+    static Quadric FromPlane(double x, double y, double z, double w, double weight)
+    {
+        Quadric q;
+        q.a[0] = x * x * weight; q.a[1] = x * y * weight; q.a[2] = x * z * weight; q.a[3] = x * w * weight;
+        q.a[4] = y * y * weight; q.a[5] = y * z * weight; q.a[6] = y * w * weight;
+        q.a[7] = z * z * weight; q.a[8] = z * w * weight;
+        q.a[9] = w * w * weight;
+        return q;
+    }
+
+    Quadric& operator+=(const Quadric& other)
+    {
+        for (int i = 0; i < 10; i++) {
+            this->a[i] += other.a[i];
+        }
+        return *this;
+    }
+
+    double Error(const glm::vec3& p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double e = this->a[0] * x * x + 2.0 * this->a[1] * x * y + 2.0 * this->a[2] * x * z + 2.0 * this->a[3] * x
+                 + this->a[4] * y * y + 2.0 * this->a[5] * y * z + 2.0 * this->a[6] * y
+                 + this->a[7] * z * z + 2.0 * this->a[8] * z
+                 + this->a[9];
+        return std::max(e, 0.0);
+    }
+};
+
+// Peso de los planos que fijan los bordes abiertos (evita que se encojan)
+const double SIMPLIFY_BORDER_WEIGHT = 10.0;
+
+// Simplifica un rango de triangulos con indices absolutos. "targets" es la
+// lista de numeros de triangulos deseados, de mayor a menor; por cada uno se
+// agrega a "levels" la lista de indices y a "errors" el error geometrico
+// (distancia en unidades del modelo) acumulado hasta ese punto. Si la malla
+// ya no se puede reducir mas, los niveles restantes repiten el ultimo.
+// Vertex necesita Position, Normal y TexCoords (CacheVertex o Vertex de Mesh.h)
+template <typename Vertex>
+void SimplifyMesh(const Vertex* vertices, const uint32_t* indices, uint32_t indexCount, const std::vector<uint32_t>& targets,
+                  std::vector<std::vector<uint32_t>>& levels, std::vector<float>& errors)
+{
+    // Soldadura por posicion exacta
+    struct PositionKey
+    {
+        float x, y, z;
+        bool operator==(const PositionKey& other) const { return x == other.x && y == other.y && z == other.z; }
+    };
+    struct PositionHash
+    {
+        size_t operator()(const PositionKey& key) const
+        {
+            uint32_t bits[3];
+            std::memcpy(bits, &key, sizeof(bits));
+            return size_t(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+        }
+    };
+
+    std::unordered_map<uint32_t, uint32_t> groupOfVertex;
+    std::unordered_map<PositionKey, uint32_t, PositionHash> groupOfPosition;
+    std::vector<glm::vec3> positions;
+    std::vector<std::vector<uint32_t>> members;  // vertices originales de cada grupo
+    for (uint32_t i = 0; i < indexCount; i++) {
+        uint32_t vertex = indices[i];
+        if (groupOfVertex.count(vertex)) {
+            continue;
+        }
+        const glm::vec3& p = vertices[vertex].Position;
+        auto inserted = groupOfPosition.emplace(PositionKey{ p.x, p.y, p.z }, uint32_t(positions.size()));
+        if (inserted.second) {
+            positions.push_back(p);
+            members.emplace_back();
+        }
+        groupOfVertex[vertex] = inserted.first->second;
+        members[inserted.first->second].push_back(vertex);
+    }
+
+    // Triangulos sobre los grupos; los degenerados se descartan desde el inicio
+    struct Triangle
+    {
+        uint32_t group[3];
+        uint32_t corner[3];  // vertice original de cada esquina
+        bool alive;
+    };
+    std::vector<Triangle> triangles;
+    for (uint32_t i = 0; i + 2 < indexCount; i += 3) {
+        Triangle triangle;
+        for (int k = 0; k < 3; k++) {
+            triangle.corner[k] = indices[i + k];
+            triangle.group[k] = groupOfVertex[indices[i + k]];
+        }
+        triangle.alive = triangle.group[0] != triangle.group[1] && triangle.group[1] != triangle.group[2] && triangle.group[0] != triangle.group[2];
+        if (triangle.alive) {
+            triangles.push_back(triangle);
+        }
+    }
+
+    uint32_t groupCount = uint32_t(positions.size());
+    std::vector<Quadric> quadrics(groupCount);
+    std::vector<std::vector<uint32_t>> adjacency(groupCount);
+    std::unordered_map<uint64_t, uint32_t> edgeUses;
+    auto edgeKey = [](uint32_t a, uint32_t b) { return a < b ? (uint64_t(a) << 32 | b) : (uint64_t(b) << 32 | a); };
+    for (uint32_t t = 0; t < triangles.size(); t++) {
+        const Triangle& triangle = triangles[t];
+        glm::vec3 p0 = positions[triangle.group[0]], p1 = positions[triangle.group[1]], p2 = positions[triangle.group[2]];
+        glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        float length = glm::length(normal);
+        if (length > 0.0f) {
+            normal /= length;
+            Quadric plane = Quadric::FromPlane(normal.x, normal.y, normal.z, -glm::dot(normal, p0), 1.0);
+            for (int k = 0; k < 3; k++) {
+                quadrics[triangle.group[k]] += plane;
+            }
+        }
+        for (int k = 0; k < 3; k++) {
+            adjacency[triangle.group[k]].push_back(t);
+            edgeUses[edgeKey(triangle.group[k], triangle.group[(k + 1) % 3])]++;
+        }
+    }
+
+    // Bordes abiertos: plano perpendicular a la cara que contiene la arista
+    for (const Triangle& triangle : triangles) {
+        glm::vec3 p0 = positions[triangle.group[0]], p1 = positions[triangle.group[1]], p2 = positions[triangle.group[2]];
+        glm::vec3 faceNormal = glm::cross(p1 - p0, p2 - p0);
+        for (int k = 0; k < 3; k++) {
+            uint32_t a = triangle.group[k], b = triangle.group[(k + 1) % 3];
+            if (edgeUses[edgeKey(a, b)] != 1) {
+                continue;
+            }
+            glm::vec3 edge = positions[b] - positions[a];
+            glm::vec3 normal = glm::cross(edge, faceNormal);
+            float length = glm::length(normal);
+            if (length <= 0.0f) {
+                continue;
+            }
+            normal /= length;
+            Quadric plane = Quadric::FromPlane(normal.x, normal.y, normal.z, -glm::dot(normal, positions[a]), SIMPLIFY_BORDER_WEIGHT);
+            quadrics[a] += plane;
+            quadrics[b] += plane;
+        }
+    }
+
+    // Cola de colapsos: "from" se mueve a la posicion de "to"
+    struct Collapse
+    {
+        double cost;
+        uint32_t from, to;
+        uint32_t fromVersion, toVersion;
+        bool operator<(const Collapse& other) const { return this->cost > other.cost; }
+    };
+    std::vector<uint32_t> version(groupCount, 0);
+    std::vector<uint8_t> removed(groupCount, 0);
+    std::priority_queue<Collapse> queue;
+    auto pushEdge = [&](uint32_t a, uint32_t b) {
+        Quadric sum = quadrics[a];
+        sum += quadrics[b];
+        double toB = sum.Error(positions[b]);
+        double toA = sum.Error(positions[a]);
+        if (toB <= toA) {
+            queue.push({ toB, a, b, version[a], version[b] });
+        }
+        else {
+            queue.push({ toA, b, a, version[b], version[a] });
+        }
+    };
+    for (const auto& edge : edgeUses) {
+        pushEdge(uint32_t(edge.first >> 32), uint32_t(edge.first & 0xffffffffu));
+    }
+
+    // Mover "from" no debe voltear ninguno de sus triangulos que sobreviven
+    auto flips = [&](uint32_t from, uint32_t to) {
+        for (uint32_t t : adjacency[from]) {
+            const Triangle& triangle = triangles[t];
+            if (!triangle.alive || triangle.group[0] == to || triangle.group[1] == to || triangle.group[2] == to) {
+                continue;
+            }
+            glm::vec3 before[3], after[3];
+            for (int k = 0; k < 3; k++) {
+                before[k] = positions[triangle.group[k]];
+                after[k] = triangle.group[k] == from ? positions[to] : before[k];
+            }
+            glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+            glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+            if (glm::dot(normalBefore, normalAfter) <= 0.2f * glm::length(normalBefore) * glm::length(normalAfter)) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // Reasigna cada esquina al vertice original mas parecido del grupo final
+    auto emit = [&](std::vector<uint32_t>& out) {
+        out.clear();
+        for (const Triangle& triangle : triangles) {
+            if (!triangle.alive) {
+                continue;
+            }
+            for (int k = 0; k < 3; k++) {
+                uint32_t corner = triangle.corner[k];
+                if (groupOfVertex[corner] != triangle.group[k]) {
+                    const Vertex& original = vertices[corner];
+                    float best = 1e30f;
+                    for (uint32_t candidate : members[triangle.group[k]]) {
+                        glm::vec2 uv = vertices[candidate].TexCoords - original.TexCoords;
+                        float distance = glm::dot(uv, uv) + 0.25f * (1.0f - glm::dot(vertices[candidate].Normal, original.Normal));
+                        if (distance < best) {
+                            best = distance;
+                            corner = candidate;
+                        }
+                    }
+                }
+                out.push_back(corner);
+            }
+        }
+    };
+
+    uint32_t aliveTriangles = uint32_t(triangles.size());
+    double maxCost = 0.0;
+    levels.clear();
+    errors.clear();
+    for (uint32_t target : targets) {
+        while (aliveTriangles > target && !queue.empty()) {
+            Collapse collapse = queue.top();
+            queue.pop();
+            if (removed[collapse.from] || removed[collapse.to]) {
+                continue;
+            }
+            if (collapse.fromVersion != version[collapse.from] || collapse.toVersion != version[collapse.to]) {
+                pushEdge(collapse.from, collapse.to);
+                continue;
+            }
+            if (flips(collapse.from, collapse.to)) {
+                continue;
+            }
+
+            uint32_t from = collapse.from, to = collapse.to;
+            maxCost = std::max(maxCost, collapse.cost);
+            quadrics[to] += quadrics[from];
+            removed[from] = 1;
+            version[to]++;
+            std::vector<uint32_t> neighbours;
+            for (uint32_t t : adjacency[from]) {
+                Triangle& triangle = triangles[t];
+                if (!triangle.alive) {
+                    continue;
+                }
+                if (triangle.group[0] == to || triangle.group[1] == to || triangle.group[2] == to) {
+                    triangle.alive = false;
+                    aliveTriangles--;
+                    continue;
+                }
+                for (int k = 0; k < 3; k++) {
+                    if (triangle.group[k] == from) {
+                        triangle.group[k] = to;
+                    }
+                    else {
+                        neighbours.push_back(triangle.group[k]);
+                    }
+                }
+                adjacency[to].push_back(t);
+            }
+            adjacency[from].clear();
+            std::vector<uint32_t>& around = adjacency[to];
+            around.erase(std::remove_if(around.begin(), around.end(), [&triangles](uint32_t t) { return !triangles[t].alive; }), around.end());
+            for (uint32_t t : around) {
+                for (int k = 0; k < 3; k++) {
+                    neighbours.push_back(triangles[t].group[k]);
+                }
+            }
+            std::sort(neighbours.begin(), neighbours.end());
+            neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+            for (uint32_t neighbour : neighbours) {
+                if (neighbour != to && !removed[neighbour]) {
+                    pushEdge(to, neighbour);
+                }
+            }
+        }
+        levels.emplace_back();
+        emit(levels.back());
+        errors.push_back(float(std::sqrt(maxCost)));
+    }
+}
@@ -0,0 +1,487 @@
+#pragma once
+
+// Oclusion por software: las submallas grandes que tapan (paredes, techo,
+// piso) se rasterizan en la CPU a un buffer de profundidad de baja resolucion
+// y cada submalla del modelo se prueba con su caja proyectada antes de
+// dibujarla. No usa consultas de oclusion de la GPU, asi que funciona igual en
+// equipos con GL por software.
+//
+// La pantalla se divide en baldosas de OCCLUSION_TILE_WIDTH x
+// OCCLUSION_TILE_HEIGHT; los triangulos se reparten por baldosa y cada
+// baldosa se rasteriza en su propio hilo (ParallelFor), 4 pixeles a la vez
+// con SSE. Un occluder que cruza el plano cercano se omite: quitar un
+// occluder solo hace que se dibuje de mas, nunca de menos.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define OCCLUSION_SIMD 1
+#else
+#define OCCLUSION_SIMD 0
+#endif
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "MeshCache.h"
+#include "ThreadPool.h"
+
+const int OCCLUSION_TILE_WIDTH = 64;
+const int OCCLUSION_TILE_HEIGHT = 32;
+const float OCCLUSION_DEPTH_BIAS = 1e-5f;  // evita que una caja se oculte tras su propia superficie
+
+static_assert(OCCLUSION_TILE_WIDTH % 4 == 0, "las filas se rasterizan de 4 en 4 pixeles");
+
+// Lista de texturas de occluders (una por linea, # para comentarios)
+inline std::vector<std::string> ReadOccluderList(const std::string& path)
+{
+    std::vector<std::string> textures;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream tokens(line);
+        std::string texture;
+        if (tokens >> texture && texture[0] != '#') {
+            textures.push_back(texture);
+        }
+    }
+    return textures;
+}
+
+class SoftwareOcclusion
+{
+public:
+    bool simd = OCCLUSION_SIMD != 0;  // el benchmark la apaga para comparar
+
+    // El ancho y el alto se redondean a baldosas completas
+    SoftwareOcclusion(int width = 256, int height = 128, unsigned int threadCount = 0)
+    {
+        this->tilesX = std::max(1, (width + OCCLUSION_TILE_WIDTH - 1) / OCCLUSION_TILE_WIDTH);
+        this->tilesY = std::max(1, (height + OCCLUSION_TILE_HEIGHT - 1) / OCCLUSION_TILE_HEIGHT);
+        this->width = this->tilesX * OCCLUSION_TILE_WIDTH;
+        this->height = this->tilesY * OCCLUSION_TILE_HEIGHT;
+        this->depth.assign(size_t(this->width) * this->height, 1.0f);
+        this->bins.resize(size_t(this->tilesX) * this->tilesY);
+        this->threads = threadCount != 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Triangulos (3 posiciones cada uno, espacio del modelo) que tapan
+    void SetOccluders(std::vector<glm::vec3> triangles)
+    {
+        this->occluders = std::move(triangles);
+    }
+
+    // Toma como occluders las submallas de un modelo cuya textura difusa esta en la lista
+    size_t SetOccluders(const MeshCacheView& view, const std::vector<std::string>& textures)
+    {
+        std::vector<glm::vec3> triangles;
+        this->occluderMeshes.assign(view.meshCount, 0);
+        for (uint32_t m = 0; m < view.meshCount; m++) {
+            const CacheMesh& mesh = view.meshes[m];
+            std::string texture = view.materials[mesh.material].diffuse;
+            if (std::find(textures.begin(), textures.end(), texture) == textures.end()) {
+                continue;
+            }
+            this->occluderMeshes[m] = 1;
+            for (uint32_t i = 0; i < mesh.indexCount; i++) {
+                triangles.push_back(view.vertices[view.indices[mesh.firstIndex + i]].Position);
+            }
+        }
+        this->SetOccluders(std::move(triangles));
+        return this->occluders.size() / 3;
+    }
+
+    // Lee la lista de texturas y toma los triangulos del cache del OBJ (que ya
+    // escribio CachedModel); sin lista o sin occluders queda desactivada
+    bool Load(const std::string& objPath, const std::string& listPath)
+    {
+        std::vector<std::string> textures = ReadOccluderList(listPath);
+        if (textures.empty()) {
+            std::cout << "[Occlusion] " << listPath << " not found or empty, occlusion culling disabled" << std::endl;
+            return false;
+        }
+        MeshCache cache;
+        if (!cache.Load(objPath)) {
+            return false;
+        }
+        size_t count = this->SetOccluders(cache.View(), textures);
+        cache.Release();
+        std::cout << "[Occlusion] " << count << " occluder triangles from " << textures.size() << " textures, "
+                  << this->width << "x" << this->height << " depth buffer on " << this->threads << " threads" << std::endl;
+        return count > 0;
+    }
+
+    bool Enabled() const { return !this->occluders.empty(); }
+
+    int Width() const { return this->width; }
+    int Height() const { return this->height; }
+    const std::vector<float>& Depth() const { return this->depth; }
+    size_t OccluderTriangles() const { return this->occluders.size() / 3; }
+    size_t RasterizedTriangles() const { return this->rasterized; }
+
+    // Transforma, reparte por baldosa y rasteriza los occluders con la vista actual
+    void Render(const glm::mat4& viewProjection)
+    {
+        auto start = std::chrono::steady_clock::now();
+        this->setupTriangles(viewProjection);
+        ParallelFor(this->bins.size(), this->threads, [this](size_t begin, size_t end, unsigned int) {
+            for (size_t tile = begin; tile < end; tile++) {
+                this->rasterizeTile(int(tile));
+            }
+        });
+        this->accumulatedMilliseconds += MillisecondsSince(start);
+    }
+
+    // Rasteriza y prueba las submallas de un modelo; Mask() queda lista para Draw
+    void Update(const std::vector<CacheMesh>& meshes, const glm::mat4& viewProjection, const std::vector<uint8_t>* input)
+    {
+        this->Render(viewProjection);
+        auto start = std::chrono::steady_clock::now();
+        this->accumulatedCulled += this->Cull(meshes, viewProjection, input, this->mask);
+        this->accumulatedMilliseconds += MillisecondsSince(start);
+        this->frames++;
+    }
+
+    // Submallas que pasaron la prueba; nullptr si no hay occluders
+    const std::vector<uint8_t>* Mask() const
+    {
+        return this->Enabled() ? &this->mask : nullptr;
+    }
+
+    // Cada "interval" segundos imprime el promedio de submallas ocultas y el costo
+    void Report(double now, double interval = 2.0)
+    {
+        if (now - this->lastReport < interval || this->frames == 0) {
+            return;
+        }
+        std::cout << "[Occlusion] " << double(this->accumulatedCulled) / this->frames << " meshes occluded/frame, "
+                  << this->rasterized << " triangles rasterized, " << this->accumulatedMilliseconds / this->frames << " ms" << std::endl;
+        this->accumulatedMilliseconds = 0.0;
+        this->accumulatedCulled = 0;
+        this->frames = 0;
+        this->lastReport = now;
+    }
+
+    // true si alguna parte de la caja puede verse por encima del buffer de profundidad
+    bool TestBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& viewProjection) const
+    {
+        float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, minZ = 1e30f;
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 point((corner & 1) ? boundsMax.x : boundsMin.x, (corner & 2) ? boundsMax.y : boundsMin.y, (corner & 4) ? boundsMax.z : boundsMin.z);
+            glm::vec4 clip = viewProjection * glm::vec4(point, 1.0f);
+            if (clip.w <= 1e-4f) {
+                return true;  // cruza el plano de la camara: no se puede probar
+            }
+            float x = (clip.x / clip.w * 0.5f + 0.5f) * this->width;
+            float y = (clip.y / clip.w * 0.5f + 0.5f) * this->height;
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+            minZ = std::min(minZ, clip.z / clip.w * 0.5f + 0.5f);
+        }
+
+        // Pixeles cuyo centro cae dentro del rectangulo (al menos uno)
+        int x0 = std::max(0, int(std::floor(minX)));
+        int x1 = std::min(this->width - 1, int(std::ceil(maxX)) - 1);
+        int y0 = std::max(0, int(std::floor(minY)));
+        int y1 = std::min(this->height - 1, int(std::ceil(maxY)) - 1);
+        if (x0 > x1 || y0 > y1) {
+            return false;  // fuera de la pantalla
+        }
+        float boxDepth = minZ - OCCLUSION_DEPTH_BIAS;
+        for (int y = y0; y <= y1; y++) {
+            const float* row = &this->depth[size_t(y) * this->width];
+            int x = x0;
+#if OCCLUSION_SIMD
+            if (this->simd) {
+                __m128 box = _mm_set1_ps(boxDepth);
+                for (; x + 3 <= x1; x += 4) {
+                    if (_mm_movemask_ps(_mm_cmple_ps(box, _mm_loadu_ps(row + x))) != 0) {
+                        return true;
+                    }
+                }
+            }
+#endif
+            for (; x <= x1; x++) {
+                if (boxDepth <= row[x]) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // Marca en "mask" las submallas visibles; las que ya venian en cero no se
+    // prueban y los occluders nunca se ocultan a si mismos
+    unsigned int Cull(const std::vector<CacheMesh>& meshes, const glm::mat4& viewProjection, const std::vector<uint8_t>* input, std::vector<uint8_t>& mask) const
+    {
+        unsigned int culled = 0;
+        mask.resize(meshes.size());
+        for (size_t i = 0; i < meshes.size(); i++) {
+            if (input != nullptr && !(*input)[i]) {
+                mask[i] = 0;
+                continue;
+            }
+            bool occluder = i < this->occluderMeshes.size() && this->occluderMeshes[i];
+            mask[i] = occluder || this->TestBox(meshes[i].boundsMin, meshes[i].boundsMax, viewProjection);
+            culled += mask[i] ? 0 : 1;
+        }
+        return culled;
+    }
+
+private:
+    // Triangulo ya en pixeles con las funciones de borde y el plano de profundidad
+    struct RasterTriangle
+    {
+        float edgeA[3], edgeB[3], edgeC[3];  // E(x, y) = A x + B y + C, >= 0 dentro
+        float depthA, depthB, depthC;        // z(x, y) = A x + B y + C
+        int minX, minY, maxX, maxY;
+    };
+
+    int width = 0, height = 0, tilesX = 0, tilesY = 0;
+    unsigned int threads = 1;
+    std::vector<float> depth;
+    std::vector<glm::vec3> occluders;
+    std::vector<uint8_t> occluderMeshes;
+    std::vector<RasterTriangle> triangles;
+    std::vector<std::vector<uint32_t>> bins;
+    size_t rasterized = 0;
+    std::vector<uint8_t> mask;
+    double accumulatedMilliseconds = 0.0;
+    size_t accumulatedCulled = 0;
+    unsigned int frames = 0;
+    double lastReport = 0.0;
+
+    void setupTriangles(const glm::mat4& viewProjection)
+    {
+        this->triangles.clear();
+        for (std::vector<uint32_t>& bin : this->bins) {
+            bin.clear();
+        }
+
+        for (size_t t = 0; t + 2 < this->occluders.size(); t += 3) {
+            glm::vec3 screen[3];
+            bool behind = false;
+            for (int v = 0; v < 3; v++) {
+                glm::vec4 clip = viewProjection * glm::vec4(this->occluders[t + v], 1.0f);
+                if (clip.w <= 1e-4f || clip.z < -clip.w) {
+                    behind = true;
+                    break;
+                }
+                screen[v] = glm::vec3((clip.x / clip.w * 0.5f + 0.5f) * this->width, (clip.y / clip.w * 0.5f + 0.5f) * this->height,
+                                      clip.z / clip.w * 0.5f + 0.5f);
+            }
+            if (behind) {
+                continue;
+            }
+
+            // Orientacion consistente: los occluders se dibujan por ambas caras
+            float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+            if (std::fabs(area) < 1e-8f) {
+                continue;
+            }
+            if (area < 0.0f) {
+                std::swap(screen[1], screen[2]);
+                area = -area;
+            }
+
+            RasterTriangle triangle;
+            triangle.minX = std::max(0, int(std::floor(std::min(screen[0].x, std::min(screen[1].x, screen[2].x)))));
+            triangle.maxX = std::min(this->width - 1, int(std::ceil(std::max(screen[0].x, std::max(screen[1].x, screen[2].x)))));
+            triangle.minY = std::max(0, int(std::floor(std::min(screen[0].y, std::min(screen[1].y, screen[2].y)))));
+            triangle.maxY = std::min(this->height - 1, int(std::ceil(std::max(screen[0].y, std::max(screen[1].y, screen[2].y)))));
+            if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+                continue;
+            }
+            for (int e = 0; e < 3; e++) {
+                const glm::vec3& a = screen[(e + 1) % 3];
+                const glm::vec3& b = screen[(e + 2) % 3];
+                triangle.edgeA[e] = a.y - b.y;
+                triangle.edgeB[e] = b.x - a.x;
+                triangle.edgeC[e] = a.x * b.y - a.y * b.x;
+            }
+            // Plano de profundidad a partir de las coordenadas baricentricas
+            float inverseArea = 1.0f / area;
+            triangle.depthA = (triangle.edgeA[0] * screen[0].z + triangle.edgeA[1] * screen[1].z + triangle.edgeA[2] * screen[2].z) * inverseArea;
+            triangle.depthB = (triangle.edgeB[0] * screen[0].z + triangle.edgeB[1] * screen[1].z + triangle.edgeB[2] * screen[2].z) * inverseArea;
+            triangle.depthC = (triangle.edgeC[0] * screen[0].z + triangle.edgeC[1] * screen[1].z + triangle.edgeC[2] * screen[2].z) * inverseArea;
+
+            uint32_t index = uint32_t(this->triangles.size());
+            this->triangles.push_back(triangle);
+            for (int ty = triangle.minY / OCCLUSION_TILE_HEIGHT; ty <= triangle.maxY / OCCLUSION_TILE_HEIGHT; ty++) {
+                for (int tx = triangle.minX / OCCLUSION_TILE_WIDTH; tx <= triangle.maxX / OCCLUSION_TILE_WIDTH; tx++) {
+                    this->bins[size_t(ty) * this->tilesX + tx].push_back(index);
+                }
+            }
+        }
+        this->rasterized = this->triangles.size();
+    }
+
+    void rasterizeTile(int tile)
+    {
+        int tileX0 = (tile % this->tilesX) * OCCLUSION_TILE_WIDTH;
+        int tileY0 = (tile / this->tilesX) * OCCLUSION_TILE_HEIGHT;
+        for (int y = tileY0; y < tileY0 + OCCLUSION_TILE_HEIGHT; y++) {
+            std::fill_n(&this->depth[size_t(y) * this->width + tileX0], OCCLUSION_TILE_WIDTH, 1.0f);
+        }
+
+        for (uint32_t index : this->bins[tile]) {
+            const RasterTriangle& triangle = this->triangles[index];
+            // Recorta a la baldosa; x empieza alineado a 4 para el bucle SIMD
+            int x0 = std::max(triangle.minX, tileX0) & ~3;
+            int x1 = std::min(triangle.maxX, tileX0 + OCCLUSION_TILE_WIDTH - 1);
+            int y0 = std::max(triangle.minY, tileY0);
+            int y1 = std::min(triangle.maxY, tileY0 + OCCLUSION_TILE_HEIGHT - 1);
+            for (int y = y0; y <= y1; y++) {
+                float* row = &this->depth[size_t(y) * this->width];
+                float centerY = y + 0.5f;
+                if (this->simd) {
+                    this->rasterizeRowSimd(triangle, row, x0, x1, centerY);
+                }
+                else {
+                    this->rasterizeRowScalar(triangle, row, x0, x1, centerY);
+                }
+            }
+        }
+    }
+
+    void rasterizeRowScalar(const RasterTriangle& triangle, float* row, int x0, int x1, float centerY) const
+    {
+        for (int x = x0; x <= x1; x++) {
+            // Mismo orden de operaciones que la ruta SSE para dar el mismo resultado
+            float centerX = x + 0.5f;
+            bool inside = true;
+            for (int e = 0; e < 3; e++) {
+                inside = inside && triangle.edgeA[e] * centerX + (triangle.edgeB[e] * centerY + triangle.edgeC[e]) >= 0.0f;
+            }
+            if (inside) {
+                float z = triangle.depthA * centerX + (triangle.depthB * centerY + triangle.depthC);
+                row[x] = std::min(row[x], z);
+            }
+        }
+    }
+
+    void rasterizeRowSimd(const RasterTriangle& triangle, float* row, int x0, int x1, float centerY) const
+    {
+#if OCCLUSION_SIMD
+        __m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        __m128 rowEdge[3], stepEdge[3];
+        for (int e = 0; e < 3; e++) {
+            rowEdge[e] = _mm_set1_ps(triangle.edgeB[e] * centerY + triangle.edgeC[e]);
+            stepEdge[e] = _mm_set1_ps(triangle.edgeA[e]);
+        }
+        __m128 depthRow = _mm_set1_ps(triangle.depthB * centerY + triangle.depthC);
+        __m128 depthStep = _mm_set1_ps(triangle.depthA);
+        __m128 zero = _mm_setzero_ps();
+        int last = x1 & ~3;
+        for (int x = x0; x <= last; x += 4) {
+            __m128 centerX = _mm_add_ps(_mm_set1_ps(float(x)), offsets);
+            __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(stepEdge[0], centerX), rowEdge[0]), zero);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(stepEdge[1], centerX), rowEdge[1]), zero));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(stepEdge[2], centerX), rowEdge[2]), zero));
+            if (_mm_movemask_ps(inside) == 0) {
+                continue;
+            }
+            // Los pixeles mas alla de x1 pertenecen a la siguiente baldosa o
+            // quedan fuera del triangulo, asi que solo se escriben si estan dentro
+            if (x + 3 > x1) {
+                int valid = x1 - x + 1;
+                inside = _mm_and_ps(inside, _mm_cmplt_ps(_mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f), _mm_set1_ps(float(valid))));
+            }
+            __m128 z = _mm_add_ps(_mm_mul_ps(depthStep, centerX), depthRow);
+            __m128 old = _mm_loadu_ps(row + x);
+            __m128 closest = _mm_min_ps(old, z);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closest), _mm_andnot_ps(inside, old)));
+        }
+#else
+        this->rasterizeRowScalar(triangle, row, x0, x1, centerY);
+#endif
+    }
+};
+
+// --benchmark-occlusion: una casa sintetica (cuatro paredes, techo y piso
+// subdivididos) con muebles dentro y arbustos fuera, vista desde afuera como
+// la camara en tercera persona. Mide rasterizado y pruebas escalar/SSE con
+// uno y todos los hilos. No necesita contexto de OpenGL
+inline int BenchmarkOcclusion()
+{
+    std::vector<glm::vec3> occluders;
+    auto addQuad = [&occluders](glm::vec3 origin, glm::vec3 u, glm::vec3 v, int subdivisions) {
+        for (int i = 0; i < subdivisions; i++) {
+            for (int j = 0; j < subdivisions; j++) {
+                glm::vec3 a = origin + u * (float(i) / subdivisions) + v * (float(j) / subdivisions);
+                glm::vec3 b = a + u / float(subdivisions);
+                glm::vec3 c = b + v / float(subdivisions);
+                glm::vec3 d = a + v / float(subdivisions);
+                occluders.insert(occluders.end(), { a, b, c, a, c, d });
+            }
+        }
+    };
+    const int subdivisions = 16;
+    addQuad(glm::vec3(-10, 0, 10), glm::vec3(20, 0, 0), glm::vec3(0, 6, 0), subdivisions);    // frente
+    addQuad(glm::vec3(-10, 0, -10), glm::vec3(20, 0, 0), glm::vec3(0, 6, 0), subdivisions);   // fondo
+    addQuad(glm::vec3(-10, 0, -10), glm::vec3(0, 0, 20), glm::vec3(0, 6, 0), subdivisions);   // izquierda
+    addQuad(glm::vec3(10, 0, -10), glm::vec3(0, 0, 20), glm::vec3(0, 6, 0), subdivisions);    // derecha
+    addQuad(glm::vec3(-10, 6, -10), glm::vec3(20, 0, 0), glm::vec3(0, 0, 20), subdivisions);  // techo
+    addQuad(glm::vec3(-10, 0, -10), glm::vec3(20, 0, 0), glm::vec3(0, 0, 20), subdivisions);  // piso
+
+    std::mt19937 random(5);
+    std::uniform_real_distribution<float> inside(-9.0f, 9.0f), outside(-40.0f, 40.0f), size(0.2f, 1.5f);
+    std::vector<CacheMesh> meshes;
+    for (int i = 0; i < 2000; i++) {
+        glm::vec3 center = i % 4 == 0 ? glm::vec3(outside(random), 0.5f, outside(random)) : glm::vec3(inside(random), 1.0f, inside(random));
+        CacheMesh mesh = CacheMesh();
+        mesh.boundsMin = center - glm::vec3(size(random));
+        mesh.boundsMax = center + glm::vec3(size(random));
+        meshes.push_back(mesh);
+    }
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    glm::vec3 player(0.0f, 0.8f, 18.0f);
+    glm::mat4 view = glm::lookAt(player + glm::vec3(0.0f, 4.0f, 12.0f), player, glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 viewProjection = projection * view;
+
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    const int iterations = 100;
+    std::cout << "[Occlusion] " << occluders.size() / 3 << " occluder triangles, " << meshes.size() << " boxes, "
+              << iterations << " iterations, SIMD " << (OCCLUSION_SIMD ? "SSE" : "off") << std::endl;
+    std::cout << "resolution  mode       threads  raster ms  test ms  culled" << std::endl;
+
+    const int resolutions[][2] = { { 256, 128 }, { 512, 256 } };
+    for (const auto& resolution : resolutions) {
+        for (int mode = 0; mode < 3; mode++) {
+            unsigned int modeThreads = mode == 2 ? threads : 1;
+            SoftwareOcclusion occlusion(resolution[0], resolution[1], modeThreads);
+            occlusion.simd = mode > 0 && OCCLUSION_SIMD;
+            occlusion.SetOccluders(occluders);
+            std::vector<uint8_t> mask;
+            double rasterMilliseconds = 0.0, testMilliseconds = 0.0;
+            unsigned int culled = 0;
+            for (int i = 0; i < iterations; i++) {
+                auto start = std::chrono::steady_clock::now();
+                occlusion.Render(viewProjection);
+                auto rendered = std::chrono::steady_clock::now();
+                culled = occlusion.Cull(meshes, viewProjection, nullptr, mask);
+                auto tested = std::chrono::steady_clock::now();
+                rasterMilliseconds += std::chrono::duration<double, std::milli>(rendered - start).count();
+                testMilliseconds += std::chrono::duration<double, std::milli>(tested - rendered).count();
+            }
+            std::cout << occlusion.Width() << "x" << occlusion.Height() << "     " << (occlusion.simd ? "sse   " : "scalar") << "     "
+                      << modeThreads << "        " << rasterMilliseconds / iterations << "   " << testMilliseconds / iterations
+                      << "   " << culled << "/" << meshes.size() << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,400 @@
+#pragma once
+
+// Visibilidad por celdas y portales para el interior de la casa. Las celdas
+// (cuartos) se describen en un archivo de texto junto al OBJ (casafinal.cells)
+// por el espacio de nombres de Maya de sus materiales; la caja de cada celda
+// es la union de sus submallas. Las submallas con texturas de puerta o ventana
+// se convierten en portales (un rectangulo sobre su cara mas grande) que unen
+// las celdas que tocan, o una celda con el exterior.
+//
+// Cada fotograma se recorre el grafo desde la celda de la camara, reduciendo
+// un rectangulo en pantalla a traves de cada portal, y solo se dibujan las
+// submallas de las celdas alcanzadas (mas las que no pertenecen a ninguna,
+// como las paredes que cruzan varios cuartos).
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "MeshBVH.h"
+#include "MeshCache.h"
+
+const uint32_t CELL_EXTERIOR = 0;
+const uint32_t CELL_NONE = 0xFFFFFFFF;  // submalla que se dibuja siempre
+const int PORTAL_MAX_DEPTH = 8;
+
+struct PortalCell
+{
+    std::string name;
+    std::vector<std::string> prefixes;  // espacios de nombres de material ("cama" para "cama:lambert4SG")
+    glm::vec3 boundsMin = glm::vec3(1e30f);
+    glm::vec3 boundsMax = glm::vec3(-1e30f);
+    bool explicitBounds = false;
+    std::vector<uint32_t> portals;
+};
+
+struct Portal
+{
+    glm::vec3 corners[4];
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    uint32_t cells[2];
+    uint32_t mesh;
+};
+
+// Rectangulo en coordenadas normalizadas de pantalla
+struct ScreenRect
+{
+    float minX = -1.0f, minY = -1.0f, maxX = 1.0f, maxY = 1.0f;
+
+    bool Empty() const { return this->minX >= this->maxX || this->minY >= this->maxY; }
+};
+
+inline bool BoxContains(const glm::vec3& outerMin, const glm::vec3& outerMax, const glm::vec3& innerMin, const glm::vec3& innerMax)
+{
+    return outerMin.x <= innerMin.x && outerMin.y <= innerMin.y && outerMin.z <= innerMin.z &&
+           innerMax.x <= outerMax.x && innerMax.y <= outerMax.y && innerMax.z <= outerMax.z;
+}
+
+inline bool BoxesOverlap(const glm::vec3& aMin, const glm::vec3& aMax, const glm::vec3& bMin, const glm::vec3& bMax)
+{
+    return aMin.x <= bMax.x && aMin.y <= bMax.y && aMin.z <= bMax.z &&
+           bMin.x <= aMax.x && bMin.y <= aMax.y && bMin.z <= aMax.z;
+}
+
+class PortalVisibility
+{
+public:
+    // Lee el archivo de celdas; sin archivo el sistema queda apagado y se dibuja todo
+    bool Load(const std::string& path, const std::vector<CacheMesh>& meshes, const std::vector<CacheMaterial>& materials)
+    {
+        std::ifstream file(path);
+        if (!file) {
+            std::cout << "[Portals] no cell file " << path << ", drawing every room" << std::endl;
+            return false;
+        }
+
+        this->cells.clear();
+        this->portals.clear();
+        PortalCell exterior;
+        exterior.name = "EXTERIOR";
+        this->cells.push_back(exterior);
+
+        float margin = 0.5f;
+        std::vector<std::string> portalTextures;
+        std::string line;
+        while (std::getline(file, line)) {
+            std::istringstream tokens(line);
+            std::string keyword;
+            if (!(tokens >> keyword) || keyword[0] == '#') {
+                continue;
+            }
+            if (keyword == "margin") {
+                tokens >> margin;
+            }
+            else if (keyword == "cell") {
+                PortalCell cell;
+                tokens >> cell.name;
+                std::string prefix;
+                while (tokens >> prefix) {
+                    cell.prefixes.push_back(prefix);
+                }
+                this->cells.push_back(cell);
+            }
+            else if (keyword == "box") {
+                std::string name;
+                glm::vec3 boundsMin, boundsMax;
+                tokens >> name >> boundsMin.x >> boundsMin.y >> boundsMin.z >> boundsMax.x >> boundsMax.y >> boundsMax.z;
+                for (PortalCell& cell : this->cells) {
+                    if (cell.name == name) {
+                        cell.boundsMin = boundsMin;
+                        cell.boundsMax = boundsMax;
+                        cell.explicitBounds = true;
+                    }
+                }
+            }
+            else if (keyword == "portal") {
+                std::string texture;
+                while (tokens >> texture) {
+                    portalTextures.push_back(texture);
+                }
+            }
+            else {
+                std::cout << "ERROR::PORTALS:: unknown keyword '" << keyword << "' in " << path << std::endl;
+            }
+        }
+
+        this->build(meshes, materials, margin, portalTextures);
+        this->enabled = true;
+
+        std::cout << "[Portals] " << this->cells.size() - 1 << " rooms, " << this->portals.size() << " portals" << std::endl;
+        for (uint32_t i = 0; i < this->cells.size(); i++) {
+            size_t count = std::count(this->meshCells.begin(), this->meshCells.end(), i);
+            std::cout << "  " << this->cells[i].name << ": " << count << " meshes, " << this->cells[i].portals.size() << " portals";
+            if (i != CELL_EXTERIOR && this->cells[i].portals.empty()) {
+                std::cout << " (always drawn)";
+            }
+            if (i != CELL_EXTERIOR) {
+                const PortalCell& cell = this->cells[i];
+                std::cout << ", box (" << cell.boundsMin.x << ", " << cell.boundsMin.y << ", " << cell.boundsMin.z << ") - ("
+                          << cell.boundsMax.x << ", " << cell.boundsMax.y << ", " << cell.boundsMax.z << ")";
+            }
+            std::cout << std::endl;
+        }
+        return true;
+    }
+
+    bool Enabled() const { return this->enabled; }
+
+    // Recorre los portales desde la celda que contiene el ojo y deja en Mask()
+    // las submallas visibles. viewProjection debe incluir la matriz de modelo
+    void Update(const glm::vec3& eye, const glm::mat4& viewProjection)
+    {
+        if (!this->enabled) {
+            return;
+        }
+        this->cellVisible.assign(this->cells.size(), 0);
+        this->portalsTested = 0;
+        this->cameraCell = this->cellAt(eye);
+        this->visit(this->cameraCell, ScreenRect(), viewProjection, Frustum(viewProjection), CELL_NONE, 0);
+        // Un cuarto sin portales no se puede alcanzar por el grafo; se deja
+        // visible para no perder muebles si el archivo de celdas esta incompleto
+        for (uint32_t c = 1; c < this->cells.size(); c++) {
+            if (this->cells[c].portals.empty()) {
+                this->cellVisible[c] = 1;
+            }
+        }
+
+        this->mask.resize(this->meshCells.size());
+        for (size_t i = 0; i < this->meshCells.size(); i++) {
+            this->mask[i] = this->meshCells[i] == CELL_NONE || this->cellVisible[this->meshCells[i]];
+        }
+
+        // El reporte solo se imprime cuando cambia el conjunto de celdas visibles
+        if (this->cellVisible != this->lastReported || this->cameraCell != this->lastCameraCell) {
+            std::cout << "[Portals] camera in " << this->cells[this->cameraCell].name << ", visible cells:";
+            for (uint32_t i = 0; i < this->cells.size(); i++) {
+                if (this->cellVisible[i]) {
+                    std::cout << " " << this->cells[i].name;
+                }
+            }
+            std::cout << " (" << this->portalsTested << " portals tested)" << std::endl;
+            this->lastReported = this->cellVisible;
+            this->lastCameraCell = this->cameraCell;
+        }
+    }
+
+    // Mascara por submalla para CachedModel::Draw; nullptr si esta apagado
+    const std::vector<uint8_t>* Mask() const { return this->enabled ? &this->mask : nullptr; }
+
+    std::vector<std::string> VisibleCells() const
+    {
+        std::vector<std::string> names;
+        for (uint32_t i = 0; i < this->cellVisible.size(); i++) {
+            if (this->cellVisible[i]) {
+                names.push_back(this->cells[i].name);
+            }
+        }
+        return names;
+    }
+
+    // Caja del cuarto "name" (calculada o de "box"); false si no existe
+    bool CellBounds(const std::string& name, glm::vec3& boundsMin, glm::vec3& boundsMax) const
+    {
+        for (uint32_t c = 1; c < this->cells.size(); c++) {
+            if (this->cells[c].name == name) {
+                boundsMin = this->cells[c].boundsMin;
+                boundsMax = this->cells[c].boundsMax;
+                return boundsMin.x <= boundsMax.x;
+            }
+        }
+        return false;
+    }
+
+private:
+    bool enabled = false;
+    std::vector<PortalCell> cells;
+    std::vector<Portal> portals;
+    std::vector<uint32_t> meshCells;    // celda de cada submalla o CELL_NONE
+    std::vector<uint8_t> cellVisible;
+    std::vector<uint8_t> mask;
+    std::vector<uint8_t> lastReported;
+    uint32_t cameraCell = CELL_EXTERIOR;
+    uint32_t lastCameraCell = CELL_NONE;
+    unsigned int portalsTested = 0;
+
+    static std::string namespaceOf(const char* material)
+    {
+        const char* colon = std::strchr(material, ':');
+        return colon != nullptr ? std::string(material, colon) : std::string();
+    }
+
+    void build(const std::vector<CacheMesh>& meshes, const std::vector<CacheMaterial>& materials, float margin,
+               const std::vector<std::string>& portalTextures)
+    {
+        this->meshCells.assign(meshes.size(), CELL_NONE);
+        std::vector<uint8_t> isPortal(meshes.size(), 0);
+
+        // 1. Submallas etiquetadas por el espacio de nombres de su material
+        for (uint32_t i = 0; i < meshes.size(); i++) {
+            const CacheMaterial& material = materials[meshes[i].material];
+            if (std::find(portalTextures.begin(), portalTextures.end(), std::string(material.diffuse)) != portalTextures.end()) {
+                isPortal[i] = 1;
+                continue;
+            }
+            std::string space = namespaceOf(material.name);
+            for (uint32_t c = 1; c < this->cells.size(); c++) {
+                const std::vector<std::string>& prefixes = this->cells[c].prefixes;
+                if (!space.empty() && std::find(prefixes.begin(), prefixes.end(), space) != prefixes.end()) {
+                    this->meshCells[i] = c;
+                }
+            }
+        }
+
+        // 2. Caja de cada celda: union de sus submallas mas el margen
+        for (uint32_t i = 0; i < meshes.size(); i++) {
+            uint32_t c = this->meshCells[i];
+            if (c != CELL_NONE && !this->cells[c].explicitBounds) {
+                this->cells[c].boundsMin = glm::min(this->cells[c].boundsMin, meshes[i].boundsMin);
+                this->cells[c].boundsMax = glm::max(this->cells[c].boundsMax, meshes[i].boundsMax);
+            }
+        }
+        for (uint32_t c = 1; c < this->cells.size(); c++) {
+            if (!this->cells[c].explicitBounds && this->cells[c].boundsMin.x <= this->cells[c].boundsMax.x) {
+                this->cells[c].boundsMin -= glm::vec3(margin);
+                this->cells[c].boundsMax += glm::vec3(margin);
+            }
+        }
+
+        // 3. Submallas sin etiqueta: dentro de un solo cuarto van a ese cuarto,
+        //    fuera de todos al exterior y las que cruzan cuartos se dibujan siempre
+        for (uint32_t i = 0; i < meshes.size(); i++) {
+            if (this->meshCells[i] != CELL_NONE || isPortal[i]) {
+                continue;
+            }
+            uint32_t container = CELL_NONE;
+            bool touchesRoom = false;
+            for (uint32_t c = 1; c < this->cells.size(); c++) {
+                if (BoxContains(this->cells[c].boundsMin, this->cells[c].boundsMax, meshes[i].boundsMin, meshes[i].boundsMax)) {
+                    container = c;
+                }
+                touchesRoom = touchesRoom || BoxesOverlap(this->cells[c].boundsMin, this->cells[c].boundsMax, meshes[i].boundsMin, meshes[i].boundsMax);
+            }
+            this->meshCells[i] = container != CELL_NONE ? container : (touchesRoom ? CELL_NONE : CELL_EXTERIOR);
+        }
+
+        // 4. Portales: rectangulo en la cara mas grande de la caja de la submalla
+        for (uint32_t i = 0; i < meshes.size(); i++) {
+            if (!isPortal[i]) {
+                continue;
+            }
+            Portal portal;
+            portal.mesh = i;
+            portal.boundsMin = meshes[i].boundsMin - glm::vec3(margin);
+            portal.boundsMax = meshes[i].boundsMax + glm::vec3(margin);
+            glm::vec3 extent = meshes[i].boundsMax - meshes[i].boundsMin;
+            int thin = extent.x < extent.y ? (extent.x < extent.z ? 0 : 2) : (extent.y < extent.z ? 1 : 2);
+            int u = (thin + 1) % 3, v = (thin + 2) % 3;
+            glm::vec3 center = (meshes[i].boundsMin + meshes[i].boundsMax) * 0.5f;
+            for (int k = 0; k < 4; k++) {
+                glm::vec3 corner = center;
+                corner[u] = (k == 1 || k == 2) ? meshes[i].boundsMax[u] : meshes[i].boundsMin[u];
+                corner[v] = (k >= 2) ? meshes[i].boundsMax[v] : meshes[i].boundsMin[v];
+                portal.corners[k] = corner;
+            }
+
+            std::vector<uint32_t> touching;
+            for (uint32_t c = 1; c < this->cells.size(); c++) {
+                if (BoxesOverlap(this->cells[c].boundsMin, this->cells[c].boundsMax, portal.boundsMin, portal.boundsMax)) {
+                    touching.push_back(c);
+                }
+            }
+            if (touching.size() == 1) {
+                touching.push_back(CELL_EXTERIOR);
+            }
+            for (size_t a = 0; a < touching.size(); a++) {
+                for (size_t b = a + 1; b < touching.size(); b++) {
+                    portal.cells[0] = touching[a];
+                    portal.cells[1] = touching[b];
+                    this->cells[touching[a]].portals.push_back(uint32_t(this->portals.size()));
+                    this->cells[touching[b]].portals.push_back(uint32_t(this->portals.size()));
+                    this->portals.push_back(portal);
+                }
+            }
+        }
+    }
+
+    // El cuarto mas pequeno que contiene el punto, o el exterior
+    uint32_t cellAt(const glm::vec3& point) const
+    {
+        uint32_t best = CELL_EXTERIOR;
+        float bestVolume = 1e30f;
+        for (uint32_t c = 1; c < this->cells.size(); c++) {
+            const PortalCell& cell = this->cells[c];
+            if (BoxContains(cell.boundsMin, cell.boundsMax, point, point)) {
+                glm::vec3 size = cell.boundsMax - cell.boundsMin;
+                if (size.x * size.y * size.z < bestVolume) {
+                    bestVolume = size.x * size.y * size.z;
+                    best = c;
+                }
+            }
+        }
+        return best;
+    }
+
+    // Rectangulo del portal en pantalla recortado contra "rect"; si alguna
+    // esquina queda detras de la camara se usa "rect" completo (conservador)
+    static ScreenRect clipPortal(const Portal& portal, const ScreenRect& rect, const glm::mat4& viewProjection)
+    {
+        ScreenRect projected;
+        projected.minX = projected.minY = 1e30f;
+        projected.maxX = projected.maxY = -1e30f;
+        for (const glm::vec3& corner : portal.corners) {
+            glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+            if (clip.w <= 1e-4f) {
+                return rect;
+            }
+            projected.minX = std::min(projected.minX, clip.x / clip.w);
+            projected.minY = std::min(projected.minY, clip.y / clip.w);
+            projected.maxX = std::max(projected.maxX, clip.x / clip.w);
+            projected.maxY = std::max(projected.maxY, clip.y / clip.w);
+        }
+        ScreenRect result;
+        result.minX = std::max(rect.minX, projected.minX);
+        result.minY = std::max(rect.minY, projected.minY);
+        result.maxX = std::min(rect.maxX, projected.maxX);
+        result.maxY = std::min(rect.maxY, projected.maxY);
+        return result;
+    }
+
+    void visit(uint32_t cell, const ScreenRect& rect, const glm::mat4& viewProjection, const Frustum& frustum, uint32_t fromPortal, int depth)
+    {
+        this->cellVisible[cell] = 1;
+        if (depth >= PORTAL_MAX_DEPTH) {
+            return;
+        }
+        for (uint32_t p : this->cells[cell].portals) {
+            if (p == fromPortal) {
+                continue;
+            }
+            const Portal& portal = this->portals[p];
+            this->portalsTested++;
+            if (TestBox(frustum, portal.boundsMin, portal.boundsMax) == CULL_OUTSIDE) {
+                continue;
+            }
+            ScreenRect clipped = clipPortal(portal, rect, viewProjection);
+            if (clipped.Empty()) {
+                continue;
+            }
+            uint32_t neighbor = portal.cells[0] == cell ? portal.cells[1] : portal.cells[0];
+            this->visit(neighbor, clipped, viewProjection, frustum, p, depth + 1);
+        }
+    }
+};
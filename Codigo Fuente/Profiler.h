@@ -0,0 +1,421 @@
+#pragma once
+
+// Perfilador de fotogramas en CPU y GPU. Cada fase del bucle se envuelve con
+// PROFILE_SCOPE("Nombre"): toma el tiempo de CPU al entrar y salir y, si es
+// una fase de primer nivel del hilo de OpenGL, una consulta GL_TIME_ELAPSED.
+// Las consultas se leen un fotograma despues (dos juegos alternados) y solo
+// si ya estan listas, asi que nunca detienen al driver. Los eventos van a un
+// buffer circular sin bloqueos en el que puede escribir cualquier hilo; el
+// hilo principal lo vacia en EndFrame, imprime percentiles por fase cada
+// pocos segundos y puede guardar todo en formato trace_event de Chrome
+// (chrome://tracing o ui.perfetto.dev).
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "GLStats.h"
+
+const size_t PROFILER_RING_SIZE = 1 << 16;       // potencia de dos
+const unsigned int PROFILER_GPU_BUFFERS = 2;     // juegos de consultas alternados
+const unsigned int PROFILER_MAX_GPU_SCOPES = 32; // fases con consulta por fotograma
+const size_t PROFILER_MAX_TRACE_EVENTS = 1 << 21;
+const uint32_t PROFILER_GPU_THREAD = 0xffffffffu; // pista de la GPU en el trace
+
+struct ProfileEvent
+{
+    const char* name;
+    uint32_t thread;
+    uint64_t frame;
+    int64_t begin;  // nanosegundos desde que se creo el perfilador
+    int64_t end;
+};
+
+class FrameProfiler
+{
+public:
+    FrameProfiler()
+        : ring(new Slot[PROFILER_RING_SIZE]), origin(std::chrono::steady_clock::now())
+    {
+        for (size_t i = 0; i < PROFILER_RING_SIZE; i++) {
+            this->ring[i].sequence.store(0, std::memory_order_relaxed);
+        }
+    }
+
+
+    FrameProfiler(const FrameProfiler&) = delete;
+    FrameProfiler& operator=(const FrameProfiler&) = delete;
+
+    void SetEnabled(bool value)
+    {
+        this->enabled.store(value, std::memory_order_relaxed);
+        std::cout << "[Profiler] " << (value ? "enabled" : "disabled") << std::endl;
+    }
+
+    bool Enabled() const { return this->enabled.load(std::memory_order_relaxed); }
+
+    // Guarda los eventos para escribirlos con WriteTrace (sin esto solo se
+    // calculan los percentiles)
+    void KeepTrace(bool value) { this->keepTrace = value; }
+
+    // El hilo que llama tiene el contexto de OpenGL: sus fases de primer
+    // nivel tambien se miden en la GPU
+    void SetGpuThread(const char* name)
+    {
+        this->gpuThread = this->ThreadIndex(name);
+    }
+
+    // Indice pequeno del hilo que llama, con nombre para el trace
+    uint32_t ThreadIndex(const char* name = nullptr)
+    {
+        thread_local uint32_t index = this->nextThread.fetch_add(1);
+        if (name != nullptr) {
+            std::lock_guard<std::mutex> lock(this->namesMutex);
+            this->threadNames[index] = name;
+        }
+        return index;
+    }
+
+    int64_t Now() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->origin).count();
+    }
+
+    // Devuelve la consulta abierta o -1; una sola GL_TIME_ELAPSED puede
+    // estar activa a la vez
+    int BeginGpu(const char* name, int64_t begin)
+    {
+        uint64_t current = this->frame.load(std::memory_order_relaxed);
+        GpuFrame& frame = this->gpuFrames[current % PROFILER_GPU_BUFFERS];
+        if (this->gpuOpen || frame.count >= PROFILER_MAX_GPU_SCOPES) {
+            return -1;
+        }
+        if (!this->queriesCreated) {
+            for (GpuFrame& gpuFrame : this->gpuFrames) {
+                glGenQueries(PROFILER_MAX_GPU_SCOPES, gpuFrame.queries);
+            }
+            this->queriesCreated = true;
+        }
+        int scope = int(frame.count++);
+        frame.names[scope] = name;
+        frame.begins[scope] = begin;
+        frame.frame = current;
+        GL_COUNT(glBeginQuery(GL_TIME_ELAPSED, frame.queries[scope]));
+        this->gpuOpen = true;
+        return scope;
+    }
+
+    void EndGpu()
+    {
+        GL_COUNT(glEndQuery(GL_TIME_ELAPSED));
+        this->gpuOpen = false;
+    }
+
+    bool IsGpuThread(uint32_t thread) const { return thread == this->gpuThread; }
+
+    // Cualquier hilo; si el lector se atrasa mas de PROFILER_RING_SIZE
+    // eventos los mas viejos se pierden
+    void Record(const char* name, uint32_t thread, int64_t begin, int64_t end)
+    {
+        this->push(name, thread, this->frame.load(std::memory_order_relaxed), begin, end);
+    }
+
+    // Hilo principal, despues del ultimo PROFILE_SCOPE del fotograma.
+    // Devuelve un resumen corto cuando imprime (para el titulo de la ventana)
+    std::string EndFrame(double now, double interval = 2.0)
+    {
+        if (!this->Enabled()) {
+            this->frameBegin = -1;
+            return std::string();
+        }
+        int64_t end = this->Now();
+        if (this->frameBegin >= 0) {
+            this->Record("Frame", this->gpuThread, this->frameBegin, end);
+        }
+        this->frameBegin = end;
+
+        // Las consultas del juego que se va a reusar son de hace un fotograma
+        uint64_t next = this->frame.load(std::memory_order_relaxed) + 1;
+        this->frame.store(next, std::memory_order_relaxed);
+        this->collectGpu(this->gpuFrames[next % PROFILER_GPU_BUFFERS]);
+        this->drain();
+
+        if (now - this->lastReport < interval) {
+            return std::string();
+        }
+        this->lastReport = now;
+        return this->report();
+    }
+
+    // Libera las consultas; antes de destruir el contexto
+    void Shutdown()
+    {
+        this->enabled.store(false, std::memory_order_relaxed);
+        if (this->queriesCreated) {
+            for (GpuFrame& frame : this->gpuFrames) {
+                glDeleteQueries(PROFILER_MAX_GPU_SCOPES, frame.queries);
+                frame.count = 0;
+            }
+            this->queriesCreated = false;
+        }
+    }
+
+    // Archivo JSON de trace_event con todo lo guardado desde KeepTrace(true)
+    bool WriteTrace(const std::string& path)
+    {
+        this->drain();
+        std::ofstream file(path);
+        if (!file) {
+            std::cout << "ERROR::PROFILER::CANNOT_WRITE_TRACE: " << path << std::endl;
+            return false;
+        }
+        file << "{\"traceEvents\":[\n";
+        bool first = true;
+        {
+            std::lock_guard<std::mutex> lock(this->namesMutex);
+            for (const auto& entry : this->threadNames) {
+                file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << entry.first
+                     << ",\"args\":{\"name\":\"" << entry.second << "\"}}";
+                first = false;
+            }
+        }
+        file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << PROFILER_GPU_THREAD
+             << ",\"args\":{\"name\":\"GPU\"}}";
+        file << std::fixed << std::setprecision(3);
+        for (const ProfileEvent& event : this->trace) {
+            bool gpu = event.thread == PROFILER_GPU_THREAD;
+            file << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"" << (gpu ? "gpu" : "cpu") << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                 << event.thread << ",\"ts\":" << event.begin / 1000.0 << ",\"dur\":" << (event.end - event.begin) / 1000.0
+                 << ",\"args\":{\"frame\":" << event.frame << "}}";
+        }
+        file << "\n]}\n";
+        std::cout << "[Profiler] Wrote " << this->trace.size() << " events to " << path;
+        if (this->droppedEvents > 0) {
+            std::cout << " (" << this->droppedEvents << " dropped)";
+        }
+        std::cout << std::endl;
+        return true;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<uint64_t> sequence;  // indice + 1 cuando el evento esta completo
+        ProfileEvent event;
+    };
+
+    struct GpuFrame
+    {
+        GLuint queries[PROFILER_MAX_GPU_SCOPES];
+        const char* names[PROFILER_MAX_GPU_SCOPES];
+        int64_t begins[PROFILER_MAX_GPU_SCOPES];
+        unsigned int count = 0;
+        uint64_t frame = 0;
+    };
+
+    struct PhaseSamples
+    {
+        std::vector<float> cpu;  // milisegundos
+        std::vector<float> gpu;
+    };
+
+    void push(const char* name, uint32_t thread, uint64_t frame, int64_t begin, int64_t end)
+    {
+        uint64_t index = this->head.fetch_add(1, std::memory_order_relaxed);
+        Slot& slot = this->ring[index & (PROFILER_RING_SIZE - 1)];
+        slot.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.event.name = name;
+        slot.event.thread = thread;
+        slot.event.frame = frame;
+        slot.event.begin = begin;
+        slot.event.end = end;
+        slot.sequence.store(index + 1, std::memory_order_release);
+    }
+
+    void collectGpu(GpuFrame& frame)
+    {
+        for (unsigned int i = 0; i < frame.count; i++) {
+            GLint available = 0;
+            GL_COUNT(glGetQueryObjectiv(frame.queries[i], GL_QUERY_RESULT_AVAILABLE, &available));
+            if (!available) {
+                this->lateQueries++;
+                continue;
+            }
+            GLuint64 elapsed = 0;
+            GL_COUNT(glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &elapsed));
+            // La pista de la GPU empieza donde empezo la fase en la CPU
+            this->push(frame.names[i], PROFILER_GPU_THREAD, frame.frame, frame.begins[i], frame.begins[i] + int64_t(elapsed));
+        }
+        frame.count = 0;
+    }
+
+    // Pasa los eventos completos del buffer circular a las muestras
+    void drain()
+    {
+        uint64_t head = this->head.load(std::memory_order_acquire);
+        if (head - this->tail > PROFILER_RING_SIZE) {
+            this->droppedEvents += head - this->tail - PROFILER_RING_SIZE;
+            this->tail = head - PROFILER_RING_SIZE;
+        }
+        while (this->tail < head) {
+            Slot& slot = this->ring[this->tail & (PROFILER_RING_SIZE - 1)];
+            uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+            if (sequence < this->tail + 1) {
+                break;  // otro hilo todavia lo esta escribiendo; sigue el proximo fotograma
+            }
+            ProfileEvent event = slot.event;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) != this->tail + 1) {
+                this->droppedEvents++;  // sobrescrito mientras se copiaba
+                this->tail++;
+                continue;
+            }
+            this->tail++;
+            PhaseSamples& samples = this->phases[event.name];
+            float ms = float(event.end - event.begin) / 1e6f;
+            (event.thread == PROFILER_GPU_THREAD ? samples.gpu : samples.cpu).push_back(ms);
+            if (this->keepTrace && this->trace.size() < PROFILER_MAX_TRACE_EVENTS) {
+                this->trace.push_back(event);
+            }
+        }
+    }
+
+    static float percentile(std::vector<float>& values, float p)
+    {
+        size_t index = std::min(values.size() - 1, size_t(p * float(values.size() - 1) + 0.5f));
+        std::nth_element(values.begin(), values.begin() + index, values.end());
+        return values[index];
+    }
+
+    std::string report()
+    {
+        std::ostringstream title;
+        title << std::fixed << std::setprecision(2);
+        std::cout << std::fixed << std::setprecision(3);
+        std::cout << "[Profiler] ms per phase (p50 / p95 / p99)";
+        if (this->lateQueries > 0) {
+            std::cout << ", " << this->lateQueries << " GPU queries not ready";
+        }
+        std::cout << std::endl;
+        for (auto& entry : this->phases) {
+            PhaseSamples& samples = entry.second;
+            if (samples.cpu.empty() && samples.gpu.empty()) {
+                continue;
+            }
+            std::cout << "    " << std::left << std::setw(16) << entry.first << std::right;
+            if (!samples.cpu.empty()) {
+                std::cout << " cpu " << percentile(samples.cpu, 0.5f) << " / " << percentile(samples.cpu, 0.95f) << " / " << percentile(samples.cpu, 0.99f);
+            }
+            if (!samples.gpu.empty()) {
+                std::cout << " gpu " << percentile(samples.gpu, 0.5f) << " / " << percentile(samples.gpu, 0.95f) << " / " << percentile(samples.gpu, 0.99f);
+            }
+            std::cout << std::endl;
+            if (entry.first == "Frame" && !samples.cpu.empty()) {
+                title << "frame p50 " << percentile(samples.cpu, 0.5f) << " ms, p99 " << percentile(samples.cpu, 0.99f) << " ms";
+            }
+            samples.cpu.clear();
+            samples.gpu.clear();
+        }
+        std::cout << std::defaultfloat;
+        this->lateQueries = 0;
+        return title.str();
+    }
+
+    std::unique_ptr<Slot[]> ring;
+    std::atomic<uint64_t> head{ 0 };
+    uint64_t tail = 0;
+    std::chrono::steady_clock::time_point origin;
+    std::atomic<bool> enabled{ false };
+    std::atomic<uint32_t> nextThread{ 0 };
+    std::mutex namesMutex;
+    std::map<uint32_t, std::string> threadNames;
+
+    // Solo el hilo principal
+    uint32_t gpuThread = 0;
+    std::atomic<uint64_t> frame{ 0 };  // lo lee cualquier hilo al grabar
+    int64_t frameBegin = -1;
+    GpuFrame gpuFrames[PROFILER_GPU_BUFFERS];
+    bool queriesCreated = false;
+    bool gpuOpen = false;
+    unsigned int lateQueries = 0;
+    unsigned long long droppedEvents = 0;
+    std::map<std::string, PhaseSamples> phases;
+    bool keepTrace = false;
+    std::vector<ProfileEvent> trace;
+    double lastReport = 0.0;
+};
+
+inline FrameProfiler& Profiler()
+{
+    static FrameProfiler profiler;
+    return profiler;
+}
+
+// Mide desde su creacion hasta el final del bloque; con el perfilador
+// apagado solo cuesta leer un atomico
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char* name)
+        : name(name)
+    {
+        FrameProfiler& profiler = Profiler();
+        if (!profiler.Enabled()) {
+            return;
+        }
+        this->thread = profiler.ThreadIndex();
+        this->begin = profiler.Now();
+        if (profiler.IsGpuThread(this->thread) && Depth() == 0) {
+            this->gpuScope = profiler.BeginGpu(name, this->begin);
+        }
+        Depth()++;
+        this->active = true;
+    }
+
+    ~ProfileScope()
+    {
+        if (!this->active) {
+            return;
+        }
+        FrameProfiler& profiler = Profiler();
+        Depth()--;
+        if (this->gpuScope >= 0) {
+            profiler.EndGpu();
+        }
+        profiler.Record(this->name, this->thread, this->begin, profiler.Now());
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    // Anidamiento de fases en el hilo actual
+    static int& Depth()
+    {
+        thread_local int depth = 0;
+        return depth;
+    }
+
+    const char* name;
+    uint32_t thread = 0;
+    int64_t begin = 0;
+    int gpuScope = -1;
+    bool active = false;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
@@ -18,14 +18,42 @@
 #include <glm/gtc/type_ptr.hpp>
 
 // Archivos personalizados para manejar shaders, cmara y modelos 3D
-#include "Shader.h"
 #include "Camera.h"
-#include "Model.h"
+#include "CachedModel.h"
+#include "TextureCooker.h"
+#include "LightingState.h"
+#include "ClusteredLights.h"
+#include "ShaderVariants.h"
+#include "PortalVisibility.h"
+#include "OcclusionCulling.h"
+#include "Simulation.h"
+#include "Profiler.h"
+#include "HeadlessContext.h"
+#include "FrameBenchmark.h"
+#include "RenderQueue.h"
+#include "LightmapBaker.h"
+#include "IrradianceVolume.h"
+#include "CollisionWorld.h"
+#include "RoomStreaming.h"
+#include "SkinnedModel.h"
+
+// Estado del juego que avanza el hilo de simulacin: cada paso publica una
+// copia y el render dibuja la interpolacin de las dos ltimas
+struct SimulationState
+{
+    double time = 0.0; // Segundos de simulacin (pasos * dt)
+    glm::vec3 playerPosition;
+    glm::vec3 cameraOffset;
+    glm::vec3 cameraBoom; // Offset que pide el ratn, antes de acortarlo contra las paredes
+    glm::vec3 pointLightPositions[4];
+    bool lightActive = false; // Luz pulsante encendida (se alterna con ESPACIO)
+};
 
 // Prototipos de funciones para manejar entrada de teclado, ratn y movimiento
 void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mode);
 void MouseCallback(GLFWwindow* window, double xPos, double yPos);
-void DoMovement();
+void DoMovement(SimulationState& state, float dt);
+SimulationState InterpolateState(const SimulationState& previous, const SimulationState& current, float alpha);
 
 // Dimensiones iniciales de la ventana
 const GLuint WIDTH = 800, HEIGHT = 600;
@@ -36,20 +64,33 @@ Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
 
 // Variables para seguimiento del ratn
 GLfloat lastX = WIDTH / 4.0, lastY = HEIGHT / 4.0;
-bool keys[1024]; // Arreglo para almacenar estado de teclas
+SimulationInput simulationInput; // Teclas y ngulos de cmara que lee la simulacin
 bool firstMouse = true; // Evita saltos iniciales del ratn
 
 // Posicin de la luz (inicialmente en el origen)
 glm::vec3 lightPos(0.0f, 0.0f, 0.0f);
-bool active; // Estado de activacin de la luz
 
-// Posicin del personaje y offset de la cmara para vista en tercera persona
+// Posicin inicial del personaje y offset de la cmara para vista en tercera
+// persona (despus los mueve la simulacin)
 glm::vec3 playerPosition = glm::vec3(0.0f, 0.8f, 0.0f);
 glm::vec3 cameraOffset = glm::vec3(0.0f, 4.0f, 12.0f);
+const float PLAYER_SPEED = 20.0f; // Unidades por segundo; a esta velocidad Snoopy camina del todo
+
+// Colisin con la casa: el personaje es una cpsula que se desliza por las
+// paredes y la cmara es una esfera que se acerca al personaje si algo la tapa
+CollisionWorld collisionWorld;
+CollisionCapsule playerCapsule;
+const float CAMERA_COLLISION_RADIUS = 0.2f;
+const float CAMERA_MIN_BOOM = 0.5f;
+
+// Sol; el horneado de mapas de luz usa los mismos valores
+const glm::vec3 SUN_DIRECTION(-0.2f, -1.0f, -0.3f);
+const glm::vec3 SUN_AMBIENT(0.3f);
+const glm::vec3 SUN_DIFFUSE(0.6f);
 
-// Posiciones de las luces puntuales (inicialmente en el origen)
+// Posiciones iniciales de las luces puntuales (la primera sobre la casa)
 glm::vec3 pointLightPositions[] = {
-    glm::vec3(0.0f, 0.0f, 0.0f),
+    glm::vec3(0.0f, 5.0f, 0.0f),
     glm::vec3(0.0f, 0.0f, 0.0f),
     glm::vec3(0.0f, 0.0f, 0.0f),
     glm::vec3(0.0f, 0.0f, 0.0f)
@@ -101,259 +142,1088 @@ float vertices[] = {
      -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f
 };
 
-// Color inicial de la luz (apagada)
-glm::vec3 Light1 = glm::vec3(0);
+// Funcin principal
+int main(int argc, char** argv) {
+    // --serial-textures: decodifica y sube las texturas en el hilo principal
+    // antes del primer fotograma (para comparar con la carga en paralelo)
+    // --cook-textures: convierte las imgenes de Models a KTX2 (BC1/BC3 con
+    // mipmaps), imprime PSNR y ahorro de VRAM y termina; no necesita GPU
+    // --clustered: usa lighting.frag con iluminacin por clusters
+    // --lights N: agrega N luces puntuales repartidas por la casa (implica --clustered)
+    // --benchmark-lights: mide la asignacin de luces a clusters y termina
+    // --benchmark-occlusion: mide el rasterizado de occluders en la CPU y termina
+    // --benchmark-collision: mide rayos, esferas y cpsulas contra el BVH de colisin y termina
+    // --no-collision: el personaje y la cmara atraviesan las paredes
+    // --lod-error PX: error mximo en pxeles de los niveles de detalle (0 los desactiva)
+    // --benchmark-lod: mide tringulos y tiempo de la casa a varias distancias y termina
+    // --snoopies N: agrega N copias de Snoopy alrededor de la casa (una llamada por lote)
+    // --benchmark-instancing: compara N Draw contra un DrawInstanced y termina
+    // --analyze-meshes: imprime ACMR/ATVR de los modelos antes y despus de
+    // optimizarlos (solo CPU) y termina
+    // --tick-rate HZ: pasos por segundo del hilo de simulacin (120 por defecto)
+    // --profile: empieza con el perfilador encendido (la tecla P lo alterna)
+    // --trace ARCHIVO: guarda las fases medidas como trace_event de Chrome al salir
+    // --compact-vertices: sube los modelos con vrtices cuantizados de 16 bytes
+    // (si pasan la prueba de precisin) y usa lighting.vs con COMPACT_VERTEX
+    // --benchmark: dibuja sin ventana (EGL surfaceless en Linux, sirve con
+    // llvmpipe) siguiendo un recorrido e imprime percentiles en JSON
+    //   --frames N (600), --resolution ANCHOxALTO (1280x720),
+    //   --path ARCHIVO (recorrido grabado; sin l, una vuelta a la casa),
+    //   --benchmark-output ARCHIVO (adems de la consola)
+    // --record-path ARCHIVO: graba el recorrido jugando, para --path
+    // --bake-lightmaps: hornea la luz del sol (sombras y rebotes) de la casa
+    // en Models/casafinal.obj.lightmap y en una grilla de sondas para el
+    // personaje (Models/casafinal.obj.probes) usando todos los ncleos y termina
+    //   --lightmap-size N (1024), --lightmap-samples N (64), --lightmap-bounces N (2)
+    //   --probe-spacing X (1.0 unidades), --probe-samples N (256)
+    // --no-lightmaps: ignora el mapa de luz y las sondas y calcula el sol por pxel
+    // --full-shaders: usa siempre lighting.frag completo en vez de la
+    // permutacin que solo calcula las luces que aportan algo
+    //   --benchmark-variants (con --benchmark): repite el recorrido con cada
+    //   permutacin fija para comparar su costo por fragmento
+    // --no-shader-cache: compila todos los programas sin leer ni escribir los
+    // binarios de Shader/cache
+    // --no-streaming: no carga los muebles de Models/casafinal.rooms al
+    // acercarse a cada cuarto
+    //   --streaming-budget MS KB: tope por fotograma para subir lo que el
+    //   hilo de carga ya prepar (2 ms y 4096 KB por defecto)
+    // --no-skinning: dibuja a Snoopy rgido (Models/snoopy.obj) en vez del FBX animado
+    // --benchmark-skinning: anima y dibuja cada vez ms Snoopys con skinning
+    // en la GPU, imprime cuntos caben en un fotograma de 60 Hz y termina
+    bool clusteredLighting = false;
+    int extraLights = 0;
+    float lodError = LOD_PIXEL_ERROR;
+    bool benchmarkLod = false;
+    int snoopyCopies = 0;
+    bool benchmarkInstancing = false;
+    bool collision = true;
+    bool compactVertices = false;
+    double tickRate = SIMULATION_TICK_RATE;
+    bool profile = false;
+    std::string tracePath;
+    bool benchmark = false;
+    int benchmarkFrames = BENCHMARK_DEFAULT_FRAMES;
+    int benchmarkWidth = 1280, benchmarkHeight = 720;
+    std::string benchmarkPath, benchmarkOutput, recordPath;
+    bool bakeLightmaps = false;
+    bool useLightmaps = true;
+    LightmapSettings lightmapSettings;
+    IrradianceVolumeSettings probeSettings;
+    bool fullShaders = false;
+    bool benchmarkVariants = false;
+    bool shaderCache = true;
+    bool streaming = true;
+    double streamingMilliseconds = STREAMING_BUDGET_MILLISECONDS;
+    size_t streamingBytes = STREAMING_BUDGET_BYTES;
+    bool skinning = true;
+    bool benchmarkSkinning = false;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--serial-textures") {
+            TextureCache::Instance().SetAsync(false);
+        }
+        if (std::string(argv[i]) == "--cook-textures") {
+            return CookTextures("Models");
+        }
+        if (std::string(argv[i]) == "--clustered") {
+            clusteredLighting = true;
+        }
+        if (std::string(argv[i]) == "--lights" && i + 1 < argc) {
+            extraLights = std::atoi(argv[++i]);
+            clusteredLighting = true;
+        }
+        if (std::string(argv[i]) == "--benchmark-lights") {
+            return BenchmarkClusteredLights();
+        }
+        if (std::string(argv[i]) == "--benchmark-occlusion") {
+            return BenchmarkOcclusion();
+        }
+        if (std::string(argv[i]) == "--benchmark-collision") {
+            return BenchmarkCollision();
+        }
+        if (std::string(argv[i]) == "--no-collision") {
+            collision = false;
+        }
+        if (std::string(argv[i]) == "--lod-error" && i + 1 < argc) {
+            lodError = float(std::atof(argv[++i]));
+        }
+        if (std::string(argv[i]) == "--benchmark-lod") {
+            benchmarkLod = true;
+        }
+        if (std::string(argv[i]) == "--snoopies" && i + 1 < argc) {
+            snoopyCopies = std::atoi(argv[++i]);
+        }
+        if (std::string(argv[i]) == "--benchmark-instancing") {
+            benchmarkInstancing = true;
+        }
+        if (std::string(argv[i]) == "--compact-vertices") {
+            compactVertices = true;
+        }
+        if (std::string(argv[i]) == "--tick-rate" && i + 1 < argc) {
+            tickRate = std::atof(argv[++i]);
+        }
+        if (std::string(argv[i]) == "--profile") {
+            profile = true;
+        }
+        if (std::string(argv[i]) == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+            profile = true;
+        }
+        if (std::string(argv[i]) == "--benchmark") {
+            benchmark = true;
+        }
+        if (std::string(argv[i]) == "--frames" && i + 1 < argc) {
+            benchmarkFrames = std::max(1, std::atoi(argv[++i]));
+        }
+        if (std::string(argv[i]) == "--resolution" && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &benchmarkWidth, &benchmarkHeight) != 2 || benchmarkWidth <= 0 || benchmarkHeight <= 0) {
+                std::cout << "ERROR::BENCHMARK::BAD_RESOLUTION: " << argv[i] << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        if (std::string(argv[i]) == "--path" && i + 1 < argc) {
+            benchmarkPath = argv[++i];
+        }
+        if (std::string(argv[i]) == "--benchmark-output" && i + 1 < argc) {
+            benchmarkOutput = argv[++i];
+        }
+        if (std::string(argv[i]) == "--record-path" && i + 1 < argc) {
+            recordPath = argv[++i];
+        }
+        if (std::string(argv[i]) == "--bake-lightmaps") {
+            bakeLightmaps = true;
+        }
+        if (std::string(argv[i]) == "--lightmap-size" && i + 1 < argc) {
+            lightmapSettings.size = std::max(64, atoi(argv[++i]));
+        }
+        if (std::string(argv[i]) == "--lightmap-samples" && i + 1 < argc) {
+            lightmapSettings.samples = std::max(1, atoi(argv[++i]));
+        }
+        if (std::string(argv[i]) == "--lightmap-bounces" && i + 1 < argc) {
+            lightmapSettings.bounces = std::max(0, atoi(argv[++i]));
+        }
+        if (std::string(argv[i]) == "--probe-spacing" && i + 1 < argc) {
+            probeSettings.spacing = std::max(0.05f, float(atof(argv[++i])));
+        }
+        if (std::string(argv[i]) == "--probe-samples" && i + 1 < argc) {
+            probeSettings.samples = std::max(1, atoi(argv[++i]));
+        }
+        if (std::string(argv[i]) == "--no-lightmaps") {
+            useLightmaps = false;
+        }
+        if (std::string(argv[i]) == "--full-shaders") {
+            fullShaders = true;
+        }
+        if (std::string(argv[i]) == "--benchmark-variants") {
+            benchmarkVariants = true;
+        }
+        if (std::string(argv[i]) == "--no-shader-cache") {
+            shaderCache = false;
+        }
+        if (std::string(argv[i]) == "--no-streaming") {
+            streaming = false;
+        }
+        if (std::string(argv[i]) == "--streaming-budget" && i + 2 < argc) {
+            streamingMilliseconds = std::atof(argv[++i]);
+            streamingBytes = size_t(std::max(std::atoi(argv[++i]), 1)) * 1024;
+        }
+        if (std::string(argv[i]) == "--no-skinning") {
+            skinning = false;
+        }
+        if (std::string(argv[i]) == "--benchmark-skinning") {
+            benchmarkSkinning = true;
+        }
+        if (std::string(argv[i]) == "--analyze-meshes") {
+            AnalyzeModel("Models/casafinal.obj");
+            AnalyzeModel("Models/snoopy.obj");
+            return 0;
+        }
+    }
+
+    // Horneado sin GPU; el ambiente es solo el del sol. El de la segunda luz
+    // puntual no se multiplica por la textura, as que lighting.frag lo sigue
+    // sumando aparte. Las sondas usan las mismas luces y rebotes
+    if (bakeLightmaps) {
+        LightmapLights staticLights = { SUN_DIRECTION, SUN_DIFFUSE, SUN_AMBIENT };
+        int result = BakeLightmap("Models/casafinal.obj", staticLights, lightmapSettings);
+        if (result != 0) {
+            return result;
+        }
+        probeSettings.bounces = lightmapSettings.bounces;
+        return BakeIrradianceVolume("Models/casafinal.obj", staticLights, probeSettings);
+    }
 
-// Variables para calcular el tiempo entre fotogramas (movimiento suave)
-GLfloat deltaTime = 0.0f; // Tiempo entre el fotograma actual y el anterior
-GLfloat lastFrame = 0.0f; // Tiempo del ltimo fotograma
+    // En modo benchmark no hay ventana: el contexto dibuja en un framebuffer
+    // propio y las texturas se cargan antes del primer fotograma para que
+    // todas las ejecuciones dibujen lo mismo
+    GLFWwindow* window = nullptr;
+    HeadlessContext headless;
+    if (benchmark) {
+        if (!headless.Create(benchmarkWidth, benchmarkHeight)) {
+            return EXIT_FAILURE;
+        }
+        SCREEN_WIDTH = benchmarkWidth;
+        SCREEN_HEIGHT = benchmarkHeight;
+        TextureCache::Instance().SetAsync(false);
+    }
+    else {
+        // Inicializa GLFW para gestionar ventanas y eventos
+        glfwInit();
+
+        // Crea una ventana de 800x600 pxeles con el ttulo "Fuentes de luz"
+        window = glfwCreateWindow(WIDTH, HEIGHT, "Fuentes de luz", nullptr, nullptr);
+        if (nullptr == window) {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return EXIT_FAILURE; // Termina si no se pudo crear la ventana
+        }
 
-// Funcin principal
-int main() {
-    // Inicializa GLFW para gestionar ventanas y eventos
-    glfwInit();
+        // Establece la ventana como el contexto actual de OpenGL
+        glfwMakeContextCurrent(window);
+
+        // Obtiene las dimensiones reales del framebuffer
+        glfwGetFramebufferSize(window, &SCREEN_WIDTH, &SCREEN_HEIGHT);
 
-    // Crea una ventana de 800x600 pxeles con el ttulo "Fuentes de luz"
-    GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "Fuentes de luz", nullptr, nullptr);
-    if (nullptr == window) {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return EXIT_FAILURE; // Termina si no se pudo crear la ventana
+        // Asocia funciones de callback para teclado y ratn
+        glfwSetKeyCallback(window, KeyCallback);
+        glfwSetCursorPosCallback(window, MouseCallback);
+
+        // Configura GLEW para usar un enfoque moderno en extensiones
+        glewExperimental = GL_TRUE;
+        if (GLEW_OK != glewInit()) {
+            std::cout << "Failed to initialize GLEW" << std::endl;
+            return EXIT_FAILURE; // Termina si no se pudo inicializar GLEW
+        }
+
+        // Define el rea de renderizado (viewport) segn las dimensiones de la ventana
+        glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
     }
 
-    // Establece la ventana como el contexto actual de OpenGL
-    glfwMakeContextCurrent(window);
+    // Carga los programas para objetos iluminados y fuentes de luz. Todos
+    // pasan por CompileShaderVariant, que los toma de Shader/cache si ya se
+    // enlazaron antes con este mismo driver; el programa base solo se compila
+    // sin definiciones si la variante pedida (clusters o vrtices compactos)
+    // no enlaza
+    ProgramCache().SetEnabled(shaderCache);
+    bool shaderCacheReported = false;
+    GLuint lightingProgram = 0;
+    std::vector<std::string> lightingDefines;
+    if (clusteredLighting || compactVertices) {
+        std::vector<std::string> defines;
+        if (clusteredLighting) {
+            defines = ClusteredLights::ShaderDefines();
+        }
+        if (compactVertices) {
+            defines.push_back("COMPACT_VERTEX");
+        }
+        lightingProgram = CompileShaderVariant("Shader/lighting.vs", "Shader/lighting.frag", defines);
+        if (lightingProgram != 0) {
+            lightingDefines = defines;
+        }
+        else {
+            clusteredLighting = false;
+            compactVertices = false;
+        }
+    }
+    if (lightingProgram == 0) {
+        lightingProgram = CompileShaderVariant("Shader/lighting.vs", "Shader/lighting.frag", {});
+    }
+    if (lightingProgram == 0) {
+        TextureCache::Instance().Shutdown();
+        if (benchmark) {
+            headless.Destroy();
+        }
+        else {
+            glfwTerminate();
+        }
+        return EXIT_FAILURE;
+    }
 
-    // Obtiene las dimensiones reales del framebuffer
-    glfwGetFramebufferSize(window, &SCREEN_WIDTH, &SCREEN_HEIGHT);
+    // Las dems variantes de lighting.frag parten de las mismas definiciones
+    // base (clusters y vrtices compactos) y agregan las suyas; "without"
+    // quita de la base lo que esa variante no usa
+    auto variantDefines = [&](const std::vector<std::string>& extra, const std::vector<std::string>& without) {
+        std::vector<std::string> defines;
+        for (const std::string& define : lightingDefines) {
+            if (std::find(without.begin(), without.end(), define) == without.end()) {
+                defines.push_back(define);
+            }
+        }
+        defines.insert(defines.end(), extra.begin(), extra.end());
+        return defines;
+    };
+
+    // Variantes que leen la transformacin de cada instancia de un atributo:
+    // los cubos de las luces salen en una sola llamada y las copias de Snoopy
+    // tambin. Las copias usan las cuatro luces de siempre aunque est activo
+    // el modo clustered
+    bool lampInstanced = false;
+    GLuint lampProgram = CompileShaderVariant("Shader/lamp.vs", "Shader/lamp.frag", { "INSTANCED" });
+    if (lampProgram != 0) {
+        lampInstanced = true;
+    }
+    else {
+        lampProgram = CompileShaderVariant("Shader/lamp.vs", "Shader/lamp.frag", {});
+    }
+    std::vector<std::string> instancedDefines = variantDefines({ "INSTANCED" }, ClusteredLights::ShaderDefines());
+    GLuint instancedProgram = CompileShaderVariant("Shader/lighting.vs", "Shader/lighting.frag", instancedDefines);
+    if (instancedProgram == 0) {
+        instancedProgram = lightingProgram;
+        snoopyCopies = 0;
+        benchmarkInstancing = false;
+    }
 
-    // Asocia funciones de callback para teclado y ratn
-    glfwSetKeyCallback(window, KeyCallback);
-    glfwSetCursorPosCallback(window, MouseCallback);
+    // Carga los modelos 3D (casa y personaje); la primera ejecucin escribe un
+    // cache binario junto a cada OBJ y las siguientes lo mapean sin usar Assimp.
+    // Las texturas se decodifican en segundo plano y se muestran en gris hasta
+    // que estn listas
+    CachedModel Dog("Models/casafinal.obj", compactVertices); // Modelo de la casa
+    CachedModel personaje("Models/snoopy.obj", compactVertices); // Modelo del personaje
+
+    // La casa usa la variante LIGHTMAP si hay un mapa de luz horneado para ella
+    GLuint lightmapProgram = lightingProgram;
+    std::vector<std::string> casaDefines = lightingDefines;
+    bool casaBaked = false;
+    if (useLightmaps && Dog.HasLightmap()) {
+        std::vector<std::string> defines = variantDefines({ "LIGHTMAP" }, {});
+        GLuint program = CompileShaderVariant("Shader/lighting.vs", "Shader/lighting.frag", defines);
+        if (program != 0) {
+            lightmapProgram = program;
+            casaDefines = defines;
+            casaBaked = true;
+        }
+    }
 
-    // Configura GLEW para usar un enfoque moderno en extensiones
-    glewExperimental = GL_TRUE;
-    if (GLEW_OK != glewInit()) {
-        std::cout << "Failed to initialize GLEW" << std::endl;
-        return EXIT_FAILURE; // Termina si no se pudo inicializar GLEW
+    // El personaje toma la luz horneada de las sondas de la casa en su posicin
+    GLuint probeProgram = lightingProgram;
+    std::vector<std::string> personajeDefines = lightingDefines;
+    bool personajeBaked = false;
+    if (useLightmaps && Dog.Probes().Loaded()) {
+        std::vector<std::string> defines = variantDefines({ "IRRADIANCE_PROBES" }, {});
+        GLuint program = CompileShaderVariant("Shader/lighting.vs", "Shader/lighting.frag", defines);
+        if (program != 0) {
+            probeProgram = program;
+            personajeDefines = defines;
+            personajeBaked = true;
+        }
     }
 
-    // Define el rea de renderizado (viewport) segn las dimensiones de la ventana
-    glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+    // Snoopy animado (Models/snoopy.fbx): la pose se muestrea en otro hilo y
+    // el skinning lo hace lighting.vs con SKINNED, con las mismas definiciones
+    // que el personaje rgido. Si el FBX no se puede importar queda snoopy.obj
+    SkinnedModel snoopy;
+    bool skinned = (skinning || benchmarkSkinning) && snoopy.Load("Models/snoopy.fbx");
+    GLuint skinnedProgram = lightingProgram;
+    std::vector<std::string> skinnedDefines;
+    if (skinned) {
+        std::vector<std::string> extra = { "INSTANCED", "SKINNED" };
+        if (personajeBaked) {
+            extra.insert(extra.begin(), "IRRADIANCE_PROBES");
+        }
+        skinnedDefines = variantDefines(extra, { "COMPACT_VERTEX" });
+        GLuint program = CompileShaderVariant("Shader/lighting.vs", "Shader/lighting.frag", skinnedDefines);
+        if (program != 0) {
+            skinnedProgram = program;
+        }
+        else {
+            skinned = false;
+        }
+    }
+
+    // El FBX se lleva a la altura y al piso de snoopy.obj, as la escala 0.7
+    // del personaje vale para los dos
+    glm::mat4 snoopyFit(1.0f);
+    float snoopyHeight = snoopy.BoundsMax().y - snoopy.BoundsMin().y;
+    float personajeHeight = personaje.BoundsMax().y - personaje.BoundsMin().y;
+    if (skinned && snoopyHeight > 0.0f && personajeHeight > 0.0f) {
+        glm::vec3 snoopyBase((snoopy.BoundsMin().x + snoopy.BoundsMax().x) * 0.5f, snoopy.BoundsMin().y, (snoopy.BoundsMin().z + snoopy.BoundsMax().z) * 0.5f);
+        glm::vec3 personajeBase((personaje.BoundsMin().x + personaje.BoundsMax().x) * 0.5f, personaje.BoundsMin().y,
+                                (personaje.BoundsMin().z + personaje.BoundsMax().z) * 0.5f);
+        snoopyFit = glm::translate(glm::mat4(1.0f), personajeBase);
+        snoopyFit = glm::scale(snoopyFit, glm::vec3(personajeHeight / snoopyHeight));
+        snoopyFit = glm::translate(snoopyFit, -snoopyBase);
+    }
 
-    // Carga los shaders para objetos iluminados y fuentes de luz
-    Shader lightingShader("Shader/lighting.vs", "Shader/lighting.frag");
-    Shader lampShader("Shader/lamp.vs", "Shader/lamp.frag");
+    // Cuartos y portales de la casa (Models/casafinal.cells); solo se dibujan
+    // los cuartos que se ven desde la cmara a travs de puertas y ventanas
+    PortalVisibility casaPortals;
+    casaPortals.Load("Models/casafinal.cells", Dog.Meshes(), Dog.Materials());
+
+    // Paredes, techo y piso (Models/casafinal.occluders) se rasterizan en la CPU
+    // a un buffer de profundidad pequeo; lo que queda detrs no se dibuja
+    SoftwareOcclusion casaOcclusion;
+    casaOcclusion.Load("Models/casafinal.obj", "Models/casafinal.occluders");
+
+    // Tringulos de la casa para mover al personaje y a la cmara (el
+    // benchmark sigue un recorrido grabado y no los usa); las puertas de
+    // Models/casafinal.collision no chocan
+    if (collision && !benchmark) {
+        collisionWorld.Load("Models/casafinal.obj", "Models/casafinal.collision");
+    }
 
-    // Carga los modelos 3D (casa y personaje)
-    Model Dog((char*)"Models/casafinal.obj"); // Modelo de la casa
-    Model personaje((char*)"Models/snoopy.obj"); // Modelo del personaje
+    // Muebles de Models/casafinal.rooms: se cargan en segundo plano al
+    // acercarse el personaje a cada cuarto y se liberan al alejarse. El
+    // benchmark no los usa para que todas las ejecuciones dibujen lo mismo
+    RoomStreaming casaRooms;
+    if (streaming && !benchmark) {
+        casaRooms.Load("Models/casafinal.rooms", casaPortals, compactVertices);
+        casaRooms.SetBudget(streamingMilliseconds, streamingBytes);
+    }
 
-    // Configura los buffers para los vrtices del cubo (usado para luces)
-    GLuint VBO, VAO;
+    // Todas las salidas a partir de aqu pasan por el mismo cierre: primero se
+    // paran los hilos que todava pueden tocar modelos o texturas y despus se
+    // destruye el contexto (las texturas se liberan con l)
+    auto shutdownGraphics = [&]() {
+        Profiler().Shutdown();
+        casaRooms.Shutdown();
+        TextureCache::Instance().Shutdown();
+        if (benchmark) {
+            headless.Destroy();
+        }
+        else {
+            glfwTerminate();
+        }
+    };
+
+    // Configura los buffers para los vrtices del cubo (usado para luces); las
+    // esquinas repetidas se sueldan y el cubo se dibuja con ndices
+    std::vector<uint32_t> cubeRemap;
+    uint32_t cubeVertexCount = WeldVertexBytes(vertices, 36, 6 * sizeof(GLfloat), cubeRemap);
+    std::vector<GLfloat> cubeVertices(cubeVertexCount * 6);
+    for (size_t i = 0; i < cubeRemap.size(); i++) {
+        std::copy(vertices + i * 6, vertices + i * 6 + 6, cubeVertices.begin() + cubeRemap[i] * 6);
+    }
+    OptimizeVertexCache(cubeRemap.data(), cubeRemap.size());
+    GLuint VBO, VAO, cubeEBO;
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
+    glGenBuffers(1, &cubeEBO);
     glBindVertexArray(VAO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, cubeVertices.size() * sizeof(GLfloat), cubeVertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, cubeRemap.size() * sizeof(uint32_t), cubeRemap.data(), GL_STATIC_DRAW);
     // Atributo de posicin (3 componentes: x, y, z)
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (GLvoid*)0);
     glEnableVertexAttribArray(0);
     // Atributo de normal (3 componentes para iluminacin)
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(1);
+    // Transformaciones de los cuatro cubos, una por instancia
+    InstanceBuffer lampInstances;
+    lampInstances.Attach(VAO);
+
+    // Copias de Snoopy en un anillo alrededor de la casa
+    std::vector<glm::mat4> snoopyTransforms;
+    glm::vec3 casaCenter = (Dog.BoundsMin() + Dog.BoundsMax()) * 0.5f;
+    float ringRadius = glm::length(glm::vec2(Dog.BoundsMax().x - Dog.BoundsMin().x, Dog.BoundsMax().z - Dog.BoundsMin().z)) * 0.5f + 3.0f;
+    for (int i = 0; i < snoopyCopies; i++) {
+        float angle = glm::radians(360.0f) * i / snoopyCopies;
+        float radius = ringRadius + 2.0f * (i % 5);
+        glm::vec3 position(casaCenter.x + radius * cos(angle), playerPosition.y, casaCenter.z + radius * sin(angle));
+        glm::mat4 transform = glm::translate(glm::mat4(1.0f), position);
+        transform = glm::rotate(transform, -angle, glm::vec3(0.0f, 1.0f, 0.0f));
+        snoopyTransforms.push_back(glm::scale(transform, glm::vec3(0.7f)));
+    }
 
-    // Configura las unidades de textura en el shader de iluminacin
-    lightingShader.Use();
-    glUniform1i(glGetUniformLocation(lightingShader.Program, "Material.difuse"), 0);
-    glUniform1i(glGetUniformLocation(lightingShader.Program, "Material.specular"), 1);
+    // Las ubicaciones de las matrices se buscan una sola vez; el modelo del
+    // shader de iluminacin va en el bloque Object
+    GLint lightingViewLoc = glGetUniformLocation(lightingProgram, "view");
+    GLint lightingProjLoc = glGetUniformLocation(lightingProgram, "projection");
+    GLint lightmapViewLoc = glGetUniformLocation(lightmapProgram, "view");
+    GLint lightmapProjLoc = glGetUniformLocation(lightmapProgram, "projection");
+    GLint probeViewLoc = glGetUniformLocation(probeProgram, "view");
+    GLint probeProjLoc = glGetUniformLocation(probeProgram, "projection");
+    GLint skinnedViewLoc = glGetUniformLocation(skinnedProgram, "view");
+    GLint skinnedProjLoc = glGetUniformLocation(skinnedProgram, "projection");
+    GLint instancedViewLoc = glGetUniformLocation(instancedProgram, "view");
+    GLint instancedProjLoc = glGetUniformLocation(instancedProgram, "projection");
+    GLint lampModelLoc = glGetUniformLocation(lampProgram, "model");
+    GLint lampViewLoc = glGetUniformLocation(lampProgram, "view");
+    GLint lampProjLoc = glGetUniformLocation(lampProgram, "projection");
+
+    // Estado de las luces en un uniform buffer; las luces que no cambian se
+    // configuran aqu y el bucle solo actualiza lo que se mueve
+    LightingState lighting;
+
+    // Luz direccional (como un sol)
+    lighting.SetDirLight(SUN_DIRECTION, SUN_AMBIENT, SUN_DIFFUSE, glm::vec3(1.0f));
+
+    // Primera luz puntual (su color pulsa en el bucle)
+    lighting.SetPointLight(0, pointLightPositions[0], glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(1.0f, 0.2f, 0.2f), 1.0f, 0.045f, 0.075f);
+
+    // Las otras luces puntuales (desactivadas)
+    lighting.SetPointLight(1, pointLightPositions[1], glm::vec3(0.05f), glm::vec3(0.0f), glm::vec3(0.0f), 1.0f, 0.0f, 0.0f);
+    lighting.SetPointLight(2, pointLightPositions[2], glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), 1.0f, 0.0f, 0.0f);
+    lighting.SetPointLight(3, pointLightPositions[3], glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), 1.0f, 0.0f, 0.0f);
+
+    // Luz de foco (spotlight) que sigue la cmara
+    lighting.SetSpotLight(camera.GetPosition(), camera.GetFront(), glm::cos(glm::radians(12.0f)), glm::cos(glm::radians(18.0f)),
+                          glm::vec3(0.2f, 0.2f, 0.8f), glm::vec3(0.2f, 0.2f, 0.8f), glm::vec3(0.0f), 1.0f, 0.3f, 0.7f);
 
     // Define la matriz de proyeccin (perspectiva)
     glm::mat4 projection = glm::perspective(camera.GetZoom(), (GLfloat)SCREEN_WIDTH / (GLfloat)SCREEN_HEIGHT, 0.1f, 100.0f);
 
+    // Cada submalla usa el nivel de detalle ms simple que no se note en pantalla
+    Dog.SetLodProjection(projection, SCREEN_HEIGHT, lodError);
+    personaje.SetLodProjection(projection, SCREEN_HEIGHT, lodError);
+
+    // En modo clustered las luces puntuales viven en ClusteredLights: las
+    // cuatro de siempre (mismos ndices) ms las luces extra dentro de la casa
+    ClusteredLights clustered;
+    if (clusteredLighting) {
+        clustered.AddPointLight(pointLightPositions[0], glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(1.0f, 0.2f, 0.2f), 1.0f, 0.045f, 0.075f);
+        clustered.AddPointLight(pointLightPositions[1], glm::vec3(0.05f), glm::vec3(0.0f), glm::vec3(0.0f), 1.0f, 0.0f, 0.0f);
+        clustered.AddPointLight(pointLightPositions[2], glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), 1.0f, 0.0f, 0.0f);
+        clustered.AddPointLight(pointLightPositions[3], glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), 1.0f, 0.0f, 0.0f);
+        AddScatteredLights(clustered, extraLights, Dog.BoundsMin(), Dog.BoundsMax());
+        clustered.SetProjection(projection, 0.1f, 100.0f, SCREEN_WIDTH, SCREEN_HEIGHT);
+    }
+
+    // Todos los programas de lighting.frag (los fijos de aqu y las
+    // permutaciones que se compilan despus) se configuran igual: unidades de
+    // textura del material y del mapa de luz, bloques de luces y, en modo
+    // clustered, los buffers de los clusters. Se llama con el programa en uso
+    auto setupLightingProgram = [&](GLuint program) {
+        glUniform1i(glGetUniformLocation(program, "material.diffuse"), 0);
+        glUniform1i(glGetUniformLocation(program, "material.specular"), 1);
+        glUniform1f(glGetUniformLocation(program, "material.shininess"), 16.0f);
+        glUniform1i(glGetUniformLocation(program, "transparency"), 0);
+        glUniform1i(glGetUniformLocation(program, "lightmap"), LIGHTMAP_TEXTURE_UNIT);
+        lighting.Attach(program);
+        if (clusteredLighting) {
+            clustered.Attach(program);
+        }
+    };
+    for (GLuint program : { lightingProgram, instancedProgram, lightmapProgram, probeProgram, skinnedProgram }) {
+        glUseProgram(program);
+        setupLightingProgram(program);
+    }
+    snoopy.SetupProgram(skinnedProgram);
+
+    if (benchmarkLod) {
+        lighting.Upload();
+        lighting.SetObject(glm::mat4(1.0f));
+        glUniformMatrix4fv(lightingProjLoc, 1, GL_FALSE, glm::value_ptr(projection));
+        BenchmarkLod(Dog, lightingProgram, lightingViewLoc, projection, SCREEN_HEIGHT, (Dog.BoundsMin() + Dog.BoundsMax()) * 0.5f, cameraOffset);
+        shutdownGraphics();
+        return 0;
+    }
+    if (benchmarkInstancing) {
+        glm::mat4 benchmarkView = glm::lookAt(glm::vec3(0.0f, 12.0f, 15.0f), glm::vec3(0.0f, 0.0f, -20.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        lighting.Upload();
+        glUseProgram(instancedProgram);
+        glUniformMatrix4fv(instancedViewLoc, 1, GL_FALSE, glm::value_ptr(benchmarkView));
+        glUniformMatrix4fv(instancedProjLoc, 1, GL_FALSE, glm::value_ptr(projection));
+        glUseProgram(lightingProgram);
+        glUniformMatrix4fv(lightingViewLoc, 1, GL_FALSE, glm::value_ptr(benchmarkView));
+        glUniformMatrix4fv(lightingProjLoc, 1, GL_FALSE, glm::value_ptr(projection));
+        BenchmarkInstancing(personaje, lightingProgram, instancedProgram, lighting);
+        shutdownGraphics();
+        return 0;
+    }
+
+    // Permutaciones de lighting.frag para la casa y el personaje: cada
+    // fotograma se usa la que solo calcula las luces que aportan algo. Las
+    // variantes horneadas ya traen el sol y solo calculan las dos primeras
+    // luces puntuales (la que se mueve y el ambiente plano de la segunda), y
+    // en modo clustered las luces puntuales salen de los clusters
+    auto relevantFeatures = [&](bool baked) {
+        uint32_t relevant = LIGHTING_ALL_FEATURES;
+        if (clusteredLighting) {
+            relevant &= ~LIGHTING_POINT_LIGHT_MASK;
+        }
+        else if (baked) {
+            relevant &= ~(LIGHTING_POINT_LIGHT_MASK & ~(LIGHTING_POINT_LIGHT_0 | LIGHTING_POINT_LIGHT_1));
+        }
+        return relevant;
+    };
+    ShaderPermutations casaVariants("Shader/lighting.vs", "Shader/lighting.frag", casaDefines, LightingFeatureDefines,
+                                    relevantFeatures(casaBaked), { "view", "projection" });
+    ShaderPermutations personajeVariants("Shader/lighting.vs", "Shader/lighting.frag", personajeDefines, LightingFeatureDefines,
+                                         relevantFeatures(personajeBaked), { "view", "projection" });
+    ShaderPermutations skinnedVariants("Shader/lighting.vs", "Shader/lighting.frag", skinnedDefines, LightingFeatureDefines,
+                                       relevantFeatures(personajeBaked), { "view", "projection" });
+    casaVariants.OnCompile(setupLightingProgram);
+    personajeVariants.OnCompile(setupLightingProgram);
+    skinnedVariants.OnCompile([&](GLuint program) {
+        setupLightingProgram(program);
+        snoopy.SetupProgram(program);
+    });
+    uint32_t forcedFeatures = UINT32_MAX; // UINT32_MAX: segn las luces (--benchmark-variants fija otras)
+
+    // La medicin usa la variante SKINNED completa con las luces ya configuradas
+    if (benchmarkSkinning) {
+        if (skinned) {
+            glm::mat4 benchmarkView = glm::lookAt(glm::vec3(0.0f, 6.0f, 8.0f), glm::vec3(0.0f, 0.0f, -15.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            lighting.Upload();
+            glUseProgram(skinnedProgram);
+            glUniformMatrix4fv(skinnedViewLoc, 1, GL_FALSE, glm::value_ptr(benchmarkView));
+            glUniformMatrix4fv(skinnedProjLoc, 1, GL_FALSE, glm::value_ptr(projection));
+            int clip = std::max(snoopy.FindClip("walk"), snoopy.Clips().empty() ? -1 : 0);
+            BenchmarkSkinning(snoopy, skinnedProgram, clip);
+        }
+        shutdownGraphics();
+        return 0;
+    }
+
+    // Snoopy se queda en la pose de reposo (o en un clip "idle" si lo hay) y
+    // pasa al clip de caminar segn la velocidad con que se mueve
+    AnimationUpdater snoopyAnimation(1);
+    snoopyAnimation.SetRig(&snoopy.GetSkeleton(), &snoopy.Clips());
+    int snoopyIdleClip = snoopy.FindClip("idle");
+    int snoopyWalkClip = std::max(snoopy.FindClip("walk"), snoopy.Clips().empty() ? -1 : 0);
+    glm::vec3 snoopyLastPosition = playerPosition;
+    double snoopyLastTime = 0.0;
+    float snoopyWalk = 0.0f;
+
+    // Los dibujos del fotograma se juntan en la cola, se ordenan por pase,
+    // shader, texturas y profundidad, y se ejecutan a travs de la cach de
+    // estado, que no repite binds ni uniforms que ya tienen ese valor
+    GLStateCache stateCache;
+    RenderQueue renderQueue;
+    renderQueue.SetFarDepth(100.0f);
+
+    // Dibuja un fotograma con el estado dado; lo usan el bucle interactivo y
+    // el benchmark. "now" solo se usa para los reportes peridicos
+    auto renderFrame = [&](const SimulationState& state, double now) {
+            // Crea la matriz de vista para la cmara en tercera persona
+            glm::vec3 newCamPos = state.playerPosition + state.cameraOffset; // Posicin de la cmara relativa al personaje
+            glm::mat4 view = glm::lookAt(newCamPos, state.playerPosition, glm::vec3(0.0f, 1.0f, 0.0f)); // Mira al personaje
+
+            // Pose de Snoopy: se pide aqu y se recoge antes de dibujarlo, as
+            // el muestreo corre mientras se arma la casa. El peso de caminar
+            // sigue a la velocidad horizontal, suavizado para no saltar
+            if (skinned) {
+                float dt = float(state.time - snoopyLastTime);
+                if (dt > 0.0f) {
+                    glm::vec3 delta = state.playerPosition - snoopyLastPosition;
+                    float target = glm::clamp(glm::length(glm::vec2(delta.x, delta.z)) / dt / PLAYER_SPEED, 0.0f, 1.0f);
+                    snoopyWalk += (target - snoopyWalk) * std::min(1.0f, dt * 8.0f);
+                }
+                snoopyLastPosition = state.playerPosition;
+                snoopyLastTime = state.time;
+                AnimationRequest request;
+                request.clipA = snoopyIdleClip;
+                request.timeA = float(state.time);
+                request.clipB = snoopyWalkClip;
+                request.timeB = float(state.time);
+                request.blend = snoopyWalkClip >= 0 ? snoopyWalk : 0.0f;
+                snoopyAnimation.Kick({ request });
+            }
+
+            // Limpieza, estado y luces del fotograma
+            GLuint casaProgram = lightmapProgram;
+            GLuint personajeProgram = probeProgram;
+            GLuint snoopyProgram = skinnedProgram;
+            {
+                PROFILE_SCOPE("Lighting");
+                // Limpia los buffers de color y profundidad con un fondo gris oscuro
+                stateCache.ClearColor(glm::vec4(0.1f, 0.1f, 0.1f, 1.0f));
+                stateCache.SetEnabled(GL_DEPTH_TEST, true);
+                GL_COUNT(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+
+                // Actualiza solo las luces que se mueven: la cmara y el foco
+                lighting.SetViewPosition(camera.GetPosition());
+                lighting.SetSpotLightTransform(camera.GetPosition(), camera.GetFront());
+
+                // La primera luz puntual tiene un color pulsante (amarillo si est activa)
+                glm::vec3 Light1 = state.lightActive ? glm::vec3(1.0f, 1.0f, 0.0f) : glm::vec3(0);
+                glm::vec3 lightColor;
+                lightColor.x = abs(sin(state.time * Light1.x)); // Color pulsante
+                lightColor.y = abs(sin(state.time * Light1.y));
+                lightColor.z = sin(state.time * Light1.z);
+                lighting.SetPointLightPosition(0, state.pointLightPositions[0]);
+                // Apagada tampoco deja brillo especular, as no hace falta calcularla
+                lighting.SetPointLightColor(0, lightColor, lightColor, state.lightActive ? glm::vec3(1.0f, 0.2f, 0.2f) : glm::vec3(0.0f));
+                if (clusteredLighting) {
+                    clustered.SetPosition(0, state.pointLightPositions[0]);
+                    clustered.SetColor(0, lightColor, lightColor);
+                }
+
+                // Una sola subida con el rango que cambi (nada si todo est quieto)
+                lighting.Upload();
+
+                // Las matrices de cada shader se ponen cuando la cola lo usa
+                renderQueue.Begin(&lighting);
+                renderQueue.SetUniform(lightingProgram, lightingViewLoc, view);
+                renderQueue.SetUniform(lightingProgram, lightingProjLoc, projection);
+                renderQueue.SetUniform(lightmapProgram, lightmapViewLoc, view);
+                renderQueue.SetUniform(lightmapProgram, lightmapProjLoc, projection);
+                renderQueue.SetUniform(probeProgram, probeViewLoc, view);
+                renderQueue.SetUniform(probeProgram, probeProjLoc, projection);
+                renderQueue.SetUniform(skinnedProgram, skinnedViewLoc, view);
+                renderQueue.SetUniform(skinnedProgram, skinnedProjLoc, projection);
+                renderQueue.SetUniform(instancedProgram, instancedViewLoc, view);
+                renderQueue.SetUniform(instancedProgram, instancedProjLoc, projection);
+                renderQueue.SetUniform(lampProgram, lampViewLoc, view);
+                renderQueue.SetUniform(lampProgram, lampProjLoc, projection);
+
+                // Permutaciones de este fotograma (se compilan la primera vez)
+                if (!fullShaders) {
+                    auto selectVariant = [&](ShaderPermutations& variants, GLuint& program, bool baked) {
+                        uint32_t features = forcedFeatures;
+                        if (features == UINT32_MAX) {
+                            features = baked ? lighting.ActiveFeatures(LIGHTING_POINT_LIGHT_0 | LIGHTING_POINT_LIGHT_1, false) : lighting.ActiveFeatures();
+                            features |= clusteredLighting ? LIGHTING_SPECULAR : 0u;
+                        }
+                        const ShaderPermutation& variant = variants.Get(features);
+                        if (variant.program != 0) {
+                            program = variant.program;
+                            renderQueue.SetUniform(variant.program, variant.locations[0], view);
+                            renderQueue.SetUniform(variant.program, variant.locations[1], projection);
+                        }
+                    };
+                    selectVariant(casaVariants, casaProgram, casaBaked);
+                    selectVariant(personajeVariants, personajeProgram, personajeBaked);
+                    if (skinned) {
+                        selectVariant(skinnedVariants, snoopyProgram, personajeBaked);
+                    }
+                }
+
+                // Reparte las luces en los clusters de esta vista
+                if (clusteredLighting) {
+                    clustered.Update(view);
+                    clustered.Bind();
+                    clustered.Report(now);
+                    stateCache.InvalidateTextures();
+                }
+            }
+
+            // Dibuja la casa; las partes fuera de la vista se descartan con el BVH
+            glm::mat4 viewProjection = projection * view;
+            glm::mat4 model(1);
+            const std::vector<uint8_t>* casaMask = nullptr;
+            {
+                PROFILE_SCOPE("Culling");
+                casaPortals.Update(newCamPos, viewProjection * model);
+                casaMask = casaPortals.Mask();
+                if (casaOcclusion.Enabled()) {
+                    casaOcclusion.Update(Dog.Meshes(), viewProjection * model, casaMask);
+                    casaOcclusion.Report(now);
+                    casaMask = casaOcclusion.Mask();
+                }
+            }
+            {
+                PROFILE_SCOPE("Dog.Submit");
+                Dog.Submit(renderQueue, casaProgram, viewProjection, model, casaMask); // Renderiza el modelo de la casa
+            }
+
+            // Dibuja el personaje
+            model = glm::mat4(1.0f);
+            model = glm::translate(model, state.playerPosition); // Posiciona el personaje
+            model = glm::scale(model, glm::vec3(0.7f)); // Escala el modelo
+            if (skinned) {
+                // Las matrices de la pose van al texture buffer de la unidad SKIN_PALETTE_UNIT
+                PROFILE_SCOPE("snoopy.Submit");
+                snoopy.UploadPalette(snoopyAnimation.Wait());
+                snoopy.BindPalette();
+                stateCache.InvalidateTextures();
+                snoopy.SetIrradiance(Dog.Probes().Sample(state.playerPosition));
+                float depth = (viewProjection * glm::vec4(state.playerPosition, 1.0f)).w;
+                snoopy.SubmitInstanced(renderQueue, snoopyProgram, RENDER_PASS_SCENE, { model * snoopyFit }, depth);
+            }
+            else {
+                PROFILE_SCOPE("personaje.Submit");
+                personaje.SetIrradiance(Dog.Probes().Sample(state.playerPosition)); // Luz de las sondas donde est parado
+                personaje.Submit(renderQueue, personajeProgram, viewProjection, model); // Renderiza el modelo del personaje
+            }
+
+            // Muebles de los cuartos cargados, con la luz de las sondas igual que el personaje
+            if (casaRooms.Enabled()) {
+                PROFILE_SCOPE("Rooms.Submit");
+                casaRooms.Submit(renderQueue, personajeProgram, viewProjection, Dog.Probes());
+            }
+
+            // Copias de Snoopy: una sola llamada por lote para todas
+            if (!snoopyTransforms.empty()) {
+                PROFILE_SCOPE("Snoopies");
+                personaje.SubmitInstanced(renderQueue, instancedProgram, RENDER_PASS_SCENE, snoopyTransforms);
+            }
+
+            // Cubos de las luces, en el pase sin mezcla
+            {
+                PROFILE_SCOPE("Lamps");
+                // Dibuja las fuentes de luz como cubos pequeos, los cuatro en una llamada
+                glm::mat4 lampTransforms[4];
+                for (GLuint i = 0; i < 4; i++) {
+                    model = glm::mat4(1);
+                    model = glm::translate(model, state.pointLightPositions[i]);
+                    model = glm::scale(model, glm::vec3(0.2f)); // Cubo pequeo
+                    lampTransforms[i] = model;
+                }
+                if (lampInstanced) {
+                    lampInstances.Upload(lampTransforms, 4);
+                    uint32_t object = renderQueue.AddObject(glm::mat4(1.0f), nullptr, -1, false);
+                    DrawItem& item = renderQueue.Add(RENDER_PASS_UNLIT, lampProgram, object, VAO, 0, 0, 0.0f);
+                    renderQueue.AddElementsInstanced(item, 36, 0, 4);
+                }
+                else {
+                    for (GLuint i = 0; i < 4; i++) {
+                        uint32_t object = renderQueue.AddObject(lampTransforms[i], nullptr, lampModelLoc, false);
+                        glm::vec4 center = viewProjection * glm::vec4(state.pointLightPositions[i], 1.0f);
+                        DrawItem& item = renderQueue.Add(RENDER_PASS_UNLIT, lampProgram, object, VAO, 0, 0, center.w);
+                        renderQueue.AddElements(item, 36, 0); // Dibuja el cubo
+                    }
+                }
+            }
+
+            // Ejecuta la cola ordenada
+            {
+                PROFILE_SCOPE("RenderQueue");
+                renderQueue.Execute(stateCache);
+            }
+
+            // Cierra el contador de llamadas GL del fotograma
+            GLStats().EndFrame(now);
+            CullingStats().EndFrame(now);
+            stateCache.EndFrame(now);
+
+            // Tiempo de compilacin que se ahorr al arrancar (incluye las
+            // permutaciones que pidi el primer fotograma)
+            if (!shaderCacheReported) {
+                ProgramCache().Report();
+                shaderCacheReported = true;
+            }
+    };
+
+    // El personaje, la cmara y las luces se actualizan en su propio hilo a
+    // paso fijo; el bucle de render nunca espera a la simulacin
+    SimulationState initialState;
+    initialState.playerPosition = playerPosition;
+    initialState.cameraOffset = cameraOffset;
+    initialState.cameraBoom = cameraOffset;
+    std::copy(pointLightPositions, pointLightPositions + 4, initialState.pointLightPositions);
+
+    // Fases del bucle medidas en CPU y GPU; los percentiles salen por consola
+    // y en el ttulo de la ventana
+    Profiler().SetGpuThread("Main");
+    Profiler().KeepTrace(!tracePath.empty());
+    if (profile) {
+        Profiler().SetEnabled(true);
+    }
+
+    // Benchmark: el recorrido reemplaza a la simulacin y cada fotograma
+    // representa el mismo instante del recorrido en todas las ejecuciones
+    if (benchmark) {
+        CameraPath path;
+        std::string pathName = "orbit";
+        if (!benchmarkPath.empty()) {
+            if (!path.Load(benchmarkPath)) {
+                shutdownGraphics();
+                return EXIT_FAILURE;
+            }
+            pathName = benchmarkPath;
+        }
+        else {
+            path = CameraPath::Orbit(casaCenter, ringRadius, playerPosition.y, 20.0f);
+        }
+
+        SimulationState state = initialState;
+        double start = SimulationThread<SimulationState>::Now();
+        auto runPath = [&](BenchmarkResults& results) {
+            for (int frame = -BENCHMARK_WARMUP_FRAMES; frame < benchmarkFrames; frame++) {
+                float t = path.LastTime() - path.Duration() + path.Duration() * float(std::max(frame, 0)) / float(std::max(benchmarkFrames - 1, 1));
+                CameraKey key = path.Sample(t);
+                state.time = t;
+                state.playerPosition = key.playerPosition;
+                state.cameraOffset = key.cameraOffset;
+                state.lightActive = key.lightActive;
+
+                // glFinish para que el tiempo incluya el trabajo de la GPU
+                double begin = SimulationThread<SimulationState>::Now();
+                renderFrame(state, begin - start);
+                glFinish();
+                double milliseconds = (SimulationThread<SimulationState>::Now() - begin) * 1000.0;
+                if (frame >= 0) {
+                    results.AddFrame(milliseconds, GLStats().lastFrame, GLStats().lastDraws, GLStats().lastTriangles);
+                }
+                Profiler().EndFrame(begin - start);
+            }
+        };
+        BenchmarkResults results;
+        runPath(results);
+
+        // Hash del ltimo fotograma para comparar la imagen entre versiones
+        std::vector<unsigned char> pixels = headless.ReadPixels();
+
+        // El mismo recorrido con cada permutacin fija (la pasada de arriba
+        // usa la que corresponde a las luces): los vrtices cuestan lo mismo
+        // en todas, la diferencia es el trabajo por fragmento
+        if (benchmarkVariants && !fullShaders) {
+            const uint32_t variants[] = { LIGHTING_ALL_FEATURES, LIGHTING_POINT_LIGHT_0 | LIGHTING_SPOT_LIGHT | LIGHTING_SPECULAR,
+                                          LIGHTING_SPOT_LIGHT | LIGHTING_SPECULAR, LIGHTING_SPOT_LIGHT, 0u };
+            for (uint32_t features : variants) {
+                forcedFeatures = features;
+                BenchmarkResults variantResults;
+                runPath(variantResults);
+                std::ostringstream name;
+                name << "0x" << std::hex << std::setw(2) << std::setfill('0') << features;
+                results.AddVariant(name.str(), variantResults);
+            }
+            forcedFeatures = UINT32_MAX;
+        }
+        std::string json = results.Json(SCREEN_WIDTH, SCREEN_HEIGHT, pathName, SimulationThread<SimulationState>::Now() - start,
+                                        HashBytes(pixels.data(), pixels.size()));
+        std::cout << json;
+        if (!benchmarkOutput.empty()) {
+            std::ofstream output(benchmarkOutput);
+            output << json;
+            if (!output) {
+                std::cout << "ERROR::BENCHMARK::CANNOT_WRITE: " << benchmarkOutput << std::endl;
+            }
+        }
+        if (!tracePath.empty()) {
+            Profiler().WriteTrace(tracePath);
+        }
+        shutdownGraphics();
+        return 0;
+    }
+
+    SimulationThread<SimulationState> simulation(tickRate);
+    simulation.Start(initialState, DoMovement);
+    CameraPath recording; // --record-path
+
     // Bucle principal del juego
     while (!glfwWindowShouldClose(window)) {
-        // Calcula el tiempo entre fotogramas para movimiento suave
-        GLfloat currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-
-        // Procesa eventos de teclado y ratn
-        glfwPollEvents();
-        DoMovement(); // Actualiza posiciones del personaje y luces
-
-        // Limpia los buffers de color y profundidad con un fondo gris oscuro
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // Activa pruebas de profundidad y mezcla para transparencias
-        glEnable(GL_DEPTH_TEST);
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-        // Usa el shader de iluminacin para los objetos
-        lightingShader.Use();
-
-        // Configura texturas difusa y especular
-        glUniform1i(glGetUniformLocation(lightingShader.Program, "diffuse"), 0);
-        glUniform1i(glGetUniformLocation(lightingShader.Program, "specular"), 1);
-
-        // Pasa la posicin de la cmara al shader
-        GLint viewPosLoc = glGetUniformLocation(lightingShader.Program, "viewPos");
-        glUniform3f(viewPosLoc, camera.GetPosition().x, camera.GetPosition().y, camera.GetPosition().z);
-
-        // Configura la luz direccional (como un sol)
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "dirLight.ambient"), 0.3f, 0.3f, 0.3f);
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "dirLight.diffuse"), 0.6f, 0.6f, 0.6f);
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "dirLight.specular"), 1.0f, 1.0f, 1.0f);
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "dirLight.direction"), -0.2f, -1.0f, -0.3f);
-
-        // Configura la primera luz puntual (con color dinmico)
-        pointLightPositions[0] = glm::vec3(0.0f, 5.0f, 0.0f);
-        glm::vec3 lightColor;
-        lightColor.x = abs(sin(glfwGetTime() * Light1.x)); // Color pulsante
-        lightColor.y = abs(sin(glfwGetTime() * Light1.y));
-        lightColor.z = sin(glfwGetTime() * Light1.z);
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "pointLights[0].ambient"), 0.2f, 0.2f, 0.2f);
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "pointLights[0].diffuse"), 0.6f, 0.6f, 0.6f);
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "pointLights[0].specular"), 1.0f, 1.0f, 1.0f);
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "pointLights[0].position"), pointLightPositions[0].x, pointLightPositions[0].y, pointLightPositions[0].z);
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "pointLights[0].ambient"), lightColor.x, lightColor.y, lightColor.z);
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "pointLights[0].diffuse"), lightColor.x, lightColor.y, lightColor.z);
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "pointLights[0].specular"), 1.0f, 0.2f, 0.2f);
-        glUniform1f(glGetUniformLocation(lightingShader.Program, "pointLights[0].constant"), 1.0f);
-        glUniform1f(glGetUniformLocation(lightingShader.Program, "pointLights[0].linear"), 0.045f);
-        glUniform1f(glGetUniformLocation(lightingShader.Program, "pointLights[0].quadratic"), 0.075f);
-
-        // Configura las otras luces puntuales (desactivadas)
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "pointLights[1].position"), pointLightPositions[1].x, pointLightPositions[1].y, pointLightPositions[1].z);
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "pointLights[1].ambient"), 0.05f, 0.05f, 0.05f);
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "pointLights[1].diffuse"), 0.0f, 0.0f, 0.0f);
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "pointLights[1].specular"), 0.0f, 0.0f, 0.0f);
-        glUniform1f(glGetUniformLocation(lightingShader.Program, "pointLights[1].constant"), 1.0f);
-        glUniform1f(glGetUniformLocation(lightingShader.Program, "pointLights[1].linear"), 0.0f);
-        glUniform1f(glGetUniformLocation(lightingShader.Program, "pointLights[1].quadratic"), 0.0f);
-
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "pointLights[2].position"), pointLightPositions[2].x, pointLightPositions[2].y, pointLightPositions[2].z);
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "pointLights[2].ambient"), 0.0f, 0.0f, 0.0f);
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "pointLights[2].diffuse"), 0.0f, 0.0f, 0.0f);
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "pointLights[2].specular"), 0.0f, 0.0f, 0.0f);
-        glUniform1f(glGetUniformLocation(lightingShader.Program, "pointLights[2].constant"), 1.0f);
-        glUniform1f(glGetUniformLocation(lightingShader.Program, "pointLights[2].linear"), 0.0f);
-        glUniform1f(glGetUniformLocation(lightingShader.Program, "pointLights[2].quadratic"), 0.0f);
-
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "pointLights[3].position"), pointLightPositions[3].x, pointLightPositions[3].y, pointLightPositions[3].z);
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "pointLights[3].ambient"), 0.0f, 0.0f, 0.0f);
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "pointLights[3].diffuse"), 0.0f, 0.0f, 0.0f);
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "pointLights[3].specular"), 0.0f, 0.0f, 0.0f);
-        glUniform1f(glGetUniformLocation(lightingShader.Program, "pointLights[3].constant"), 1.0f);
-        glUniform1f(glGetUniformLocation(lightingShader.Program, "pointLights[3].linear"), 0.0f);
-        glUniform1f(glGetUniformLocation(lightingShader.Program, "pointLights[3].quadratic"), 0.0f);
-
-        // Configura la luz de foco (spotlight) que sigue la cmara
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "spotLight.position"), camera.GetPosition().x, camera.GetPosition().y, camera.GetPosition().z);
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "spotLight.direction"), camera.GetFront().x, camera.GetFront().y, camera.GetFront().z);
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "spotLight.ambient"), 0.2f, 0.2f, 0.8f);
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "spotLight.diffuse"), 0.2f, 0.2f, 0.8f);
-        glUniform3f(glGetUniformLocation(lightingShader.Program, "spotLight.specular"), 0.0f, 0.0f, 0.0f);
-        glUniform1f(glGetUniformLocation(lightingShader.Program, "spotLight.constant"), 1.0f);
-        glUniform1f(glGetUniformLocation(lightingShader.Program, "spotLight.linear"), 0.3f);
-        glUniform1f(glGetUniformLocation(lightingShader.Program, "spotLight.quadratic"), 0.7f);
-        glUniform1f(glGetUniformLocation(lightingShader.Program, "spotLight.cutOff"), glm::cos(glm::radians(12.0f)));
-        glUniform1f(glGetUniformLocation(lightingShader.Program, "spotLight.outerCutOff"), glm::cos(glm::radians(18.0f)));
-
-        // Configura la propiedad de brillo del material
-        glUniform1f(glGetUniformLocation(lightingShader.Program, "material.shininess"), 16.0f);
-
-        // Crea la matriz de vista para la cmara en tercera persona
-        glm::mat4 view;
-        glm::vec3 newCamPos = playerPosition + cameraOffset; // Posicin de la cmara relativa al personaje
-        view = glm::lookAt(newCamPos, playerPosition, glm::vec3(0.0f, 1.0f, 0.0f)); // Mira al personaje
-
-        // Obtiene las ubicaciones de las matrices en el shader
-        GLint modelLoc = glGetUniformLocation(lightingShader.Program, "model");
-        GLint viewLoc = glGetUniformLocation(lightingShader.Program, "view");
-        GLint projLoc = glGetUniformLocation(lightingShader.Program, "projection");
-
-        // Pasa las matrices al shader
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-        // Dibuja la casa
-        glm::mat4 model(1);
-        glEnable(GL_BLEND); // Activa la transparencia
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(glGetUniformLocation(lightingShader.Program, "transparency"), 0);
-        Dog.Draw(lightingShader); // Renderiza el modelo de la casa
-
-        // Dibuja el personaje
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, playerPosition); // Posiciona el personaje
-        model = glm::scale(model, glm::vec3(0.7f)); // Escala el modelo
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-        personaje.Draw(lightingShader); // Renderiza el modelo del personaje
-
-        glDisable(GL_BLEND); // Desactiva la transparencia
-        glBindVertexArray(0);
-
-        // Usa el shader para las fuentes de luz
-        lampShader.Use();
-        modelLoc = glGetUniformLocation(lampShader.Program, "model");
-        viewLoc = glGetUniformLocation(lampShader.Program, "view");
-        projLoc = glGetUniformLocation(lampShader.Program, "projection");
-
-        // Pasa las matrices al shader de la lmpara
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-        // Dibuja las fuentes de luz como cubos pequeos
-        for (GLuint i = 0; i < 4; i++) {
-            model = glm::mat4(1);
-            model = glm::translate(model, pointLightPositions[i]);
-            model = glm::scale(model, glm::vec3(0.2f)); // Cubo pequeo
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-            glBindVertexArray(VAO);
-            glDrawArrays(GL_TRIANGLES, 0, 36); // Dibuja el cubo
-        }
-        glBindVertexArray(0);
+        // Procesa eventos de teclado y ratn (los lee el hilo de simulacin)
+        {
+            PROFILE_SCOPE("PollEvents");
+            glfwPollEvents();
+        }
+
+        // Estado a dibujar: entre los dos ltimos pasos de la simulacin
+        const SimulationSnapshot<SimulationState>& snapshot = simulation.Latest();
+        SimulationState state = InterpolateState(snapshot.previous, snapshot.current, simulation.Alpha(snapshot));
+        simulation.Report(glfwGetTime());
+        if (!recordPath.empty() && (recording.Empty() || state.time >= recording.LastTime() + CAMERA_PATH_RECORD_INTERVAL)) {
+            recording.Add({ float(state.time), state.playerPosition, state.cameraOffset, state.lightActive });
+        }
+
+        // Cuartos cerca del personaje: sube lo que el hilo de carga ya prepar
+        // sin pasar del presupuesto del fotograma. Las subidas enlazan VAOs,
+        // buffers y texturas sin pasar por la cache de estado
+        {
+            PROFILE_SCOPE("Streaming");
+            if (casaRooms.Update(state.playerPosition)) {
+                stateCache.Invalidate();
+            }
+        }
+
+        // Sube las texturas que los hilos ya terminaron de decodificar
+        // (incluidas las que acaba de pedir el streaming)
+        {
+            PROFILE_SCOPE("Textures");
+            TextureCache::Instance().Update();
+            stateCache.InvalidateTextures();
+        }
+
+        renderFrame(state, glfwGetTime());
 
         // Intercambia los buffers para mostrar el fotograma renderizado
-        glfwSwapBuffers(window);
+        {
+            PROFILE_SCOPE("SwapBuffers");
+            glfwSwapBuffers(window);
+        }
+
+        // Percentiles de las fases; el resumen tambin va al ttulo
+        std::string profileSummary = Profiler().EndFrame(glfwGetTime());
+        if (!profileSummary.empty()) {
+            glfwSetWindowTitle(window, ("Fuentes de luz - " + profileSummary).c_str());
+        }
     }
 
     // Libera los recursos de GLFW y termina el programa
-    glfwTerminate();
+    simulation.Stop();
+    if (!recordPath.empty()) {
+        recording.Save(recordPath);
+    }
+    if (!tracePath.empty()) {
+        Profiler().WriteTrace(tracePath);
+    }
+    shutdownGraphics();
     return 0;
 }
 
-// Funcin para manejar el movimiento del personaje y la luz
-void DoMovement() {
-    float speed = 20.0f * deltaTime; // Velocidad ajustada al tiempo
+// Un paso de simulacin: mueve el personaje y la luz, alterna la luz y
+// coloca la cmara. Corre en el hilo de simulacin, siempre con el mismo dt
+void DoMovement(SimulationState& state, float dt) {
+    PROFILE_SCOPE("DoMovement");
+    float speed = PLAYER_SPEED * dt; // Velocidad ajustada al tiempo
+    // La luz se mova 0.01 por fotograma; a 60 fotogramas por segundo son 0.6 por segundo
+    float lightSpeed = 0.6f * dt;
+    state.time += dt;
 
     // Movimiento del personaje con teclas W, S, A, D o flechas
-    if (keys[GLFW_KEY_S] || keys[GLFW_KEY_UP])
-        playerPosition.z -= speed; // Mueve hacia adelante
-    if (keys[GLFW_KEY_W] || keys[GLFW_KEY_DOWN])
-        playerPosition.z += speed; // Mueve hacia atrs
-    if (keys[GLFW_KEY_D] || keys[GLFW_KEY_LEFT])
-        playerPosition.x -= speed; // Mueve a la izquierda
-    if (keys[GLFW_KEY_A] || keys[GLFW_KEY_RIGHT])
-        playerPosition.x += speed; // Mueve a la derecha
+    glm::vec3 motion(0.0f);
+    if (simulationInput.Key(GLFW_KEY_S) || simulationInput.Key(GLFW_KEY_UP))
+        motion.z -= speed; // Mueve hacia adelante
+    if (simulationInput.Key(GLFW_KEY_W) || simulationInput.Key(GLFW_KEY_DOWN))
+        motion.z += speed; // Mueve hacia atrs
+    if (simulationInput.Key(GLFW_KEY_D) || simulationInput.Key(GLFW_KEY_LEFT))
+        motion.x -= speed; // Mueve a la izquierda
+    if (simulationInput.Key(GLFW_KEY_A) || simulationInput.Key(GLFW_KEY_RIGHT))
+        motion.x += speed; // Mueve a la derecha
+
+    // La cpsula se desliza por las paredes y muebles en vez de atravesarlos
+    state.playerPosition = collisionWorld.MoveCapsule(playerCapsule, state.playerPosition, motion);
 
     // Movimiento manual de la primera luz puntual
-    if (keys[GLFW_KEY_T])
-        pointLightPositions[0].x += 0.01f; // Derecha
-    if (keys[GLFW_KEY_G])
-        pointLightPositions[0].x -= 0.01f; // Izquierda
-    if (keys[GLFW_KEY_F])
-        pointLightPositions[0].y += 0.01f; // Arriba
-    if (keys[GLFW_KEY_H])
-        pointLightPositions[0].y -= 0.01f; // Abajo
-    if (keys[GLFW_KEY_U])
-        pointLightPositions[0].z -= 0.1f; // Adelante
-    if (keys[GLFW_KEY_J])
-        pointLightPositions[0].z += 0.01f; // Atrs
+    if (simulationInput.Key(GLFW_KEY_T))
+        state.pointLightPositions[0].x += lightSpeed; // Derecha
+    if (simulationInput.Key(GLFW_KEY_G))
+        state.pointLightPositions[0].x -= lightSpeed; // Izquierda
+    if (simulationInput.Key(GLFW_KEY_F))
+        state.pointLightPositions[0].y += lightSpeed; // Arriba
+    if (simulationInput.Key(GLFW_KEY_H))
+        state.pointLightPositions[0].y -= lightSpeed; // Abajo
+    if (simulationInput.Key(GLFW_KEY_U))
+        state.pointLightPositions[0].z -= 10.0f * lightSpeed; // Adelante
+    if (simulationInput.Key(GLFW_KEY_J))
+        state.pointLightPositions[0].z += lightSpeed; // Atrs
+
+    // Alterna el estado de la luz con cada pulsacin de ESPACIO
+    if (simulationInput.TakePresses(GLFW_KEY_SPACE) % 2 == 1) {
+        state.lightActive = !state.lightActive;
+    }
+
+    // Calcula la posicin de la cmara en coordenadas esfricas con los
+    // ngulos del ratn (hasta que se mueve se conserva el offset inicial)
+    float yaw, pitch;
+    if (simulationInput.Look(yaw, pitch)) {
+        float radius = 6.0f; // Distancia de la cmara al personaje
+        float camX = radius * cos(glm::radians(pitch)) * cos(glm::radians(yaw));
+        float camY = radius * sin(glm::radians(pitch));
+        float camZ = radius * cos(glm::radians(pitch)) * sin(glm::radians(yaw));
+
+        // Asegura que la cmara no baje demasiado
+        if ((state.playerPosition.y + camY) < 1.0f)
+            camY = 1.0f - state.playerPosition.y;
+
+        // Actualiza el offset de la cmara
+        state.cameraBoom = glm::vec3(camX, camY, camZ);
+    }
+
+    // Si una pared queda entre el personaje y la cmara, la cmara se acerca
+    // hasta donde la esfera choca
+    state.cameraOffset = state.cameraBoom;
+    float boomLength = glm::length(state.cameraBoom);
+    CollisionHit hit;
+    if (boomLength > CAMERA_MIN_BOOM
+        && collisionWorld.SphereCast(state.playerPosition, state.cameraBoom / boomLength, CAMERA_COLLISION_RADIUS, boomLength, hit)) {
+        state.cameraOffset = state.cameraBoom * (std::max(hit.distance, CAMERA_MIN_BOOM) / boomLength);
+    }
+}
+
+// Estado intermedio entre dos pasos para dibujar sin saltos
+SimulationState InterpolateState(const SimulationState& previous, const SimulationState& current, float alpha) {
+    SimulationState state = current;
+    state.time = previous.time + (current.time - previous.time) * alpha;
+    state.playerPosition = glm::mix(previous.playerPosition, current.playerPosition, alpha);
+    state.cameraOffset = glm::mix(previous.cameraOffset, current.cameraOffset, alpha);
+    for (int i = 0; i < 4; i++) {
+        state.pointLightPositions[i] = glm::mix(previous.pointLightPositions[i], current.pointLightPositions[i], alpha);
+    }
+    return state;
 }
 
 // Funcin para manejar eventos de teclado
@@ -363,25 +1233,18 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mode
         glfwSetWindowShouldClose(window, GL_TRUE);
     }
 
-    // Actualiza el estado de las teclas (presionada o liberada)
-    if (key >= 0 && key < 1024) {
-        if (action == GLFW_PRESS) {
-            keys[key] = true;
-        }
-        else if (action == GLFW_RELEASE) {
-            keys[key] = false;
-        }
+    // Enciende o apaga el perfilador con P
+    if (GLFW_KEY_P == key && GLFW_PRESS == action) {
+        Profiler().SetEnabled(!Profiler().Enabled());
     }
 
-    // Alterna el estado de la luz al presionar ESPACIO
-    if (keys[GLFW_KEY_SPACE]) {
-        active = !active;
-        if (active) {
-            Light1 = glm::vec3(1.0f, 1.0f, 0.0f); // Luz amarilla
-        }
-        else {
-            Light1 = glm::vec3(0); // Luz apagada
-        }
+    // Actualiza el estado de las teclas (presionada o liberada); la
+    // simulacin cuenta las pulsaciones de ESPACIO para alternar la luz
+    if (action == GLFW_PRESS) {
+        simulationInput.SetKey(key, true);
+    }
+    else if (action == GLFW_RELEASE) {
+        simulationInput.SetKey(key, false);
     }
 }
 
@@ -415,16 +1278,6 @@ void MouseCallback(GLFWwindow* window, double xPos, double yPos) {
     if (pitch > 89.0f) pitch = 89.0f;
     if (pitch < 5.0f) pitch = 5.0f; // Evita cmara demasiado baja
 
-    // Calcula la posicin de la cmara en coordenadas esfricas
-    float radius = 6.0f; // Distancia de la cmara al personaje
-    float camX = radius * cos(glm::radians(pitch)) * cos(glm::radians(yaw));
-    float camY = radius * sin(glm::radians(pitch));
-    float camZ = radius * cos(glm::radians(pitch)) * sin(glm::radians(yaw));
-
-    // Asegura que la cmara no baje demasiado
-    if ((playerPosition.y + camY) < 1.0f)
-        camY = 1.0f - playerPosition.y;
-
-    // Actualiza el offset de la cmara
-    cameraOffset = glm::vec3(camX, camY, camZ);
+    // La simulacin calcula el offset de la cmara en el siguiente paso
+    simulationInput.SetLook(yaw, pitch);
 }
\ No newline at end of file
@@ -0,0 +1,305 @@
+// Pruebas de las partes de CPU que tienen una version SSE y otra escalar, o
+// que codifican y decodifican datos: si las dos versiones dejan de coincidir
+// o la ida y vuelta pierde precision, el programa termina con codigo 1.
+//
+// No necesita contexto de OpenGL. Desde "Codigo Fuente":
+//
+//     g++ -O2 -std=c++17 -I. Pruebas/PruebasCPU.cpp -o PruebasCPU -lassimp -lpthread
+//     ./PruebasCPU
+//
+// (con las mismas rutas de include de glm y Assimp que el proyecto)
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "FrameBenchmark.h"
+#include "OcclusionCulling.h"
+#include "SkeletalAnimation.h"
+#include "VertexQuantization.h"
+
+static int failures = 0;
+
+static void Check(bool condition, const std::string& what)
+{
+    std::cout << (condition ? "[Pruebas] ok   " : "[Pruebas] FAIL ") << what << std::endl;
+    if (!condition) {
+        failures++;
+    }
+}
+
+// Cuadrado de lado 2 * size centrado en (0, 0, z), como dos triangulos
+static void AddQuad(std::vector<glm::vec3>& triangles, float size, float z)
+{
+    glm::vec3 a(-size, -size, z), b(size, -size, z), c(size, size, z), d(-size, size, z);
+    triangles.insert(triangles.end(), { a, b, c, a, c, d });
+}
+
+static void TestOcclusion()
+{
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 2.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 viewProjection = projection * view;
+
+    // Una pared que tapa el centro de la pantalla y unos triangulos sueltos
+    std::vector<glm::vec3> triangles;
+    AddQuad(triangles, 1.5f, 0.0f);
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> spread(-4.0f, 4.0f);
+    for (int i = 0; i < 60; i++) {
+        glm::vec3 center(spread(random), spread(random) * 0.5f, spread(random) * 0.5f - 2.0f);
+        triangles.push_back(center);
+        triangles.push_back(center + glm::vec3(0.7f, 0.1f, 0.2f));
+        triangles.push_back(center + glm::vec3(0.2f, 0.8f, -0.3f));
+    }
+
+    SoftwareOcclusion simd(256, 128, 2);
+    SoftwareOcclusion scalar(256, 128, 1);
+    scalar.simd = false;
+    simd.SetOccluders(triangles);
+    scalar.SetOccluders(triangles);
+    simd.Render(viewProjection);
+    scalar.Render(viewProjection);
+
+    float depthDifference = 0.0f;
+    for (size_t i = 0; i < simd.Depth().size(); i++) {
+        depthDifference = std::max(depthDifference, std::fabs(simd.Depth()[i] - scalar.Depth()[i]));
+    }
+    Check(depthDifference <= 1e-5f, "occlusion: SSE and scalar depth buffers match (max diff " + std::to_string(depthDifference) + ")");
+
+    // Detras de la pared, delante de la pared, fuera de la pared y cruzando la camara
+    glm::vec3 hiddenMin(-0.3f, -0.3f, -3.0f), hiddenMax(0.3f, 0.3f, -2.5f);
+    glm::vec3 frontMin(-0.3f, -0.3f, 1.0f), frontMax(0.3f, 0.3f, 1.5f);
+    glm::vec3 asideMin(2.6f, 1.8f, -3.0f), asideMax(3.0f, 2.2f, -2.5f);
+    glm::vec3 nearMin(-1.0f, -1.0f, 4.0f), nearMax(1.0f, 1.0f, 6.0f);
+    for (int pass = 0; pass < 2; pass++) {
+        const SoftwareOcclusion& occlusion = pass == 0 ? simd : scalar;
+        std::string name = pass == 0 ? "SSE" : "scalar";
+        Check(!occlusion.TestBox(hiddenMin, hiddenMax, viewProjection), "occlusion (" + name + "): box behind the wall is hidden");
+        Check(occlusion.TestBox(frontMin, frontMax, viewProjection), "occlusion (" + name + "): box in front of the wall is visible");
+        Check(occlusion.TestBox(asideMin, asideMax, viewProjection), "occlusion (" + name + "): box beside the wall is visible");
+        Check(occlusion.TestBox(nearMin, nearMax, viewProjection), "occlusion (" + name + "): box crossing the near plane is kept");
+    }
+
+    // Un occluder que cruza el plano cercano no se rasteriza: no oculta nada
+    std::vector<glm::vec3> crossing;
+    crossing.push_back(glm::vec3(-5.0f, -5.0f, 8.0f));
+    crossing.push_back(glm::vec3(5.0f, -5.0f, 0.0f));
+    crossing.push_back(glm::vec3(0.0f, 5.0f, 0.0f));
+    SoftwareOcclusion skipped(256, 128, 1);
+    skipped.SetOccluders(crossing);
+    skipped.Render(viewProjection);
+    Check(skipped.RasterizedTriangles() == 0 && skipped.TestBox(hiddenMin, hiddenMax, viewProjection),
+          "occlusion: occluder crossing the near plane is skipped");
+}
+
+static void TestHalf()
+{
+    // Todos los half finitos vuelven exactos
+    int mismatches = 0;
+    for (uint32_t bits = 0; bits < 0x10000u; bits++) {
+        uint16_t half = uint16_t(bits);
+        if (((half >> 10) & 0x1fu) == 0x1fu) {
+            continue;
+        }
+        if (FloatToHalf(HalfToFloat(half)) != half) {
+            mismatches++;
+        }
+    }
+    Check(mismatches == 0, "half: every finite half survives HalfToFloat -> FloatToHalf (" + std::to_string(mismatches) + " mismatches)");
+
+    // Floats arbitrarios en el rango de las UV: error relativo de a lo mas medio ulp de half
+    std::mt19937 random(11);
+    std::uniform_real_distribution<float> range(-8.0f, 8.0f);
+    float worst = 0.0f;
+    for (int i = 0; i < 100000; i++) {
+        float value = range(random);
+        float back = HalfToFloat(FloatToHalf(value));
+        if (std::fabs(value) > 1e-3f) {
+            worst = std::max(worst, std::fabs(back - value) / std::fabs(value));
+        }
+    }
+    Check(worst <= 1.0f / 2048.0f + 1e-7f, "half: float round trip within half an ulp (" + std::to_string(worst) + ")");
+    Check(std::isinf(HalfToFloat(FloatToHalf(1e6f))) && HalfToFloat(FloatToHalf(1e-9f)) == 0.0f, "half: overflow to infinity, underflow to zero");
+}
+
+static void TestQuantization()
+{
+    std::mt19937 random(5);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::vector<CacheVertex> vertices(20000);
+    glm::vec3 boundsMin(1e30f), boundsMax(-1e30f);
+    for (CacheVertex& vertex : vertices) {
+        vertex.Position = glm::vec3(unit(random) * 12.0f, unit(random) * 4.0f + 4.0f, unit(random) * 9.0f);
+        vertex.Normal = glm::vec3(unit(random), unit(random), unit(random));
+        if (glm::length(vertex.Normal) < 1e-3f) {
+            vertex.Normal = glm::vec3(0.0f, 1.0f, 0.0f);
+        }
+        vertex.Normal = glm::normalize(vertex.Normal);
+        vertex.TexCoords = glm::vec2(unit(random) * 0.5f + 0.5f, unit(random) * 0.5f + 0.5f);
+        boundsMin = glm::min(boundsMin, vertex.Position);
+        boundsMax = glm::max(boundsMax, vertex.Position);
+    }
+
+    std::vector<CompactVertex> compact;
+    QuantizationError error = QuantizeVertices(vertices.data(), vertices.size(), boundsMin, boundsMax, compact);
+    Check(compact.size() == vertices.size() && error.Acceptable(),
+          "quantize: 20000 vertices within limits (position " + std::to_string(error.position) + ", normal "
+              + std::to_string(error.normalDegrees) + " deg, uv " + std::to_string(error.texCoords) + ")");
+
+    // Los ejes exactos no deben moverse
+    glm::vec3 axes[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+    float worstAxis = 0.0f;
+    for (const glm::vec3& axis : axes) {
+        int16_t encoded[2];
+        EncodeNormal(axis, encoded);
+        glm::vec3 decoded = OctDecode(glm::vec2(encoded[0], encoded[1]) / 32767.0f);
+        worstAxis = std::max(worstAxis, glm::length(decoded - axis));
+    }
+    Check(worstAxis <= 1e-4f, "quantize: axis normals decode exactly (" + std::to_string(worstAxis) + ")");
+}
+
+// Esqueleto en cadena con pistas senoidales, suficiente para muestrear y mezclar
+static void BuildTestRig(size_t jointCount, Skeleton& skeleton, AnimationClip& clip)
+{
+    std::mt19937 random(3);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    skeleton.rest.Resize(jointCount);
+    for (size_t j = 0; j < jointCount; j++) {
+        skeleton.names.push_back("joint" + std::to_string(j));
+        skeleton.parents.push_back(int(j) - 1);
+        JointTransform rest;
+        rest.translation = glm::vec3(0.0f, 0.1f, 0.0f);
+        skeleton.rest.Set(j, rest);
+        skeleton.inverseBind.push_back(glm::mat4(1.0f));
+    }
+
+    RawClip raw;
+    raw.name = "prueba";
+    raw.duration = 2.0f;
+    raw.rotations.resize(jointCount);
+    raw.translations.resize(jointCount);
+    raw.scales.resize(jointCount);
+    for (size_t j = 0; j < jointCount; j++) {
+        if (j % 3 == 2) {
+            continue;  // pista constante
+        }
+        float phase = unit(random) * 3.0f;
+        float amplitude = 0.3f + 0.5f * std::fabs(unit(random));
+        glm::vec3 axis = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(0.0f, 0.0f, 0.01f));
+        for (int k = 0; k <= 48; k++) {
+            float time = k * raw.duration / 48.0f;
+            float angle = amplitude * std::sin(time * 3.14159f + phase);
+            raw.rotations[j].times.push_back(time);
+            raw.rotations[j].values.push_back(glm::vec4(axis * std::sin(angle * 0.5f), std::cos(angle * 0.5f)));
+            if (j == 0) {
+                raw.translations[j].times.push_back(time);
+                raw.translations[j].values.push_back(glm::vec4(std::sin(time * 3.14159f) * 0.5f, 0.1f, time, 0.0f));
+            }
+        }
+    }
+    clip = CompressClip(raw, skeleton);
+}
+
+static float PoseDifference(const Pose& a, const Pose& b)
+{
+    float worst = 0.0f;
+    for (int s = 0; s < POSE_STREAMS; s++) {
+        for (size_t j = 0; j < a.Count(); j++) {
+            worst = std::max(worst, std::fabs(a.Stream(s)[j] - b.Stream(s)[j]));
+        }
+    }
+    return worst;
+}
+
+static void TestAnimation()
+{
+    // 37 huesos: el ultimo grupo de cuatro queda incompleto
+    const size_t jointCount = 37;
+    Skeleton skeleton;
+    AnimationClip clip;
+    BuildTestRig(jointCount, skeleton, clip);
+
+    Pose a, b, other, simdBlend, scalarBlend;
+    a.Resize(jointCount);
+    b.Resize(jointCount);
+    other.Resize(jointCount);
+    float sampleDifference = 0.0f, blendDifference = 0.0f;
+    for (float time = 0.0f; time < 4.0f; time += 0.037f) {
+        SampleClip(clip, time, a, true);
+        SampleClip(clip, time, b, false);
+        sampleDifference = std::max(sampleDifference, PoseDifference(a, b));
+
+        SampleClip(clip, time * 0.7f + 0.3f, other, false);
+        for (float weight : { 0.0f, 0.3f, 0.5f, 1.0f }) {
+            BlendPoses(b, other, weight, simdBlend, true);
+            BlendPoses(b, other, weight, scalarBlend, false);
+            blendDifference = std::max(blendDifference, PoseDifference(simdBlend, scalarBlend));
+        }
+    }
+    Check(sampleDifference <= 1e-5f, "animation: SampleClip SSE matches scalar (" + std::to_string(sampleDifference) + ")");
+    Check(blendDifference <= 1e-5f, "animation: BlendPoses SSE matches scalar (" + std::to_string(blendDifference) + ")");
+
+    // Mezclar con peso 0 o 1 devuelve una de las dos poses
+    BlendPoses(b, other, 0.0f, scalarBlend);
+    float atZero = PoseDifference(scalarBlend, b);
+    BlendPoses(b, other, 1.0f, scalarBlend);
+    float atOne = PoseDifference(scalarBlend, other);
+    Check(atZero <= 1e-5f && atOne <= 1e-5f, "animation: BlendPoses endpoints return the inputs");
+}
+
+static void TestCameraPath()
+{
+    CameraPath path;
+    CameraKey first = { 0.0f, glm::vec3(0.0f), glm::vec3(0.0f, 4.0f, 8.0f), false };
+    CameraKey second = { 2.0f, glm::vec3(10.0f, 0.0f, 0.0f), glm::vec3(0.0f, 4.0f, -8.0f), true };
+    CameraKey outOfOrder = { 1.0f, glm::vec3(99.0f), glm::vec3(99.0f), true };
+    path.Add(first);
+    path.Add(second);
+    path.Add(outOfOrder);
+    Check(path.Size() == 2 && path.Duration() == 2.0f, "camera path: out-of-order keys are ignored");
+
+    CameraKey middle = path.Sample(0.5f);
+    Check(glm::length(middle.playerPosition - glm::vec3(2.5f, 0.0f, 0.0f)) < 1e-5f && glm::length(middle.cameraOffset - glm::vec3(0.0f, 4.0f, 4.0f)) < 1e-5f
+              && !middle.lightActive && middle.time == 0.5f,
+          "camera path: Sample interpolates positions and holds the light of the previous key");
+    CameraKey before = path.Sample(-1.0f);
+    CameraKey after = path.Sample(5.0f);
+    Check(before.playerPosition == first.playerPosition && after.playerPosition == second.playerPosition && after.lightActive,
+          "camera path: Sample clamps outside the path");
+
+    // Save y Load conservan el recorrido
+    CameraPath orbit = CameraPath::Orbit(glm::vec3(0.0f), 20.0f, 1.0f, 30.0f);
+    std::string file = "PruebasCPU.campath";
+    CameraPath loaded;
+    bool saved = orbit.Save(file) && loaded.Load(file);
+    std::remove(file.c_str());
+    float worst = 0.0f;
+    for (float time = 0.0f; saved && time <= orbit.LastTime(); time += 0.25f) {
+        worst = std::max(worst, glm::length(orbit.Sample(time).playerPosition - loaded.Sample(time).playerPosition));
+    }
+    Check(saved && loaded.Size() == orbit.Size() && worst < 1e-3f, "camera path: Save/Load round trip (" + std::to_string(worst) + ")");
+}
+
+int main()
+{
+    TestOcclusion();
+    TestHalf();
+    TestQuantization();
+    TestAnimation();
+    TestCameraPath();
+    if (failures > 0) {
+        std::cout << "[Pruebas] " << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "[Pruebas] all checks passed" << std::endl;
+    return 0;
+}
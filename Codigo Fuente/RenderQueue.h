@@ -0,0 +1,495 @@
+#pragma once
+
+// Cola de dibujo entre la escena y OpenGL. Los modelos agregan elementos con
+// una clave de 64 bits (pase, shader, juego de texturas, profundidad); al
+// final del fotograma se ordenan y se ejecutan a traves de GLStateCache, que
+// recuerda el estado actual y no repite binds, enables ni uniforms que ya
+// tienen ese valor. GLStateCache cuenta las llamadas emitidas y las que se
+// ahorraron en cada fotograma.
+//
+// Lo que cambie estado de OpenGL por fuera de la cache (subir texturas,
+// ClusteredLights::Bind, Draw directo de CachedModel) debe ir seguido de
+// InvalidateTextures() o Invalidate().
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "GLStats.h"
+#include "LightingState.h"
+
+const GLuint STATE_CACHE_TEXTURE_UNITS = 8;
+const GLuint STATE_CACHE_UNKNOWN = 0xffffffffu;
+
+// Bits de la clave, del mas al menos significativo
+const int RENDER_KEY_PASS_BITS = 4;
+const int RENDER_KEY_PROGRAM_BITS = 8;
+const int RENDER_KEY_TEXTURE_BITS = 16;
+const int RENDER_KEY_DEPTH_BITS = 24;
+const int RENDER_KEY_OBJECT_BITS = 12;
+
+// Pases en el orden en que se dibujan
+enum RenderPass
+{
+    RENDER_PASS_SCENE = 0,  // modelos iluminados, con mezcla alfa
+    RENDER_PASS_UNLIT = 1   // cubos de las luces, sin mezcla
+};
+
+class GLStateCache
+{
+public:
+    GLStateCache()
+    {
+        this->Invalidate();
+    }
+
+    // Olvida todo: la siguiente llamada de cada tipo siempre se emite
+    void Invalidate()
+    {
+        this->program = STATE_CACHE_UNKNOWN;
+        this->vertexArray = STATE_CACHE_UNKNOWN;
+        this->InvalidateTextures();
+        for (int i = 0; i < CAPABILITY_COUNT; i++) {
+            this->capabilities[i] = -1;
+        }
+        this->blendSource = this->blendDestination = STATE_CACHE_UNKNOWN;
+        this->clearColorValid = false;
+        this->uniforms.clear();
+    }
+
+    void InvalidateTextures()
+    {
+        this->activeUnit = STATE_CACHE_UNKNOWN;
+        for (GLuint unit = 0; unit < STATE_CACHE_TEXTURE_UNITS; unit++) {
+            this->textures[unit] = STATE_CACHE_UNKNOWN;
+        }
+    }
+
+    bool UseProgram(GLuint value)
+    {
+        if (this->program == value) {
+            this->elided++;
+            return false;
+        }
+        this->program = value;
+        this->issued++;
+        GL_COUNT(glUseProgram(value));
+        return true;
+    }
+
+    GLuint Program() const { return this->program; }
+
+    void BindVertexArray(GLuint value)
+    {
+        if (this->vertexArray == value) {
+            this->elided++;
+            return;
+        }
+        this->vertexArray = value;
+        this->issued++;
+        GL_COUNT(glBindVertexArray(value));
+    }
+
+    // Solo GL_TEXTURE_2D en las unidades que lleva la cache
+    void BindTexture(GLuint unit, GLuint texture)
+    {
+        if (unit >= STATE_CACHE_TEXTURE_UNITS || this->textures[unit] == texture) {
+            this->elided++;
+            return;
+        }
+        if (this->activeUnit != unit) {
+            this->activeUnit = unit;
+            this->issued++;
+            GL_COUNT(glActiveTexture(GL_TEXTURE0 + unit));
+        }
+        this->textures[unit] = texture;
+        this->issued++;
+        GL_COUNT(glBindTexture(GL_TEXTURE_2D, texture));
+    }
+
+    // GL_BLEND y GL_DEPTH_TEST
+    void SetEnabled(GLenum capability, bool enabled)
+    {
+        int index = capability == GL_BLEND ? 0 : capability == GL_DEPTH_TEST ? 1 : -1;
+        if (index >= 0 && this->capabilities[index] == int(enabled)) {
+            this->elided++;
+            return;
+        }
+        if (index >= 0) {
+            this->capabilities[index] = int(enabled);
+        }
+        if (enabled) {
+            this->issued++;
+            GL_COUNT(glEnable(capability));
+        }
+        else {
+            this->issued++;
+            GL_COUNT(glDisable(capability));
+        }
+    }
+
+    void BlendFunc(GLenum source, GLenum destination)
+    {
+        if (this->blendSource == source && this->blendDestination == destination) {
+            this->elided++;
+            return;
+        }
+        this->blendSource = source;
+        this->blendDestination = destination;
+        this->issued++;
+        GL_COUNT(glBlendFunc(source, destination));
+    }
+
+    void ClearColor(const glm::vec4& color)
+    {
+        if (this->clearColorValid && this->clearColor == color) {
+            this->elided++;
+            return;
+        }
+        this->clearColor = color;
+        this->clearColorValid = true;
+        this->issued++;
+        GL_COUNT(glClearColor(color.x, color.y, color.z, color.w));
+    }
+
+    // Los uniforms se recuerdan por programa y ubicacion; el programa debe
+    // estar en uso
+    void UniformMatrix4(GLint location, const glm::mat4& value)
+    {
+        if (this->uniformChanged(location, glm::value_ptr(value), 16)) {
+            this->issued++;
+            GL_COUNT(glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value)));
+        }
+    }
+
+    void Uniform3(GLint location, const glm::vec3& value)
+    {
+        if (this->uniformChanged(location, glm::value_ptr(value), 3)) {
+            this->issued++;
+            GL_COUNT(glUniform3fv(location, 1, glm::value_ptr(value)));
+        }
+    }
+
+    void Uniform1(GLint location, int value)
+    {
+        float stored = float(value);
+        if (this->uniformChanged(location, &stored, 1)) {
+            this->issued++;
+            GL_COUNT(glUniform1i(location, value));
+        }
+    }
+
+    unsigned int Issued() const { return this->issued; }
+    unsigned int Elided() const { return this->elided; }
+
+    // Cierra el fotograma; cada "interval" segundos imprime el promedio
+    void EndFrame(double now, double interval = 2.0)
+    {
+        this->accumulatedIssued += this->issued;
+        this->accumulatedElided += this->elided;
+        this->frames++;
+        this->issued = 0;
+        this->elided = 0;
+        if (now - this->lastReport >= interval && this->frames > 0) {
+            std::cout << "[StateCache] " << double(this->accumulatedIssued) / this->frames << " state calls issued, "
+                      << double(this->accumulatedElided) / this->frames << " elided per frame" << std::endl;
+            this->accumulatedIssued = 0;
+            this->accumulatedElided = 0;
+            this->frames = 0;
+            this->lastReport = now;
+        }
+    }
+
+private:
+    static const int CAPABILITY_COUNT = 2;
+
+    struct UniformValue
+    {
+        float data[16];
+    };
+
+    bool uniformChanged(GLint location, const float* value, int count)
+    {
+        if (location < 0) {
+            return false;
+        }
+        uint64_t key = uint64_t(this->program) << 32 | uint32_t(location);
+        auto found = this->uniforms.find(key);
+        if (found != this->uniforms.end() && std::memcmp(found->second.data, value, count * sizeof(float)) == 0) {
+            this->elided++;
+            return false;
+        }
+        UniformValue& stored = this->uniforms[key];
+        std::memcpy(stored.data, value, count * sizeof(float));
+        return true;
+    }
+
+    GLuint program;
+    GLuint vertexArray;
+    GLuint activeUnit;
+    GLuint textures[STATE_CACHE_TEXTURE_UNITS];
+    int capabilities[CAPABILITY_COUNT];  // -1 desconocido
+    GLenum blendSource, blendDestination;
+    glm::vec4 clearColor;
+    bool clearColorValid;
+    std::unordered_map<uint64_t, UniformValue> uniforms;
+
+    unsigned int issued = 0;
+    unsigned int elided = 0;
+    unsigned long long accumulatedIssued = 0;
+    unsigned long long accumulatedElided = 0;
+    unsigned int frames = 0;
+    double lastReport = 0.0;
+};
+
+// Quien dibuja un objeto puede poner uniforms propios al cambiar de objeto
+// o de programa (por ejemplo la decodificacion de vertices compactos)
+class RenderSource
+{
+public:
+    virtual ~RenderSource() {}
+    virtual void BindObject(GLuint program, GLStateCache& cache) = 0;
+};
+
+enum DrawKind
+{
+    DRAW_ELEMENTS,
+    DRAW_MULTI_ELEMENTS,
+    DRAW_ELEMENTS_INSTANCED
+};
+
+struct DrawItem
+{
+    uint64_t key;
+    RenderPass pass;
+    GLuint program;
+    uint32_t object;
+    GLuint vertexArray;
+    GLuint textures[2];  // unidades 0 y 1; 0 = no se toca
+    DrawKind kind;
+    GLsizei count;       // indices (DRAW_ELEMENTS / INSTANCED) o rangos (MULTI)
+    const GLvoid* offset;
+    uint32_t firstRun;   // DRAW_MULTI_ELEMENTS: rangos en RenderQueue
+    GLsizei instances;
+    unsigned long long triangles;
+};
+
+class RenderQueue
+{
+public:
+    // Vacia la cola; "lighting" recibe la matriz de los objetos que la usan
+    void Begin(LightingState* lighting)
+    {
+        this->lighting = lighting;
+        this->items.clear();
+        this->objects.clear();
+        this->runCounts.clear();
+        this->runOffsets.clear();
+        this->programUniforms.clear();
+        this->textureSets.clear();
+    }
+
+    // modelLocation >= 0: la matriz va en ese uniform; si no, en el bloque
+    // Object de LightingState
+    uint32_t AddObject(const glm::mat4& model, RenderSource* source = nullptr, GLint modelLocation = -1, bool useLighting = true)
+    {
+        this->objects.push_back({ model, source, modelLocation, useLighting });
+        return uint32_t(this->objects.size() - 1);
+    }
+
+    // Uniform que vale para todos los elementos de un programa en este fotograma
+    void SetUniform(GLuint program, GLint location, const glm::mat4& value)
+    {
+        this->programUniforms.push_back({ program, location, value });
+    }
+
+    // "depth" es la profundidad en la vista (w en el clip): los elementos
+    // iguales en lo demas se dibujan de adelante hacia atras
+    DrawItem& Add(RenderPass pass, GLuint program, uint32_t object, GLuint vertexArray, GLuint diffuse, GLuint specular, float depth)
+    {
+        DrawItem item = {};
+        item.pass = pass;
+        item.program = program;
+        item.object = object;
+        item.vertexArray = vertexArray;
+        item.textures[0] = diffuse;
+        item.textures[1] = specular;
+        item.instances = 1;
+
+        uint64_t depthBits = uint64_t(std::max(0.0f, std::min(1.0f, depth / this->farDepth)) * float((1u << RENDER_KEY_DEPTH_BITS) - 1));
+        item.key = uint64_t(pass) << (64 - RENDER_KEY_PASS_BITS);
+        item.key |= uint64_t(this->programIndex(program)) << (64 - RENDER_KEY_PASS_BITS - RENDER_KEY_PROGRAM_BITS);
+        item.key |= uint64_t(this->textureSetIndex(diffuse, specular)) << (RENDER_KEY_DEPTH_BITS + RENDER_KEY_OBJECT_BITS);
+        item.key |= depthBits << RENDER_KEY_OBJECT_BITS;
+        item.key |= uint64_t(std::min<uint32_t>(object, (1u << RENDER_KEY_OBJECT_BITS) - 1));
+        this->items.push_back(item);
+        return this->items.back();
+    }
+
+    void AddElements(DrawItem& item, GLsizei count, GLuint firstIndex)
+    {
+        item.kind = DRAW_ELEMENTS;
+        item.count = count;
+        item.offset = (const GLvoid*)(sizeof(GLuint) * firstIndex);
+        item.triangles = count / 3;
+    }
+
+    void AddElementsInstanced(DrawItem& item, GLsizei count, GLuint firstIndex, GLsizei instances)
+    {
+        this->AddElements(item, count, firstIndex);
+        item.kind = DRAW_ELEMENTS_INSTANCED;
+        item.instances = instances;
+        item.triangles *= instances;
+    }
+
+    // Varios rangos de indices del mismo buffer en una llamada
+    void AddRuns(DrawItem& item, const GLsizei* counts, const GLvoid* const* offsets, size_t runs)
+    {
+        item.kind = DRAW_MULTI_ELEMENTS;
+        item.firstRun = uint32_t(this->runCounts.size());
+        item.count = GLsizei(runs);
+        item.triangles = 0;
+        for (size_t i = 0; i < runs; i++) {
+            this->runCounts.push_back(counts[i]);
+            this->runOffsets.push_back(offsets[i]);
+            item.triangles += counts[i] / 3;
+        }
+        if (runs == 1) {
+            item.kind = DRAW_ELEMENTS;
+            item.count = counts[0];
+            item.offset = offsets[0];
+        }
+    }
+
+    // Profundidad que corresponde al final de los bits de la clave
+    void SetFarDepth(float value) { this->farDepth = std::max(value, 1e-3f); }
+
+    size_t Size() const { return this->items.size(); }
+
+    void Execute(GLStateCache& cache)
+    {
+        std::stable_sort(this->items.begin(), this->items.end(), [](const DrawItem& a, const DrawItem& b) { return a.key < b.key; });
+
+        // El estado del pase, el programa y sus uniforms solo se piden a la
+        // cache cuando cambian respecto al elemento anterior
+        int currentPass = -1;
+        GLuint currentProgram = STATE_CACHE_UNKNOWN;
+        uint32_t currentObject = UINT32_MAX;
+        for (const DrawItem& item : this->items) {
+            if (int(item.pass) != currentPass) {
+                currentPass = int(item.pass);
+                cache.SetEnabled(GL_DEPTH_TEST, true);
+                if (item.pass == RENDER_PASS_SCENE) {
+                    cache.SetEnabled(GL_BLEND, true);
+                    cache.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                }
+                else {
+                    cache.SetEnabled(GL_BLEND, false);
+                }
+            }
+            if (item.program != currentProgram) {
+                currentProgram = item.program;
+                currentObject = UINT32_MAX;
+                cache.UseProgram(item.program);
+                this->applyProgramUniforms(cache, item.program);
+            }
+            if (item.object != currentObject) {
+                currentObject = item.object;
+                const RenderObject& object = this->objects[item.object];
+                if (object.modelLocation >= 0) {
+                    cache.UniformMatrix4(object.modelLocation, object.model);
+                }
+                else if (object.useLighting && this->lighting != nullptr) {
+                    this->lighting->SetObject(object.model);
+                }
+                if (object.source != nullptr) {
+                    object.source->BindObject(item.program, cache);
+                }
+            }
+
+            cache.BindVertexArray(item.vertexArray);
+            for (GLuint unit = 0; unit < 2; unit++) {
+                if (item.textures[unit] != 0) {
+                    cache.BindTexture(unit, item.textures[unit]);
+                }
+            }
+
+            switch (item.kind) {
+            case DRAW_ELEMENTS:
+                GL_COUNT_DRAW(item.triangles, glDrawElements(GL_TRIANGLES, item.count, GL_UNSIGNED_INT, item.offset));
+                break;
+            case DRAW_MULTI_ELEMENTS:
+                GL_COUNT_DRAW(item.triangles, glMultiDrawElements(GL_TRIANGLES, &this->runCounts[item.firstRun], GL_UNSIGNED_INT,
+                                                                  &this->runOffsets[item.firstRun], item.count));
+                break;
+            case DRAW_ELEMENTS_INSTANCED:
+                GL_COUNT_DRAW(item.triangles, glDrawElementsInstanced(GL_TRIANGLES, item.count, GL_UNSIGNED_INT, item.offset, item.instances));
+                break;
+            }
+        }
+    }
+
+private:
+    struct RenderObject
+    {
+        glm::mat4 model;
+        RenderSource* source;
+        GLint modelLocation;
+        bool useLighting;
+    };
+
+    struct ProgramUniform
+    {
+        GLuint program;
+        GLint location;
+        glm::mat4 value;
+    };
+
+    void applyProgramUniforms(GLStateCache& cache, GLuint program)
+    {
+        for (const ProgramUniform& uniform : this->programUniforms) {
+            if (uniform.program == program) {
+                cache.UniformMatrix4(uniform.location, uniform.value);
+            }
+        }
+    }
+
+    uint32_t programIndex(GLuint program)
+    {
+        auto found = std::find(this->programs.begin(), this->programs.end(), program);
+        if (found != this->programs.end()) {
+            return uint32_t(found - this->programs.begin());
+        }
+        this->programs.push_back(program);
+        return uint32_t(std::min<size_t>(this->programs.size() - 1, (1u << RENDER_KEY_PROGRAM_BITS) - 1));
+    }
+
+    uint32_t textureSetIndex(GLuint diffuse, GLuint specular)
+    {
+        uint64_t key = uint64_t(diffuse) << 32 | specular;
+        auto found = this->textureSets.find(key);
+        if (found != this->textureSets.end()) {
+            return found->second;
+        }
+        uint32_t index = uint32_t(std::min<size_t>(this->textureSets.size(), (1u << RENDER_KEY_TEXTURE_BITS) - 1));
+        this->textureSets[key] = index;
+        return index;
+    }
+
+    LightingState* lighting = nullptr;
+    float farDepth = 100.0f;
+    std::vector<DrawItem> items;
+    std::vector<RenderObject> objects;
+    std::vector<GLsizei> runCounts;
+    std::vector<const GLvoid*> runOffsets;
+    std::vector<ProgramUniform> programUniforms;
+    std::vector<GLuint> programs;  // orden estable entre fotogramas
+    std::unordered_map<uint64_t, uint32_t> textureSets;
+};
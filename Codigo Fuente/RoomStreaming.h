@@ -0,0 +1,338 @@
+#pragma once
+
+// Carga por cuartos. Los modelos de cada cuarto se listan en un archivo de
+// texto (Models/casafinal.rooms) y no se cargan al arrancar: cuando el
+// personaje se acerca a la caja de un cuarto, un hilo de E/S hace la parte
+// de CachedModel que no usa OpenGL (mapear o importar el cache, cuantizar) y
+// el hilo principal sube los buffers por partes sin pasar de un presupuesto
+// de milisegundos y de bytes por fotograma. Al alejarse mas alla de la
+// distancia de descarga el cuarto se libera; las texturas se van con la
+// ultima referencia, igual que con cualquier modelo.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "CachedModel.h"
+#include "PortalVisibility.h"
+#include "ThreadPool.h"
+
+const float STREAMING_LOAD_DISTANCE = 2.0f;
+const float STREAMING_UNLOAD_DISTANCE = 6.0f;       // mayor que la de carga: en la puerta no se carga y descarga
+const double STREAMING_BUDGET_MILLISECONDS = 2.0;
+const size_t STREAMING_BUDGET_BYTES = 4 * 1024 * 1024;
+const size_t STREAMING_UPLOAD_SLICE = 256 * 1024;   // cada cuanto se revisa el tiempo dentro de un modelo
+
+enum RoomState
+{
+    ROOM_UNLOADED,
+    ROOM_LOADING,
+    ROOM_LOADED
+};
+
+struct StreamedModel
+{
+    std::string path;
+    glm::mat4 transform = glm::mat4(1.0f);
+    std::unique_ptr<CachedModel> model;
+    std::unique_ptr<CachedModelData> data;  // de Prepare al final de Upload
+    bool failed = false;
+};
+
+struct StreamedRoom
+{
+    std::string name;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    std::vector<StreamedModel> models;
+    RoomState state = ROOM_UNLOADED;
+    uint32_t generation = 0;    // los trabajos de una carga cancelada ya no coinciden
+    size_t pendingJobs = 0;
+    size_t uploadedBytes = 0;
+    int uploadFrames = 0;
+    std::chrono::steady_clock::time_point requested;
+};
+
+class RoomStreaming
+{
+public:
+    // Un solo hilo: la E/S del disco no gana nada con mas, y asi no compite
+    // con los decodificadores de TextureCache
+    RoomStreaming() : io(1) { }
+
+    ~RoomStreaming()
+    {
+        this->io.Stop();
+    }
+
+    // Lee la lista de cuartos; las cajas salen de "cells" salvo las fijas.
+    // Sin archivo o sin modelos queda apagado
+    bool Load(const std::string& path, const PortalVisibility& cells, bool compactVertices)
+    {
+        std::ifstream file(path);
+        if (!file) {
+            std::cout << "[Streaming] no room list " << path << ", nothing is streamed" << std::endl;
+            return false;
+        }
+        this->rooms.clear();
+        this->compact = compactVertices;
+        size_t modelCount = 0;
+        std::string line;
+        while (std::getline(file, line)) {
+            std::istringstream tokens(line);
+            std::string keyword;
+            if (!(tokens >> keyword) || keyword[0] == '#') {
+                continue;
+            }
+            if (keyword == "load") {
+                tokens >> this->loadDistance;
+            }
+            else if (keyword == "unload") {
+                tokens >> this->unloadDistance;
+            }
+            else if (keyword == "room") {
+                StreamedRoom room;
+                tokens >> room.name;
+                if (!cells.CellBounds(room.name, room.boundsMin, room.boundsMax)) {
+                    // Sin celda hace falta un "box"; mientras tanto nunca se acerca
+                    room.boundsMin = glm::vec3(1e30f);
+                    room.boundsMax = glm::vec3(1e30f);
+                }
+                this->rooms.push_back(std::move(room));
+            }
+            else if (keyword == "box" && !this->rooms.empty()) {
+                StreamedRoom& room = this->rooms.back();
+                tokens >> room.boundsMin.x >> room.boundsMin.y >> room.boundsMin.z >> room.boundsMax.x >> room.boundsMax.y >> room.boundsMax.z;
+            }
+            else if (keyword == "model" && !this->rooms.empty()) {
+                // La ruta es el resto de la linea (los directorios pueden tener espacios)
+                glm::vec3 position;
+                float scale = 1.0f;
+                tokens >> position.x >> position.y >> position.z >> scale >> std::ws;
+                StreamedModel model;
+                std::getline(tokens, model.path);
+                model.path.erase(model.path.find_last_not_of(" \t\r") + 1);
+                if (!model.path.empty()) {
+                    model.transform = glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(scale));
+                    this->rooms.back().models.push_back(std::move(model));
+                    modelCount++;
+                }
+            }
+        }
+        for (const StreamedRoom& room : this->rooms) {
+            if (!room.models.empty() && room.boundsMin.x == 1e30f) {
+                std::cout << "WARNING::STREAMING:: room " << room.name << " has no cell or box in " << path << ", never loaded" << std::endl;
+            }
+        }
+        this->unloadDistance = std::max(this->unloadDistance, this->loadDistance);
+        this->enabled = modelCount > 0;
+        if (!this->enabled) {
+            std::cout << "[Streaming] " << path << " lists " << this->rooms.size() << " rooms but no models, nothing is streamed" << std::endl;
+            return false;
+        }
+        std::cout << "[Streaming] " << modelCount << " models in " << this->rooms.size() << " rooms, loaded within "
+                  << this->loadDistance << " units and released beyond " << this->unloadDistance << std::endl;
+        return true;
+    }
+
+    void SetBudget(double milliseconds, size_t bytes)
+    {
+        this->budgetMilliseconds = milliseconds;
+        this->budgetBytes = std::max<size_t>(bytes, 1);
+    }
+
+    bool Enabled() const { return this->enabled; }
+
+    // Una vez por fotograma en el hilo de OpenGL: recibe lo que preparo el
+    // hilo de E/S, pide o libera cuartos segun "player" y sube dentro del
+    // presupuesto. Devuelve true si subio o libero algo: las subidas enlazan
+    // VAOs, buffers y texturas por fuera de GLStateCache
+    bool Update(const glm::vec3& player)
+    {
+        if (!this->enabled) {
+            return false;
+        }
+        this->collectPrepared();
+        bool touchedState = false;
+
+        for (uint32_t r = 0; r < this->rooms.size(); r++) {
+            StreamedRoom& room = this->rooms[r];
+            float distance = glm::length(player - glm::clamp(player, room.boundsMin, room.boundsMax));
+            if (room.state == ROOM_UNLOADED && distance <= this->loadDistance) {
+                this->request(r);
+            }
+            else if (room.state != ROOM_UNLOADED && distance > this->unloadDistance) {
+                this->release(room);
+                touchedState = true;
+            }
+        }
+
+        // En el orden del archivo, de modelo en modelo
+        auto start = std::chrono::steady_clock::now();
+        size_t bytes = this->budgetBytes;
+        for (StreamedRoom& room : this->rooms) {
+            if (room.state != ROOM_LOADING) {
+                continue;
+            }
+            bool uploaded = false;
+            for (StreamedModel& entry : room.models) {
+                while (entry.data && bytes > 0 && MillisecondsSince(start) < this->budgetMilliseconds) {
+                    if (!entry.model) {
+                        entry.model.reset(new CachedModel());
+                    }
+                    size_t slice = std::min(bytes, STREAMING_UPLOAD_SLICE);
+                    size_t sliceStart = slice;
+                    bool done = entry.model->Upload(*entry.data, slice);
+                    bytes -= sliceStart - slice;
+                    room.uploadedBytes += sliceStart - slice;
+                    uploaded = true;
+                    if (done) {
+                        entry.data.reset();
+                    }
+                }
+            }
+            room.uploadFrames += uploaded ? 1 : 0;
+            touchedState = touchedState || uploaded;
+            this->finishIfComplete(room);
+        }
+        return touchedState;
+    }
+
+    // Agrega los modelos listos a la cola; la luz de cada uno sale de las
+    // sondas de la casa en su posicion (si las hay)
+    void Submit(RenderQueue& queue, GLuint program, const glm::mat4& viewProjection, const IrradianceVolume& probes)
+    {
+        for (StreamedRoom& room : this->rooms) {
+            for (StreamedModel& entry : room.models) {
+                if (!entry.model || !entry.model->Ready()) {
+                    continue;
+                }
+                if (probes.Loaded()) {
+                    entry.model->SetIrradiance(probes.Sample(glm::vec3(entry.transform[3])));
+                }
+                entry.model->Submit(queue, program, viewProjection, entry.transform);
+            }
+        }
+    }
+
+    // Antes de destruir el contexto: para el hilo y libera los modelos
+    void Shutdown()
+    {
+        this->io.Stop();
+        for (StreamedRoom& room : this->rooms) {
+            this->release(room, false);
+        }
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->prepared.clear();
+    }
+
+private:
+    // Resultado del hilo de E/S; "data" vacio si el modelo no se pudo leer
+    struct PreparedModel
+    {
+        uint32_t room;
+        uint32_t model;
+        uint32_t generation;
+        std::unique_ptr<CachedModelData> data;
+    };
+
+    ThreadPool io;
+    std::mutex mutex;
+    std::deque<PreparedModel> prepared;
+    std::vector<StreamedRoom> rooms;
+    float loadDistance = STREAMING_LOAD_DISTANCE;
+    float unloadDistance = STREAMING_UNLOAD_DISTANCE;
+    double budgetMilliseconds = STREAMING_BUDGET_MILLISECONDS;
+    size_t budgetBytes = STREAMING_BUDGET_BYTES;
+    bool compact = false;
+    bool enabled = false;
+
+    void request(uint32_t index)
+    {
+        StreamedRoom& room = this->rooms[index];
+        room.state = ROOM_LOADING;
+        room.generation++;
+        room.pendingJobs = room.models.size();
+        room.uploadedBytes = 0;
+        room.uploadFrames = 0;
+        room.requested = std::chrono::steady_clock::now();
+        for (uint32_t m = 0; m < room.models.size(); m++) {
+            std::string path = room.models[m].path;
+            uint32_t generation = room.generation;
+            bool useCompact = this->compact;
+            this->io.Submit([this, index, m, generation, path, useCompact]() {
+                std::unique_ptr<CachedModelData> data(new CachedModelData());
+                if (!CachedModel::Prepare(path, useCompact, *data)) {
+                    data.reset();
+                }
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->prepared.push_back({ index, m, generation, std::move(data) });
+            });
+        }
+    }
+
+    // Lo de una carga cancelada se descarta aqui; el cache se desmapea en el hilo principal
+    void collectPrepared()
+    {
+        std::deque<PreparedModel> ready;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            ready.swap(this->prepared);
+        }
+        for (PreparedModel& result : ready) {
+            StreamedRoom& room = this->rooms[result.room];
+            if (room.state != ROOM_LOADING || room.generation != result.generation) {
+                continue;
+            }
+            StreamedModel& entry = room.models[result.model];
+            entry.failed = !result.data;
+            entry.data = std::move(result.data);
+            room.pendingJobs--;
+        }
+    }
+
+    void finishIfComplete(StreamedRoom& room)
+    {
+        if (room.pendingJobs > 0) {
+            return;
+        }
+        size_t loaded = 0;
+        for (const StreamedModel& entry : room.models) {
+            if (entry.data) {
+                return;
+            }
+            loaded += entry.failed ? 0 : 1;
+        }
+        room.state = ROOM_LOADED;
+        std::cout << "[Streaming] " << room.name << " loaded: " << loaded << "/" << room.models.size() << " models, "
+                  << room.uploadedBytes / (1024.0 * 1024.0) << " MB uploaded over " << room.uploadFrames << " frames, "
+                  << MillisecondsSince(room.requested) << " ms after the request" << std::endl;
+    }
+
+    // Los trabajos en vuelo de este cuarto quedan con otra generacion
+    void release(StreamedRoom& room, bool report = true)
+    {
+        if (report) {
+            std::cout << "[Streaming] " << room.name << (room.state == ROOM_LOADING ? " cancelled" : " released") << std::endl;
+        }
+        for (StreamedModel& entry : room.models) {
+            entry.model.reset();
+            entry.data.reset();
+            entry.failed = false;
+        }
+        room.state = ROOM_UNLOADED;
+        room.generation++;
+        room.pendingJobs = 0;
+    }
+};
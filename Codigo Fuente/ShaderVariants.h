@@ -0,0 +1,394 @@
+#pragma once
+
+// Compila un par de shaders agregando #define despues de la linea #version,
+// para activar rutas opcionales (p. ej. CLUSTERED en lighting.frag) sin
+// duplicar archivos. El programa resultante puede asignarse a Shader::Program.
+// ShaderPermutations guarda las variantes de un mismo par de shaders que se
+// eligen por bits (p. ej. que luces calcula lighting.frag) y compila cada una
+// la primera vez que se pide.
+// Los programas enlazados se guardan en Shader/cache con glGetProgramBinary,
+// con una clave que mezcla el texto de los shaders (ya con sus #define) y el
+// driver; la siguiente ejecucion los carga con glProgramBinary y solo
+// compila si el archivo falta o el driver lo rechaza.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "ContentHash.h"
+#include "TextureCache.h"
+
+const uint32_t PROGRAM_BINARY_VERSION = 1;
+const char PROGRAM_BINARY_MAGIC[4] = { 'P', 'B', 'I', 'N' };
+
+struct ProgramBinaryHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t key;                 // repetida para detectar colisiones de nombre
+    uint32_t format;              // formato que devolvio glGetProgramBinary
+    uint32_t length;              // bytes que siguen al encabezado
+    float compileMilliseconds;    // lo que costo compilar y enlazar este programa
+    uint32_t pad;
+};
+
+// Cache en disco de programas enlazados. El nombre de cada archivo es la clave
+// en hexadecimal; si el driver cambia, cambia la clave y el archivo viejo
+// simplemente deja de usarse
+class ProgramBinaryCache
+{
+public:
+    void SetDirectory(const std::string& path) { this->directory = path; }
+    void SetEnabled(bool enabled) { this->enabled = enabled; }
+    int Loaded() const { return this->loaded; }
+
+    // Clave de un programa: fuentes ya preprocesadas mas fabricante, GPU y
+    // version del driver (un binario solo sirve para el driver que lo genero)
+    uint64_t Key(const std::string& vertexSource, const std::string& fragmentSource)
+    {
+        if (this->driverHash == 0) {
+            std::string driver;
+            for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+                const GLubyte* text = glGetString(name);
+                driver += text != nullptr ? reinterpret_cast<const char*>(text) : "";
+                driver += '\n';
+            }
+            this->driverHash = HashString(driver) | 1;
+        }
+        uint64_t h = HashString(vertexSource, this->driverHash ^ PROGRAM_BINARY_VERSION);
+        return HashString(fragmentSource, h);
+    }
+
+    // Programa creado desde el binario guardado o 0 si no hay o no sirve
+    GLuint Load(uint64_t key)
+    {
+        if (!this->available()) {
+            return 0;
+        }
+        auto start = std::chrono::steady_clock::now();
+        std::vector<unsigned char> bytes;
+        if (!ReadFileBytes(this->pathOf(key), bytes)) {
+            return 0;
+        }
+        ProgramBinaryHeader header;
+        if (bytes.size() < sizeof(header)) {
+            return 0;
+        }
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        if (std::memcmp(header.magic, PROGRAM_BINARY_MAGIC, 4) != 0 || header.version != PROGRAM_BINARY_VERSION || header.key != key
+            || bytes.size() != sizeof(header) + header.length) {
+            return 0;
+        }
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, GLenum(header.format), bytes.data() + sizeof(header), GLsizei(header.length));
+        GLint success = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            // Otra version del driver o un binario corrupto: se vuelve a compilar
+            glDeleteProgram(program);
+            this->rejected++;
+            std::cout << "WARNING::SHADER_CACHE::BINARY_REJECTED " << HashToHex(key) << std::endl;
+            return 0;
+        }
+        this->loaded++;
+        this->loadMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        this->savedMilliseconds += header.compileMilliseconds;
+        return program;
+    }
+
+    // Antes de enlazar, para que el driver conserve el binario
+    void PrepareProgram(GLuint program)
+    {
+        if (this->available()) {
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+    }
+
+    // Guarda el programa recien enlazado; "compileMilliseconds" es lo que se
+    // ahorrara cada vez que se cargue
+    void Store(uint64_t key, GLuint program, double compileMilliseconds)
+    {
+        this->compiled++;
+        this->compileMilliseconds += compileMilliseconds;
+        if (!this->available()) {
+            return;
+        }
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) {
+            return;
+        }
+        std::vector<unsigned char> bytes(sizeof(ProgramBinaryHeader) + size_t(length));
+        ProgramBinaryHeader header = {};
+        std::memcpy(header.magic, PROGRAM_BINARY_MAGIC, 4);
+        header.version = PROGRAM_BINARY_VERSION;
+        header.key = key;
+        GLenum format = 0;
+        GLsizei written = 0;
+        glGetProgramBinary(program, length, &written, &format, bytes.data() + sizeof(header));
+        if (written <= 0) {
+            return;
+        }
+        header.format = format;
+        header.length = uint32_t(written);
+        header.compileMilliseconds = float(compileMilliseconds);
+        std::memcpy(bytes.data(), &header, sizeof(header));
+        bytes.resize(sizeof(header) + size_t(written));
+
+        // Se escribe aparte y se renombra para no dejar archivos a medias
+        std::error_code error;
+        std::filesystem::create_directories(this->directory, error);
+        std::string path = this->pathOf(key);
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            if (!file || !file.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()))) {
+                std::cout << "WARNING::SHADER_CACHE::WRITE_FAILED " << temporary << std::endl;
+                return;
+            }
+        }
+        std::filesystem::rename(temporary, path, error);
+        if (error) {
+            std::remove(temporary.c_str());
+        }
+    }
+
+    // Cuanto tiempo de compilacion se evito en este arranque
+    void Report() const
+    {
+        std::cout << "[ShaderCache] " << this->loaded << " programs loaded from " << this->directory << " in " << this->loadMilliseconds
+                  << " ms, " << this->compiled << " compiled in " << this->compileMilliseconds << " ms";
+        if (this->rejected > 0) {
+            std::cout << " (" << this->rejected << " binaries rejected by the driver)";
+        }
+        std::cout << "; saved ~" << this->savedMilliseconds - this->loadMilliseconds << " ms of compile time";
+        if (!this->available()) {
+            std::cout << " (program binaries " << (this->enabled ? "not supported by the driver" : "disabled") << ")";
+        }
+        std::cout << std::endl;
+    }
+
+private:
+    std::string directory = "Shader/cache";
+    bool enabled = true;
+    uint64_t driverHash = 0;
+    mutable int supported = -1;
+    int loaded = 0;
+    int compiled = 0;
+    int rejected = 0;
+    double loadMilliseconds = 0.0;
+    double compileMilliseconds = 0.0;
+    double savedMilliseconds = 0.0;
+
+    std::string pathOf(uint64_t key) const { return this->directory + "/" + HashToHex(key) + ".bin"; }
+
+    // Hace falta ARB_get_program_binary (o GL 4.1) y al menos un formato;
+    // algunos drivers anuncian la extension sin ningun formato
+    bool available() const
+    {
+        if (!this->enabled) {
+            return false;
+        }
+        if (this->supported < 0) {
+            GLint formats = 0;
+            if (GLEW_ARB_get_program_binary || GLEW_VERSION_4_1) {
+                glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+            }
+            this->supported = formats > 0 ? 1 : 0;
+        }
+        return this->supported == 1;
+    }
+};
+
+inline ProgramBinaryCache& ProgramCache()
+{
+    static ProgramBinaryCache cache;
+    return cache;
+}
+
+// Inserta las definiciones despues de #version (que debe ser la primera linea)
+inline std::string InjectDefines(const std::string& source, const std::vector<std::string>& defines)
+{
+    std::string header;
+    for (const std::string& define : defines) {
+        header += "#define " + define + "\n";
+    }
+    size_t version = source.find("#version");
+    if (version == std::string::npos) {
+        return header + source;
+    }
+    size_t lineEnd = source.find('\n', version);
+    if (lineEnd == std::string::npos) {
+        return source + "\n" + header;
+    }
+    return source.substr(0, lineEnd + 1) + header + source.substr(lineEnd + 1);
+}
+
+inline GLuint CompileShaderStage(GLenum type, const std::string& source, const char* path)
+{
+    GLuint shader = glCreateShader(type);
+    const GLchar* code = source.c_str();
+    glShaderSource(shader, 1, &code, NULL);
+    glCompileShader(shader);
+    GLint success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        GLchar infoLog[1024];
+        glGetShaderInfoLog(shader, sizeof(infoLog), NULL, infoLog);
+        std::cout << "ERROR::SHADER::COMPILATION_FAILED " << path << "\n" << infoLog << std::endl;
+    }
+    return shader;
+}
+
+// Devuelve 0 si falla la lectura o el enlace
+inline GLuint CompileShaderVariant(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines)
+{
+    std::string sources[2];
+    const char* paths[2] = { vertexPath, fragmentPath };
+    for (int i = 0; i < 2; i++) {
+        std::ifstream file(paths[i]);
+        if (!file) {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << paths[i] << std::endl;
+            return 0;
+        }
+        std::stringstream stream;
+        stream << file.rdbuf();
+        sources[i] = InjectDefines(stream.str(), defines);
+    }
+
+    uint64_t key = ProgramCache().Key(sources[0], sources[1]);
+    GLuint cached = ProgramCache().Load(key);
+    if (cached != 0) {
+        return cached;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    GLuint vertex = CompileShaderStage(GL_VERTEX_SHADER, sources[0], vertexPath);
+    GLuint fragment = CompileShaderStage(GL_FRAGMENT_SHADER, sources[1], fragmentPath);
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertex);
+    glAttachShader(program, fragment);
+    ProgramCache().PrepareProgram(program);
+    glLinkProgram(program);
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        GLchar infoLog[1024];
+        glGetProgramInfoLog(program, sizeof(infoLog), NULL, infoLog);
+        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+    ProgramCache().Store(key, program, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    return program;
+}
+
+// Programa de una permutacion y las ubicaciones de los uniforms pedidos
+struct ShaderPermutation
+{
+    GLuint program = 0;
+    std::vector<GLint> locations;
+};
+
+class ShaderPermutations
+{
+public:
+    typedef std::vector<std::string> (*FeatureDefines)(uint32_t features);
+
+    // "baseDefines" van en todas las variantes y "featureDefines" traduce los
+    // bits a #define. Los bits fuera de "relevant" no cambian el shader con
+    // estas definiciones base y se ignoran, asi no se compila dos veces lo mismo
+    ShaderPermutations(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& baseDefines,
+                       FeatureDefines featureDefines, uint32_t relevant, const std::vector<std::string>& uniformNames = {})
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), baseDefines(baseDefines), featureDefines(featureDefines),
+          relevant(relevant), uniformNames(uniformNames)
+    {
+    }
+
+    ~ShaderPermutations()
+    {
+        if (!TextureCache::Instance().ContextAlive()) {
+            return;
+        }
+        for (auto& entry : this->variants) {
+            if (entry.second.program != 0) {
+                glDeleteProgram(entry.second.program);
+            }
+        }
+    }
+
+    ShaderPermutations(const ShaderPermutations&) = delete;
+    ShaderPermutations& operator=(const ShaderPermutations&) = delete;
+
+    // Se llama con cada variante recien compilada y en uso (samplers, bloques
+    // de uniforms...); despues se vuelve a poner el programa que estaba
+    void OnCompile(std::function<void(GLuint)> setup) { this->setup = setup; }
+
+    // Variante con esos bits; program es 0 si no compila
+    const ShaderPermutation& Get(uint32_t features)
+    {
+        features &= this->relevant;
+        auto found = this->variants.find(features);
+        if (found != this->variants.end()) {
+            return found->second;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::string> defines = this->baseDefines;
+        std::vector<std::string> extra = this->featureDefines(features);
+        defines.insert(defines.end(), extra.begin(), extra.end());
+        ShaderPermutation& variant = this->variants[features];
+        int loadedBefore = ProgramCache().Loaded();
+        variant.program = CompileShaderVariant(this->vertexPath.c_str(), this->fragmentPath.c_str(), defines);
+        if (variant.program != 0) {
+            GLint previous = 0;
+            glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+            glUseProgram(variant.program);
+            for (const std::string& name : this->uniformNames) {
+                variant.locations.push_back(glGetUniformLocation(variant.program, name.c_str()));
+            }
+            if (this->setup) {
+                this->setup(variant.program);
+            }
+            glUseProgram(GLuint(previous));
+        }
+        else {
+            variant.locations.assign(this->uniformNames.size(), -1);
+        }
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        const char* outcome = variant.program == 0 ? " failed after "
+                              : ProgramCache().Loaded() > loadedBefore ? " loaded from cache in " : " compiled in ";
+        std::cout << "[ShaderVariants] " << this->fragmentPath << " 0x" << std::hex << std::setw(2) << std::setfill('0') << features
+                  << std::dec << std::setfill(' ') << outcome << milliseconds
+                  << " ms (" << this->variants.size() << " cached)" << std::endl;
+        return variant;
+    }
+
+    size_t Count() const { return this->variants.size(); }
+
+private:
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::vector<std::string> baseDefines;
+    FeatureDefines featureDefines;
+    uint32_t relevant;
+    std::vector<std::string> uniformNames;
+    std::function<void(GLuint)> setup;
+    std::unordered_map<uint32_t, ShaderPermutation> variants;
+};
@@ -0,0 +1,274 @@
+#pragma once
+
+// Simulacion a paso fijo en su propio hilo. El hilo avanza el estado del
+// juego a SIMULATION_TICK_RATE pasos por segundo con el mismo dt siempre y
+// publica cada resultado en un triple buffer; el render toma la ultima copia
+// sin esperar (solo un intercambio atomico) e interpola entre el paso
+// anterior y el actual. La entrada llega por SimulationInput, que los
+// callbacks de GLFW escriben con atomicos desde el hilo principal.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+const double SIMULATION_TICK_RATE = 120.0;
+// Si el hilo se atrasa mas de esto (por ejemplo al depurar) se descarta el
+// tiempo perdido en lugar de encadenar pasos sin fin
+const int SIMULATION_MAX_CATCHUP_TICKS = 8;
+const int SIMULATION_KEY_COUNT = 1024;
+
+// Un escritor y un lector, sin bloqueos: el escritor llena su copia y la
+// intercambia con la del medio; el lector toma la del medio solo si es nueva
+template<typename T>
+class TripleBuffer
+{
+public:
+    // Solo antes de que empiecen a usarlo los dos hilos
+    void Reset(const T& value)
+    {
+        for (T& slot : this->slots) {
+            slot = value;
+        }
+        this->back = 0;
+        this->front = 2;
+        this->middle.store(1, std::memory_order_relaxed);
+    }
+
+    T& Back() { return this->slots[this->back]; }
+
+    void Publish()
+    {
+        uint8_t previous = this->middle.exchange(uint8_t(this->back | FRESH), std::memory_order_acq_rel);
+        this->back = previous & INDEX;
+    }
+
+    const T& Read()
+    {
+        if (this->middle.load(std::memory_order_relaxed) & FRESH) {
+            uint8_t previous = this->middle.exchange(this->front, std::memory_order_acq_rel);
+            this->front = previous & INDEX;
+        }
+        return this->slots[this->front];
+    }
+
+private:
+    static const uint8_t INDEX = 3;
+    static const uint8_t FRESH = 4;
+
+    T slots[3];
+    uint8_t back = 0;   // solo el escritor
+    uint8_t front = 2;  // solo el lector
+    std::atomic<uint8_t> middle{ 1 };
+};
+
+// Estado de las teclas y del raton que lee la simulacion
+class SimulationInput
+{
+public:
+    SimulationInput()
+    {
+        for (int i = 0; i < SIMULATION_KEY_COUNT; i++) {
+            this->keys[i].store(false, std::memory_order_relaxed);
+            this->presses[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Hilo principal (callbacks de GLFW)
+    void SetKey(int key, bool pressed)
+    {
+        if (key < 0 || key >= SIMULATION_KEY_COUNT) {
+            return;
+        }
+        bool wasPressed = this->keys[key].exchange(pressed, std::memory_order_relaxed);
+        if (pressed && !wasPressed) {
+            this->presses[key].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Angulos de la camara; los dos van en un solo atomico para que la
+    // simulacion nunca lea un yaw nuevo con un pitch viejo
+    void SetLook(float yaw, float pitch)
+    {
+        float angles[2] = { yaw, pitch };
+        uint64_t packed;
+        std::memcpy(&packed, angles, sizeof(packed));
+        this->look.store(packed, std::memory_order_relaxed);
+        this->hasLook.store(true, std::memory_order_release);
+    }
+
+    // Hilo de simulacion
+    bool Key(int key) const
+    {
+        return key >= 0 && key < SIMULATION_KEY_COUNT && this->keys[key].load(std::memory_order_relaxed);
+    }
+
+    // Pulsaciones desde la ultima llamada (no se pierden aunque la tecla se
+    // suelte antes del siguiente paso)
+    unsigned int TakePresses(int key)
+    {
+        if (key < 0 || key >= SIMULATION_KEY_COUNT) {
+            return 0;
+        }
+        return this->presses[key].exchange(0, std::memory_order_relaxed);
+    }
+
+    bool Look(float& yaw, float& pitch) const
+    {
+        if (!this->hasLook.load(std::memory_order_acquire)) {
+            return false;
+        }
+        uint64_t packed = this->look.load(std::memory_order_relaxed);
+        float angles[2];
+        std::memcpy(angles, &packed, sizeof(packed));
+        yaw = angles[0];
+        pitch = angles[1];
+        return true;
+    }
+
+private:
+    std::atomic<bool> keys[SIMULATION_KEY_COUNT];
+    std::atomic<unsigned int> presses[SIMULATION_KEY_COUNT];
+    std::atomic<uint64_t> look{ 0 };
+    std::atomic<bool> hasLook{ false };
+};
+
+// Lo que publica cada paso: el estado anterior y el actual para interpolar
+template<typename State>
+struct SimulationSnapshot
+{
+    State previous;
+    State current;
+    uint64_t tick = 0;
+    double tickTime = 0.0;  // segundos (reloj monotono) en que tocaba este paso
+};
+
+template<typename State>
+class SimulationThread
+{
+public:
+    typedef std::function<void(State&, float)> StepFunction;
+
+    explicit SimulationThread(double tickRate = SIMULATION_TICK_RATE)
+        : step(1.0 / std::max(1.0, tickRate))
+    {
+    }
+
+    ~SimulationThread()
+    {
+        this->Stop();
+    }
+
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+
+    void Start(const State& initial, StepFunction stepFunction)
+    {
+        this->Stop();
+        SimulationSnapshot<State> snapshot;
+        snapshot.previous = initial;
+        snapshot.current = initial;
+        snapshot.tickTime = Now();
+        this->buffer.Reset(snapshot);
+        this->running.store(true);
+        this->worker = std::thread([this, initial, stepFunction]() { this->loop(initial, stepFunction); });
+    }
+
+    void Stop()
+    {
+        this->running.store(false);
+        if (this->worker.joinable()) {
+            this->worker.join();
+        }
+    }
+
+    // Ultimo paso publicado; nunca espera al hilo de simulacion
+    const SimulationSnapshot<State>& Latest()
+    {
+        return this->buffer.Read();
+    }
+
+    // Fraccion del paso siguiente ya transcurrida, para interpolar
+    // snapshot.previous -> snapshot.current
+    float Alpha(const SimulationSnapshot<State>& snapshot) const
+    {
+        double alpha = (Now() - snapshot.tickTime) / this->step;
+        return float(std::max(0.0, std::min(1.0, alpha)));
+    }
+
+    float Step() const { return float(this->step); }
+
+    // Cada "interval" segundos imprime los pasos por segundo y el tiempo descartado
+    void Report(double now, double interval = 2.0)
+    {
+        if (now - this->lastReport < interval) {
+            return;
+        }
+        uint64_t ticks = this->ticks.load(std::memory_order_relaxed);
+        uint64_t dropped = this->droppedTicks.load(std::memory_order_relaxed);
+        if (this->lastReport > 0.0) {
+            std::cout << "[Simulation] " << double(ticks - this->reportedTicks) / (now - this->lastReport) << " ticks/s (target "
+                      << 1.0 / this->step << "), " << dropped - this->reportedDropped << " ticks dropped" << std::endl;
+        }
+        this->reportedTicks = ticks;
+        this->reportedDropped = dropped;
+        this->lastReport = now;
+    }
+
+    static double Now()
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    void loop(State current, StepFunction stepFunction)
+    {
+        State previous = current;
+        double start = Now();
+        uint64_t tick = 0;
+        while (this->running.load(std::memory_order_relaxed)) {
+            double next = start + double(tick + 1) * this->step;
+            double now = Now();
+            if (now < next) {
+                std::this_thread::sleep_for(std::chrono::duration<double>(next - now));
+                continue;
+            }
+
+            // Todos los pasos pendientes con el mismo dt
+            int steps = 0;
+            while (now >= start + double(tick + 1) * this->step && steps < SIMULATION_MAX_CATCHUP_TICKS) {
+                previous = current;
+                stepFunction(current, float(this->step));
+                tick++;
+                steps++;
+            }
+            uint64_t behind = uint64_t(std::max(0.0, (now - start) / this->step - double(tick)));
+            if (behind > 0) {
+                start += double(behind) * this->step;
+                this->droppedTicks.fetch_add(behind, std::memory_order_relaxed);
+            }
+            this->ticks.fetch_add(uint64_t(steps), std::memory_order_relaxed);
+
+            SimulationSnapshot<State>& snapshot = this->buffer.Back();
+            snapshot.previous = previous;
+            snapshot.current = current;
+            snapshot.tick = tick;
+            snapshot.tickTime = start + double(tick) * this->step;
+            this->buffer.Publish();
+        }
+    }
+
+    double step;
+    TripleBuffer<SimulationSnapshot<State>> buffer;
+    std::thread worker;
+    std::atomic<bool> running{ false };
+    std::atomic<uint64_t> ticks{ 0 };
+    std::atomic<uint64_t> droppedTicks{ 0 };
+    uint64_t reportedTicks = 0;
+    uint64_t reportedDropped = 0;
+    double lastReport = 0.0;
+};
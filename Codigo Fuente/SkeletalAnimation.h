@@ -0,0 +1,827 @@
+#pragma once
+
+// Animacion esqueletica del personaje (ver SkinnedModel.h para la parte de
+// GPU). Un esqueleto es una lista de huesos con el padre siempre antes que
+// los hijos y la matriz inversa de la pose de union de cada uno.
+//
+// Los clips se comprimen al importarlos: se remuestrean a
+// ANIMATION_SAMPLE_RATE, las pistas que no cambian se guardan una sola vez
+// en float, y la frecuencia de muestreo del clip se baja a la mitad mientras
+// la interpolacion siga dentro de la tolerancia (reduccion de claves). Las
+// rotaciones animadas se guardan con los tres componentes menores del
+// cuaternion en 15 bits cada uno (6 bytes) y las traslaciones y escalas en
+// 16 bits dentro del rango de su pista.
+//
+// Las poses se guardan en columnas (todas las x de las rotaciones juntas,
+// etc.) para muestrear, interpolar y mezclar cuatro huesos a la vez con SSE.
+// AnimationUpdater hace ese trabajo en hilos aparte mientras el hilo
+// principal arma el fotograma, y entrega las matrices de skinning de todos
+// los personajes listas para subir.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "MeshCache.h"
+#include "ThreadPool.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define ANIMATION_SIMD 1
+#else
+#define ANIMATION_SIMD 0
+#endif
+
+const float ANIMATION_SAMPLE_RATE = 30.0f;          // fotogramas por segundo al importar
+const float ANIMATION_MIN_SAMPLE_RATE = 5.0f;       // la reduccion de claves no baja de aqui
+const float ANIMATION_ROTATION_TOLERANCE = 1e-5f;   // 1 - |dot| entre cuaterniones (~0.5 grados)
+const float ANIMATION_POSITION_TOLERANCE = 5e-4f;   // fraccion del tamano del esqueleto
+const float ANIMATION_QUAT_RANGE = 0.70710678f;     // los tres menores de un cuaternion unitario
+const int ANIMATION_PALETTE_FLOATS = 12;            // matriz 3x4 por hueso (tres filas)
+
+// Transformacion local de un hueso; la rotacion es un cuaternion (x, y, z, w)
+struct JointTransform
+{
+    glm::vec4 rotation = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    glm::vec3 translation = glm::vec3(0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+};
+
+// Columnas de una pose
+enum PoseStream
+{
+    POSE_RX, POSE_RY, POSE_RZ, POSE_RW,
+    POSE_TX, POSE_TY, POSE_TZ,
+    POSE_SX, POSE_SY, POSE_SZ,
+    POSE_STREAMS
+};
+
+// Pose local de todos los huesos en columnas. Siempre sobra al menos un
+// lugar al final: ahi escriben los carriles de relleno de los grupos de cuatro
+class Pose
+{
+public:
+    void Resize(size_t jointCount)
+    {
+        this->count = jointCount;
+        this->padded = (jointCount + 4) & ~size_t(3);
+        this->data.assign(POSE_STREAMS * this->padded, 0.0f);
+        std::fill(this->Stream(POSE_RW), this->Stream(POSE_RW) + this->padded, 1.0f);
+        for (int s = POSE_SX; s <= POSE_SZ; s++) {
+            std::fill(this->Stream(s), this->Stream(s) + this->padded, 1.0f);
+        }
+    }
+
+    float* Stream(int stream) { return this->data.data() + stream * this->padded; }
+    const float* Stream(int stream) const { return this->data.data() + stream * this->padded; }
+
+    JointTransform Get(size_t joint) const
+    {
+        JointTransform t;
+        t.rotation = glm::vec4(this->Stream(POSE_RX)[joint], this->Stream(POSE_RY)[joint], this->Stream(POSE_RZ)[joint], this->Stream(POSE_RW)[joint]);
+        t.translation = glm::vec3(this->Stream(POSE_TX)[joint], this->Stream(POSE_TY)[joint], this->Stream(POSE_TZ)[joint]);
+        t.scale = glm::vec3(this->Stream(POSE_SX)[joint], this->Stream(POSE_SY)[joint], this->Stream(POSE_SZ)[joint]);
+        return t;
+    }
+
+    void Set(size_t joint, const JointTransform& t)
+    {
+        for (int k = 0; k < 4; k++) {
+            this->Stream(POSE_RX + k)[joint] = t.rotation[k];
+        }
+        for (int k = 0; k < 3; k++) {
+            this->Stream(POSE_TX + k)[joint] = t.translation[k];
+            this->Stream(POSE_SX + k)[joint] = t.scale[k];
+        }
+    }
+
+    size_t Count() const { return this->count; }
+    size_t Padded() const { return this->padded; }
+    size_t Bytes() const { return this->data.size() * sizeof(float); }
+
+private:
+    std::vector<float> data;
+    size_t count = 0;
+    size_t padded = 0;
+};
+
+struct Skeleton
+{
+    std::vector<std::string> names;
+    std::vector<int> parents;              // -1 en la raiz
+    std::vector<glm::mat4> inverseBind;    // espacio del modelo -> espacio del hueso en la pose de union
+    Pose rest;                             // pose local de los nodos sin animacion
+
+    size_t Count() const { return this->names.size(); }
+
+    int Find(const std::string& name) const
+    {
+        for (size_t i = 0; i < this->names.size(); i++) {
+            if (this->names[i] == name) {
+                return int(i);
+            }
+        }
+        return -1;
+    }
+};
+
+namespace AnimationDetail
+{
+    inline glm::mat4 TransformMatrix(const JointTransform& t)
+    {
+        const glm::vec4& q = t.rotation;
+        float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+        float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+        float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+        glm::mat4 m(1.0f);
+        m[0] = glm::vec4(1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy), 0.0f) * t.scale.x;
+        m[1] = glm::vec4(2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx), 0.0f) * t.scale.y;
+        m[2] = glm::vec4(2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy), 0.0f) * t.scale.z;
+        m[3] = glm::vec4(t.translation, 1.0f);
+        return m;
+    }
+
+    // Traslacion, rotacion y escala de una matriz afin (sin cizalla)
+    inline JointTransform DecomposeMatrix(const glm::mat4& m)
+    {
+        JointTransform t;
+        t.translation = glm::vec3(m[3]);
+        glm::vec3 axes[3] = { glm::vec3(m[0]), glm::vec3(m[1]), glm::vec3(m[2]) };
+        t.scale = glm::vec3(glm::length(axes[0]), glm::length(axes[1]), glm::length(axes[2]));
+        if (glm::dot(glm::cross(axes[0], axes[1]), axes[2]) < 0.0f) {
+            t.scale.x = -t.scale.x;
+        }
+        for (int i = 0; i < 3; i++) {
+            axes[i] /= (t.scale[i] != 0.0f ? t.scale[i] : 1.0f);
+        }
+        // Cuaternion de la matriz de rotacion (columnas en axes)
+        float trace = axes[0].x + axes[1].y + axes[2].z;
+        glm::vec4& q = t.rotation;
+        if (trace > 0.0f) {
+            float s = std::sqrt(trace + 1.0f) * 2.0f;
+            q = glm::vec4((axes[1].z - axes[2].y) / s, (axes[2].x - axes[0].z) / s, (axes[0].y - axes[1].x) / s, 0.25f * s);
+        }
+        else if (axes[0].x > axes[1].y && axes[0].x > axes[2].z) {
+            float s = std::sqrt(1.0f + axes[0].x - axes[1].y - axes[2].z) * 2.0f;
+            q = glm::vec4(0.25f * s, (axes[1].x + axes[0].y) / s, (axes[2].x + axes[0].z) / s, (axes[1].z - axes[2].y) / s);
+        }
+        else if (axes[1].y > axes[2].z) {
+            float s = std::sqrt(1.0f + axes[1].y - axes[0].x - axes[2].z) * 2.0f;
+            q = glm::vec4((axes[1].x + axes[0].y) / s, 0.25f * s, (axes[2].y + axes[1].z) / s, (axes[2].x - axes[0].z) / s);
+        }
+        else {
+            float s = std::sqrt(1.0f + axes[2].z - axes[0].x - axes[1].y) * 2.0f;
+            q = glm::vec4((axes[2].x + axes[0].z) / s, (axes[2].y + axes[1].z) / s, 0.25f * s, (axes[0].y - axes[1].x) / s);
+        }
+        q = glm::normalize(q);
+        return t;
+    }
+
+    // Interpolacion normalizada por el camino corto
+    inline glm::vec4 Nlerp(const glm::vec4& a, const glm::vec4& b, float weight)
+    {
+        float sign = glm::dot(a, b) < 0.0f ? -1.0f : 1.0f;
+        return glm::normalize(a * (1.0f - weight) + b * (weight * sign));
+    }
+
+    inline float QuatDistance(const glm::vec4& a, const glm::vec4& b)
+    {
+        return 1.0f - std::fabs(glm::dot(a, b));
+    }
+
+    // Tres componentes menores en 15 bits; el indice del mayor va en el bit
+    // bajo de las dos primeras palabras
+    inline void EncodeRotation(glm::vec4 q, uint16_t* out)
+    {
+        int largest = 0;
+        for (int k = 1; k < 4; k++) {
+            if (std::fabs(q[k]) > std::fabs(q[largest])) {
+                largest = k;
+            }
+        }
+        if (q[largest] < 0.0f) {
+            q = -q;
+        }
+        int slot = 0;
+        for (int k = 0; k < 4; k++) {
+            if (k == largest) {
+                continue;
+            }
+            float unit = glm::clamp(q[k] / ANIMATION_QUAT_RANGE * 0.5f + 0.5f, 0.0f, 1.0f);
+            uint16_t bits = uint16_t(std::lround(unit * 32767.0f)) << 1;
+            out[slot] = bits | uint16_t(slot == 0 ? (largest & 1) : slot == 1 ? (largest >> 1) : 0);
+            slot++;
+        }
+    }
+
+    inline glm::vec4 DecodeRotation(const uint16_t* in)
+    {
+        int largest = (in[0] & 1) | ((in[1] & 1) << 1);
+        float small[3];
+        float sum = 0.0f;
+        for (int i = 0; i < 3; i++) {
+            small[i] = ((in[i] >> 1) * (2.0f / 32767.0f) - 1.0f) * ANIMATION_QUAT_RANGE;
+            sum += small[i] * small[i];
+        }
+        glm::vec4 q;
+        int slot = 0;
+        for (int k = 0; k < 4; k++) {
+            q[k] = k == largest ? std::sqrt(std::max(0.0f, 1.0f - sum)) : small[slot++];
+        }
+        return q;
+    }
+
+    inline uint16_t QuantizeRange(float value, float minimum, float extent)
+    {
+        float unit = extent > 0.0f ? (value - minimum) / extent : 0.0f;
+        return uint16_t(std::lround(glm::clamp(unit, 0.0f, 1.0f) * 65535.0f));
+    }
+}
+
+// Claves tal como vienen del archivo (tiempos en segundos); rotaciones en
+// (x, y, z, w) y vectores en xyz. Una pista vacia usa la pose de reposo
+struct RawTrack
+{
+    std::vector<float> times;
+    std::vector<glm::vec4> values;
+
+    glm::vec4 Sample(float time, bool rotation) const
+    {
+        if (this->times.size() == 1 || time <= this->times.front()) {
+            return this->values.front();
+        }
+        if (time >= this->times.back()) {
+            return this->values.back();
+        }
+        size_t next = size_t(std::upper_bound(this->times.begin(), this->times.end(), time) - this->times.begin());
+        float span = this->times[next] - this->times[next - 1];
+        float weight = span > 0.0f ? (time - this->times[next - 1]) / span : 0.0f;
+        if (rotation) {
+            return AnimationDetail::Nlerp(this->values[next - 1], this->values[next], weight);
+        }
+        return glm::mix(this->values[next - 1], this->values[next], weight);
+    }
+};
+
+struct RawClip
+{
+    std::string name;
+    float duration = 0.0f;
+    std::vector<RawTrack> rotations;     // por hueso
+    std::vector<RawTrack> translations;
+    std::vector<RawTrack> scales;
+};
+
+// Clip comprimido. Las pistas animadas van en grupos de cuatro huesos
+// (rotationJoints, etc., con el relleno apuntando al lugar sobrante de la
+// pose) y cada fotograma guarda los grupos seguidos, componente por componente:
+// rotations[((frame * grupos + grupo) * 3 + componente) * 4 + carril]
+struct AnimationClip
+{
+    std::string name;
+    float duration = 0.0f;
+    float sampleRate = ANIMATION_SAMPLE_RATE;
+    uint32_t frameCount = 0;
+    Pose constant;                                      // pistas constantes y lo que no se anima
+    std::vector<uint16_t> rotationJoints;
+    std::vector<uint16_t> translationJoints;
+    std::vector<uint16_t> scaleJoints;
+    std::vector<uint16_t> rotations;
+    std::vector<uint16_t> translations;
+    std::vector<uint16_t> scales;
+    std::vector<float> translationMin, translationExtent;  // [(grupo * 3 + componente) * 4 + carril]
+    std::vector<float> scaleMin, scaleExtent;
+    size_t rawBytes = 0;                                // claves sin comprimir (como las deja Assimp)
+    float maxRotationDegrees = 0.0f;                    // error contra el muestreo a ANIMATION_SAMPLE_RATE
+    float maxPositionError = 0.0f;
+
+    size_t Bytes() const
+    {
+        return this->constant.Bytes()
+               + (this->rotationJoints.size() + this->translationJoints.size() + this->scaleJoints.size()
+                  + this->rotations.size() + this->translations.size() + this->scales.size()) * sizeof(uint16_t)
+               + (this->translationMin.size() + this->translationExtent.size() + this->scaleMin.size() + this->scaleExtent.size()) * sizeof(float);
+    }
+};
+
+// Matrices de skinning de "pose": global de cada hueso por la inversa de la
+// union, en filas (tres vec4 por hueso) como las lee lighting.vs con SKINNED
+inline void PoseToPalette(const Skeleton& skeleton, const Pose& pose, std::vector<glm::mat4>& globals, float* palette)
+{
+    size_t count = skeleton.Count();
+    globals.resize(count);
+    for (size_t j = 0; j < count; j++) {
+        glm::mat4 local = AnimationDetail::TransformMatrix(pose.Get(j));
+        globals[j] = skeleton.parents[j] >= 0 ? globals[skeleton.parents[j]] * local : local;
+        glm::mat4 skin = globals[j] * skeleton.inverseBind[j];
+        float* rows = palette + j * ANIMATION_PALETTE_FLOATS;
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 4; c++) {
+                rows[r * 4 + c] = skin[c][r];
+            }
+        }
+    }
+}
+
+// Muestrea "clip" en "time" (en bucle) sobre "out", que debe tener el tamano del esqueleto
+inline void SampleClip(const AnimationClip& clip, float time, Pose& out, bool simd = ANIMATION_SIMD != 0)
+{
+    out = clip.constant;
+    if (clip.frameCount == 0) {
+        return;
+    }
+    float local = clip.duration > 0.0f ? std::fmod(time, clip.duration) : 0.0f;
+    if (local < 0.0f) {
+        local += clip.duration;
+    }
+    float position = std::min(local * clip.sampleRate, float(clip.frameCount - 1));
+    uint32_t frame0 = uint32_t(position);
+    uint32_t frame1 = std::min(frame0 + 1, clip.frameCount - 1);
+    float weight = position - float(frame0);
+
+    // Rotaciones: los tres menores de cada carril a float, luego en columnas
+    size_t groups = clip.rotationJoints.size() / 4;
+    for (size_t g = 0; g < groups; g++) {
+        const uint16_t* packed[2] = { &clip.rotations[(frame0 * groups + g) * 12], &clip.rotations[(frame1 * groups + g) * 12] };
+        float q[2][4][4];   // [fotograma][x y z w][carril]
+        for (int f = 0; f < 2; f++) {
+            float small[3][4];
+            float largest[4];
+            for (int lane = 0; lane < 4; lane++) {
+                largest[lane] = float((packed[f][lane] & 1) | ((packed[f][4 + lane] & 1) << 1));
+                for (int c = 0; c < 3; c++) {
+                    small[c][lane] = ((packed[f][c * 4 + lane] >> 1) * (2.0f / 32767.0f) - 1.0f) * ANIMATION_QUAT_RANGE;
+                }
+            }
+#if ANIMATION_SIMD
+            if (simd) {
+                __m128 a = _mm_loadu_ps(small[0]), b = _mm_loadu_ps(small[1]), c = _mm_loadu_ps(small[2]);
+                __m128 k = _mm_loadu_ps(largest);
+                __m128 sum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, a), _mm_mul_ps(b, b)), _mm_mul_ps(c, c));
+                __m128 d = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(1.0f), sum), _mm_setzero_ps()));
+                __m128 k0 = _mm_cmpeq_ps(k, _mm_setzero_ps());
+                __m128 k1 = _mm_cmpeq_ps(k, _mm_set1_ps(1.0f));
+                __m128 k2 = _mm_cmpeq_ps(k, _mm_set1_ps(2.0f));
+                __m128 k3 = _mm_cmpeq_ps(k, _mm_set1_ps(3.0f));
+                auto select = [](__m128 mask, __m128 yes, __m128 no) { return _mm_or_ps(_mm_and_ps(mask, yes), _mm_andnot_ps(mask, no)); };
+                // El mayor se inserta en su posicion y los menores se corren
+                _mm_storeu_ps(q[f][0], select(k0, d, a));
+                _mm_storeu_ps(q[f][1], select(k0, a, select(k1, d, b)));
+                _mm_storeu_ps(q[f][2], select(_mm_or_ps(k0, k1), b, select(k2, d, c)));
+                _mm_storeu_ps(q[f][3], select(k3, d, c));
+                continue;
+            }
+#endif
+            for (int lane = 0; lane < 4; lane++) {
+                uint16_t words[3] = { packed[f][lane], packed[f][4 + lane], packed[f][8 + lane] };
+                glm::vec4 decoded = AnimationDetail::DecodeRotation(words);
+                for (int k = 0; k < 4; k++) {
+                    q[f][k][lane] = decoded[k];
+                }
+            }
+        }
+
+        float result[4][4];
+#if ANIMATION_SIMD
+        if (simd) {
+            __m128 x0 = _mm_loadu_ps(q[0][0]), y0 = _mm_loadu_ps(q[0][1]), z0 = _mm_loadu_ps(q[0][2]), w0 = _mm_loadu_ps(q[0][3]);
+            __m128 x1 = _mm_loadu_ps(q[1][0]), y1 = _mm_loadu_ps(q[1][1]), z1 = _mm_loadu_ps(q[1][2]), w1 = _mm_loadu_ps(q[1][3]);
+            __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x0, x1), _mm_mul_ps(y0, y1)), _mm_add_ps(_mm_mul_ps(z0, z1), _mm_mul_ps(w0, w1)));
+            // Camino corto: si el producto es negativo se invierte el signo del peso
+            __m128 signBit = _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), _mm_set1_ps(-0.0f));
+            __m128 w = _mm_xor_ps(_mm_set1_ps(weight), signBit);
+            __m128 iw = _mm_set1_ps(1.0f - weight);
+            __m128 x = _mm_add_ps(_mm_mul_ps(x0, iw), _mm_mul_ps(x1, w));
+            __m128 y = _mm_add_ps(_mm_mul_ps(y0, iw), _mm_mul_ps(y1, w));
+            __m128 z = _mm_add_ps(_mm_mul_ps(z0, iw), _mm_mul_ps(z1, w));
+            __m128 ww = _mm_add_ps(_mm_mul_ps(w0, iw), _mm_mul_ps(w1, w));
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(ww, ww))));
+            __m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), length);
+            _mm_storeu_ps(result[0], _mm_mul_ps(x, inverse));
+            _mm_storeu_ps(result[1], _mm_mul_ps(y, inverse));
+            _mm_storeu_ps(result[2], _mm_mul_ps(z, inverse));
+            _mm_storeu_ps(result[3], _mm_mul_ps(ww, inverse));
+        }
+        else
+#endif
+        {
+            for (int lane = 0; lane < 4; lane++) {
+                glm::vec4 a(q[0][0][lane], q[0][1][lane], q[0][2][lane], q[0][3][lane]);
+                glm::vec4 b(q[1][0][lane], q[1][1][lane], q[1][2][lane], q[1][3][lane]);
+                glm::vec4 r = AnimationDetail::Nlerp(a, b, weight);
+                for (int k = 0; k < 4; k++) {
+                    result[k][lane] = r[k];
+                }
+            }
+        }
+        for (int lane = 0; lane < 4; lane++) {
+            uint16_t joint = clip.rotationJoints[g * 4 + lane];
+            for (int k = 0; k < 4; k++) {
+                out.Stream(POSE_RX + k)[joint] = result[k][lane];
+            }
+        }
+    }
+
+    // Traslaciones y escalas: misma forma, tres componentes en su rango
+    auto sampleVectors = [&](const std::vector<uint16_t>& joints, const std::vector<uint16_t>& frames, const std::vector<float>& minimum,
+                             const std::vector<float>& extent, int firstStream) {
+        size_t vectorGroups = joints.size() / 4;
+        for (size_t g = 0; g < vectorGroups; g++) {
+            const uint16_t* packed0 = &frames[(frame0 * vectorGroups + g) * 12];
+            const uint16_t* packed1 = &frames[(frame1 * vectorGroups + g) * 12];
+            for (int c = 0; c < 3; c++) {
+                float a[4], b[4], result[4];
+                for (int lane = 0; lane < 4; lane++) {
+                    a[lane] = float(packed0[c * 4 + lane]);
+                    b[lane] = float(packed1[c * 4 + lane]);
+                }
+                const float* low = &minimum[(g * 3 + c) * 4];
+                const float* range = &extent[(g * 3 + c) * 4];
+#if ANIMATION_SIMD
+                if (simd) {
+                    __m128 scale = _mm_mul_ps(_mm_loadu_ps(range), _mm_set1_ps(1.0f / 65535.0f));
+                    __m128 va = _mm_loadu_ps(a), vb = _mm_loadu_ps(b);
+                    __m128 mixed = _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), _mm_set1_ps(weight)));
+                    _mm_storeu_ps(result, _mm_add_ps(_mm_loadu_ps(low), _mm_mul_ps(mixed, scale)));
+                }
+                else
+#endif
+                {
+                    for (int lane = 0; lane < 4; lane++) {
+                        result[lane] = low[lane] + (a[lane] + (b[lane] - a[lane]) * weight) * (range[lane] / 65535.0f);
+                    }
+                }
+                for (int lane = 0; lane < 4; lane++) {
+                    out.Stream(firstStream + c)[joints[g * 4 + lane]] = result[lane];
+                }
+            }
+        }
+    };
+    sampleVectors(clip.translationJoints, clip.translations, clip.translationMin, clip.translationExtent, POSE_TX);
+    sampleVectors(clip.scaleJoints, clip.scales, clip.scaleMin, clip.scaleExtent, POSE_SX);
+}
+
+// out = a mezclada con b por "weight" (nlerp de las rotaciones, lerp del resto)
+inline void BlendPoses(const Pose& a, const Pose& b, float weight, Pose& out, bool simd = ANIMATION_SIMD != 0)
+{
+    if (out.Padded() != a.Padded()) {
+        out.Resize(a.Count());
+    }
+    size_t padded = a.Padded();
+    const float* ra[4] = { a.Stream(POSE_RX), a.Stream(POSE_RY), a.Stream(POSE_RZ), a.Stream(POSE_RW) };
+    const float* rb[4] = { b.Stream(POSE_RX), b.Stream(POSE_RY), b.Stream(POSE_RZ), b.Stream(POSE_RW) };
+    float* ro[4] = { out.Stream(POSE_RX), out.Stream(POSE_RY), out.Stream(POSE_RZ), out.Stream(POSE_RW) };
+#if ANIMATION_SIMD
+    if (simd) {
+        __m128 iw = _mm_set1_ps(1.0f - weight);
+        __m128 vw = _mm_set1_ps(weight);
+        for (size_t i = 0; i < padded; i += 4) {
+            __m128 qa[4], qb[4];
+            for (int k = 0; k < 4; k++) {
+                qa[k] = _mm_loadu_ps(ra[k] + i);
+                qb[k] = _mm_loadu_ps(rb[k] + i);
+            }
+            __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qa[0], qb[0]), _mm_mul_ps(qa[1], qb[1])),
+                                    _mm_add_ps(_mm_mul_ps(qa[2], qb[2]), _mm_mul_ps(qa[3], qb[3])));
+            __m128 w = _mm_xor_ps(vw, _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), _mm_set1_ps(-0.0f)));
+            __m128 q[4];
+            __m128 length = _mm_setzero_ps();
+            for (int k = 0; k < 4; k++) {
+                q[k] = _mm_add_ps(_mm_mul_ps(qa[k], iw), _mm_mul_ps(qb[k], w));
+                length = _mm_add_ps(length, _mm_mul_ps(q[k], q[k]));
+            }
+            __m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(length));
+            for (int k = 0; k < 4; k++) {
+                _mm_storeu_ps(ro[k] + i, _mm_mul_ps(q[k], inverse));
+            }
+            for (int s = POSE_TX; s < POSE_STREAMS; s++) {
+                __m128 va = _mm_loadu_ps(a.Stream(s) + i);
+                __m128 vb = _mm_loadu_ps(b.Stream(s) + i);
+                _mm_storeu_ps(out.Stream(s) + i, _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), vw)));
+            }
+        }
+        return;
+    }
+#endif
+    for (size_t i = 0; i < padded; i++) {
+        glm::vec4 q = AnimationDetail::Nlerp(glm::vec4(ra[0][i], ra[1][i], ra[2][i], ra[3][i]), glm::vec4(rb[0][i], rb[1][i], rb[2][i], rb[3][i]), weight);
+        for (int k = 0; k < 4; k++) {
+            ro[k][i] = q[k];
+        }
+        for (int s = POSE_TX; s < POSE_STREAMS; s++) {
+            out.Stream(s)[i] = a.Stream(s)[i] + (b.Stream(s)[i] - a.Stream(s)[i]) * weight;
+        }
+    }
+}
+
+namespace AnimationDetail
+{
+    // Pistas de un clip muestreadas a "rate": [hueso][fotograma]
+    struct DenseClip
+    {
+        float rate = 0.0f;
+        uint32_t frames = 0;
+        std::vector<std::vector<glm::vec4>> rotations, translations, scales;
+    };
+
+    inline DenseClip Resample(const RawClip& raw, const Skeleton& skeleton, float rate)
+    {
+        DenseClip dense;
+        dense.rate = rate;
+        dense.frames = std::max(2u, uint32_t(std::ceil(raw.duration * rate - 1e-3f)) + 1);
+        size_t count = skeleton.Count();
+        dense.rotations.assign(count, std::vector<glm::vec4>(dense.frames));
+        dense.translations.assign(count, std::vector<glm::vec4>(dense.frames));
+        dense.scales.assign(count, std::vector<glm::vec4>(dense.frames));
+        for (size_t j = 0; j < count; j++) {
+            JointTransform rest = skeleton.rest.Get(j);
+            for (uint32_t f = 0; f < dense.frames; f++) {
+                float time = std::min(float(f) / rate, raw.duration);
+                dense.rotations[j][f] = raw.rotations[j].times.empty() ? rest.rotation : raw.rotations[j].Sample(time, true);
+                dense.translations[j][f] = raw.translations[j].times.empty() ? glm::vec4(rest.translation, 0.0f) : raw.translations[j].Sample(time, false);
+                dense.scales[j][f] = raw.scales[j].times.empty() ? glm::vec4(rest.scale, 0.0f) : raw.scales[j].Sample(time, false);
+                // Continuidad de signo para que la interpolacion tome el camino corto
+                if (f > 0 && glm::dot(dense.rotations[j][f], dense.rotations[j][f - 1]) < 0.0f) {
+                    dense.rotations[j][f] = -dense.rotations[j][f];
+                }
+            }
+        }
+        return dense;
+    }
+
+    inline glm::vec4 SampleDense(const std::vector<glm::vec4>& track, float rate, float time, bool rotation)
+    {
+        float position = std::min(time * rate, float(track.size() - 1));
+        size_t frame0 = size_t(position);
+        size_t frame1 = std::min(frame0 + 1, track.size() - 1);
+        float weight = position - float(frame0);
+        return rotation ? Nlerp(track[frame0], track[frame1], weight) : glm::mix(track[frame0], track[frame1], weight);
+    }
+
+    // Mayor error de "coarse" contra "reference" en los tiempos de "reference"
+    inline void TrackError(const std::vector<glm::vec4>& reference, float referenceRate, const std::vector<glm::vec4>& coarse, float coarseRate,
+                           bool rotation, float& error)
+    {
+        for (size_t f = 0; f < reference.size(); f++) {
+            glm::vec4 value = SampleDense(coarse, coarseRate, float(f) / referenceRate, rotation);
+            error = std::max(error, rotation ? QuatDistance(value, reference[f]) : glm::length(glm::vec3(value - reference[f])));
+        }
+    }
+
+    inline bool IsConstant(const std::vector<glm::vec4>& track, bool rotation, float tolerance)
+    {
+        for (const glm::vec4& value : track) {
+            float error = rotation ? QuatDistance(value, track[0]) : glm::length(glm::vec3(value - track[0]));
+            if (error > tolerance) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Tamano del esqueleto en reposo (diagonal de la caja de sus huesos)
+    inline float SkeletonExtent(const Skeleton& skeleton)
+    {
+        std::vector<glm::mat4> globals(skeleton.Count());
+        glm::vec3 low(1e30f), high(-1e30f);
+        for (size_t j = 0; j < skeleton.Count(); j++) {
+            glm::mat4 local = TransformMatrix(skeleton.rest.Get(j));
+            globals[j] = skeleton.parents[j] >= 0 ? globals[skeleton.parents[j]] * local : local;
+            low = glm::min(low, glm::vec3(globals[j][3]));
+            high = glm::max(high, glm::vec3(globals[j][3]));
+        }
+        return skeleton.Count() > 0 ? glm::length(high - low) : 0.0f;
+    }
+}
+
+// Comprime "raw" para "skeleton" (ver el comentario del principio)
+inline AnimationClip CompressClip(const RawClip& raw, const Skeleton& skeleton)
+{
+    using namespace AnimationDetail;
+    AnimationClip clip;
+    clip.name = raw.name;
+    clip.duration = std::max(raw.duration, 0.0f);
+    size_t count = skeleton.Count();
+    for (size_t j = 0; j < count; j++) {
+        clip.rawBytes += (raw.rotations[j].times.size() + raw.translations[j].times.size() + raw.scales[j].times.size()) * 24;
+    }
+    float positionTolerance = std::max(ANIMATION_POSITION_TOLERANCE * SkeletonExtent(skeleton), 1e-6f);
+
+    DenseClip reference = Resample(raw, skeleton, ANIMATION_SAMPLE_RATE);
+    std::vector<uint8_t> animated(count * 3, 0);   // rotacion, traslacion, escala
+    for (size_t j = 0; j < count; j++) {
+        animated[j * 3 + 0] = !IsConstant(reference.rotations[j], true, ANIMATION_ROTATION_TOLERANCE);
+        animated[j * 3 + 1] = !IsConstant(reference.translations[j], false, positionTolerance);
+        animated[j * 3 + 2] = !IsConstant(reference.scales[j], false, positionTolerance);
+    }
+
+    // Reduccion de claves: mitad de fotogramas mientras todas las pistas
+    // animadas sigan dentro de la tolerancia
+    DenseClip chosen = reference;
+    for (float rate = ANIMATION_SAMPLE_RATE * 0.5f; rate >= ANIMATION_MIN_SAMPLE_RATE; rate *= 0.5f) {
+        DenseClip coarse = Resample(raw, skeleton, rate);
+        float rotationError = 0.0f, positionError = 0.0f;
+        for (size_t j = 0; j < count; j++) {
+            if (animated[j * 3 + 0]) {
+                TrackError(reference.rotations[j], reference.rate, coarse.rotations[j], rate, true, rotationError);
+            }
+            if (animated[j * 3 + 1]) {
+                TrackError(reference.translations[j], reference.rate, coarse.translations[j], rate, false, positionError);
+            }
+            if (animated[j * 3 + 2]) {
+                TrackError(reference.scales[j], reference.rate, coarse.scales[j], rate, false, positionError);
+            }
+        }
+        if (rotationError > ANIMATION_ROTATION_TOLERANCE || positionError > positionTolerance) {
+            break;
+        }
+        chosen = std::move(coarse);
+    }
+    clip.sampleRate = chosen.rate;
+    clip.frameCount = chosen.frames;
+
+    // Las constantes (y los huesos sin pista) quedan en la pose base
+    clip.constant.Resize(count);
+    for (size_t j = 0; j < count; j++) {
+        JointTransform t;
+        t.rotation = glm::normalize(reference.rotations[j][0]);
+        t.translation = glm::vec3(reference.translations[j][0]);
+        t.scale = glm::vec3(reference.scales[j][0]);
+        clip.constant.Set(j, t);
+        if (animated[j * 3 + 0]) {
+            clip.rotationJoints.push_back(uint16_t(j));
+        }
+        if (animated[j * 3 + 1]) {
+            clip.translationJoints.push_back(uint16_t(j));
+        }
+        if (animated[j * 3 + 2]) {
+            clip.scaleJoints.push_back(uint16_t(j));
+        }
+    }
+    // El relleno escribe en el lugar sobrante de la pose
+    for (std::vector<uint16_t>* joints : { &clip.rotationJoints, &clip.translationJoints, &clip.scaleJoints }) {
+        while (joints->size() % 4 != 0) {
+            joints->push_back(uint16_t(count));
+        }
+    }
+
+    size_t rotationGroups = clip.rotationJoints.size() / 4;
+    clip.rotations.assign(clip.frameCount * rotationGroups * 12, 0);
+    for (uint32_t f = 0; f < clip.frameCount; f++) {
+        for (size_t i = 0; i < clip.rotationJoints.size(); i++) {
+            size_t g = i / 4, lane = i % 4;
+            uint16_t joint = clip.rotationJoints[i];
+            glm::vec4 q = joint < count ? glm::normalize(chosen.rotations[joint][f]) : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+            uint16_t words[3];
+            EncodeRotation(q, words);
+            for (int c = 0; c < 3; c++) {
+                clip.rotations[((f * rotationGroups + g) * 3 + c) * 4 + lane] = words[c];
+            }
+        }
+    }
+
+    auto packVectors = [&](const std::vector<uint16_t>& joints, const std::vector<std::vector<glm::vec4>>& tracks, std::vector<uint16_t>& frames,
+                           std::vector<float>& minimum, std::vector<float>& extent) {
+        size_t groups = joints.size() / 4;
+        minimum.assign(groups * 12, 0.0f);
+        extent.assign(groups * 12, 0.0f);
+        frames.assign(clip.frameCount * groups * 12, 0);
+        for (size_t i = 0; i < joints.size(); i++) {
+            size_t g = i / 4, lane = i % 4;
+            if (joints[i] >= count) {
+                continue;
+            }
+            const std::vector<glm::vec4>& track = tracks[joints[i]];
+            for (int c = 0; c < 3; c++) {
+                float low = 1e30f, high = -1e30f;
+                for (const glm::vec4& value : track) {
+                    low = std::min(low, value[c]);
+                    high = std::max(high, value[c]);
+                }
+                minimum[(g * 3 + c) * 4 + lane] = low;
+                extent[(g * 3 + c) * 4 + lane] = high - low;
+                for (uint32_t f = 0; f < clip.frameCount; f++) {
+                    frames[((f * groups + g) * 3 + c) * 4 + lane] = QuantizeRange(track[f][c], low, high - low);
+                }
+            }
+        }
+    };
+    packVectors(clip.translationJoints, chosen.translations, clip.translations, clip.translationMin, clip.translationExtent);
+    packVectors(clip.scaleJoints, chosen.scales, clip.scales, clip.scaleMin, clip.scaleExtent);
+
+    // Error final (reduccion mas cuantizacion) contra el muestreo de referencia
+    Pose pose;
+    pose.Resize(count);
+    for (uint32_t f = 0; f < reference.frames; f++) {
+        SampleClip(clip, std::min(float(f) / reference.rate, clip.duration - 1e-4f), pose, false);
+        for (size_t j = 0; j < count; j++) {
+            JointTransform t = pose.Get(j);
+            float dot = std::min(1.0f, std::fabs(glm::dot(t.rotation, glm::normalize(reference.rotations[j][f]))));
+            clip.maxRotationDegrees = std::max(clip.maxRotationDegrees, glm::degrees(2.0f * std::acos(dot)));
+            clip.maxPositionError = std::max(clip.maxPositionError, glm::length(t.translation - glm::vec3(reference.translations[j][f])));
+        }
+    }
+    return clip;
+}
+
+// Lo que reproduce un personaje en un fotograma: clipA en timeA mezclado con
+// clipB en timeB con peso "blend". Un clip -1 es la pose de reposo
+struct AnimationRequest
+{
+    int clipA = -1;
+    float timeA = 0.0f;
+    int clipB = -1;
+    float timeB = 0.0f;
+    float blend = 0.0f;
+};
+
+// Muestreo y mezcla en hilos aparte: Kick reparte los personajes y vuelve
+// enseguida; Wait espera y devuelve las matrices de todos, una tras otra
+class AnimationUpdater
+{
+public:
+    explicit AnimationUpdater(unsigned int threads = 1) : pool(std::max(threads, 1u)) { }
+
+    bool simd = ANIMATION_SIMD != 0;  // el benchmark la apaga para comparar
+
+    void SetRig(const Skeleton* skeleton, const std::vector<AnimationClip>* clips)
+    {
+        this->skeleton = skeleton;
+        this->clips = clips;
+    }
+
+    void Kick(const std::vector<AnimationRequest>& requests)
+    {
+        this->requests = requests;
+        size_t joints = this->skeleton->Count();
+        this->palette.resize(requests.size() * joints * ANIMATION_PALETTE_FLOATS);
+        this->workMicroseconds = 0;
+        size_t chunks = std::min(requests.size(), size_t(this->pool.Size()) * 4);
+        this->scratch.resize(std::max(chunks, this->scratch.size()));
+        for (size_t c = 0; c < chunks; c++) {
+            size_t begin = requests.size() * c / chunks;
+            size_t end = requests.size() * (c + 1) / chunks;
+            this->pool.Submit([this, c, begin, end]() { this->evaluate(this->scratch[c], begin, end); });
+        }
+    }
+
+    const std::vector<float>& Wait()
+    {
+        this->pool.Wait();
+        return this->palette;
+    }
+
+    // Tiempo sumado de los hilos en la ultima tanda
+    double WorkMilliseconds() const { return double(this->workMicroseconds.load()) / 1000.0; }
+
+    unsigned int Threads() const { return this->pool.Size(); }
+
+private:
+    struct Scratch
+    {
+        Pose a, b, blended;
+        std::vector<glm::mat4> globals;
+    };
+
+    ThreadPool pool;
+    const Skeleton* skeleton = nullptr;
+    const std::vector<AnimationClip>* clips = nullptr;
+    std::vector<AnimationRequest> requests;
+    std::vector<float> palette;
+    std::vector<Scratch> scratch;
+    std::atomic<long long> workMicroseconds{ 0 };
+
+    void evaluate(Scratch& scratch, size_t begin, size_t end)
+    {
+        auto start = std::chrono::steady_clock::now();
+        size_t joints = this->skeleton->Count();
+        auto sample = [this](int clip, float time, Pose& out) {
+            if (clip < 0 || clip >= int(this->clips->size())) {
+                out = this->skeleton->rest;
+            }
+            else {
+                SampleClip((*this->clips)[clip], time, out, this->simd);
+            }
+        };
+        for (size_t i = begin; i < end; i++) {
+            const AnimationRequest& request = this->requests[i];
+            sample(request.clipA, request.timeA, scratch.a);
+            const Pose* pose = &scratch.a;
+            if (request.blend > 0.0f) {
+                sample(request.clipB, request.timeB, scratch.b);
+                BlendPoses(scratch.a, scratch.b, request.blend, scratch.blended, this->simd);
+                pose = &scratch.blended;
+            }
+            PoseToPalette(*this->skeleton, *pose, scratch.globals, &this->palette[i * joints * ANIMATION_PALETTE_FLOATS]);
+        }
+        this->workMicroseconds += (long long)(MillisecondsSince(start) * 1000.0);
+    }
+};
@@ -0,0 +1,628 @@
+#pragma once
+
+// Personaje con esqueleto (Models/snoopy.fbx). Assimp da la malla, los huesos
+// con sus pesos y los clips; la malla queda en el espacio de la escena en la
+// pose de union, con hasta cuatro huesos por vertice (indices de 16 bits y
+// pesos de 8 bits que suman 255), y los clips se comprimen con
+// SkeletalAnimation.h. El skinning lo hace lighting.vs con SKINNED: las
+// matrices de todos los personajes van en un texture buffer (tres filas por
+// hueso) y cada instancia de la llamada es un personaje.
+// Los nodos sin pesos que cuelgan del esqueleto (o que solo tienen mallas)
+// tambien son huesos: sus mallas se mueven rigidas con ellos.
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <assimp/config.h>
+
+#include "MeshCache.h"
+#include "TextureCache.h"
+#include "GLStats.h"
+#include "InstanceBuffer.h"
+#include "RenderQueue.h"
+#include "IrradianceVolume.h"
+#include "SkeletalAnimation.h"
+
+const GLuint SKIN_JOINTS_LOCATION = 11;     // despues de LIGHTMAP_UV_LOCATION
+const GLuint SKIN_WEIGHTS_LOCATION = 12;
+const GLint SKIN_PALETTE_UNIT = 6;          // 5 es el mapa de luz
+const int SKIN_MAX_INFLUENCES = 4;
+
+struct SkinnedVertex
+{
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+    uint16_t joints[SKIN_MAX_INFLUENCES];
+    uint8_t weights[SKIN_MAX_INFLUENCES];
+};
+
+// Rango de indices de una malla del archivo con su material
+struct SkinnedPart
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t material;
+};
+
+struct SkinnedModelData
+{
+    std::vector<SkinnedVertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<SkinnedPart> parts;
+    std::vector<std::string> diffuseTextures;  // por material, solo el nombre del archivo
+    Skeleton skeleton;
+    std::vector<AnimationClip> clips;
+    glm::vec3 boundsMin = glm::vec3(0.0f);     // pose de union
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    size_t skinnedVertices = 0;                // con pesos (el resto va rigido con su nodo)
+    double importMilliseconds = 0.0;
+};
+
+namespace SkinningDetail
+{
+    // Nodos que hacen falta en el esqueleto: huesos, sus ancestros y los que tienen mallas
+    inline bool MarkJoints(const aiNode* node, const std::set<std::string>& bones, std::set<const aiNode*>& needed)
+    {
+        bool keep = node->mNumMeshes > 0 || bones.count(node->mName.C_Str()) > 0;
+        for (unsigned int i = 0; i < node->mNumChildren; i++) {
+            keep = MarkJoints(node->mChildren[i], bones, needed) || keep;
+        }
+        if (keep) {
+            needed.insert(node);
+        }
+        return keep;
+    }
+
+    // Padre antes que hijos, en el orden del archivo
+    inline void AddJoints(const aiNode* node, int parent, const std::set<const aiNode*>& needed, Skeleton& skeleton, std::vector<const aiNode*>& nodes)
+    {
+        if (needed.count(node) == 0) {
+            return;
+        }
+        int index = int(skeleton.names.size());
+        skeleton.names.push_back(node->mName.C_Str());
+        skeleton.parents.push_back(parent);
+        nodes.push_back(node);
+        for (unsigned int i = 0; i < node->mNumChildren; i++) {
+            AddJoints(node->mChildren[i], index, needed, skeleton, nodes);
+        }
+    }
+
+    // Pesos normalizados a 8 bits; el redondeo que sobra o falta va al mayor
+    inline void QuantizeWeights(const float* weights, int count, uint8_t* out)
+    {
+        float sum = 0.0f;
+        for (int k = 0; k < count; k++) {
+            sum += weights[k];
+        }
+        int total = 0;
+        int largest = 0;
+        for (int k = 0; k < SKIN_MAX_INFLUENCES; k++) {
+            out[k] = k < count && sum > 0.0f ? uint8_t(std::lround(weights[k] / sum * 255.0f)) : 0;
+            total += out[k];
+            largest = out[k] > out[largest] ? k : largest;
+        }
+        out[largest] = uint8_t(int(out[largest]) + 255 - total);
+    }
+
+    inline std::string FileName(const std::string& path)
+    {
+        size_t slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+}
+
+// Importa la malla, el esqueleto y los clips de "path". false si el archivo
+// no se pudo leer o no tiene mallas
+inline bool ImportSkinnedModel(const std::string& path, SkinnedModelData& out)
+{
+    using namespace SkinningDetail;
+    auto start = std::chrono::steady_clock::now();
+    Assimp::Importer importer;
+    // Sin los nodos auxiliares de pivotes de FBX las pistas apuntan a los huesos
+    importer.SetPropertyBool(AI_CONFIG_IMPORT_FBX_PRESERVE_PIVOTS, false);
+    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_LimitBoneWeights | aiProcess_FlipUVs);
+    if (scene == nullptr || scene->mRootNode == nullptr || scene->mNumMeshes == 0) {
+        std::cout << "ERROR::SKINNED_MODEL:: could not import " << path << ": " << importer.GetErrorString() << std::endl;
+        return false;
+    }
+    out = SkinnedModelData();
+
+    std::set<std::string> bones;
+    for (unsigned int m = 0; m < scene->mNumMeshes; m++) {
+        for (unsigned int b = 0; b < scene->mMeshes[m]->mNumBones; b++) {
+            bones.insert(scene->mMeshes[m]->mBones[b]->mName.C_Str());
+        }
+    }
+    std::set<const aiNode*> needed;
+    MarkJoints(scene->mRootNode, bones, needed);
+    std::vector<const aiNode*> nodes;
+    Skeleton& skeleton = out.skeleton;
+    AddJoints(scene->mRootNode, -1, needed, skeleton, nodes);
+    size_t count = skeleton.Count();
+    if (count >= 0xffff) {
+        std::cout << "ERROR::SKINNED_MODEL:: " << path << " has " << count << " joints, more than 16-bit indices allow" << std::endl;
+        return false;
+    }
+
+    // Pose de reposo = transformaciones de los nodos al importar
+    skeleton.rest.Resize(count);
+    std::vector<glm::mat4> globals(count);
+    std::map<std::string, int> jointByName;
+    for (size_t j = 0; j < count; j++) {
+        skeleton.rest.Set(j, AnimationDetail::DecomposeMatrix(AiToGlm(nodes[j]->mTransformation)));
+        glm::mat4 local = AiToGlm(nodes[j]->mTransformation);
+        globals[j] = skeleton.parents[j] >= 0 ? globals[skeleton.parents[j]] * local : local;
+        jointByName.insert({ skeleton.names[j], int(j) });
+    }
+    // Por defecto la inversa de la global: un nodo sin huesos se mueve rigido
+    skeleton.inverseBind.resize(count);
+    std::vector<uint8_t> fromBone(count, 0);
+    for (size_t j = 0; j < count; j++) {
+        skeleton.inverseBind[j] = glm::inverse(globals[j]);
+    }
+
+    out.boundsMin = glm::vec3(1e30f);
+    out.boundsMax = glm::vec3(-1e30f);
+    for (size_t j = 0; j < count; j++) {
+        const aiNode* node = nodes[j];
+        const glm::mat4& transform = globals[j];
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+        for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+            const aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+            uint32_t baseVertex = uint32_t(out.vertices.size());
+
+            // Influencias por vertice; la de la inversa de union es offset * inversa(malla)
+            std::vector<std::vector<std::pair<float, uint16_t>>> influences(mesh->mNumVertices);
+            for (unsigned int b = 0; b < mesh->mNumBones; b++) {
+                const aiBone* bone = mesh->mBones[b];
+                int joint = jointByName[bone->mName.C_Str()];
+                if (!fromBone[joint]) {
+                    skeleton.inverseBind[joint] = AiToGlm(bone->mOffsetMatrix) * glm::inverse(transform);
+                    fromBone[joint] = 1;
+                }
+                for (unsigned int w = 0; w < bone->mNumWeights; w++) {
+                    const aiVertexWeight& weight = bone->mWeights[w];
+                    if (weight.mWeight > 0.0f && weight.mVertexId < mesh->mNumVertices) {
+                        influences[weight.mVertexId].push_back({ weight.mWeight, uint16_t(joint) });
+                    }
+                }
+            }
+
+            for (unsigned int v = 0; v < mesh->mNumVertices; v++) {
+                SkinnedVertex vertex;
+                vertex.Position = glm::vec3(transform * glm::vec4(mesh->mVertices[v].x, mesh->mVertices[v].y, mesh->mVertices[v].z, 1.0f));
+                vertex.Normal = glm::vec3(0.0f);
+                if (mesh->mNormals != nullptr) {
+                    vertex.Normal = normalMatrix * glm::vec3(mesh->mNormals[v].x, mesh->mNormals[v].y, mesh->mNormals[v].z);
+                }
+                vertex.TexCoords = glm::vec2(0.0f);
+                if (mesh->mTextureCoords[0] != nullptr) {
+                    vertex.TexCoords = glm::vec2(mesh->mTextureCoords[0][v].x, mesh->mTextureCoords[0][v].y);
+                }
+                // LimitBoneWeights deja cuatro; si llegan mas se quedan los mayores
+                std::vector<std::pair<float, uint16_t>>& list = influences[v];
+                std::sort(list.begin(), list.end(), [](const std::pair<float, uint16_t>& a, const std::pair<float, uint16_t>& b) { return a.first > b.first; });
+                if (list.empty()) {
+                    list.push_back({ 1.0f, uint16_t(j) });
+                }
+                else {
+                    out.skinnedVertices++;
+                }
+                int used = std::min(int(list.size()), SKIN_MAX_INFLUENCES);
+                float weights[SKIN_MAX_INFLUENCES] = {};
+                for (int k = 0; k < SKIN_MAX_INFLUENCES; k++) {
+                    vertex.joints[k] = k < used ? list[k].second : 0;
+                    weights[k] = k < used ? list[k].first : 0.0f;
+                }
+                QuantizeWeights(weights, used, vertex.weights);
+                out.boundsMin = glm::min(out.boundsMin, vertex.Position);
+                out.boundsMax = glm::max(out.boundsMax, vertex.Position);
+                out.vertices.push_back(vertex);
+            }
+
+            SkinnedPart part;
+            part.firstIndex = uint32_t(out.indices.size());
+            part.material = mesh->mMaterialIndex;
+            for (unsigned int f = 0; f < mesh->mNumFaces; f++) {
+                const aiFace& face = mesh->mFaces[f];
+                if (face.mNumIndices != 3) {
+                    continue;
+                }
+                for (unsigned int k = 0; k < 3; k++) {
+                    out.indices.push_back(baseVertex + face.mIndices[k]);
+                }
+            }
+            part.indexCount = uint32_t(out.indices.size()) - part.firstIndex;
+            if (part.indexCount > 0) {
+                out.parts.push_back(part);
+            }
+        }
+    }
+
+    // Las rutas de FBX suelen ser absolutas de la maquina del autor; se busca
+    // el archivo junto al modelo. Las embebidas ("*0") quedan en blanco
+    for (unsigned int i = 0; i < scene->mNumMaterials; i++) {
+        aiString value;
+        std::string name;
+        if (scene->mMaterials[i]->GetTextureCount(aiTextureType_DIFFUSE) > 0
+            && scene->mMaterials[i]->GetTexture(aiTextureType_DIFFUSE, 0, &value) == aiReturn_SUCCESS && value.C_Str()[0] != '*') {
+            name = FileName(value.C_Str());
+        }
+        out.diffuseTextures.push_back(name);
+    }
+
+    // Clips: claves en segundos por hueso; las pistas de nodos que no quedaron
+    // en el esqueleto no mueven ninguna malla y se descartan
+    for (unsigned int a = 0; a < scene->mNumAnimations; a++) {
+        const aiAnimation* animation = scene->mAnimations[a];
+        double ticks = animation->mTicksPerSecond > 0.0 ? animation->mTicksPerSecond : 25.0;
+        RawClip raw;
+        raw.name = animation->mName.C_Str();
+        raw.duration = float(animation->mDuration / ticks);
+        raw.rotations.resize(count);
+        raw.translations.resize(count);
+        raw.scales.resize(count);
+        for (unsigned int c = 0; c < animation->mNumChannels; c++) {
+            const aiNodeAnim* channel = animation->mChannels[c];
+            auto joint = jointByName.find(channel->mNodeName.C_Str());
+            if (joint == jointByName.end()) {
+                continue;
+            }
+            RawTrack& rotation = raw.rotations[joint->second];
+            for (unsigned int k = 0; k < channel->mNumRotationKeys; k++) {
+                const aiQuaternion& q = channel->mRotationKeys[k].mValue;
+                rotation.times.push_back(float(channel->mRotationKeys[k].mTime / ticks));
+                rotation.values.push_back(glm::normalize(glm::vec4(q.x, q.y, q.z, q.w)));
+            }
+            RawTrack& translation = raw.translations[joint->second];
+            for (unsigned int k = 0; k < channel->mNumPositionKeys; k++) {
+                const aiVector3D& p = channel->mPositionKeys[k].mValue;
+                translation.times.push_back(float(channel->mPositionKeys[k].mTime / ticks));
+                translation.values.push_back(glm::vec4(p.x, p.y, p.z, 0.0f));
+            }
+            RawTrack& scale = raw.scales[joint->second];
+            for (unsigned int k = 0; k < channel->mNumScalingKeys; k++) {
+                const aiVector3D& s = channel->mScalingKeys[k].mValue;
+                scale.times.push_back(float(channel->mScalingKeys[k].mTime / ticks));
+                scale.values.push_back(glm::vec4(s.x, s.y, s.z, 0.0f));
+            }
+        }
+        auto compressStart = std::chrono::steady_clock::now();
+        AnimationClip clip = CompressClip(raw, skeleton);
+        std::cout << "[Animation] " << path << ": clip \"" << clip.name << "\" " << clip.duration << " s, "
+                  << clip.rotationJoints.size() << "/" << clip.translationJoints.size() << "/" << clip.scaleJoints.size()
+                  << " rotation/translation/scale tracks (padded to 4), " << ANIMATION_SAMPLE_RATE << " -> " << clip.sampleRate << " Hz, "
+                  << clip.rawBytes / 1024.0 << " KB -> " << clip.Bytes() / 1024.0 << " KB, max error " << clip.maxRotationDegrees
+                  << " deg / " << clip.maxPositionError << " units (" << MillisecondsSince(compressStart) << " ms)" << std::endl;
+        out.clips.push_back(std::move(clip));
+    }
+    out.importMilliseconds = MillisecondsSince(start);
+    return !out.parts.empty();
+}
+
+class SkinnedModel : public RenderSource
+{
+public:
+    SkinnedModel() { }
+
+    ~SkinnedModel()
+    {
+        if (!TextureCache::Instance().ContextAlive()) {
+            return;
+        }
+        glDeleteVertexArrays(1, &this->VAO);
+        glDeleteBuffers(1, &this->VBO);
+        glDeleteBuffers(1, &this->EBO);
+        glDeleteBuffers(1, &this->paletteBuffer);
+        glDeleteTextures(1, &this->paletteTexture);
+    }
+
+    SkinnedModel(const SkinnedModel&) = delete;
+    SkinnedModel& operator=(const SkinnedModel&) = delete;
+
+    // Importa y sube el modelo; false si no se pudo leer o no tiene huesos
+    bool Load(const std::string& path)
+    {
+        SkinnedModelData data;
+        if (!ImportSkinnedModel(path, data)) {
+            return false;
+        }
+        if (data.skinnedVertices == 0) {
+            std::cout << "WARNING::SKINNED_MODEL:: " << path << " has no bone weights" << std::endl;
+            return false;
+        }
+        this->Upload(data, DirectoryOf(path));
+        std::cout << "[Skinning] " << path << ": " << this->skeleton.Count() << " joints, " << data.vertices.size() << " vertices ("
+                  << data.skinnedVertices << " weighted), " << this->indexCount / 3 << " triangles, " << this->clips.size()
+                  << " clips; imported in " << data.importMilliseconds << " ms" << std::endl;
+        return true;
+    }
+
+    // Sube "data" (ya importado); las texturas se buscan en "directory"
+    void Upload(SkinnedModelData& data, const std::string& directory)
+    {
+        this->skeleton = std::move(data.skeleton);
+        this->clips = std::move(data.clips);
+        this->parts = std::move(data.parts);
+        this->boundsMin = data.boundsMin;
+        this->boundsMax = data.boundsMax;
+        this->indexCount = uint32_t(data.indices.size());
+
+        glGenVertexArrays(1, &this->VAO);
+        glGenBuffers(1, &this->VBO);
+        glGenBuffers(1, &this->EBO);
+        glBindVertexArray(this->VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+        glBufferData(GL_ARRAY_BUFFER, data.vertices.size() * sizeof(SkinnedVertex), data.vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indices.size() * sizeof(GLuint), data.indices.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (GLvoid*)offsetof(SkinnedVertex, Position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (GLvoid*)offsetof(SkinnedVertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (GLvoid*)offsetof(SkinnedVertex, TexCoords));
+        // Los indices de hueso llegan enteros al shader (uvec4)
+        glEnableVertexAttribArray(SKIN_JOINTS_LOCATION);
+        glVertexAttribIPointer(SKIN_JOINTS_LOCATION, 4, GL_UNSIGNED_SHORT, sizeof(SkinnedVertex), (GLvoid*)offsetof(SkinnedVertex, joints));
+        glEnableVertexAttribArray(SKIN_WEIGHTS_LOCATION);
+        glVertexAttribPointer(SKIN_WEIGHTS_LOCATION, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(SkinnedVertex), (GLvoid*)offsetof(SkinnedVertex, weights));
+        glBindVertexArray(0);
+        this->instances.Attach(this->VAO);
+
+        glGenBuffers(1, &this->paletteBuffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, this->paletteBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+        glGenTextures(1, &this->paletteTexture);
+        glBindTexture(GL_TEXTURE_BUFFER, this->paletteTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, this->paletteBuffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+        // Sin mapa especular se reutiliza la difusa, como en CachedModel
+        for (const std::string& name : data.diffuseTextures) {
+            this->diffuseMaps.push_back(name.empty() ? TextureCache::Instance().White() : TextureCache::Instance().Load(directory + '/' + name));
+        }
+        if (this->diffuseMaps.empty()) {
+            this->diffuseMaps.push_back(TextureCache::Instance().White());
+        }
+    }
+
+    bool Loaded() const { return this->VAO != 0; }
+
+    const Skeleton& GetSkeleton() const { return this->skeleton; }
+    const std::vector<AnimationClip>& Clips() const { return this->clips; }
+
+    // Primer clip cuyo nombre contiene "text" (sin distinguir mayusculas); -1 si ninguno
+    int FindClip(const std::string& text) const
+    {
+        auto lower = [](std::string value) {
+            std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+            return value;
+        };
+        for (size_t i = 0; i < this->clips.size(); i++) {
+            if (lower(this->clips[i].name).find(lower(text)) != std::string::npos) {
+                return int(i);
+            }
+        }
+        return -1;
+    }
+
+    // Con el programa en uso (p. ej. desde ShaderPermutations::OnCompile)
+    void SetupProgram(GLuint program) const
+    {
+        glUniform1i(glGetUniformLocation(program, "boneMatrices"), SKIN_PALETTE_UNIT);
+        glUniform1i(glGetUniformLocation(program, "boneCount"), GLint(this->skeleton.Count()));
+    }
+
+    // Matrices de AnimationUpdater::Wait, un personaje tras otro; el
+    // almacenamiento se huerfana para no esperar a la GPU
+    void UploadPalette(const std::vector<float>& palette)
+    {
+        size_t size = std::max<size_t>(palette.size() * sizeof(float), 16);
+        GL_COUNT(glBindBuffer(GL_TEXTURE_BUFFER, this->paletteBuffer));
+        GL_COUNT(glBufferData(GL_TEXTURE_BUFFER, size, NULL, GL_STREAM_DRAW));
+        GL_COUNT(glBufferSubData(GL_TEXTURE_BUFFER, 0, palette.size() * sizeof(float), palette.data()));
+        GL_COUNT(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+    }
+
+    // Antes de dibujar; despues hay que invalidar las texturas de GLStateCache
+    void BindPalette()
+    {
+        GL_COUNT(glActiveTexture(GL_TEXTURE0 + SKIN_PALETTE_UNIT));
+        GL_COUNT(glBindTexture(GL_TEXTURE_BUFFER, this->paletteTexture));
+        GL_COUNT(glActiveTexture(GL_TEXTURE0));
+    }
+
+    // Un personaje por matriz, con las matrices de skinning en el mismo orden
+    // en la paleta. Las matrices se suben ahora, como en CachedModel
+    void SubmitInstanced(RenderQueue& queue, GLuint program, RenderPass pass, const std::vector<glm::mat4>& transforms, float depth = 0.0f)
+    {
+        if (transforms.empty()) {
+            return;
+        }
+        this->instances.Upload(transforms.data(), transforms.size());
+        uint32_t object = queue.AddObject(glm::mat4(1.0f), this, -1, false);
+        for (const SkinnedPart& part : this->parts) {
+            GLuint diffuse = this->diffuseMaps[std::min<size_t>(part.material, this->diffuseMaps.size() - 1)]->id;
+            DrawItem& item = queue.Add(pass, program, object, this->VAO, diffuse, diffuse, depth);
+            queue.AddElementsInstanced(item, part.indexCount, part.firstIndex, GLsizei(this->instances.Count()));
+        }
+    }
+
+    // Como SubmitInstanced pero dibujando ya (el programa debe estar en uso)
+    void DrawInstanced(GLuint program, const std::vector<glm::mat4>& transforms)
+    {
+        if (transforms.empty()) {
+            return;
+        }
+        this->instances.Upload(transforms.data(), transforms.size());
+        this->bindIrradiance(program);
+        GL_COUNT(glBindVertexArray(this->VAO));
+        for (const SkinnedPart& part : this->parts) {
+            GLuint diffuse = this->diffuseMaps[std::min<size_t>(part.material, this->diffuseMaps.size() - 1)]->id;
+            GL_COUNT(glActiveTexture(GL_TEXTURE0));
+            GL_COUNT(glBindTexture(GL_TEXTURE_2D, diffuse));
+            GL_COUNT(glActiveTexture(GL_TEXTURE1));
+            GL_COUNT(glBindTexture(GL_TEXTURE_2D, diffuse));
+            GL_COUNT_DRAW(part.indexCount / 3 * this->instances.Count(),
+                          glDrawElementsInstanced(GL_TRIANGLES, part.indexCount, GL_UNSIGNED_INT, (GLvoid*)(sizeof(GLuint) * part.firstIndex),
+                                                  this->instances.Count()));
+        }
+        GL_COUNT(glBindVertexArray(0));
+        GL_COUNT(glActiveTexture(GL_TEXTURE0));
+    }
+
+    void BindObject(GLuint program, GLStateCache& cache) override
+    {
+        this->bindIrradiance(program, &cache);
+    }
+
+    void SetIrradiance(const ShIrradiance& value) { this->irradiance = value; }
+
+    // Caja de la pose de union (espacio del modelo)
+    glm::vec3 BoundsMin() const { return this->boundsMin; }
+    glm::vec3 BoundsMax() const { return this->boundsMax; }
+
+private:
+    GLuint VAO = 0, VBO = 0, EBO = 0;
+    GLuint paletteBuffer = 0, paletteTexture = 0;
+    uint32_t indexCount = 0;
+    std::vector<SkinnedPart> parts;
+    std::vector<TextureHandle> diffuseMaps;   // por material
+    Skeleton skeleton;
+    std::vector<AnimationClip> clips;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    InstanceBuffer instances;
+    ShIrradiance irradiance = {};
+    // Ubicacion de irradianceSH[0] por programa (-1 si no usa IRRADIANCE_PROBES)
+    std::vector<std::pair<GLuint, GLint>> irradianceUniforms;
+
+    void bindIrradiance(GLuint program, GLStateCache* cache = nullptr)
+    {
+        GLint location = -2;
+        for (const std::pair<GLuint, GLint>& entry : this->irradianceUniforms) {
+            if (entry.first == program) {
+                location = entry.second;
+            }
+        }
+        if (location == -2) {
+            location = glGetUniformLocation(program, "irradianceSH[0]");
+            this->irradianceUniforms.push_back({ program, location });
+        }
+        if (location < 0) {
+            return;
+        }
+        // Los elementos de un arreglo de uniforms tienen ubicaciones seguidas
+        for (int k = 0; k < SH_COEFFICIENTS; k++) {
+            if (cache != nullptr) {
+                cache->Uniform3(location + k, this->irradiance.coefficients[k]);
+            }
+            else {
+                GL_COUNT(glUniform3fv(location + k, 1, glm::value_ptr(this->irradiance.coefficients[k])));
+            }
+        }
+    }
+};
+
+// --benchmark-skinning: N personajes caminando, cada uno en otro instante del
+// clip "clip" mezclado con la pose de reposo. Mide el muestreo y la mezcla
+// (escalar y SSE en un hilo, SSE en todos los nucleos), la subida de las
+// matrices con el dibujo (con glFinish) e imprime cuantos personajes caben
+// en un fotograma de "budgetMilliseconds". El programa debe ser la variante
+// SKINNED con proyeccion, vista y luces listos
+inline void BenchmarkSkinning(SkinnedModel& model, GLuint program, int clip, double budgetMilliseconds = 1000.0 / 60.0)
+{
+    const size_t counts[] = { 1, 10, 50, 100, 250, 500, 1000, 2000 };
+    const int frames = 10;
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    AnimationUpdater single(1);
+    AnimationUpdater parallel(threads);
+    single.SetRig(&model.GetSkeleton(), &model.Clips());
+    parallel.SetRig(&model.GetSkeleton(), &model.Clips());
+    // Todos a una unidad de alto, en una cuadricula
+    float height = std::max(model.BoundsMax().y - model.BoundsMin().y, 1e-3f);
+
+    std::cout << "[Skinning] " << model.GetSkeleton().Count() << " joints, " << threads << " threads, budget " << budgetMilliseconds << " ms" << std::endl;
+    std::cout << "[Skinning] characters  scalar ms  simd ms  simd x" << threads << " ms  draw ms  frame ms" << std::endl;
+    size_t fits = 0;
+    double fitsAnimation = 0.0, fitsDraw = 0.0;
+    glUseProgram(program);
+    glEnable(GL_DEPTH_TEST);
+    for (size_t count : counts) {
+        std::vector<AnimationRequest> requests(count);
+        std::vector<glm::mat4> transforms(count);
+        int side = int(std::ceil(std::sqrt(double(count))));
+        for (size_t i = 0; i < count; i++) {
+            requests[i].clipA = -1;
+            requests[i].clipB = clip;
+            requests[i].blend = 0.5f + 0.5f * float(i % 2);
+            glm::vec3 offset(float(int(i) % side - side / 2), 0.0f, -float(int(i) / side));
+            transforms[i] = glm::scale(glm::translate(glm::mat4(1.0f), offset * 0.8f), glm::vec3(1.0f / height));
+        }
+
+        // Mejor de varias tandas para cada forma de evaluar
+        auto animate = [&](AnimationUpdater& updater, bool simd) {
+            updater.simd = simd;
+            double best = 1e30;
+            for (int frame = 0; frame < frames; frame++) {
+                for (size_t i = 0; i < count; i++) {
+                    requests[i].timeB = float(frame) / 60.0f + 0.37f * float(i);
+                }
+                auto start = std::chrono::steady_clock::now();
+                updater.Kick(requests);
+                updater.Wait();
+                best = std::min(best, MillisecondsSince(start));
+            }
+            return best;
+        };
+        double scalar = animate(single, false);
+        double simd = animate(single, true);
+        double spread = animate(parallel, true);
+
+        double draw = 1e30;
+        for (int frame = -2; frame < frames; frame++) {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glFinish();
+            auto start = std::chrono::steady_clock::now();
+            model.UploadPalette(parallel.Wait());
+            model.BindPalette();
+            model.DrawInstanced(program, transforms);
+            glFinish();
+            if (frame >= 0) {
+                draw = std::min(draw, MillisecondsSince(start));
+            }
+        }
+        // El muestreo corre mientras el hilo principal arma el fotograma, pero
+        // aqui se suma completo: es el peor caso
+        double frame = spread + draw;
+        std::cout << "[Skinning] " << count << "  " << scalar << "  " << simd << "  " << spread << "  " << draw << "  " << frame << std::endl;
+        if (frame <= budgetMilliseconds) {
+            fits = count;
+            fitsAnimation = spread;
+            fitsDraw = draw;
+        }
+    }
+    std::cout << "[Skinning] " << fits << " animated characters fit in " << budgetMilliseconds << " ms (" << fitsAnimation
+              << " ms sampling on " << threads << " threads + " << fitsDraw << " ms upload and draw)" << std::endl;
+}
@@ -0,0 +1,506 @@
+#pragma once
+
+// Cache de texturas de todo el proceso indexado por el hash del contenido del
+// archivo. Si dos modelos (o dos nombres distintos, como madera1.png y
+// madera3.png) apuntan a la misma imagen, se decodifica y se sube una sola vez
+// y todos comparten el mismo objeto de textura con conteo de referencias.
+//
+// La carga es asincrona: Load() devuelve en el acto una textura con un color
+// provisional, un pool de hilos lee y decodifica las imagenes en paralelo y
+// Update() (una vez por fotograma, en el hilo de OpenGL) sube las que ya estan
+// listas a traves de un anillo de pixel buffer objects, reemplazando el
+// contenido provisional en el mismo objeto de textura.
+//
+// Si junto a la imagen hay un .ktx2 generado con --cook-textures para esos
+// mismos bytes, se sube su cadena de mipmaps BCn ya comprimida en lugar de
+// decodificar el PNG.
+
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "SOIL2/SOIL2.h"
+
+#include "ContentHash.h"
+#include "TextureCompression.h"
+#include "ThreadPool.h"
+
+// Textura de OpenGL compartida; se borra cuando la suelta el ultimo modelo
+class CachedTexture
+{
+public:
+    GLuint id = 0;
+    int width = 1;
+    int height = 1;
+    uint64_t contentHash = 0;
+    size_t vramBytes = 4;
+    bool ready = false;  // false mientras muestra el color provisional
+    std::shared_ptr<CachedTexture> alias;  // si es un duplicado, la textura real
+
+    explicit CachedTexture(GLuint id) : id(id) { }
+    ~CachedTexture();
+
+    CachedTexture(const CachedTexture&) = delete;
+    CachedTexture& operator=(const CachedTexture&) = delete;
+};
+
+typedef std::shared_ptr<CachedTexture> TextureHandle;
+
+// Resultado de un hilo decodificador
+struct DecodedImage
+{
+    uint64_t job = 0;
+    std::string path;
+    uint64_t contentHash = 0;
+    unsigned char* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    double decodeMilliseconds = 0.0;
+    bool duplicate = false;  // otro trabajo ya decodifica estos mismos bytes
+    CompressedTexture compressed;  // niveles BCn si habia un .ktx2 valido
+};
+
+const int TEXTURE_PBO_RING_SIZE = 4;
+
+class TextureCache
+{
+public:
+    static TextureCache& Instance()
+    {
+        static TextureCache cache;
+        return cache;
+    }
+
+    // Con false se decodifica y sube todo en el acto, como antes (para comparar tiempos)
+    void SetAsync(bool enabled) { this->async = enabled; }
+
+    // Devuelve la textura del archivo; mientras se decodifica muestra un color provisional
+    TextureHandle Load(const std::string& path)
+    {
+        this->requests++;
+        if (this->requests == 1) {
+            this->streamStart = std::chrono::steady_clock::now();
+            this->compressedSupported = GLEW_EXT_texture_compression_s3tc != 0;
+        }
+
+        // Mismo nombre de archivo: ni siquiera hace falta volver a leerlo
+        auto byPath = this->texturesByPath.find(path);
+        if (byPath != this->texturesByPath.end()) {
+            TextureHandle shared = byPath->second.lock();
+            if (shared) {
+                this->pathHits++;
+                return shared;
+            }
+        }
+
+        TextureHandle texture = std::make_shared<CachedTexture>(this->createPlaceholder());
+        this->texturesByPath[path] = texture;
+        uint64_t job = ++this->jobCounter;
+        this->pending[job] = texture;
+        this->reported = false;
+
+        this->startDecode(job, path);
+        if (!this->async) {
+            this->Update(1e9);
+        }
+        return texture;
+    }
+
+    // Sube a la GPU las imagenes ya decodificadas sin pasarse del presupuesto
+    // de tiempo del fotograma. Llamar una vez por fotograma desde el hilo de OpenGL.
+    void Update(double budgetMilliseconds = 4.0)
+    {
+        if (this->pending.empty()) {
+            if (!this->reported) {
+                this->PrintReport();
+                this->reported = true;
+            }
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (;;) {
+            DecodedImage image;
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                if (this->decoded.empty()) {
+                    break;
+                }
+                image = this->decoded.front();
+                this->decoded.pop_front();
+            }
+            this->finish(image);
+            if (MillisecondsSinceStart(start) > budgetMilliseconds) {
+                break;
+            }
+        }
+        this->uploadMilliseconds += MillisecondsSinceStart(start);
+
+        if (this->pending.empty()) {
+            this->streamMilliseconds = MillisecondsSinceStart(this->streamStart);
+        }
+    }
+
+    bool Busy() const { return !this->pending.empty(); }
+
+    // Textura blanca de 1x1 para materiales sin mapa
+    TextureHandle White()
+    {
+        if (!this->white) {
+            const unsigned char pixel[4] = { 255, 255, 255, 255 };
+            this->white = std::make_shared<CachedTexture>(this->createSolid(pixel));
+            this->white->ready = true;
+        }
+        return this->white;
+    }
+
+    // Resumen de lo que se ahorro al compartir texturas y de los tiempos de carga.
+    // En modo asincrono se imprime solo cuando termina la ultima subida.
+    void PrintReport() const
+    {
+        // Los duplicados apuntan al original, que ya tiene su tamano final
+        size_t duplicateUploads = 0;
+        size_t savedBytes = 0;
+        for (const auto& entry : this->texturesByPath) {
+            TextureHandle texture = entry.second.lock();
+            if (texture && texture->alias && texture->alias != this->white) {
+                duplicateUploads++;
+                savedBytes += texture->alias->vramBytes;
+            }
+        }
+        std::cout << "[TextureCache] " << this->requests << " texture requests, " << this->pathHits << " already loaded, "
+                  << this->uploads << " uploads (" << this->uploadedBytes / (1024.0 * 1024.0) << " MB), "
+                  << duplicateUploads << " byte-identical files shared (" << savedBytes / (1024.0 * 1024.0)
+                  << " MB of decode, upload and VRAM saved)" << std::endl;
+        if (this->compressedUploads > 0) {
+            std::cout << "[TextureCache] " << this->compressedUploads << " textures uploaded as BCn from .ktx2 ("
+                      << this->compressedBytes / (1024.0 * 1024.0) << " MB instead of " << this->compressedRGBABytes / (1024.0 * 1024.0)
+                      << " MB as RGBA8 with mipmaps)" << std::endl;
+        }
+        std::cout << "[TextureCache] " << (this->async ? "parallel" : "serial") << " load: " << this->streamMilliseconds
+                  << " ms wall clock, decode " << this->decodeMilliseconds << " ms of CPU time"
+                  << (this->async ? " on " + std::to_string(this->workers().Size()) + " threads" : std::string())
+                  << ", GL upload " << this->uploadMilliseconds << " ms on the render thread (serial estimate "
+                  << this->decodeMilliseconds + this->uploadMilliseconds << " ms)" << std::endl;
+    }
+
+    // Llamar antes de destruir el contexto: para los hilos y a partir de ahi las
+    // texturas ya no se borran una por una (el driver las libera con el contexto)
+    void Shutdown()
+    {
+        if (this->pool) {
+            this->pool->Stop();
+        }
+        for (DecodedImage& image : this->decoded) {
+            SOIL_free_image_data(image.pixels);
+        }
+        this->decoded.clear();
+        this->pending.clear();
+        this->contextAlive = false;
+        this->textures.clear();
+        this->white.reset();
+    }
+
+    bool ContextAlive() const { return this->contextAlive; }
+
+    // El original de ese contenido se libero: una nueva carga de los mismos
+    // bytes tiene que decodificarlos otra vez en lugar de esperar un duplicado
+    void Forget(uint64_t contentHash)
+    {
+        this->textures.erase(contentHash);
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->claimedHashes.erase(contentHash);
+    }
+
+    // Tamano en VRAM de una textura RGBA8 con su cadena de mipmaps completa
+    static size_t TextureBytes(int width, int height)
+    {
+        return size_t(width) * size_t(height) * 4 * 4 / 3;
+    }
+
+private:
+    std::unordered_map<uint64_t, std::weak_ptr<CachedTexture>> textures;    // por hash de contenido
+    std::unordered_map<std::string, std::weak_ptr<CachedTexture>> texturesByPath;
+    std::unordered_map<uint64_t, TextureHandle> pending;                    // por trabajo
+    TextureHandle white;
+    bool contextAlive = true;
+    bool async = true;
+    bool compressedSupported = false;
+    bool reported = true;
+
+    // Compartido con los hilos decodificadores
+    std::unique_ptr<ThreadPool> pool;
+    std::mutex mutex;
+    std::deque<DecodedImage> decoded;
+    std::unordered_map<uint64_t, uint64_t> claimedHashes;  // hash -> trabajo que lo decodifica
+    uint64_t jobCounter = 0;
+    double decodeMilliseconds = 0.0;
+
+    // Anillo de PBO: mientras la GPU copia desde uno se llena el siguiente
+    GLuint pixelBuffers[TEXTURE_PBO_RING_SIZE] = { 0 };
+    int nextPixelBuffer = 0;
+
+    size_t requests = 0;
+    size_t uploads = 0;
+    size_t pathHits = 0;
+    size_t uploadedBytes = 0;
+    size_t compressedUploads = 0;
+    size_t compressedBytes = 0;
+    size_t compressedRGBABytes = 0;
+    std::chrono::steady_clock::time_point streamStart;
+    double streamMilliseconds = 0.0;
+    double uploadMilliseconds = 0.0;
+
+    TextureCache() { }
+
+    static double MillisecondsSinceStart(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    ThreadPool& workers() const
+    {
+        TextureCache* self = const_cast<TextureCache*>(this);
+        if (!self->pool) {
+            self->pool.reset(new ThreadPool());
+        }
+        return *self->pool;
+    }
+
+    void startDecode(uint64_t job, const std::string& path)
+    {
+        if (this->async) {
+            this->workers().Submit([this, job, path]() { this->decode(job, path); });
+        }
+        else {
+            this->decode(job, path);
+        }
+    }
+
+    // Hilo decodificador: lee, hashea y decodifica; no toca OpenGL
+    void decode(uint64_t job, const std::string& path)
+    {
+        auto start = std::chrono::steady_clock::now();
+        DecodedImage image;
+        image.job = job;
+        image.path = path;
+
+        std::vector<unsigned char> bytes;
+        if (ReadFileBytes(path, bytes) && !bytes.empty()) {
+            image.contentHash = HashBytes(bytes.data(), bytes.size());
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                auto claimed = this->claimedHashes.find(image.contentHash);
+                if (claimed != this->claimedHashes.end()) {
+                    image.duplicate = true;
+                }
+                else {
+                    this->claimedHashes[image.contentHash] = job;
+                }
+            }
+            if (!image.duplicate && this->compressedSupported) {
+                std::vector<unsigned char> container;
+                if (ReadFileBytes(CompressedPathFor(path), container) && ReadKtx2(container, image.contentHash, image.compressed)) {
+                    image.width = image.compressed.levels[0].width;
+                    image.height = image.compressed.levels[0].height;
+                }
+            }
+            if (!image.duplicate && image.compressed.levels.empty()) {
+                image.pixels = SOIL_load_image_from_memory(bytes.data(), int(bytes.size()), &image.width, &image.height, 0, SOIL_LOAD_RGBA);
+            }
+        }
+        image.decodeMilliseconds = MillisecondsSinceStart(start);
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->decodeMilliseconds += image.decodeMilliseconds;
+        this->decoded.push_back(image);
+    }
+
+    // Hilo de OpenGL: sube la imagen decodificada o enlaza el duplicado
+    void finish(DecodedImage& image)
+    {
+        auto found = this->pending.find(image.job);
+        if (found == this->pending.end()) {
+            SOIL_free_image_data(image.pixels);
+            return;
+        }
+        TextureHandle texture = found->second;
+        this->pending.erase(found);
+
+        if (image.duplicate) {
+            TextureHandle owner = this->ownerOf(image.contentHash);
+            if (owner) {
+                this->aliasTo(texture, owner);
+                return;
+            }
+            // El original ya no existe (se libero o fallo mientras este se
+            // decodificaba): se vuelve a decodificar como textura propia
+            this->pending[image.job] = texture;
+            this->startDecode(image.job, image.path);
+            return;
+        }
+        if (image.pixels == nullptr && image.compressed.levels.empty()) {
+            std::cout << "ERROR::TEXTURE_CACHE:: could not load " << image.path << std::endl;
+            if (image.contentHash != 0) {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->claimedHashes.erase(image.contentHash);
+            }
+            this->aliasTo(texture, this->White());
+            return;
+        }
+
+        if (!image.compressed.levels.empty()) {
+            texture->vramBytes = this->uploadCompressed(texture->id, image.compressed);
+            this->compressedUploads++;
+            this->compressedBytes += texture->vramBytes;
+            this->compressedRGBABytes += TextureBytes(image.width, image.height);
+        }
+        else {
+            this->uploadThroughPixelBuffer(texture->id, image);
+            SOIL_free_image_data(image.pixels);
+            texture->vramBytes = TextureBytes(image.width, image.height);
+        }
+        texture->width = image.width;
+        texture->height = image.height;
+        texture->contentHash = image.contentHash;
+        texture->ready = true;
+        this->textures[image.contentHash] = texture;
+        this->uploads++;
+        this->uploadedBytes += texture->vramBytes;
+    }
+
+    // Sube la cadena de mipmaps BCn tal cual viene del .ktx2
+    size_t uploadCompressed(GLuint textureID, const CompressedTexture& compressed)
+    {
+        GLenum format = compressed.vkFormat == VK_FORMAT_BC3_UNORM_BLOCK ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        for (size_t level = 0; level < compressed.levels.size(); level++) {
+            const TextureLevel& mip = compressed.levels[level];
+            glCompressedTexImage2D(GL_TEXTURE_2D, GLint(level), format, mip.width, mip.height, 0, GLsizei(mip.data.size()), mip.data.data());
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(compressed.levels.size()) - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return CompressedBytes(compressed);
+    }
+
+    // La textura viva que decodifica (o ya decodifico) ese contenido. Si el
+    // trabajo que lo reclamo ya no esta pendiente ni subido, el reclamo se
+    // descarta para que el proximo en llegar lo decodifique.
+    TextureHandle ownerOf(uint64_t contentHash)
+    {
+        auto uploaded = this->textures.find(contentHash);
+        if (uploaded != this->textures.end()) {
+            TextureHandle owner = uploaded->second.lock();
+            if (owner) {
+                return owner;
+            }
+        }
+        std::lock_guard<std::mutex> lock(this->mutex);
+        auto claimed = this->claimedHashes.find(contentHash);
+        if (claimed == this->claimedHashes.end()) {
+            return TextureHandle();
+        }
+        auto pendingOwner = this->pending.find(claimed->second);
+        if (pendingOwner == this->pending.end()) {
+            this->claimedHashes.erase(claimed);
+            return TextureHandle();
+        }
+        return pendingOwner->second;
+    }
+
+    // El duplicado pasa a usar el objeto de textura del original. Los duplicados
+    // que ya apuntaban a esta textura (llegaron antes de que fallara su carga) se
+    // reapuntan tambien, asi nadie se queda con un id borrado; el objeto del
+    // original lo borra su destructor cuando lo suelta la ultima referencia.
+    void aliasTo(const TextureHandle& texture, const TextureHandle& owner)
+    {
+        for (const auto& entry : this->texturesByPath) {
+            TextureHandle dependent = entry.second.lock();
+            if (dependent && dependent->alias == texture) {
+                this->aliasTo(dependent, owner);
+            }
+        }
+        if (!texture->alias) {
+            glDeleteTextures(1, &texture->id);
+        }
+        texture->id = owner->id;
+        texture->width = owner->width;
+        texture->height = owner->height;
+        texture->contentHash = owner->contentHash;
+        texture->vramBytes = 0;
+        texture->ready = true;
+        texture->alias = owner;
+    }
+
+    void uploadThroughPixelBuffer(GLuint textureID, const DecodedImage& image)
+    {
+        if (this->pixelBuffers[0] == 0) {
+            glGenBuffers(TEXTURE_PBO_RING_SIZE, this->pixelBuffers);
+        }
+        int slot = this->nextPixelBuffer;
+        this->nextPixelBuffer = (slot + 1) % TEXTURE_PBO_RING_SIZE;
+
+        // No se espera a la GPU: si aun copia desde este PBO, glBufferData con
+        // nullptr huerfana el almacenamiento viejo y el driver da uno nuevo
+        GLsizeiptr size = GLsizeiptr(image.width) * image.height * 4;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->pixelBuffers[slot]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        void* destination = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (destination != nullptr) {
+            std::memcpy(destination, image.pixels, size_t(size));
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        if (destination != nullptr) {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)0);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (destination == nullptr) {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels);
+        }
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Color provisional (gris medio) hasta que llegue la imagen real
+    GLuint createPlaceholder()
+    {
+        const unsigned char grey[4] = { 128, 128, 128, 255 };
+        return this->createSolid(grey);
+    }
+
+    GLuint createSolid(const unsigned char pixel[4])
+    {
+        GLuint textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return textureID;
+    }
+};
+
+inline CachedTexture::~CachedTexture()
+{
+    // Los duplicados no son duenos del objeto de textura
+    if (!this->alias && TextureCache::Instance().ContextAlive()) {
+        glDeleteTextures(1, &this->id);
+        if (this->contentHash != 0) {
+            TextureCache::Instance().Forget(this->contentHash);
+        }
+    }
+}
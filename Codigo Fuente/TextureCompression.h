@@ -0,0 +1,622 @@
+#pragma once
+
+// Compresion de texturas por bloques fuera de linea. Cada imagen de Models se
+// convierte a un contenedor KTX2 con su cadena de mipmaps ya calculada: BC1
+// (4 bits por texel) si es opaca y BC3 (8 bits por texel) si usa alfa. En
+// ejecucion TextureCache sube esos niveles tal cual con glCompressedTexImage2D
+// en lugar de decodificar el PNG, subirlo en RGBA8 y generar los mipmaps.
+//
+// Todo es codigo de CPU: la calidad (PSNR) y el ahorro de VRAM se pueden
+// comprobar sin GPU con --cook-textures.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "ContentHash.h"
+
+// Formatos de Vulkan que usa KTX2 para identificar el tipo de bloque
+const uint32_t VK_FORMAT_BC1_RGB_UNORM_BLOCK = 131;
+const uint32_t VK_FORMAT_BC3_UNORM_BLOCK = 137;
+
+// Nivel de mipmap en memoria: RGBA8 sin comprimir o bloques BCn
+struct TextureLevel
+{
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> data;
+};
+
+struct CompressedTexture
+{
+    uint32_t vkFormat = 0;
+    uint64_t sourceHash = 0;
+    std::vector<TextureLevel> levels;
+};
+
+inline bool HasAlpha(const unsigned char* rgba, int width, int height)
+{
+    for (size_t i = 0; i < size_t(width) * height; i++) {
+        if (rgba[i * 4 + 3] != 255) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Cadena de mipmaps completa hasta 1x1 con filtro de caja de 2x2
+inline std::vector<TextureLevel> BuildMipChain(const unsigned char* rgba, int width, int height)
+{
+    std::vector<TextureLevel> levels(1);
+    levels[0].width = width;
+    levels[0].height = height;
+    levels[0].data.assign(rgba, rgba + size_t(width) * height * 4);
+
+    while (levels.back().width > 1 || levels.back().height > 1) {
+        const TextureLevel& source = levels.back();
+        TextureLevel level;
+        level.width = std::max(1, source.width / 2);
+        level.height = std::max(1, source.height / 2);
+        level.data.resize(size_t(level.width) * level.height * 4);
+        for (int y = 0; y < level.height; y++) {
+            for (int x = 0; x < level.width; x++) {
+                int x0 = std::min(x * 2, source.width - 1), x1 = std::min(x * 2 + 1, source.width - 1);
+                int y0 = std::min(y * 2, source.height - 1), y1 = std::min(y * 2 + 1, source.height - 1);
+                for (int c = 0; c < 4; c++) {
+                    int sum = source.data[(size_t(y0) * source.width + x0) * 4 + c] + source.data[(size_t(y0) * source.width + x1) * 4 + c]
+                            + source.data[(size_t(y1) * source.width + x0) * 4 + c] + source.data[(size_t(y1) * source.width + x1) * 4 + c];
+                    level.data[(size_t(y) * level.width + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+                }
+            }
+        }
+        levels.push_back(level);
+    }
+    return levels;
+}
+
+inline uint16_t PackRGB565(const float color[3])
+{
+    int r = int(std::lround(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f));
+    int g = int(std::lround(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f));
+    int b = int(std::lround(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f));
+    return uint16_t((r << 11) | (g << 5) | b);
+}
+
+inline void UnpackRGB565(uint16_t packed, int color[3])
+{
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// Paleta de 4 colores de un bloque BC1 (modo de 4 colores si c0 > c1)
+inline void BC1Palette(uint16_t c0, uint16_t c1, bool forceFourColors, int palette[4][3])
+{
+    UnpackRGB565(c0, palette[0]);
+    UnpackRGB565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        if (c0 > c1 || forceFourColors) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+}
+
+// Asigna a cada texel el color de la paleta mas cercano; devuelve el error cuadratico
+inline int BC1ChooseIndices(const unsigned char block[64], const int palette[4][3], uint32_t& indices)
+{
+    int error = 0;
+    indices = 0;
+    for (int i = 0; i < 16; i++) {
+        int best = 0, bestDistance = 1 << 30;
+        for (int p = 0; p < 4; p++) {
+            int dr = block[i * 4] - palette[p][0], dg = block[i * 4 + 1] - palette[p][1], db = block[i * 4 + 2] - palette[p][2];
+            int distance = dr * dr + dg * dg + db * db;
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                best = p;
+            }
+        }
+        indices |= uint32_t(best) << (2 * i);
+        error += bestDistance;
+    }
+    return error;
+}
+
+// Codifica el color de un bloque de 4x4 (RGBA8) en 8 bytes BC1. Los extremos
+// salen del eje principal de los colores del bloque y luego se reajustan por
+// minimos cuadrados con los indices elegidos.
+inline void EncodeBC1Block(const unsigned char block[64], unsigned char out[8])
+{
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            mean[c] += block[i * 4 + c] / 16.0f;
+        }
+    }
+    float covariance[6] = { 0.0f };
+    for (int i = 0; i < 16; i++) {
+        float d[3] = { block[i * 4] - mean[0], block[i * 4 + 1] - mean[1], block[i * 4 + 2] - mean[2] };
+        covariance[0] += d[0] * d[0]; covariance[1] += d[0] * d[1]; covariance[2] += d[0] * d[2];
+        covariance[3] += d[1] * d[1]; covariance[4] += d[1] * d[2]; covariance[5] += d[2] * d[2];
+    }
+    // Iteracion de potencia para el eje principal
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[3] = {
+            covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+            covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+            covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]
+        };
+        float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (length < 1e-6f) {
+            break;
+        }
+        for (int c = 0; c < 3; c++) {
+            axis[c] = next[c] / length;
+        }
+    }
+    float minT = 1e30f, maxT = -1e30f;
+    for (int i = 0; i < 16; i++) {
+        float t = (block[i * 4] - mean[0]) * axis[0] + (block[i * 4 + 1] - mean[1]) * axis[1] + (block[i * 4 + 2] - mean[2]) * axis[2];
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+    float high[3], low[3];
+    for (int c = 0; c < 3; c++) {
+        high[c] = mean[c] + axis[c] * maxT;
+        low[c] = mean[c] + axis[c] * minT;
+    }
+
+    uint16_t bestC0 = 0, bestC1 = 0;
+    uint32_t bestIndices = 0;
+    int bestError = 1 << 30;
+    for (int pass = 0; pass < 2; pass++) {
+        uint16_t c0 = PackRGB565(high), c1 = PackRGB565(low);
+        if (c0 < c1) {
+            std::swap(c0, c1);
+        }
+        int palette[4][3];
+        BC1Palette(c0, c1, true, palette);
+        uint32_t indices;
+        int error = BC1ChooseIndices(block, palette, indices);
+        if (c0 == c1) {
+            indices = 0;  // con extremos iguales el modo de 3 colores usa solo el 0
+        }
+        if (error < bestError) {
+            bestError = error;
+            bestC0 = c0;
+            bestC1 = c1;
+            bestIndices = indices;
+        }
+        if (c0 == c1) {
+            break;
+        }
+
+        // Reajuste por minimos cuadrados: color = a * c0 + b * c1
+        static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        float aa = 0.0f, bb = 0.0f, ab = 0.0f, ax[3] = { 0.0f }, bx[3] = { 0.0f };
+        for (int i = 0; i < 16; i++) {
+            float a = weights[(indices >> (2 * i)) & 3], b = 1.0f - a;
+            aa += a * a; bb += b * b; ab += a * b;
+            for (int c = 0; c < 3; c++) {
+                ax[c] += a * block[i * 4 + c];
+                bx[c] += b * block[i * 4 + c];
+            }
+        }
+        float determinant = aa * bb - ab * ab;
+        if (std::fabs(determinant) < 1e-6f) {
+            break;
+        }
+        for (int c = 0; c < 3; c++) {
+            high[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+            low[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+        }
+    }
+
+    out[0] = (unsigned char)(bestC0 & 0xff);
+    out[1] = (unsigned char)(bestC0 >> 8);
+    out[2] = (unsigned char)(bestC1 & 0xff);
+    out[3] = (unsigned char)(bestC1 >> 8);
+    for (int i = 0; i < 4; i++) {
+        out[4 + i] = (unsigned char)((bestIndices >> (8 * i)) & 0xff);
+    }
+}
+
+// Bloque de alfa de BC3: 8 niveles interpolados entre el minimo y el maximo
+inline void EncodeBC3AlphaBlock(const unsigned char block[64], unsigned char out[8])
+{
+    int high = 0, low = 255;
+    for (int i = 0; i < 16; i++) {
+        high = std::max(high, int(block[i * 4 + 3]));
+        low = std::min(low, int(block[i * 4 + 3]));
+    }
+    out[0] = (unsigned char)high;
+    out[1] = (unsigned char)low;
+    uint64_t bits = 0;
+    if (high > low) {
+        int palette[8] = { high, low };
+        for (int i = 1; i < 7; i++) {
+            palette[i + 1] = ((7 - i) * high + i * low) / 7;
+        }
+        for (int i = 0; i < 16; i++) {
+            int alpha = block[i * 4 + 3], best = 0, bestDistance = 1 << 30;
+            for (int p = 0; p < 8; p++) {
+                int distance = std::abs(alpha - palette[p]);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            bits |= uint64_t(best) << (3 * i);
+        }
+    }
+    for (int i = 0; i < 6; i++) {
+        out[2 + i] = (unsigned char)((bits >> (8 * i)) & 0xff);
+    }
+}
+
+inline void DecodeBC1Block(const unsigned char in[8], bool forceFourColors, unsigned char block[64])
+{
+    uint16_t c0 = uint16_t(in[0] | (in[1] << 8)), c1 = uint16_t(in[2] | (in[3] << 8));
+    uint32_t indices = uint32_t(in[4]) | (uint32_t(in[5]) << 8) | (uint32_t(in[6]) << 16) | (uint32_t(in[7]) << 24);
+    int palette[4][3];
+    BC1Palette(c0, c1, forceFourColors, palette);
+    for (int i = 0; i < 16; i++) {
+        int p = (indices >> (2 * i)) & 3;
+        for (int c = 0; c < 3; c++) {
+            block[i * 4 + c] = (unsigned char)palette[p][c];
+        }
+        block[i * 4 + 3] = (!forceFourColors && c0 <= c1 && p == 3) ? 0 : 255;
+    }
+}
+
+inline void DecodeBC3AlphaBlock(const unsigned char in[8], unsigned char block[64])
+{
+    int palette[8] = { in[0], in[1] };
+    if (in[0] > in[1]) {
+        for (int i = 1; i < 7; i++) {
+            palette[i + 1] = ((7 - i) * in[0] + i * in[1]) / 7;
+        }
+    }
+    else {
+        for (int i = 1; i < 5; i++) {
+            palette[i + 1] = ((5 - i) * in[0] + i * in[1]) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+    uint64_t bits = 0;
+    for (int i = 0; i < 6; i++) {
+        bits |= uint64_t(in[2 + i]) << (8 * i);
+    }
+    for (int i = 0; i < 16; i++) {
+        block[i * 4 + 3] = (unsigned char)palette[(bits >> (3 * i)) & 7];
+    }
+}
+
+inline int BlockBytes(uint32_t vkFormat)
+{
+    return vkFormat == VK_FORMAT_BC1_RGB_UNORM_BLOCK ? 8 : 16;
+}
+
+// Copia el bloque de 4x4 en (bx, by) repitiendo el borde en imagenes chicas
+inline void FetchBlock(const TextureLevel& level, int bx, int by, unsigned char block[64])
+{
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            int sx = std::min(bx * 4 + x, level.width - 1), sy = std::min(by * 4 + y, level.height - 1);
+            std::memcpy(block + (y * 4 + x) * 4, &level.data[(size_t(sy) * level.width + sx) * 4], 4);
+        }
+    }
+}
+
+inline TextureLevel CompressLevel(const TextureLevel& level, uint32_t vkFormat)
+{
+    TextureLevel out;
+    out.width = level.width;
+    out.height = level.height;
+    int blocksX = (level.width + 3) / 4, blocksY = (level.height + 3) / 4;
+    int blockBytes = BlockBytes(vkFormat);
+    out.data.resize(size_t(blocksX) * blocksY * blockBytes);
+    unsigned char block[64];
+    for (int by = 0; by < blocksY; by++) {
+        for (int bx = 0; bx < blocksX; bx++) {
+            FetchBlock(level, bx, by, block);
+            unsigned char* destination = &out.data[(size_t(by) * blocksX + bx) * blockBytes];
+            if (vkFormat == VK_FORMAT_BC3_UNORM_BLOCK) {
+                EncodeBC3AlphaBlock(block, destination);
+                EncodeBC1Block(block, destination + 8);
+            }
+            else {
+                EncodeBC1Block(block, destination);
+            }
+        }
+    }
+    return out;
+}
+
+inline TextureLevel DecompressLevel(const TextureLevel& level, uint32_t vkFormat)
+{
+    TextureLevel out;
+    out.width = level.width;
+    out.height = level.height;
+    out.data.resize(size_t(level.width) * level.height * 4);
+    int blocksX = (level.width + 3) / 4, blocksY = (level.height + 3) / 4;
+    int blockBytes = BlockBytes(vkFormat);
+    unsigned char block[64];
+    for (int by = 0; by < blocksY; by++) {
+        for (int bx = 0; bx < blocksX; bx++) {
+            const unsigned char* source = &level.data[(size_t(by) * blocksX + bx) * blockBytes];
+            if (vkFormat == VK_FORMAT_BC3_UNORM_BLOCK) {
+                DecodeBC1Block(source + 8, true, block);
+                DecodeBC3AlphaBlock(source, block);
+            }
+            else {
+                DecodeBC1Block(source, false, block);
+            }
+            for (int y = 0; y < 4 && by * 4 + y < level.height; y++) {
+                for (int x = 0; x < 4 && bx * 4 + x < level.width; x++) {
+                    std::memcpy(&out.data[(size_t(by * 4 + y) * level.width + bx * 4 + x) * 4], block + (y * 4 + x) * 4, 4);
+                }
+            }
+        }
+    }
+    return out;
+}
+
+// PSNR en dB sobre RGB (y alfa si se pide) entre dos niveles del mismo tamano
+inline double ComputePSNR(const TextureLevel& reference, const TextureLevel& test, bool includeAlpha)
+{
+    double squaredError = 0.0;
+    size_t samples = 0;
+    for (size_t i = 0; i < size_t(reference.width) * reference.height; i++) {
+        for (int c = 0; c < (includeAlpha ? 4 : 3); c++) {
+            double d = double(reference.data[i * 4 + c]) - double(test.data[i * 4 + c]);
+            squaredError += d * d;
+            samples++;
+        }
+    }
+    if (squaredError == 0.0) {
+        return 99.0;
+    }
+    double mse = squaredError / double(samples);
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+// Comprime una imagen RGBA8 con toda su cadena de mipmaps; BC1 si es opaca, BC3 si no
+inline CompressedTexture CompressImage(const unsigned char* rgba, int width, int height, uint64_t sourceHash, double* psnr = nullptr)
+{
+    CompressedTexture texture;
+    texture.vkFormat = HasAlpha(rgba, width, height) ? VK_FORMAT_BC3_UNORM_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+    texture.sourceHash = sourceHash;
+    std::vector<TextureLevel> mips = BuildMipChain(rgba, width, height);
+    for (const TextureLevel& mip : mips) {
+        texture.levels.push_back(CompressLevel(mip, texture.vkFormat));
+    }
+    if (psnr != nullptr) {
+        *psnr = ComputePSNR(mips[0], DecompressLevel(texture.levels[0], texture.vkFormat), texture.vkFormat == VK_FORMAT_BC3_UNORM_BLOCK);
+    }
+    return texture;
+}
+
+// ---------------------------------------------------------------------------
+// Contenedor KTX2 (sin supercompresion; un solo layer y una sola cara)
+
+const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+const char KTX2_SOURCE_HASH_KEY[] = "ProyectoFinal.sourceHash";
+
+inline void PutU32(std::vector<unsigned char>& out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        out.push_back((unsigned char)((value >> (8 * i)) & 0xff));
+    }
+}
+
+inline void PutU64(std::vector<unsigned char>& out, uint64_t value)
+{
+    PutU32(out, uint32_t(value & 0xffffffffu));
+    PutU32(out, uint32_t(value >> 32));
+}
+
+inline uint32_t GetU32(const unsigned char* in)
+{
+    return uint32_t(in[0]) | (uint32_t(in[1]) << 8) | (uint32_t(in[2]) << 16) | (uint32_t(in[3]) << 24);
+}
+
+inline uint64_t GetU64(const unsigned char* in)
+{
+    return uint64_t(GetU32(in)) | (uint64_t(GetU32(in + 4)) << 32);
+}
+
+// Data Format Descriptor basico para BC1 (una muestra) o BC3 (alfa + color)
+inline std::vector<unsigned char> BuildKtx2DataFormatDescriptor(uint32_t vkFormat)
+{
+    bool bc3 = vkFormat == VK_FORMAT_BC3_UNORM_BLOCK;
+    uint32_t sampleCount = bc3 ? 2 : 1;
+    uint32_t blockSize = 24 + 16 * sampleCount;
+    std::vector<unsigned char> dfd;
+    PutU32(dfd, 4 + blockSize);               // dfdTotalSize
+    PutU32(dfd, 0);                           // vendorId = Khronos, descriptorType = basico
+    PutU32(dfd, 2 | (blockSize << 16));       // versionNumber, descriptorBlockSize
+    // colorModel (BC1A = 128, BC3 = 130), primarias BT.709, transferencia lineal, alfa recta
+    PutU32(dfd, (bc3 ? 130u : 128u) | (1u << 8) | (1u << 16));
+    PutU32(dfd, 3 | (3 << 8));                // bloques de 4x4 (dimension - 1)
+    PutU32(dfd, uint32_t(BlockBytes(vkFormat)));
+    PutU32(dfd, 0);
+    if (bc3) {
+        // Alfa en los bits 0..63, color en 64..127
+        PutU32(dfd, 0 | (63u << 16) | (15u << 24));
+        PutU32(dfd, 0);
+        PutU32(dfd, 0);
+        PutU32(dfd, 0xffffffffu);
+        PutU32(dfd, 64 | (63u << 16) | (0u << 24));
+    }
+    else {
+        PutU32(dfd, 0 | (63u << 16) | (0u << 24));
+    }
+    PutU32(dfd, 0);
+    PutU32(dfd, 0);
+    PutU32(dfd, 0xffffffffu);
+    return dfd;
+}
+
+inline bool WriteKtx2(const std::string& path, const CompressedTexture& texture)
+{
+    uint32_t levelCount = uint32_t(texture.levels.size());
+    std::vector<unsigned char> dfd = BuildKtx2DataFormatDescriptor(texture.vkFormat);
+
+    // Par clave/valor con el hash del PNG para invalidar el archivo si cambia
+    std::string value = HashToHex(texture.sourceHash);
+    std::vector<unsigned char> kvd;
+    uint32_t keyValueLength = uint32_t(sizeof(KTX2_SOURCE_HASH_KEY) + value.size() + 1);
+    PutU32(kvd, keyValueLength);
+    kvd.insert(kvd.end(), KTX2_SOURCE_HASH_KEY, KTX2_SOURCE_HASH_KEY + sizeof(KTX2_SOURCE_HASH_KEY));
+    kvd.insert(kvd.end(), value.begin(), value.end());
+    kvd.push_back(0);
+    while (kvd.size() % 4 != 0) {
+        kvd.push_back(0);
+    }
+
+    uint32_t headerSize = 12 + 4 * 9 + 4 * 4 + 8 * 2;
+    uint32_t dfdOffset = headerSize + levelCount * 24;
+    uint32_t kvdOffset = dfdOffset + uint32_t(dfd.size());
+    uint64_t dataOffset = kvdOffset + kvd.size();
+
+    // Los niveles se guardan del mas chico al mas grande, alineados al tamano de bloque
+    uint64_t alignment = uint64_t(BlockBytes(texture.vkFormat));
+    std::vector<uint64_t> levelOffsets(levelCount);
+    for (int level = int(levelCount) - 1; level >= 0; level--) {
+        dataOffset = (dataOffset + alignment - 1) / alignment * alignment;
+        levelOffsets[level] = dataOffset;
+        dataOffset += texture.levels[level].data.size();
+    }
+
+    std::vector<unsigned char> file(KTX2_IDENTIFIER, KTX2_IDENTIFIER + 12);
+    PutU32(file, texture.vkFormat);
+    PutU32(file, 1);  // typeSize
+    PutU32(file, uint32_t(texture.levels[0].width));
+    PutU32(file, uint32_t(texture.levels[0].height));
+    PutU32(file, 0);  // pixelDepth
+    PutU32(file, 0);  // layerCount
+    PutU32(file, 1);  // faceCount
+    PutU32(file, levelCount);
+    PutU32(file, 0);  // supercompressionScheme
+    PutU32(file, dfdOffset);
+    PutU32(file, uint32_t(dfd.size()));
+    PutU32(file, kvdOffset);
+    PutU32(file, uint32_t(kvd.size()));
+    PutU64(file, 0);  // sgdByteOffset
+    PutU64(file, 0);  // sgdByteLength
+    for (uint32_t level = 0; level < levelCount; level++) {
+        PutU64(file, levelOffsets[level]);
+        PutU64(file, texture.levels[level].data.size());
+        PutU64(file, texture.levels[level].data.size());
+    }
+    file.insert(file.end(), dfd.begin(), dfd.end());
+    file.insert(file.end(), kvd.begin(), kvd.end());
+    for (int level = int(levelCount) - 1; level >= 0; level--) {
+        file.resize(size_t(levelOffsets[level]), 0);
+        file.insert(file.end(), texture.levels[level].data.begin(), texture.levels[level].data.end());
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(file.data()), std::streamsize(file.size()));
+    return bool(out);
+}
+
+// Lee un KTX2 escrito por WriteKtx2; false si no es BC1/BC3 o si no viene del mismo PNG
+inline bool ReadKtx2(const std::vector<unsigned char>& file, uint64_t expectedSourceHash, CompressedTexture& texture)
+{
+    const uint32_t headerSize = 12 + 4 * 9 + 4 * 4 + 8 * 2;
+    if (file.size() < headerSize || std::memcmp(file.data(), KTX2_IDENTIFIER, 12) != 0) {
+        return false;
+    }
+    const unsigned char* header = file.data() + 12;
+    texture.vkFormat = GetU32(header);
+    uint32_t width = GetU32(header + 8), height = GetU32(header + 12);
+    uint32_t levelCount = GetU32(header + 28), supercompression = GetU32(header + 32);
+    uint32_t kvdOffset = GetU32(header + 44), kvdLength = GetU32(header + 48);
+    if ((texture.vkFormat != VK_FORMAT_BC1_RGB_UNORM_BLOCK && texture.vkFormat != VK_FORMAT_BC3_UNORM_BLOCK)
+        || supercompression != 0 || width == 0 || height == 0 || width > 16384 || height > 16384 || levelCount == 0 || levelCount > 32
+        || file.size() < headerSize + uint64_t(levelCount) * 24 || uint64_t(kvdOffset) + kvdLength > file.size()) {
+        return false;
+    }
+
+    // Se lee desde un hilo decodificador: un archivo corrupto tiene que dar
+    // false, nunca una excepcion ni una lectura fuera del bloque key/value
+    texture.sourceHash = 0;
+    bool hashFound = false;
+    uint64_t kvdEnd = uint64_t(kvdOffset) + kvdLength;
+    for (uint64_t offset = kvdOffset; offset + 4 <= kvdEnd;) {
+        uint64_t length = GetU32(file.data() + offset);
+        if (offset + 4 + length > kvdEnd) {
+            break;
+        }
+        const char* pair = reinterpret_cast<const char*>(file.data() + offset + 4);
+        const char* keyEnd = static_cast<const char*>(std::memchr(pair, 0, size_t(length)));
+        if (keyEnd != nullptr && std::string(pair, keyEnd) == KTX2_SOURCE_HASH_KEY) {
+            std::string value(keyEnd + 1, pair + length);
+            value = value.substr(0, value.find('\0'));
+            char* parsedEnd = nullptr;
+            unsigned long long parsed = std::strtoull(value.c_str(), &parsedEnd, 16);
+            if (!value.empty() && parsedEnd == value.c_str() + value.size()) {
+                texture.sourceHash = parsed;
+                hashFound = true;
+            }
+        }
+        offset += (4 + length + 3) & ~uint64_t(3);
+    }
+    if (!hashFound || texture.sourceHash != expectedSourceHash) {
+        return false;
+    }
+
+    texture.levels.assign(levelCount, TextureLevel());
+    for (uint32_t level = 0; level < levelCount; level++) {
+        const unsigned char* entry = file.data() + headerSize + level * 24;
+        uint64_t offset = GetU64(entry), length = GetU64(entry + 8);
+        if (offset > file.size() || length > file.size() - offset) {
+            return false;
+        }
+        texture.levels[level].width = std::max(1u, width >> level);
+        texture.levels[level].height = std::max(1u, height >> level);
+        // glCompressedTexImage2D leeria de mas si el nivel no trae todos sus bloques
+        uint64_t blocksX = (texture.levels[level].width + 3) / 4, blocksY = (texture.levels[level].height + 3) / 4;
+        if (length != blocksX * blocksY * uint64_t(BlockBytes(texture.vkFormat))) {
+            return false;
+        }
+        texture.levels[level].data.assign(file.begin() + size_t(offset), file.begin() + size_t(offset + length));
+    }
+    return true;
+}
+
+// Bytes en VRAM de la cadena comprimida
+inline size_t CompressedBytes(const CompressedTexture& texture)
+{
+    size_t total = 0;
+    for (const TextureLevel& level : texture.levels) {
+        total += level.data.size();
+    }
+    return total;
+}
+
+// Ruta del KTX2 que acompana a una imagen: Models/madera.png -> Models/madera.ktx2
+inline std::string CompressedPathFor(const std::string& imagePath)
+{
+    size_t dot = imagePath.find_last_of('.');
+    size_t slash = imagePath.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return imagePath + ".ktx2";
+    }
+    return imagePath.substr(0, dot) + ".ktx2";
+}
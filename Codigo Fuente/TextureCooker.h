@@ -0,0 +1,83 @@
+#pragma once
+
+// Paso de conversion de assets (--cook-textures): comprime cada PNG/JPG de un
+// directorio a KTX2 con TextureCompression.h y reporta la calidad (PSNR) y el
+// ahorro de VRAM. No necesita contexto de OpenGL.
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "SOIL2/SOIL2.h"
+
+#include "ContentHash.h"
+#include "TextureCompression.h"
+#include "ThreadPool.h"
+
+struct CookedTextureReport
+{
+    std::string path;
+    int width = 0;
+    int height = 0;
+    uint32_t vkFormat = 0;
+    double psnr = 0.0;
+    size_t uncompressedBytes = 0;  // RGBA8 con mipmaps
+    size_t compressedBytes = 0;
+    bool ok = false;
+};
+
+inline int CookTextures(const std::string& directory)
+{
+    std::vector<std::string> images;
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+        if (entry.is_regular_file() && (extension == ".png" || extension == ".jpg" || extension == ".jpeg")) {
+            images.push_back(entry.path().generic_string());
+        }
+    }
+    std::sort(images.begin(), images.end());
+
+    std::vector<CookedTextureReport> reports(images.size());
+    ParallelFor(images.size(), 0, [&images, &reports](size_t begin, size_t end, unsigned int) {
+        for (size_t i = begin; i < end; i++) {
+            CookedTextureReport& report = reports[i];
+            report.path = images[i];
+            std::vector<unsigned char> bytes;
+            if (!ReadFileBytes(images[i], bytes) || bytes.empty()) {
+                continue;
+            }
+            int channels;
+            unsigned char* image = SOIL_load_image_from_memory(bytes.data(), int(bytes.size()), &report.width, &report.height, &channels, SOIL_LOAD_RGBA);
+            if (image == nullptr) {
+                continue;
+            }
+            CompressedTexture texture = CompressImage(image, report.width, report.height, HashBytes(bytes.data(), bytes.size()), &report.psnr);
+            SOIL_free_image_data(image);
+            report.vkFormat = texture.vkFormat;
+            report.uncompressedBytes = size_t(report.width) * report.height * 4 * 4 / 3;
+            report.compressedBytes = CompressedBytes(texture);
+            report.ok = WriteKtx2(CompressedPathFor(images[i]), texture);
+        }
+    });
+
+    size_t totalUncompressed = 0, totalCompressed = 0, failures = 0;
+    for (const CookedTextureReport& report : reports) {
+        if (!report.ok) {
+            std::cout << "ERROR::TEXTURE_COOKER:: could not convert " << report.path << std::endl;
+            failures++;
+            continue;
+        }
+        std::cout << report.path << ": " << report.width << "x" << report.height << " "
+                  << (report.vkFormat == VK_FORMAT_BC3_UNORM_BLOCK ? "BC3" : "BC1") << ", PSNR " << report.psnr << " dB, "
+                  << report.uncompressedBytes / 1024 << " KB -> " << report.compressedBytes / 1024 << " KB" << std::endl;
+        totalUncompressed += report.uncompressedBytes;
+        totalCompressed += report.compressedBytes;
+    }
+    std::cout << "[TextureCooker] " << reports.size() - failures << " textures, VRAM " << totalUncompressed / (1024.0 * 1024.0)
+              << " MB -> " << totalCompressed / (1024.0 * 1024.0) << " MB" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
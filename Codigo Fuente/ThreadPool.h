@@ -0,0 +1,181 @@
+#pragma once
+
+// Pool de hilos sencillo para trabajo de CPU en segundo plano (decodificar
+// imagenes, horneado, etc.). Los trabajos no tocan OpenGL: el contexto solo
+// existe en el hilo principal.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    // Sin argumento usa todos los nucleos menos el del hilo principal
+    explicit ThreadPool(unsigned int threadCount = 0)
+    {
+        if (threadCount == 0) {
+            unsigned int cores = std::thread::hardware_concurrency();
+            threadCount = cores > 1 ? cores - 1 : 1;
+        }
+        for (unsigned int i = 0; i < threadCount; i++) {
+            this->workers.emplace_back([this]() { this->workerLoop(); });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        this->Stop();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void Submit(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->jobs.push(std::move(job));
+        }
+        this->wake.notify_one();
+    }
+
+    // Espera a que terminen todos los trabajos encolados
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->idle.wait(lock, [this]() { return this->jobs.empty() && this->running == 0; });
+    }
+
+    // Descarta lo pendiente y une los hilos
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if (this->stopping) {
+                return;
+            }
+            this->stopping = true;
+            std::queue<std::function<void()>> empty;
+            this->jobs.swap(empty);
+        }
+        this->wake.notify_all();
+        for (std::thread& worker : this->workers) {
+            worker.join();
+        }
+        this->workers.clear();
+    }
+
+    unsigned int Size() const { return unsigned(this->workers.size()); }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    unsigned int running = 0;
+    bool stopping = false;
+
+    void workerLoop()
+    {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->wake.wait(lock, [this]() { return this->stopping || !this->jobs.empty(); });
+                if (this->stopping) {
+                    return;
+                }
+                job = std::move(this->jobs.front());
+                this->jobs.pop();
+                this->running++;
+            }
+            job();
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->running--;
+            }
+            this->idle.notify_all();
+        }
+    }
+};
+
+// Pool compartido por todos los ParallelFor. Se crea una sola vez: los
+// llamados por fotograma (clusters de luces, oclusion) no pueden pagar la
+// creacion de hilos cada vez.
+inline ThreadPool& ParallelPool()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+// Reparte [0, count) en bloques entre el hilo actual y los del pool compartido;
+// los bloques se toman dinamicamente para que ningun hilo se quede sin trabajo.
+// fn(begin, end, worker) recibe ademas el indice del hilo para acumular por hilo.
+//
+// El hilo que llama tambien trabaja y solo espera a los ayudantes que ya
+// empezaron: los que el pool saca despues de que se repartio todo salen sin
+// tocar fn. Asi un ParallelFor dentro de otro no se bloquea aunque todos los
+// hilos del pool esten ocupados.
+inline void ParallelFor(size_t count, unsigned int threadCount, const std::function<void(size_t, size_t, unsigned int)>& fn)
+{
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threadCount = unsigned(std::min<size_t>(threadCount, std::max<size_t>(count, 1)));
+    if (threadCount <= 1) {
+        fn(0, count, 0);
+        return;
+    }
+
+    struct Shared
+    {
+        std::atomic<size_t> next{ 0 };
+        std::mutex mutex;
+        std::condition_variable finished;
+        unsigned int active = 0;  // ayudantes dentro de fn
+        bool closed = false;      // ya no quedan bloques; los que lleguen tarde salen
+    };
+    std::shared_ptr<Shared> shared = std::make_shared<Shared>();
+    const std::function<void(size_t, size_t, unsigned int)>* body = &fn;
+    size_t grain = std::max<size_t>(1, count / (size_t(threadCount) * 8));
+    auto work = [body, count, grain](Shared& state, unsigned int worker) {
+        for (;;) {
+            size_t begin = state.next.fetch_add(grain);
+            if (begin >= count) {
+                return;
+            }
+            (*body)(begin, std::min(count, begin + grain), worker);
+        }
+    };
+
+    for (unsigned int t = 1; t < threadCount; t++) {
+        ParallelPool().Submit([shared, work, t]() {
+            {
+                std::lock_guard<std::mutex> lock(shared->mutex);
+                if (shared->closed) {
+                    return;
+                }
+                shared->active++;
+            }
+            work(*shared, t);
+            {
+                std::lock_guard<std::mutex> lock(shared->mutex);
+                shared->active--;
+            }
+            shared->finished.notify_all();
+        });
+    }
+    work(*shared, 0);
+
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    shared->closed = true;
+    shared->finished.wait(lock, [&shared]() { return shared->active == 0; });
+}
@@ -0,0 +1,328 @@
+#pragma once
+
+// BVH sobre triangulos individuales para trazar rayos en la CPU (horneado de
+// luz). Se construye con SAH por cubetas: en cada nodo se prueban
+// TRIANGLE_BVH_BINS cortes por eje sobre los centroides y se elige el de
+// menor costo estimado. Los triangulos quedan reordenados para que cada hoja
+// sea un rango contiguo.
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+const int TRIANGLE_BVH_BINS = 12;
+const uint32_t TRIANGLE_BVH_LEAF_SIZE = 4;
+const int TRIANGLE_BVH_STACK = 64;
+
+struct TriangleBVHNode
+{
+    glm::vec3 boundsMin;
+    uint32_t leftOrFirst;  // hoja: primer triangulo; interno: hijo izquierdo (el derecho es el siguiente)
+    glm::vec3 boundsMax;
+    uint32_t count;        // triangulos de la hoja; 0 en nodos internos
+};
+
+struct RayHit
+{
+    float t = FLT_MAX;
+    uint32_t triangle = UINT32_MAX;  // indice original del triangulo
+    float u = 0.0f, v = 0.0f;        // baricentricas de los vertices 1 y 2
+    bool backFace = false;
+};
+
+class TriangleBVH
+{
+public:
+    // "indices" de a tres; los triangulos se identifican por su posicion ahi
+    void Build(const glm::vec3* positions, const uint32_t* indices, size_t triangleCount)
+    {
+        this->triangles.resize(triangleCount);
+        this->order.resize(triangleCount);
+        std::vector<glm::vec3> centroids(triangleCount);
+        std::vector<glm::vec3> boxMin(triangleCount), boxMax(triangleCount);
+        for (size_t i = 0; i < triangleCount; i++) {
+            glm::vec3 a = positions[indices[i * 3]];
+            glm::vec3 b = positions[indices[i * 3 + 1]];
+            glm::vec3 c = positions[indices[i * 3 + 2]];
+            this->triangles[i] = { a, b - a, c - a };
+            boxMin[i] = glm::min(a, glm::min(b, c));
+            boxMax[i] = glm::max(a, glm::max(b, c));
+            centroids[i] = (boxMin[i] + boxMax[i]) * 0.5f;
+            this->order[i] = uint32_t(i);
+        }
+
+        this->nodes.clear();
+        this->nodes.reserve(triangleCount * 2 + 1);
+        this->nodes.push_back(TriangleBVHNode());
+        this->nodes[0].leftOrFirst = 0;
+        this->nodes[0].count = uint32_t(triangleCount);
+        this->updateBounds(0, boxMin, boxMax);
+        this->subdivide(0, centroids, boxMin, boxMax);
+
+        // Los triangulos se guardan en el orden de las hojas
+        std::vector<Triangle> sorted(triangleCount);
+        for (size_t i = 0; i < triangleCount; i++) {
+            sorted[i] = this->triangles[this->order[i]];
+        }
+        this->triangles.swap(sorted);
+    }
+
+    // Impacto mas cercano en (tMin, hit.t); devuelve true si encontro alguno
+    bool Intersect(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit, float tMin = 0.0f) const
+    {
+        if (this->nodes.empty()) {
+            return false;
+        }
+        glm::vec3 inverse = safeInverse(direction);
+        uint32_t stack[TRIANGLE_BVH_STACK];
+        int top = 0;
+        stack[top++] = 0;
+        bool found = false;
+        while (top > 0) {
+            const TriangleBVHNode& node = this->nodes[stack[--top]];
+            if (slab(node, origin, inverse, tMin, hit.t) == FLT_MAX) {
+                continue;
+            }
+            if (node.count > 0) {
+                for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++) {
+                    if (intersectTriangle(this->triangles[i], origin, direction, tMin, hit)) {
+                        hit.triangle = this->order[i];
+                        found = true;
+                    }
+                }
+                continue;
+            }
+            // Primero el hijo mas cercano para recortar hit.t antes
+            uint32_t left = node.leftOrFirst, right = left + 1;
+            float leftDistance = slab(this->nodes[left], origin, inverse, tMin, hit.t);
+            float rightDistance = slab(this->nodes[right], origin, inverse, tMin, hit.t);
+            if (leftDistance > rightDistance) {
+                std::swap(left, right);
+                std::swap(leftDistance, rightDistance);
+            }
+            if (rightDistance != FLT_MAX && top < TRIANGLE_BVH_STACK) {
+                stack[top++] = right;
+            }
+            if (leftDistance != FLT_MAX && top < TRIANGLE_BVH_STACK) {
+                stack[top++] = left;
+            }
+        }
+        return found;
+    }
+
+    // Solo si hay algo entre tMin y tMax (rayos de sombra): corta en el primer impacto
+    bool Occluded(const glm::vec3& origin, const glm::vec3& direction, float tMax, float tMin = 0.0f) const
+    {
+        if (this->nodes.empty()) {
+            return false;
+        }
+        glm::vec3 inverse = safeInverse(direction);
+        uint32_t stack[TRIANGLE_BVH_STACK];
+        int top = 0;
+        stack[top++] = 0;
+        RayHit hit;
+        while (top > 0) {
+            const TriangleBVHNode& node = this->nodes[stack[--top]];
+            hit.t = tMax;
+            if (slab(node, origin, inverse, tMin, tMax) == FLT_MAX) {
+                continue;
+            }
+            if (node.count > 0) {
+                for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++) {
+                    if (intersectTriangle(this->triangles[i], origin, direction, tMin, hit)) {
+                        return true;
+                    }
+                }
+                continue;
+            }
+            if (top + 2 <= TRIANGLE_BVH_STACK) {
+                stack[top++] = node.leftOrFirst + 1;
+                stack[top++] = node.leftOrFirst;
+            }
+        }
+        return false;
+    }
+
+    size_t NodeCount() const { return this->nodes.size(); }
+    size_t TriangleCount() const { return this->triangles.size(); }
+    const std::vector<TriangleBVHNode>& Nodes() const { return this->nodes; }
+    // Triangulo original del elemento i en el orden de las hojas
+    uint32_t Original(uint32_t i) const { return this->order[i]; }
+
+private:
+    struct Triangle
+    {
+        glm::vec3 v0, edge1, edge2;
+    };
+
+    struct Bin
+    {
+        glm::vec3 boundsMin = glm::vec3(FLT_MAX);
+        glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
+        uint32_t count = 0;
+    };
+
+    std::vector<TriangleBVHNode> nodes;
+    std::vector<Triangle> triangles;
+    std::vector<uint32_t> order;
+
+    static float area(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+    {
+        glm::vec3 extent = glm::max(boundsMax - boundsMin, glm::vec3(0.0f));
+        return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+    }
+
+    static glm::vec3 safeInverse(const glm::vec3& direction)
+    {
+        return glm::vec3(std::abs(direction.x) > 1e-12f ? 1.0f / direction.x : FLT_MAX,
+                         std::abs(direction.y) > 1e-12f ? 1.0f / direction.y : FLT_MAX,
+                         std::abs(direction.z) > 1e-12f ? 1.0f / direction.z : FLT_MAX);
+    }
+
+    // Distancia de entrada a la caja, o FLT_MAX si el rayo no la cruza en [tMin, tMax)
+    static float slab(const TriangleBVHNode& node, const glm::vec3& origin, const glm::vec3& inverse, float tMin, float tMax)
+    {
+        glm::vec3 t0 = (node.boundsMin - origin) * inverse;
+        glm::vec3 t1 = (node.boundsMax - origin) * inverse;
+        glm::vec3 near = glm::min(t0, t1), far = glm::max(t0, t1);
+        float enter = std::max(std::max(near.x, near.y), std::max(near.z, tMin));
+        float exit = std::min(std::min(far.x, far.y), std::min(far.z, tMax));
+        return enter <= exit ? enter : FLT_MAX;
+    }
+
+    // Moller-Trumbore; las dos caras cuentan
+    static bool intersectTriangle(const Triangle& triangle, const glm::vec3& origin, const glm::vec3& direction, float tMin, RayHit& hit)
+    {
+        glm::vec3 p = glm::cross(direction, triangle.edge2);
+        float determinant = glm::dot(triangle.edge1, p);
+        if (std::abs(determinant) < 1e-12f) {
+            return false;
+        }
+        float inverse = 1.0f / determinant;
+        glm::vec3 s = origin - triangle.v0;
+        float u = glm::dot(s, p) * inverse;
+        if (u < 0.0f || u > 1.0f) {
+            return false;
+        }
+        glm::vec3 q = glm::cross(s, triangle.edge1);
+        float v = glm::dot(direction, q) * inverse;
+        if (v < 0.0f || u + v > 1.0f) {
+            return false;
+        }
+        float t = glm::dot(triangle.edge2, q) * inverse;
+        if (t <= tMin || t >= hit.t) {
+            return false;
+        }
+        hit.t = t;
+        hit.u = u;
+        hit.v = v;
+        hit.backFace = determinant < 0.0f;
+        return true;
+    }
+
+    void updateBounds(uint32_t index, const std::vector<glm::vec3>& boxMin, const std::vector<glm::vec3>& boxMax)
+    {
+        TriangleBVHNode& node = this->nodes[index];
+        node.boundsMin = glm::vec3(FLT_MAX);
+        node.boundsMax = glm::vec3(-FLT_MAX);
+        for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++) {
+            node.boundsMin = glm::min(node.boundsMin, boxMin[this->order[i]]);
+            node.boundsMax = glm::max(node.boundsMax, boxMax[this->order[i]]);
+        }
+    }
+
+    void subdivide(uint32_t index, const std::vector<glm::vec3>& centroids, const std::vector<glm::vec3>& boxMin,
+                   const std::vector<glm::vec3>& boxMax)
+    {
+        uint32_t first = this->nodes[index].leftOrFirst;
+        uint32_t count = this->nodes[index].count;
+        if (count <= TRIANGLE_BVH_LEAF_SIZE) {
+            return;
+        }
+
+        glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+        for (uint32_t i = first; i < first + count; i++) {
+            centroidMin = glm::min(centroidMin, centroids[this->order[i]]);
+            centroidMax = glm::max(centroidMax, centroids[this->order[i]]);
+        }
+
+        // Mejor corte por SAH entre las cubetas de los tres ejes
+        int bestAxis = -1;
+        int bestSplit = 0;
+        float bestCost = float(count) * area(this->nodes[index].boundsMin, this->nodes[index].boundsMax);
+        for (int axis = 0; axis < 3; axis++) {
+            float extent = centroidMax[axis] - centroidMin[axis];
+            if (extent <= 0.0f) {
+                continue;
+            }
+            Bin bins[TRIANGLE_BVH_BINS];
+            float scale = TRIANGLE_BVH_BINS / extent;
+            for (uint32_t i = first; i < first + count; i++) {
+                uint32_t triangle = this->order[i];
+                int bin = std::min(TRIANGLE_BVH_BINS - 1, int((centroids[triangle][axis] - centroidMin[axis]) * scale));
+                bins[bin].count++;
+                bins[bin].boundsMin = glm::min(bins[bin].boundsMin, boxMin[triangle]);
+                bins[bin].boundsMax = glm::max(bins[bin].boundsMax, boxMax[triangle]);
+            }
+            // Barrido de izquierda a derecha y de derecha a izquierda
+            float leftArea[TRIANGLE_BVH_BINS - 1], rightArea[TRIANGLE_BVH_BINS - 1];
+            uint32_t leftCount[TRIANGLE_BVH_BINS - 1], rightCount[TRIANGLE_BVH_BINS - 1];
+            glm::vec3 leftMin(FLT_MAX), leftMax(-FLT_MAX), rightMin(FLT_MAX), rightMax(-FLT_MAX);
+            uint32_t leftSum = 0, rightSum = 0;
+            for (int i = 0; i < TRIANGLE_BVH_BINS - 1; i++) {
+                leftSum += bins[i].count;
+                leftCount[i] = leftSum;
+                leftMin = glm::min(leftMin, bins[i].boundsMin);
+                leftMax = glm::max(leftMax, bins[i].boundsMax);
+                leftArea[i] = area(leftMin, leftMax);
+                int j = TRIANGLE_BVH_BINS - 1 - i;
+                rightSum += bins[j].count;
+                rightCount[j - 1] = rightSum;
+                rightMin = glm::min(rightMin, bins[j].boundsMin);
+                rightMax = glm::max(rightMax, bins[j].boundsMax);
+                rightArea[j - 1] = area(rightMin, rightMax);
+            }
+            for (int i = 0; i < TRIANGLE_BVH_BINS - 1; i++) {
+                if (leftCount[i] == 0 || rightCount[i] == 0) {
+                    continue;
+                }
+                float cost = float(leftCount[i]) * leftArea[i] + float(rightCount[i]) * rightArea[i];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i;
+                }
+            }
+        }
+        if (bestAxis < 0) {
+            return;  // partir no mejora: queda como hoja
+        }
+
+        float scale = TRIANGLE_BVH_BINS / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+        auto middle = std::partition(this->order.begin() + first, this->order.begin() + first + count, [&](uint32_t triangle) {
+            int bin = std::min(TRIANGLE_BVH_BINS - 1, int((centroids[triangle][bestAxis] - centroidMin[bestAxis]) * scale));
+            return bin <= bestSplit;
+        });
+        uint32_t leftCount = uint32_t(middle - (this->order.begin() + first));
+        if (leftCount == 0 || leftCount == count) {
+            return;
+        }
+
+        uint32_t left = uint32_t(this->nodes.size());
+        this->nodes.push_back(TriangleBVHNode());
+        this->nodes.push_back(TriangleBVHNode());
+        this->nodes[left].leftOrFirst = first;
+        this->nodes[left].count = leftCount;
+        this->nodes[left + 1].leftOrFirst = first + leftCount;
+        this->nodes[left + 1].count = count - leftCount;
+        this->nodes[index].leftOrFirst = left;
+        this->nodes[index].count = 0;
+        this->updateBounds(left, boxMin, boxMax);
+        this->updateBounds(left + 1, boxMin, boxMax);
+        this->subdivide(left, centroids, boxMin, boxMax);
+        this->subdivide(left + 1, centroids, boxMin, boxMax);
+    }
+};
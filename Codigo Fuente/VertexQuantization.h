@@ -0,0 +1,183 @@
+#pragma once
+
+// Formato compacto de vertice para mallas estaticas (16 bytes en lugar de 32):
+//   posicion: 3 x uint16 normalizados dentro de la caja del modelo (+ relleno)
+//   normal:   codificacion octaedrica en 2 x int16 normalizados
+//   UV:       2 x half float
+// lighting.vs con COMPACT_VERTEX lo decodifica. Antes de usarlo se compara
+// contra los vertices en float; si algun error pasa de los limites el modelo
+// se queda con el formato completo.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "MeshCache.h"
+
+struct CompactVertex
+{
+    uint16_t position[4];  // el cuarto componente es relleno para alinear a 8 bytes
+    int16_t normal[2];
+    uint16_t texCoords[2];
+};
+
+static_assert(sizeof(CompactVertex) == 16, "CompactVertex debe medir 16 bytes");
+
+// Limites de la prueba de precision
+const float COMPACT_MAX_POSITION_ERROR = 1e-3f;     // unidades del modelo
+const float COMPACT_MAX_NORMAL_DEGREES = 0.1f;
+const float COMPACT_MAX_UV_ERROR = 1.0f / 2048.0f;  // medio texel en una textura de 1024
+
+inline uint16_t FloatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    int32_t exponent = int32_t((bits >> 23) & 0xffu) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffffu;
+    if (exponent <= 0) {
+        // Subnormal o cero
+        if (exponent < -10) {
+            return uint16_t(sign);
+        }
+        mantissa |= 0x800000u;
+        uint32_t shift = uint32_t(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1u) {
+            half++;
+        }
+        return uint16_t(sign | half);
+    }
+    if (exponent >= 31) {
+        return uint16_t(sign | 0x7c00u);  // fuera de rango: infinito
+    }
+    uint32_t half = sign | uint32_t(exponent) << 10 | mantissa >> 13;
+    if (mantissa & 0x1000u) {
+        half++;  // redondeo al mas cercano
+    }
+    return uint16_t(half);
+}
+
+inline float HalfToFloat(uint16_t half)
+{
+    uint32_t sign = uint32_t(half & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1fu;
+    uint32_t mantissa = half & 0x3ffu;
+    float value;
+    if (exponent == 0) {
+        value = std::ldexp(float(mantissa), -24);
+    }
+    else if (exponent == 31) {
+        value = mantissa == 0 ? INFINITY : NAN;
+    }
+    else {
+        value = std::ldexp(float(mantissa | 0x400u), int(exponent) - 25);
+    }
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    bits |= sign;
+    std::memcpy(&value, &bits, sizeof(bits));
+    return value;
+}
+
+// Proyeccion octaedrica de una normal unitaria a [-1, 1]^2
+inline glm::vec2 OctEncode(const glm::vec3& normal)
+{
+    float length = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+    if (length <= 0.0f) {
+        return glm::vec2(0.0f);
+    }
+    glm::vec3 n = normal / length;
+    if (n.z < 0.0f) {
+        float x = (1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+        float y = (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+        return glm::vec2(x, y);
+    }
+    return glm::vec2(n.x, n.y);
+}
+
+// Mismo calculo que OctDecode en lighting.vs
+inline glm::vec3 OctDecode(const glm::vec2& encoded)
+{
+    glm::vec3 n(encoded.x, encoded.y, 1.0f - std::fabs(encoded.x) - std::fabs(encoded.y));
+    float t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+// Elige el mejor de los cuatro redondeos de la normal codificada
+inline void EncodeNormal(const glm::vec3& normal, int16_t out[2])
+{
+    glm::vec2 encoded = OctEncode(normal);
+    glm::vec3 target = glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f, 0.0f, 1.0f);
+    float best = -2.0f;
+    for (int i = 0; i < 4; i++) {
+        float x = (i & 1) ? std::ceil(encoded.x * 32767.0f) : std::floor(encoded.x * 32767.0f);
+        float y = (i & 2) ? std::ceil(encoded.y * 32767.0f) : std::floor(encoded.y * 32767.0f);
+        x = std::max(-32767.0f, std::min(32767.0f, x));
+        y = std::max(-32767.0f, std::min(32767.0f, y));
+        float similarity = glm::dot(OctDecode(glm::vec2(x, y) / 32767.0f), target);
+        if (similarity > best) {
+            best = similarity;
+            out[0] = int16_t(x);
+            out[1] = int16_t(y);
+        }
+    }
+}
+
+// Errores maximos de la version compacta frente a los vertices originales
+struct QuantizationError
+{
+    float position = 0.0f;  // unidades del modelo
+    float normalDegrees = 0.0f;
+    float texCoords = 0.0f;
+
+    bool Acceptable() const
+    {
+        return this->position <= COMPACT_MAX_POSITION_ERROR && this->normalDegrees <= COMPACT_MAX_NORMAL_DEGREES && this->texCoords <= COMPACT_MAX_UV_ERROR;
+    }
+};
+
+// Cuantiza dentro de la caja [boundsMin, boundsMax]; el shader reconstruye
+// con offset + q * scale (scale = tamano de la caja, ver CompactScale)
+inline glm::vec3 CompactScale(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    return glm::max(boundsMax - boundsMin, glm::vec3(1e-6f));
+}
+
+inline QuantizationError QuantizeVertices(const CacheVertex* vertices, size_t count, const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+                                          std::vector<CompactVertex>& out)
+{
+    QuantizationError error;
+    glm::vec3 scale = CompactScale(boundsMin, boundsMax);
+    out.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        const CacheVertex& vertex = vertices[i];
+        CompactVertex& compact = out[i];
+        glm::vec3 unit = glm::clamp((vertex.Position - boundsMin) / scale, glm::vec3(0.0f), glm::vec3(1.0f));
+        for (int k = 0; k < 3; k++) {
+            compact.position[k] = uint16_t(std::lround(unit[k] * 65535.0f));
+        }
+        compact.position[3] = 0;
+        EncodeNormal(vertex.Normal, compact.normal);
+        compact.texCoords[0] = FloatToHalf(vertex.TexCoords.x);
+        compact.texCoords[1] = FloatToHalf(vertex.TexCoords.y);
+
+        // Decodifica igual que el shader y mide la diferencia
+        glm::vec3 position = boundsMin + glm::vec3(compact.position[0], compact.position[1], compact.position[2]) / 65535.0f * scale;
+        error.position = std::max(error.position, glm::length(position - vertex.Position));
+        if (glm::length(vertex.Normal) > 0.0f) {
+            glm::vec3 normal = OctDecode(glm::vec2(compact.normal[0], compact.normal[1]) / 32767.0f);
+            float cosine = std::max(-1.0f, std::min(1.0f, glm::dot(normal, glm::normalize(vertex.Normal))));
+            error.normalDegrees = std::max(error.normalDegrees, glm::degrees(std::acos(cosine)));
+        }
+        glm::vec2 texCoords(HalfToFloat(compact.texCoords[0]), HalfToFloat(compact.texCoords[1]));
+        error.texCoords = std::max(error.texCoords, std::max(std::fabs(texCoords.x - vertex.TexCoords.x), std::fabs(texCoords.y - vertex.TexCoords.y)));
+    }
+    return error;
+}
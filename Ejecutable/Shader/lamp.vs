@@ -3,12 +3,20 @@ layout (location = 0) in vec3 position;
 
 
 
+#ifdef INSTANCED
+layout (location = 3) in mat4 instanceModel;
+#else
 uniform mat4 model;
+#endif
 uniform mat4 view;
 uniform mat4 projection;
 
 void main()
 {
+#ifdef INSTANCED
+    gl_Position = projection * view * instanceModel * vec4(position, 1.0f);
+#else
     gl_Position = projection * view * model * vec4(position, 1.0f);
+#endif
     
 }
\ No newline at end of file
@@ -2,6 +2,21 @@
 
 #define NUMBER_OF_POINT_LIGHTS 4
 
+// Permutaciones (ver LightingFeatureDefines en LightingState.h). Sin ningun
+// #define el shader hace todo, como siempre
+#ifndef POINT_LIGHT_MASK
+#define POINT_LIGHT_MASK 15   // bit i: se calcula pointLights[i]
+#endif
+#ifndef SPOT_LIGHT
+#define SPOT_LIGHT 1
+#endif
+#ifndef SPECULAR
+#define SPECULAR 1
+#endif
+#ifndef ALPHA_TEST
+#define ALPHA_TEST 1
+#endif
+
 struct Material
 {
     sampler2D diffuse;
@@ -53,13 +68,66 @@ in vec2 TexCoords;
 
 out vec4 color;
 
-uniform vec3 viewPos;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NUMBER_OF_POINT_LIGHTS];
-uniform SpotLight spotLight;
+// Estado de las luces compartido por todos los shaders (layout std140, ver
+// LightingState.h); solo se vuelve a subir cuando cambia alguna luz
+layout (std140) uniform Lights
+{
+    DirLight dirLight;
+    PointLight pointLights[NUMBER_OF_POINT_LIGHTS];
+    SpotLight spotLight;
+    vec3 viewPos;
+};
+
 uniform Material material;
 uniform int transparency;
 
+#ifdef LIGHTMAP
+// Irradiancia horneada del sol (con sombras y rebotes) y de su ambiente;
+// reemplaza a CalcDirLight y a las luces puntuales que no se mueven. La
+// primera luz puntual, el ambiente plano de la segunda y el foco se siguen
+// calculando por pixel
+uniform sampler2D lightmap;
+in vec2 LightmapCoords;
+#define DYNAMIC_POINT_LIGHT_MASK ( POINT_LIGHT_MASK & 3 )
+#elif defined(IRRADIANCE_PROBES)
+// Lo mismo para objetos que se mueven: la irradiancia de las sondas ya viene
+// evaluada por vertice
+in vec3 Irradiance;
+#define DYNAMIC_POINT_LIGHT_MASK ( POINT_LIGHT_MASK & 3 )
+#else
+#define DYNAMIC_POINT_LIGHT_MASK POINT_LIGHT_MASK
+#endif
+
+#ifdef CLUSTERED
+// Luces puntuales asignadas por cluster en la CPU (ver ClusteredLights.h);
+// CLUSTER_TILES_X/Y y CLUSTER_SLICES llegan como #define al compilar
+uniform samplerBuffer clusterLights;    // 4 texeles por luz
+uniform usamplerBuffer clusterRanges;   // (inicio, cantidad) por cluster
+uniform usamplerBuffer clusterIndices;  // indices de luz de cada cluster
+uniform vec2 clusterTileSize;           // pixeles por baldosa
+uniform vec4 clusterDepth;              // near, far, escala y sesgo del corte logaritmico
+
+PointLight FetchClusterLight( int index )
+{
+    vec4 positionRadius = texelFetch( clusterLights, index * 4 );
+    vec4 ambientConstant = texelFetch( clusterLights, index * 4 + 1 );
+    vec4 diffuseLinear = texelFetch( clusterLights, index * 4 + 2 );
+    vec4 specularQuadratic = texelFetch( clusterLights, index * 4 + 3 );
+    return PointLight( positionRadius.xyz, ambientConstant.w, diffuseLinear.w, specularQuadratic.w,
+                       ambientConstant.rgb, diffuseLinear.rgb, specularQuadratic.rgb );
+}
+
+int ClusterIndex( )
+{
+    // Profundidad lineal en espacio de vista a partir del z-buffer
+    float ndcDepth = gl_FragCoord.z * 2.0 - 1.0;
+    float depth = 2.0 * clusterDepth.x * clusterDepth.y / ( clusterDepth.y + clusterDepth.x - ndcDepth * ( clusterDepth.y - clusterDepth.x ) );
+    int slice = clamp( int( floor( log( depth ) * clusterDepth.z + clusterDepth.w ) ), 0, CLUSTER_SLICES - 1 );
+    ivec2 tile = clamp( ivec2( gl_FragCoord.xy / clusterTileSize ), ivec2( 0 ), ivec2( CLUSTER_TILES_X - 1, CLUSTER_TILES_Y - 1 ) );
+    return ( slice * CLUSTER_TILES_Y + tile.y ) * CLUSTER_TILES_X + tile.x;
+}
+#endif
+
 // Function prototypes
 vec3 CalcDirLight( DirLight light, vec3 normal, vec3 viewDir );
 vec3 CalcPointLight( PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir );
@@ -72,22 +140,49 @@ void main( )
     vec3 viewDir = normalize( viewPos - FragPos );
     
     // Directional lighting
+#ifdef LIGHTMAP
+    vec3 result = texture( lightmap, LightmapCoords ).rgb * vec3( texture( material.diffuse, TexCoords ) );
+#elif defined(IRRADIANCE_PROBES)
+    vec3 result = Irradiance * vec3( texture( material.diffuse, TexCoords ) );
+#else
     vec3 result = CalcDirLight( dirLight, norm, viewDir );
+#endif
     
     // Point lights
-    for ( int i = 0; i < NUMBER_OF_POINT_LIGHTS; i++ )
+#ifdef CLUSTERED
+    uvec2 range = texelFetch( clusterRanges, ClusterIndex( ) ).xy;
+    for ( uint i = 0u; i < range.y; i++ )
     {
-        result += CalcPointLight( pointLights[i], norm, FragPos, viewDir );
+        int light = int( texelFetch( clusterIndices, int( range.x + i ) ).r );
+        result += CalcPointLight( FetchClusterLight( light ), norm, FragPos, viewDir );
     }
+#else
+#if ( DYNAMIC_POINT_LIGHT_MASK & 1 ) != 0
+    result += CalcPointLight( pointLights[0], norm, FragPos, viewDir );
+#endif
+#if ( DYNAMIC_POINT_LIGHT_MASK & 2 ) != 0
+    result += CalcPointLight( pointLights[1], norm, FragPos, viewDir );
+#endif
+#if ( DYNAMIC_POINT_LIGHT_MASK & 4 ) != 0
+    result += CalcPointLight( pointLights[2], norm, FragPos, viewDir );
+#endif
+#if ( DYNAMIC_POINT_LIGHT_MASK & 8 ) != 0
+    result += CalcPointLight( pointLights[3], norm, FragPos, viewDir );
+#endif
+#endif
     
     // Spot light
+#if SPOT_LIGHT
     result += CalcSpotLight( spotLight, norm, FragPos, viewDir );
+#endif
     color = vec4(result, 1.0);
 
  	
    // color = vec4( result,texture(material.diffuse, TexCoords).rgb );
+#if ALPHA_TEST
 	  if(color.a < 0.1 && transparency==1)
         discard;
+#endif
 
 }
 
@@ -101,13 +196,19 @@ vec3 CalcDirLight( DirLight light, vec3 normal, vec3 viewDir )
     float diff = max( dot( normal, lightDir ), 0.0 );
     
     // Specular shading
+#if SPECULAR
     vec3 reflectDir = reflect( -lightDir, normal );
     float spec = pow( max( dot( viewDir, reflectDir ), 0.0 ), material.shininess );
+#endif
     
     // Combine results
     vec3 ambient = light.ambient * vec3( texture( material.diffuse, TexCoords ) );
     vec3 diffuse = light.diffuse * diff * vec3( texture( material.diffuse, TexCoords ) );
+#if SPECULAR
     vec3 specular = light.specular * spec * vec3( texture( material.specular, TexCoords ) );
+#else
+    vec3 specular = vec3( 0.0 );
+#endif
     
     return ( ambient + diffuse + specular );
 }
@@ -121,8 +222,10 @@ vec3 CalcPointLight( PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir )
     float diff = max( dot( normal, lightDir ), 0.0 );
     
     // Specular shading
+#if SPECULAR
     vec3 reflectDir = reflect( -lightDir, normal );
     float spec = pow( max( dot( viewDir, reflectDir ), 0.0 ), material.shininess );
+#endif
     
     // Attenuation
     float distance = length( light.position - fragPos );
@@ -133,7 +236,11 @@ vec3 CalcPointLight( PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir )
 
     // vec3 ambient = light.ambient * vec3( texture( material.diffuse, TexCoords ) );
     vec3 diffuse = light.diffuse * diff * vec3( texture( material.diffuse, TexCoords ) );
+#if SPECULAR
     vec3 specular = light.specular * spec * vec3( texture( material.specular, TexCoords ) );
+#else
+    vec3 specular = vec3( 0.0 );
+#endif
     
     ambient *= attenuation;
     diffuse *= attenuation;
@@ -151,8 +258,10 @@ vec3 CalcSpotLight( SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir )
     float diff = max( dot( normal, lightDir ), 0.0 );
     
     // Specular shading
+#if SPECULAR
     vec3 reflectDir = reflect( -lightDir, normal );
     float spec = pow( max( dot( viewDir, reflectDir ), 0.0 ), material.shininess );
+#endif
     
     // Attenuation
     float distance = length( light.position - fragPos );
@@ -166,7 +275,11 @@ vec3 CalcSpotLight( SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir )
     // Combine results
     vec3 ambient = light.ambient * vec3( texture( material.diffuse, TexCoords ) );
     vec3 diffuse = light.diffuse * diff * vec3( texture( material.diffuse, TexCoords ) );
+#if SPECULAR
     vec3 specular = light.specular * spec * vec3( texture( material.specular, TexCoords ) );
+#else
+    vec3 specular = vec3( 0.0 );
+#endif
     
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
@@ -1,20 +1,119 @@
 #version 330 core
+#ifdef COMPACT_VERTEX
+// Vertices compactos (VertexQuantization.h): la posicion llega normalizada a
+// [0, 1] dentro de la caja del modelo y la normal en codificacion octaedrica.
+// Un modelo con vertices en float pone offset 0, escala 1 y octNormals false
+layout (location = 0) in vec4 position;
+layout (location = 1) in vec3 normal;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+uniform bool octNormals;
+
+vec3 OctDecode(vec2 e)
+{
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+#else
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
+#endif
 layout (location = 2) in vec2 texCoords;
 
 out vec3 Normal;
 out vec3 FragPos;
 out vec2 TexCoords;
 
-uniform mat4 model;
+// Datos por objeto; la matriz normal ya viene calculada desde la CPU
+layout (std140) uniform Object
+{
+    mat4 model;
+    mat3 normalMatrix;
+};
+
+// Con INSTANCED cada instancia trae su matriz de modelo y su matriz normal
+// como atributos (ver InstanceBuffer.h) y el bloque Object no se usa
+#ifdef INSTANCED
+layout (location = 3) in mat4 instanceModel;
+layout (location = 7) in mat3 instanceNormalMatrix;
+#endif
+
+#ifdef SKINNED
+// Skinning (SkinnedModel.h): hasta cuatro huesos por vertice. Las matrices de
+// todos los personajes van seguidas en un texture buffer, tres filas por
+// hueso, y cada instancia es un personaje con boneCount huesos
+layout (location = 11) in uvec4 boneIndices;
+layout (location = 12) in vec4 boneWeights;
+uniform samplerBuffer boneMatrices;
+uniform int boneCount;
+
+mat4 BoneMatrix(uint bone)
+{
+    int base = (gl_InstanceID * boneCount + int(bone)) * 3;
+    return transpose(mat4(texelFetch(boneMatrices, base), texelFetch(boneMatrices, base + 1),
+                          texelFetch(boneMatrices, base + 2), vec4(0.0, 0.0, 0.0, 1.0)));
+}
+#endif
+
+#ifdef LIGHTMAP
+// Segundo juego de UV con la posicion en el mapa de luz (LightmapBaker.h)
+layout (location = 10) in vec2 lightmapCoords;
+out vec2 LightmapCoords;
+#endif
+
+#ifdef IRRADIANCE_PROBES
+// Irradiancia del volumen de sondas en la posicion del objeto, en armonicos
+// esfericos de orden 2 ya escalados (IrradianceVolume.h)
+uniform vec3 irradianceSH[9];
+out vec3 Irradiance;
+
+vec3 EvaluateIrradiance(vec3 n)
+{
+    vec3 result = irradianceSH[0]
+                + irradianceSH[1] * n.y + irradianceSH[2] * n.z + irradianceSH[3] * n.x
+                + irradianceSH[4] * (n.x * n.y) + irradianceSH[5] * (n.y * n.z)
+                + irradianceSH[6] * (3.0 * n.z * n.z - 1.0) + irradianceSH[7] * (n.x * n.z)
+                + irradianceSH[8] * (n.x * n.x - n.y * n.y);
+    return max(result, vec3(0.0));
+}
+#endif
+
 uniform mat4 view;
 uniform mat4 projection;
 
 void main()
 {
-    gl_Position = projection * view *  model * vec4(position, 1.0f);
-    FragPos = vec3(model * vec4(position, 1.0f));
-    Normal = mat3(transpose(inverse(model))) * normal;
+#ifdef COMPACT_VERTEX
+    vec3 localPosition = positionOffset + position.xyz * positionScale;
+    vec3 localNormal = octNormals ? OctDecode(normal.xy) : normal;
+#else
+    vec3 localPosition = position;
+    vec3 localNormal = normal;
+#endif
+#ifdef SKINNED
+    mat4 skin = BoneMatrix(boneIndices.x) * boneWeights.x + BoneMatrix(boneIndices.y) * boneWeights.y
+              + BoneMatrix(boneIndices.z) * boneWeights.z + BoneMatrix(boneIndices.w) * boneWeights.w;
+    localPosition = vec3(skin * vec4(localPosition, 1.0));
+    localNormal = mat3(skin) * localNormal;
+#endif
+#ifdef INSTANCED
+    mat4 world = instanceModel;
+    mat3 worldNormal = instanceNormalMatrix;
+#else
+    mat4 world = model;
+    mat3 worldNormal = normalMatrix;
+#endif
+    gl_Position = projection * view *  world * vec4(localPosition, 1.0f);
+    FragPos = vec3(world * vec4(localPosition, 1.0f));
+    Normal = worldNormal * localNormal;
     TexCoords = texCoords;
+#ifdef LIGHTMAP
+    LightmapCoords = lightmapCoords;
+#endif
+#ifdef IRRADIANCE_PROBES
+    Irradiance = EvaluateIrradiance(normalize(Normal));
+#endif
 }
\ No newline at end of file